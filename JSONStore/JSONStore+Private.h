@@ -24,6 +24,15 @@
  */
 -(void) _removeAccessor:(NSString*)collectionName;
 
+/**
+ Private, provisions a collection opened with provisionLazily, does nothing if it is already provisioned.
+ Pending collections are provisioned before a transaction starts, during a transaction this returns the error of that attempt.
+ @param collection The collection
+ @return JSON_STORE_RC_OK or the error code
+ @private
+ */
+-(int) _provisionPendingCollection:(JSONStoreCollection*) collection;
+
 /**
  Private, checks if a transaction is in progress.
  @private
@@ -14,6 +14,7 @@
 #import <Foundation/Foundation.h>
 #import "JSONStoreCollection.h"
 #import "JSONStoreOpenOptions.h"
+#import "JSONStoreAsyncOperation.h"
 
 /**
  Contains JSONStore methods that operate on the store.
@@ -39,6 +40,16 @@
  */
 @property (nonatomic) BOOL _transactionActive;
 
+/**
+ Private. Incremented to cancel the running page cache warm-up.
+ */
+@property (atomic) NSUInteger _warmUpGeneration;
+
+/**
+ Private. Metrics of the last page cache warm-up, nil while it is running.
+ */
+@property (atomic, strong) NSDictionary* _warmUpMetrics;
+
 /**
  Provides access to methods that operate on a store.
  @return self
@@ -70,6 +81,15 @@
  */
 -(BOOL) closeAllCollectionsAndReturnError:(NSError**) error;
 
+/**
+ Same as closeAllCollectionsAndReturnError: but keeps the key cached by JSONStoreOpenOptions keyCacheTimeToLive,
+ so opening the store again with the same password before the key expires skips deriving it.
+ Meant for apps that close the store when they go to the background.
+ @param error Error
+ @return Boolean that indicates the operation failed (false) or succeeded (true)
+ */
+-(BOOL) closeAllCollectionsKeepingCachedKeyAndReturnError:(NSError**) error;
+
 /**
  Permanently deletes all data for a specific user, clears security artifacts, and removes accessors.
  @param username Username for the store to remove
@@ -105,6 +125,25 @@
  */
 -(NSArray*) fileInfoAndReturnError:(NSError**) error;
 
+/**
+ Returns metrics for the query result cache that is turned on with JSONStoreOpenOptions queryCacheSize.
+ @return NSDictionary with the following key value pairs: hits, misses, hitRate - hits divided by lookups, entries - number of cached queries, and size - estimated size in bytes. Returns nil when the cache is off or the store is closed
+ */
+-(NSDictionary*) queryCacheMetrics;
+
+/**
+ Stops reading collections marked hot into the page cache. Pages already read stay in the cache.
+ */
+-(void) cancelWarmUp;
+
+/**
+ Returns metrics for the page cache warm-up of collections marked hot.
+ @return NSDictionary with the following key value pairs: duration - milliseconds the warm-up took, cancelled - true when it was cancelled,
+ size - bytes in the page cache when it ended, and hitRateAfter - page cache hit rate of the reads since it ended.
+ Returns nil while the warm-up runs or when no collection is marked hot
+ */
+-(NSDictionary*) warmUpMetrics;
+
 /**
  Starts a transaction.
  @param error Error
@@ -126,6 +165,28 @@
  */
 -(BOOL) rollbackTransactionAndReturnError:(NSError**) error;
 
+/**
+ Asynchronous version of startTransactionAndReturnError:. Runs in submission order with the asynchronous collection operations,
+ the completion block is called on the main queue.
+ @param completion Called with the result and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) startTransactionWithCompletion:(void (^)(BOOL worked, NSError* error)) completion;
+
+/**
+ Asynchronous version of commitTransactionAndReturnError:.
+ @param completion Called with the result and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) commitTransactionWithCompletion:(void (^)(BOOL worked, NSError* error)) completion;
+
+/**
+ Asynchronous version of rollbackTransactionAndReturnError:.
+ @param completion Called with the result and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) rollbackTransactionWithCompletion:(void (^)(BOOL worked, NSError* error)) completion;
+
 /**
  Private. Boolean that determines if OS Security is used
  */
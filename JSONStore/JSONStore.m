@@ -21,7 +21,9 @@
 #import "JSONStoreMigrationManager.h"
 #import "JSONStoreSecurityManager.h"
 #import "JSONStoreSecurityUtils.h"
+#import "JSONStoreKeyCache.h"
 #import "JSONStoreLogger.h"
+#import "JSONStoreExecutor.h"
 
 @implementation JSONStore
 
@@ -47,8 +49,6 @@
     
     @try {
         
-        long long startTime = wlGetTimeIntervalSince1970();
-        
         if (self._accessors == nil) {
             self._accessors = [[NSMutableDictionary alloc] init];
         }
@@ -68,12 +68,29 @@
             
         }
         
+        BOOL storageOptions = options.pageSize != nil || options.mmapSize != nil || options.cacheSize != nil;
+        
+        if (worked && storageOptions && ! [self _validateStorageOptions:options error:error]) {
+            worked = NO;
+            rc = JSON_STORE_INVALID_STORAGE_OPTIONS;
+        }
+        
+        if (worked && ! [self _validateKeyDerivationOptions:options error:error]) {
+            worked = NO;
+            rc = JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS;
+        }
+        
         NSString* usr = options.username ? options.username : JSON_STORE_DEFAULT_USER;
         
-        if ([options.password length]) {
+        [JSONStoreKeyCache sharedInstance].timeToLive = [options.keyCacheTimeToLive doubleValue];
+        
+        if (worked && [options.password length]) {
             
             JSONStoreSecurityManager* secMgr = [[JSONStoreSecurityManager alloc]
                                                 initWithUsername:usr];
+            secMgr.keyDerivationFunction = options.keyDerivationFunction;
+            secMgr.keyDerivationIterations = options.keyDerivationIterations;
+            secMgr.keyDerivationTargetTime = options.keyDerivationTargetTime;
             
             BOOL keyChainIsFullyPopulated = [secMgr isKeyChainFullyPopulated];
             
@@ -105,39 +122,81 @@
             }
         }
         
-        if (worked) {
+        //Applied before any collection is provisioned, so a new store is created with the page size
+        if (worked && storageOptions) {
             
-            for (JSONStoreCollection *currentCollection in collections) {
-                
-                rc = [self _provisionCollection:currentCollection.collectionName
-                               withSearchFields:currentCollection.searchFields
-                     withAdditionalSearchFields:currentCollection.additionalSearchFields
-                                   withUsername:options.username
-                                   withPassword:options.password
-                                  withDropFirst:currentCollection._dropFirst
-                                          error:error];
-                
-                NSLog(currentCollection.collectionName, @"open", startTime, rc);
+            rc = [self _applyStorageOptions:options error:error];
+            worked = (rc == JSON_STORE_RC_OK);
+        }
+        
+        if (worked && options.provisionLazily) {
+            
+            //Only the store is opened and keyed here, each collection is provisioned by its first operation
+            rc = [self _openStoreForUsername:options.username
+                                withPassword:options.password
+                                       error:error];
+            
+            if (rc == JSON_STORE_RC_OK) {
                 
-                if (rc == JSON_STORE_RC_OK || rc == JSON_STORE_PROVISION_TABLE_EXISTS) {
+                for (JSONStoreCollection *currentCollection in collections) {
                     
-                    currentCollection.reopened = rc ? YES : NO;
+                    currentCollection._provisionPending = YES;
                     
-                    JSONStoreCollection* cachedCollection =
-                    [self._accessors objectForKey:currentCollection.collectionName];
-                    
-                    if (! cachedCollection) {
-                        [self._accessors setObject:currentCollection
-                                            forKey:currentCollection.collectionName];
+                    @synchronized (self) {
+                        if (! [self._accessors objectForKey:currentCollection.collectionName]) {
+                            [self._accessors setObject:currentCollection
+                                                forKey:currentCollection.collectionName];
+                        }
                     }
-                    
-                } else {
-                    
+                }
+                
+                if (options.warmUpInBackground) {
+                    [self _warmUpCollections:collections];
+                }
+                
+            } else {
+                
+                worked = NO;
+                
+                if (error != nil) {
+                    *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                                 code:rc
+                                             userInfo:nil];
+                }
+            }
+            
+        } else if (worked) {
+            
+            for (JSONStoreCollection *currentCollection in collections) {
+                
+                rc = [self _openCollection:currentCollection
+                              withUsername:options.username
+                              withPassword:options.password
+                                     error:error];
+                
+                if (rc != JSON_STORE_RC_OK && rc != JSON_STORE_PROVISION_TABLE_EXISTS) {
                     worked = NO;
                 }
             }
         }
         
+        if (worked) {
+            
+            [self _configureAccessor:[JSONStoreQueue sharedManager] withOptions:options];
+            
+            NSMutableArray* hotCollections = [[NSMutableArray alloc] init];
+            
+            for (JSONStoreCollection* currentCollection in collections) {
+                if (currentCollection.hot) {
+                    [hotCollections addObject:currentCollection];
+                }
+            }
+            
+            if ([hotCollections count] > 0) {
+                [self _warmUpHotCollections:hotCollections withMemoryBudget:options.warmUpMemoryBudget];
+            }
+        }
+        
     }
     @catch (NSException *exception) {
         worked = NO;
@@ -154,15 +213,34 @@
 -(JSONStoreCollection*) getCollectionWithName: (NSString*) collectionName
 {    
     //Returns nil if the collection does not exist in the hash map
-    return [self._accessors objectForKey:collectionName];
+    @synchronized (self) {
+        return [self._accessors objectForKey:collectionName];
+    }
 }
 
 -(BOOL) closeAllCollectionsAndReturnError:(NSError**) error
+{
+    return [self _closeAllCollectionsClearingKeyCache:YES error:error];
+}
+
+-(BOOL) closeAllCollectionsKeepingCachedKeyAndReturnError:(NSError**) error
+{
+    return [self _closeAllCollectionsClearingKeyCache:NO error:error];
+}
+
+-(BOOL) _closeAllCollectionsClearingKeyCache:(BOOL) clearKeyCache
+                                       error:(NSError**) error
 {
     BOOL worked = YES;
     int rc = 0;
     
     long long startTime = wlGetTimeIntervalSince1970();
+    
+    if (clearKeyCache) {
+        [[JSONStoreKeyCache sharedInstance] removeAllKeys];
+    }
+    
+    [self cancelWarmUp];
 
     @try {
         
@@ -198,7 +276,9 @@
             
             if (worked) {
                 
-                self._accessors = nil;
+                @synchronized (self) {
+                    self._accessors = nil;
+                }
                 
             } else {
                 
@@ -261,6 +341,9 @@
                                   newPassword:newPassword
                                       forUser:username];
             
+            //The cached key was stored for the old password
+            [[JSONStoreKeyCache sharedInstance] removeAllKeys];
+            
             
             if (! worked) {
                 
@@ -300,6 +383,8 @@
     long long startTime = wlGetTimeIntervalSince1970();
     
     
+    [[JSONStoreKeyCache sharedInstance] removeAllKeys];
+    
     @try {
         if (self._transactionActive) {
             
@@ -341,6 +426,22 @@
                 
                 NSURL* documentsDirectory = [fileManager URLsForDirectory:NSDocumentDirectory inDomains:NSUserDomainMask][0];
                 NSString *dbPath = [[documentsDirectory URLByAppendingPathComponent:[NSString stringWithFormat:@"%@/%@%@", JSON_STORE_DEFAULT_FOLDER_FOR_SQLITE_FILES, username, JSON_STORE_DB_FILE_EXTENSION]] path];
+                NSString *blobPath = [[documentsDirectory URLByAppendingPathComponent:[NSString stringWithFormat:@"%@/%@%@", JSON_STORE_DEFAULT_FOLDER_FOR_SQLITE_FILES, username, JSON_STORE_BLOB_FOLDER_EXTENSION]] path];
+                NSString *collectionsPath = [[documentsDirectory URLByAppendingPathComponent:[NSString stringWithFormat:@"%@/%@%@", JSON_STORE_DEFAULT_FOLDER_FOR_SQLITE_FILES, username, JSON_STORE_COLLECTION_FOLDER_EXTENSION]] path];
+                
+                //Files of documents and collections kept outside the database can not be read without the removed key
+                for (NSString* path in @[blobPath, collectionsPath]) {
+                    
+                    if ([fileManager fileExistsAtPath:path]) {
+                        
+                        NSError* err = nil;
+                        [fileManager removeItemAtPath:path error:&err];
+                        
+                        if (err != nil) {
+                            NSLog(@"Destroy failed removing file at path: %@, error: %@", path, err);
+                        }
+                    }
+                }
                 
                 if ([fileManager fileExistsAtPath:dbPath]) {
                     
@@ -407,6 +508,8 @@
     long long startTime = wlGetTimeIntervalSince1970();
 
     
+    [[JSONStoreKeyCache sharedInstance] removeAllKeys];
+    
     @try {
         if (self._transactionActive) {
             
@@ -500,7 +603,28 @@
                 
             } else {
                 
-                worked = [accessor.store startTransaction];
+                //Collections opened with provisionLazily are created outside the transaction, a rollback would drop them
+                [self _provisionPendingCollections];
+                
+                //Set before the writer lanes close, so operations that start meanwhile use the operation queue
+                self._transactionActive = YES;
+                
+                //Writes grouped before the transaction commit on their own, a rollback must not undo them
+                [accessor flushGroupCommits];
+                
+                //Writes already on the writer lanes finish before the transaction starts
+                [accessor suspendWriterLanes];
+                
+                //Writes already on the operation queue end their own transactions first
+                __block BOOL started = NO;
+                
+                [accessor performOperation:^{
+                    started = [accessor.store startTransaction];
+                }];
+                
+                worked = started;
+                
+                [accessor resumeWriterLanes];
                 
                 if (! worked) {
                     
@@ -514,9 +638,6 @@
                                                      code:rc
                                                  userInfo:nil];
                     }
-                } else {
-                    
-                    self._transactionActive = YES;
                 }
             }
         }
@@ -691,6 +812,12 @@
     
     while ( (file = [enumerator nextObject]) ) {
         
+        //Folders with documents or collections kept outside the database are not stores
+        if ([file hasSuffix:JSON_STORE_BLOB_FOLDER_EXTENSION] || [file hasSuffix:JSON_STORE_COLLECTION_FOLDER_EXTENSION]) {
+            [enumerator skipDescendants];
+            continue;
+        }
+        
         NSString* currentFilePath = [[folderPath URLByAppendingPathComponent:file] path];
         
         NSDictionary* fileAttributes = [fileManager attributesOfItemAtPath:currentFilePath error:error];
@@ -731,8 +858,83 @@
     return results;
 }
 
+-(NSDictionary*) queryCacheMetrics
+{
+    JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+    
+    return [accessor.store.queryCache metrics];
+}
+
+-(JSONStoreAsyncOperation*) startTransactionWithCompletion:(void (^)(BOOL worked, NSError* error)) completion
+{
+    return [self _submitTransactionWork:^BOOL(NSError** error) {
+        return [self startTransactionAndReturnError:error];
+    } completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) commitTransactionWithCompletion:(void (^)(BOOL worked, NSError* error)) completion
+{
+    return [self _submitTransactionWork:^BOOL(NSError** error) {
+        return [self commitTransactionAndReturnError:error];
+    } completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) rollbackTransactionWithCompletion:(void (^)(BOOL worked, NSError* error)) completion
+{
+    return [self _submitTransactionWork:^BOOL(NSError** error) {
+        return [self rollbackTransactionAndReturnError:error];
+    } completion:completion];
+}
+
+-(void) cancelWarmUp
+{
+    @synchronized (self) {
+        self._warmUpGeneration++;
+    }
+}
+
+-(NSDictionary*) warmUpMetrics
+{
+    NSDictionary* metrics = self._warmUpMetrics;
+    
+    if (metrics == nil) {
+        return nil;
+    }
+    
+    NSMutableDictionary* result = [metrics mutableCopy];
+    [result removeObjectForKey:JSON_STORE_KEY_CACHE_HITS];
+    [result removeObjectForKey:JSON_STORE_KEY_CACHE_MISSES];
+    
+    //Only the lookups made since the warm-up ended count towards the hit rate after it
+    NSDictionary* status = [[JSONStoreQueue sharedManager] cacheStatus];
+    
+    if (status != nil) {
+        
+        long long hits = [status[JSON_STORE_KEY_CACHE_HITS] longLongValue] - [metrics[JSON_STORE_KEY_CACHE_HITS] longLongValue];
+        long long misses = [status[JSON_STORE_KEY_CACHE_MISSES] longLongValue] - [metrics[JSON_STORE_KEY_CACHE_MISSES] longLongValue];
+        
+        if (hits >= 0 && misses >= 0) {
+            result[JSON_STORE_KEY_WARM_UP_HIT_RATE_AFTER] = @(hits + misses ? (double) hits / (hits + misses) : 0.0);
+        }
+    }
+    
+    return result;
+}
+
 #pragma mark Private API
 
+-(JSONStoreAsyncOperation*) _submitTransactionWork:(BOOL (^)(NSError** error)) work
+                                         completion:(void (^)(BOOL worked, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return @(work(error));
+    } forCollection:nil completion:^(id result, NSError* error) {
+        if (completion != nil) {
+            completion([result boolValue], error);
+        }
+    }];
+}
+
 -(BOOL) _isAnalyticsEnabled
 {
     return self._analytics;
@@ -768,20 +970,221 @@
 
 -(void) _removeAccessor:(NSString*)collectionName
 {
-    [self._accessors removeObjectForKey:collectionName];
+    @synchronized (self) {
+        [self._accessors removeObjectForKey:collectionName];
+    }
 }
 
 #pragma mark Helpers
 
--(int) _provisionCollection: (NSString*) collectionName
-           withSearchFields: (NSDictionary*) searchFields
- withAdditionalSearchFields: (NSDictionary*) additionalIndexes
-               withUsername: (NSString*) username
-               withPassword: (NSString*) password
-              withDropFirst: (BOOL) dropFirst
-                      error: (NSError**) error
+-(int) _openCollection:(JSONStoreCollection*) collection
+          withUsername:(NSString*) username
+          withPassword:(NSString*) password
+                 error:(NSError**) error
+{
+    long long startTime = wlGetTimeIntervalSince1970();
+    
+    int rc = [self _provisionCollection:collection.collectionName
+                       withSearchFields:collection.searchFields
+             withAdditionalSearchFields:collection.additionalSearchFields
+                           withUsername:username
+                           withPassword:password
+                          withDropFirst:collection._dropFirst
+                         inSeparateFile:collection.storeInSeparateFile
+                              encrypted:! collection.separateFileUnencrypted
+                                  error:error];
+    
+    NSLog(collection.collectionName, @"open", startTime, rc);
+    
+    //The threshold is set first so documents rewritten below are moved to files
+    [[JSONStoreQueue sharedManager] setExternalStorageThreshold:collection.externalStorageThreshold
+                                                  forCollection:collection.collectionName];
+    
+    int flags = [collection _storageFlags];
+    
+    //Opening without a format keeps the one the documents are stored with
+    if (rc == JSON_STORE_PROVISION_TABLE_EXISTS && ! collection._documentFormatSet) {
+        flags = (flags & ~JSON_STORE_STORAGE_FLAG_MESSAGE_PACK) |
+                ([[JSONStoreQueue sharedManager] storageFlagsForCollection:collection.collectionName] & JSON_STORE_STORAGE_FLAG_MESSAGE_PACK);
+    }
+    
+    if ((rc == JSON_STORE_RC_OK || rc == JSON_STORE_PROVISION_TABLE_EXISTS) &&
+        ! [[JSONStoreQueue sharedManager] setStorageFlags:flags
+                                               dictionary:collection.compressionDictionary
+                                            forCollection:collection.collectionName]) {
+        
+        rc = JSON_STORE_STORAGE_FORMAT_MIGRATION_FAILURE;
+        
+        NSLog(@"Error: JSON_STORE_STORAGE_FORMAT_MIGRATION_FAILURE, code: %d, collection name: %@", rc, collection.collectionName);
+        
+        if (error != nil) {
+            *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                         code:rc
+                                     userInfo:nil];
+        }
+    }
+    
+    if (rc == JSON_STORE_RC_OK || rc == JSON_STORE_PROVISION_TABLE_EXISTS) {
+        
+        collection.reopened = rc ? YES : NO;
+        
+        [[JSONStoreQueue sharedManager] setWriterLane:collection.ownWriterLane && collection.storeInSeparateFile
+                                        forCollection:collection.collectionName];
+        
+        //Indexes only make the pages faster, a collection without them still opens
+        for (JSONStoreQueryOptions* sortOptions in collection.pageSorts) {
+            [[JSONStoreQueue sharedManager] createPageIndexForSort:sortOptions._sort
+                                                      inCollection:collection.collectionName];
+        }
+        
+        @synchronized (self) {
+            
+            JSONStoreCollection* cachedCollection =
+            [self._accessors objectForKey:collection.collectionName];
+            
+            if (! cachedCollection) {
+                [self._accessors setObject:collection
+                                    forKey:collection.collectionName];
+            }
+        }
+    }
+    
+    return rc;
+}
+
+-(int) _provisionPendingCollection:(JSONStoreCollection*) collection
+{
+    @synchronized (collection) {
+        
+        if (! collection._provisionPending) {
+            return JSON_STORE_RC_OK;
+        }
+        
+        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        BOOL registered = NO;
+        
+        @synchronized (self) {
+            registered = [self._accessors objectForKey:collection.collectionName] != nil;
+        }
+        
+        //Closed since the collection was registered, the next open registers it again
+        if (! [accessor isOpen] || ! registered) {
+            return JSON_STORE_DATABASE_NOT_OPEN;
+        }
+        
+        //Pending collections are provisioned before a transaction starts, a rollback must not undo them.
+        //Those that failed then keep failing with the same error until the transaction ends.
+        if (self._transactionActive) {
+            
+            NSLog(@"Error: unable to provision collection: %@ during a transaction", collection.collectionName);
+            return collection._provisionError != 0 ? collection._provisionError : JSON_STORE_TRANSACTION_IN_PROGRESS;
+        }
+        
+        //The store was keyed by the open that registered the collection
+        int rc = [self _openCollection:collection
+                          withUsername:accessor.username
+                          withPassword:nil
+                                 error:nil];
+        
+        if (rc != JSON_STORE_RC_OK && rc != JSON_STORE_PROVISION_TABLE_EXISTS) {
+            
+            NSLog(@"Error: unable to provision collection: %@, code: %d", collection.collectionName, rc);
+            collection._provisionError = rc;
+            return rc;
+        }
+        
+        collection._provisionPending = NO;
+        collection._provisionError = 0;
+        
+        return JSON_STORE_RC_OK;
+    }
+}
+
+-(void) _provisionPendingCollections
+{
+    NSArray* collections = nil;
+    
+    @synchronized (self) {
+        collections = [self._accessors allValues];
+    }
+    
+    //A collection that can not be provisioned reports its error when it is used
+    for (JSONStoreCollection* collection in collections) {
+        [self _provisionPendingCollection:collection];
+    }
+}
+
+-(void) _warmUpCollections:(NSArray*) collections
+{
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        
+        for (JSONStoreCollection* collection in collections) {
+            [self _provisionPendingCollection:collection];
+        }
+    });
+}
+
+-(void) _warmUpHotCollections:(NSArray*) collections
+               withMemoryBudget:(NSNumber*) memoryBudget
 {
+    NSUInteger generation = 0;
     
+    @synchronized (self) {
+        generation = ++self._warmUpGeneration;
+    }
+    
+    NSUInteger budget = memoryBudget != nil ? [memoryBudget unsignedIntegerValue] : NSUIntegerMax;
+    
+    self._warmUpMetrics = nil;
+    
+    BOOL (^cancelled)(void) = ^BOOL{
+        @synchronized (self) {
+            return self._warmUpGeneration != generation;
+        }
+    };
+    
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        
+        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        long long startTime = _wlGetTimeIntervalSince1970();
+        
+        for (JSONStoreCollection* collection in collections) {
+            
+            if (cancelled() || [self _provisionPendingCollection:collection] != JSON_STORE_RC_OK) {
+                continue;
+            }
+            
+            for (NSString* statement in [accessor warmUpStatementsForCollection:collection.collectionName]) {
+                
+                NSDictionary* status = [accessor cacheStatus];
+                
+                if (cancelled() || status == nil || [status[JSON_STORE_KEY_CACHE_SIZE] unsignedIntegerValue] >= budget) {
+                    break;
+                }
+                
+                [accessor readIntoCache:statement memoryBudget:budget shouldStop:cancelled];
+            }
+        }
+        
+        NSDictionary* after = [accessor cacheStatus];
+        
+        //A newer warm-up already reported its metrics
+        if (self._warmUpGeneration != generation && self._warmUpMetrics != nil) {
+            return;
+        }
+        
+        self._warmUpMetrics = @{ JSON_STORE_KEY_WARM_UP_DURATION : @(_wlGetTimeIntervalSince1970() - startTime),
+                                 JSON_STORE_KEY_WARM_UP_CANCELLED : @(cancelled()),
+                                 JSON_STORE_KEY_CACHE_SIZE : after[JSON_STORE_KEY_CACHE_SIZE] ?: @0,
+                                 JSON_STORE_KEY_CACHE_HITS : after[JSON_STORE_KEY_CACHE_HITS] ?: @0,
+                                 JSON_STORE_KEY_CACHE_MISSES : after[JSON_STORE_KEY_CACHE_MISSES] ?: @0 };
+    });
+}
+
+-(int) _openStoreForUsername:(NSString*) username
+                withPassword:(NSString*) password
+                       error:(NSError**) error
+{
     [[JSONStoreMigrationManager sharedInstance] checkForUpgrade];
     
     int rc = JSON_STORE_RC_OK;
@@ -795,7 +1198,7 @@
     
     if (! accessor) {
         
-        NSLog(@"Error: JSON_STORE_USERNAME_MISMATCH, code: %d, username passed: %@, accessor username: %@, collection name: %@", JSON_STORE_USERNAME_MISMATCH, username, accessor != nil ? accessor.username : @"nil", collectionName);
+        NSLog(@"Error: JSON_STORE_USERNAME_MISMATCH, code: %d, username passed: %@, accessor username: %@", JSON_STORE_USERNAME_MISMATCH, username, accessor != nil ? accessor.username : @"nil");
         
         if(error != nil) {
             *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -828,16 +1231,46 @@
         }
     }
     
+    return rc;
+}
+
+-(int) _provisionCollection: (NSString*) collectionName
+           withSearchFields: (NSDictionary*) searchFields
+ withAdditionalSearchFields: (NSDictionary*) additionalIndexes
+               withUsername: (NSString*) username
+               withPassword: (NSString*) password
+              withDropFirst: (BOOL) dropFirst
+             inSeparateFile: (BOOL) separateFile
+                  encrypted: (BOOL) encrypted
+                      error: (NSError**) error
+{
+    int rc = [self _openStoreForUsername:username
+                            withPassword:password
+                                   error:error];
+    
+    if (rc == JSON_STORE_USERNAME_MISMATCH || rc == JSON_STORE_PROVISION_KEY_FAILURE) {
+        return rc;
+    }
+    
+    JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+    
     if (rc == 0) {
         
         if (dropFirst) {
             [accessor dropTable:collectionName];
         }
         
-        //If we aren't already broken, create the table
-        rc = [accessor provisionCollection:collectionName
-                                withSchema:searchFields
-                    additionalSearchFields:additionalIndexes];
+        if (separateFile) {
+            rc = [accessor attachFileForCollection:collectionName encrypted:encrypted];
+        }
+        
+        if (rc == JSON_STORE_RC_OK) {
+            
+            //If we aren't already broken, create the table
+            rc = [accessor provisionCollection:collectionName
+                                    withSchema:searchFields
+                        additionalSearchFields:additionalIndexes];
+        }
     }
     
     if (rc < 0) {
@@ -856,6 +1289,104 @@
     return rc;
 }
 
+-(BOOL) _validateStorageOptions:(JSONStoreOpenOptions*) options
+                          error:(NSError**) error
+{
+    long long pageSize = [options.pageSize longLongValue];
+    BOOL validPageSize = options.pageSize == nil || (pageSize >= 512 && pageSize <= 65536 && (pageSize & (pageSize - 1)) == 0);
+    
+    //Encrypted pages are decrypted into the page cache, they can not be mapped and their size is fixed by the cipher
+    BOOL encrypted = [options.password length] > 0;
+    
+    if (! validPageSize || [options.mmapSize longLongValue] < 0 || [options.cacheSize longLongValue] < 0 ||
+        (encrypted && (options.pageSize != nil || options.mmapSize != nil))) {
+        
+        NSLog(@"Error: JSON_STORE_INVALID_STORAGE_OPTIONS, code: %d, pageSize: %@, mmapSize: %@, cacheSize: %@, encrypted: %@", JSON_STORE_INVALID_STORAGE_OPTIONS, options.pageSize, options.mmapSize, options.cacheSize, encrypted ? @"YES" : @"NO");
+        
+        if (error != nil) {
+            *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                         code:JSON_STORE_INVALID_STORAGE_OPTIONS
+                                     userInfo:nil];
+        }
+        
+        return NO;
+    }
+    
+    return YES;
+}
+
+-(BOOL) _validateKeyDerivationOptions:(JSONStoreOpenOptions*) options
+                                error:(NSError**) error
+{
+    //Counts below the default are raised to it, only values that can not be a count are rejected
+    BOOL validIterations = options.keyDerivationIterations == nil || [options.keyDerivationIterations longLongValue] > 0;
+    BOOL validTargetTime = options.keyDerivationTargetTime == nil || [options.keyDerivationTargetTime doubleValue] > 0;
+    
+    if (! validIterations || ! validTargetTime) {
+        
+        NSLog(@"Error: JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS, code: %d, keyDerivationIterations: %@, keyDerivationTargetTime: %@", JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS, options.keyDerivationIterations, options.keyDerivationTargetTime);
+        
+        if (error != nil) {
+            *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                         code:JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS
+                                     userInfo:nil];
+        }
+        
+        return NO;
+    }
+    
+    return YES;
+}
+
+-(int) _applyStorageOptions:(JSONStoreOpenOptions*) options
+                      error:(NSError**) error
+{
+    int rc = [self _openStoreForUsername:options.username
+                            withPassword:options.password
+                                   error:error];
+    
+    if (rc != JSON_STORE_RC_OK) {
+        return rc;
+    }
+    
+    JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+    
+    if (! [accessor setPageSize:options.pageSize mmapSize:options.mmapSize cacheSize:options.cacheSize]) {
+        
+        NSLog(@"Error: JSON_STORE_PERSISTENT_STORE_FAILURE, code: %d, unable to apply storage options", JSON_STORE_PERSISTENT_STORE_FAILURE);
+        
+        if (error != nil) {
+            *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                         code:JSON_STORE_PERSISTENT_STORE_FAILURE
+                                     userInfo:nil];
+        }
+        
+        return JSON_STORE_PERSISTENT_STORE_FAILURE;
+    }
+    
+    return JSON_STORE_RC_OK;
+}
+
+-(void) _configureAccessor:(JSONStoreQueue*) accessor
+               withOptions:(JSONStoreOpenOptions*) options
+{
+    accessor.store.jsonPathIndexThreshold = options.jsonPathIndexThreshold;
+    accessor.store.blobStore.mapFiles = options.mapExternalDocuments;
+    accessor.keyDerivationFunction = options.keyDerivationFunction;
+    accessor.keyDerivationIterations = options.keyDerivationIterations;
+    accessor.keyDerivationTargetTime = options.keyDerivationTargetTime;
+    accessor.groupCommitWindow = options.groupCommitWindow;
+    accessor.groupCommitBatchSize = options.groupCommitBatchSize;
+    
+    NSUInteger queryCacheSize = [options.queryCacheSize unsignedIntegerValue];
+    
+    if (queryCacheSize == 0) {
+        accessor.store.queryCache = nil;
+    } else if (accessor.store.queryCache.maximumSize != queryCacheSize) {
+        accessor.store.queryCache = [[JSONStoreQueryCache alloc] initWithMaximumSize:queryCacheSize];
+    }
+}
+
 -(BOOL) _storeDataProtectionKeyForUsername:(NSString*) username
                                   withSalt:(NSString*) salt
                               withDPKClear:(NSString*) dpkClear
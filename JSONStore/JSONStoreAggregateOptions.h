@@ -0,0 +1,75 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Contains JSONStore options for the aggregate API.
+ Each result row has a key per aggregate (e.g. count, sum(price), max(date)) and a key per group by search field.
+ Keys are lowercase.
+ */
+@interface JSONStoreAggregateOptions : NSObject
+
+/**
+ Private. NSArray with aggregate criteria (e.g. [{sum: @"price"}, {count: @"*"}]).
+ @private
+ */
+@property (nonatomic,strong) NSMutableArray* _aggregates;
+
+/**
+ Private. NSArray with group by criteria (e.g. [@"category"]).
+ @private
+ */
+@property (nonatomic,strong) NSMutableArray* _groupBy;
+
+/**
+ Counts the documents, returned with the count key.
+ */
+-(void) countDocuments;
+
+/**
+ Adds the values of a search field.
+ @param searchField Search field
+ */
+-(void) sumOfSearchField:(NSString*) searchField;
+
+/**
+ Averages the values of a search field.
+ @param searchField Search field
+ */
+-(void) averageOfSearchField:(NSString*) searchField;
+
+/**
+ Returns the smallest value of a search field.
+ @param searchField Search field
+ */
+-(void) minimumOfSearchField:(NSString*) searchField;
+
+/**
+ Returns the largest value of a search field.
+ @param searchField Search field
+ */
+-(void) maximumOfSearchField:(NSString*) searchField;
+
+/**
+ Returns one result row per distinct value of the search field.
+ @param searchField Search field
+ */
+-(void) groupBySearchField:(NSString*) searchField;
+
+/**
+ String representation of the object.
+ */
+-(NSString*) description;
+
+@end
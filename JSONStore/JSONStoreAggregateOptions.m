@@ -0,0 +1,75 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreAggregateOptions.h"
+#import "JSONStoreConstants.h"
+#import "JSONStoreValidator.h"
+
+@implementation JSONStoreAggregateOptions
+
+-(void) countDocuments
+{
+    [self _addAggregate:JSON_STORE_KEY_AGGREGATE_COUNT forSearchField:@"*"];
+}
+
+-(void) sumOfSearchField:(NSString*) searchField
+{
+    [self _addAggregate:JSON_STORE_KEY_AGGREGATE_SUM forSearchField:searchField];
+}
+
+-(void) averageOfSearchField:(NSString*) searchField
+{
+    [self _addAggregate:JSON_STORE_KEY_AGGREGATE_AVG forSearchField:searchField];
+}
+
+-(void) minimumOfSearchField:(NSString*) searchField
+{
+    [self _addAggregate:JSON_STORE_KEY_AGGREGATE_MIN forSearchField:searchField];
+}
+
+-(void) maximumOfSearchField:(NSString*) searchField
+{
+    [self _addAggregate:JSON_STORE_KEY_AGGREGATE_MAX forSearchField:searchField];
+}
+
+-(void) groupBySearchField:(NSString*) searchField
+{
+    if (! __groupBy) {
+        __groupBy = [[NSMutableArray alloc] init];
+    }
+
+    [__groupBy addObject:[JSONStoreValidator getDatabaseSafeSearchField:searchField]];
+}
+
+-(NSString*) description
+{
+    return [NSString stringWithFormat: @"[JSONStoreAggregateOptions: aggregates=%@ groupBy=%@]", self._aggregates, self._groupBy];
+}
+
+#pragma mark Helpers
+
+-(void) _addAggregate:(NSString*) function
+       forSearchField:(NSString*) searchField
+{
+    if (! __aggregates) {
+        __aggregates = [[NSMutableArray alloc] init];
+    }
+
+    [__aggregates addObject:@{function : [JSONStoreValidator getDatabaseSafeSearchField:searchField]}];
+}
+
+@end
@@ -0,0 +1,41 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ Returned by the asynchronous JSONStore methods, cancels the operation before it starts.
+ */
+@interface JSONStoreAsyncOperation : NSObject
+
+/**
+ True when the operation was cancelled before it started.
+ */
+@property (atomic, readonly) BOOL cancelled;
+
+/**
+ Cancels the operation if it has not started yet. A cancelled operation calls its completion block with
+ JSON_STORE_OPERATION_CANCELLED, an operation that already started runs to the end.
+ @return True when the operation was cancelled, false when it already started
+ */
+-(BOOL) cancel;
+
+/**
+ Private. Marks the operation as started.
+ @return True when it can run, false when it was cancelled
+ @private
+ */
+-(BOOL) _start;
+
+@end
@@ -0,0 +1,55 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreAsyncOperation.h"
+
+@interface JSONStoreAsyncOperation ()
+
+@property (atomic, readwrite) BOOL cancelled;
+
+@property (nonatomic) BOOL started;
+
+@end
+
+@implementation JSONStoreAsyncOperation
+
+-(BOOL) cancel
+{
+    @synchronized(self) {
+        
+        if (! self.started) {
+            self.cancelled = YES;
+        }
+        
+        return self.cancelled;
+    }
+}
+
+-(BOOL) _start
+{
+    @synchronized(self) {
+        
+        if (! self.cancelled) {
+            self.started = YES;
+        }
+        
+        return self.started;
+    }
+}
+
+@end
@@ -0,0 +1,85 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Keeps documents in files next to the database, one file per document under a folder per collection.
+ Removed files are unlinked on commit and files written since the last commit are unlinked on rollback,
+ so the files follow the rows that reference them.
+ @private
+ */
+@interface JSONStoreBlobStore : NSObject
+
+/**
+ Folder with the files, created on the first write.
+ */
+@property (nonatomic, strong, readonly) NSString* directory;
+
+/**
+ UTF-8 bytes of the key used to encrypt the files, nil to write them as is. The owner of the key zeroes it when it is done with it.
+ */
+@property (nonatomic, strong) NSData* key;
+
+/**
+ When true, files that are not encrypted are memory mapped instead of read when possible.
+ */
+@property (nonatomic) BOOL mapFiles;
+
+/**
+ Returns an instance of self that keeps its files in a folder.
+ @param directory Folder with the files
+ @return self
+ */
+-(instancetype) initWithDirectory:(NSString*) directory;
+
+/**
+ Writes data to a new file.
+ @param data Data to write
+ @param collection Name of the collection
+ @return Name of the file, nil if it could not be written
+ */
+-(NSString*) writeData:(NSData*) data
+          inCollection:(NSString*) collection;
+
+/**
+ Reads the data of a file.
+ @param name Name returned by writeData:inCollection:
+ @return Data, nil if the file is missing or can not be decrypted
+ */
+-(NSData*) dataWithName:(NSString*) name;
+
+/**
+ Unlinks a file on the next commit.
+ @param name Name returned by writeData:inCollection:
+ */
+-(void) removeDataWithName:(NSString*) name;
+
+/**
+ Unlinks every file of a collection on the next commit, the files are restored on rollback.
+ @param collection Name of the collection
+ @return True if the files were removed
+ */
+-(BOOL) removeCollection:(NSString*) collection;
+
+/**
+ Unlinks the files and collections removed since the last commit or rollback.
+ */
+-(void) commit;
+
+/**
+ Unlinks the files written since the last commit or rollback and restores the collections removed since then.
+ */
+-(void) rollback;
+
+@end
@@ -0,0 +1,185 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreBlobStore.h"
+#import "JSONStoreSecurityUtils.h"
+
+@interface JSONStoreBlobStore ()
+
+@property (nonatomic, strong, readwrite) NSString* directory;
+
+//Names written and removed since the last commit or rollback
+@property (nonatomic, strong) NSMutableArray* writtenNames;
+@property (nonatomic, strong) NSMutableArray* removedNames;
+
+//Folders of removed collections, moved aside until the next commit or rollback, as collection and folder pairs
+@property (nonatomic, strong) NSMutableArray* removedFolders;
+
+@end
+
+@implementation JSONStoreBlobStore
+
+-(instancetype) initWithDirectory:(NSString*) directory
+{
+    if (self = [super init]) {
+        self.directory = directory;
+        self.writtenNames = [[NSMutableArray alloc] init];
+        self.removedNames = [[NSMutableArray alloc] init];
+        self.removedFolders = [[NSMutableArray alloc] init];
+    }
+    
+    return self;
+}
+
+-(NSString*) writeData:(NSData*) data
+          inCollection:(NSString*) collection
+{
+    NSString* name = [collection stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSString* folder = [self.directory stringByAppendingPathComponent:collection];
+    NSError* error = nil;
+    
+    if (! [[NSFileManager defaultManager] createDirectoryAtPath:folder withIntermediateDirectories:YES attributes:nil error:&error]) {
+        NSLog(@"Unable to create folder for external documents at path: %@, error: %@", folder, error);
+        return nil;
+    }
+    
+    if (self.key != nil) {
+        data = [JSONStoreSecurityUtils encryptData:data withKey:self.key];
+    }
+    
+    if (data == nil || ! [data writeToFile:[self _pathForName:name] options:NSDataWritingAtomic error:&error]) {
+        NSLog(@"Unable to write external document: %@, error: %@", name, error);
+        return nil;
+    }
+    
+    @synchronized(self) {
+        [self.writtenNames addObject:name];
+    }
+    
+    return name;
+}
+
+-(NSData*) dataWithName:(NSString*) name
+{
+    NSDataReadingOptions options = self.key == nil && self.mapFiles ? NSDataReadingMappedIfSafe : 0;
+    NSError* error = nil;
+    NSData* data = [NSData dataWithContentsOfFile:[self _pathForName:name] options:options error:&error];
+    
+    if (data == nil) {
+        NSLog(@"Unable to read external document: %@, error: %@", name, error);
+        return nil;
+    }
+    
+    return self.key != nil ? [JSONStoreSecurityUtils decryptData:data withKey:self.key] : data;
+}
+
+-(void) removeDataWithName:(NSString*) name
+{
+    @synchronized(self) {
+        [self.removedNames addObject:name];
+    }
+}
+
+-(BOOL) removeCollection:(NSString*) collection
+{
+    NSString* folder = [self.directory stringByAppendingPathComponent:collection];
+    NSString* removedFolder = [self.directory stringByAppendingPathComponent:[NSString stringWithFormat:@".removed-%@", [[NSUUID UUID] UUIDString]]];
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    NSError* error = nil;
+    
+    if (! [fileManager fileExistsAtPath:folder]) {
+        return YES;
+    }
+    
+    //Moving the folder aside is cheap and can be undone, documents written after it go to a new folder
+    if (! [fileManager moveItemAtPath:folder toPath:removedFolder error:&error]) {
+        NSLog(@"Unable to remove external documents at path: %@, error: %@", folder, error);
+        return NO;
+    }
+    
+    @synchronized(self) {
+        [self.removedFolders addObject:@[collection, removedFolder]];
+    }
+    
+    return YES;
+}
+
+-(void) commit
+{
+    NSArray* names = nil;
+    NSArray* folders = nil;
+    
+    @synchronized(self) {
+        names = [self.removedNames copy];
+        folders = [self.removedFolders copy];
+        [self.removedNames removeAllObjects];
+        [self.removedFolders removeAllObjects];
+        [self.writtenNames removeAllObjects];
+    }
+    
+    [self _unlinkNames:names];
+    
+    for (NSArray* folder in folders) {
+        [[NSFileManager defaultManager] removeItemAtPath:folder[1] error:nil];
+    }
+}
+
+-(void) rollback
+{
+    NSArray* names = nil;
+    NSArray* folders = nil;
+    
+    @synchronized(self) {
+        names = [self.writtenNames copy];
+        folders = [self.removedFolders copy];
+        [self.removedNames removeAllObjects];
+        [self.removedFolders removeAllObjects];
+        [self.writtenNames removeAllObjects];
+    }
+    
+    //Newest first, so the folder a collection had before the first removal is the one left in place
+    for (NSArray* folder in [folders reverseObjectEnumerator]) {
+        
+        NSString* path = [self.directory stringByAppendingPathComponent:folder[0]];
+        NSError* error = nil;
+        
+        [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        
+        if (! [[NSFileManager defaultManager] moveItemAtPath:folder[1] toPath:path error:&error]) {
+            NSLog(@"Unable to restore external documents at path: %@, error: %@", path, error);
+        }
+    }
+    
+    [self _unlinkNames:names];
+}
+
+#pragma mark Helpers
+
+-(NSString*) _pathForName:(NSString*) name
+{
+    return [self.directory stringByAppendingPathComponent:name];
+}
+
+-(void) _unlinkNames:(NSArray*) names
+{
+    for (NSString* name in names) {
+        //Files of cleared collections are already gone
+        [[NSFileManager defaultManager] removeItemAtPath:[self _pathForName:name] error:nil];
+    }
+}
+
+@end
@@ -14,6 +14,8 @@
 #import <Foundation/Foundation.h>
 #import "JSONStoreQueryOptions.h"
 #import "JSONStoreAddOptions.h"
+#import "JSONStoreAggregateOptions.h"
+#import "JSONStoreAsyncOperation.h"
 
 typedef enum {
     JSONStore_Boolean = 1,
@@ -22,6 +24,11 @@ typedef enum {
     JSONStore_String = 4
 } JSONStoreSearchFieldType;
 
+typedef enum {
+    JSONStore_JSON = 0,
+    JSONStore_MessagePack = 1
+} JSONStoreDocumentFormat;
+
 /**
  Contains JSONStore methods that operate on a single collection.
  */
@@ -47,12 +54,99 @@ typedef enum {
  */
 @property (nonatomic, getter = wasReopened) BOOL reopened;
 
+/**
+ Format used to store documents, JSONStore_JSON by default. JSONStore_MessagePack is smaller and faster to decode.
+ Documents already in the collection are converted when it is opened with a format set explicitly,
+ collections opened without setting it keep the format they were stored with.
+ */
+@property (nonatomic) JSONStoreDocumentFormat documentFormat;
+
+/**
+ When true, the json of each document is compressed with zlib. Default is false.
+ Search fields are stored uncompressed, so queries on them do not decompress documents.
+ Documents already in the collection are converted when it is opened with a different setting.
+ */
+@property (nonatomic) BOOL compressDocuments;
+
+/**
+ Optional preset dictionary used when compressDocuments is true, for example the bytes of a typical document.
+ Small documents compress much better with a dictionary trained on documents like them.
+ Documents already in the collection are compressed again when it is opened with a different dictionary.
+ */
+@property (nonatomic, strong) NSData* compressionDictionary;
+
+/**
+ Optional size in bytes from which a document is kept in its own file next to the database instead of in the collection.
+ Search fields stay in the collection, so queries only read the files of the documents they return.
+ Files are encrypted like the database and removed with their documents. Default is nil, which keeps every document in the collection.
+ */
+@property (nonatomic, strong) NSNumber* externalStorageThreshold;
+
+/**
+ When true, the json of each document is kept in a separate table from its search fields, dirty flag and operation,
+ and is only read for the documents that are returned. Counts, dirty scans and queries on search fields then read
+ far fewer pages. Queries on JSON paths read the documents they check and do not create JSON path indexes.
+ Documents already in the collection are moved when it is opened with a different setting. Default is false.
+ */
+@property (nonatomic) BOOL storeDocumentsSeparately;
+
+/**
+ When true, the collection is kept in its own database file attached to the store, so clearing or removing
+ the collection removes the file instead of its rows. Must be the same every time the collection is opened,
+ a collection that already exists in the store file stays there. Default is false.
+ */
+@property (nonatomic) BOOL storeInSeparateFile;
+
+/**
+ When true, the file of a collection kept in its own file is not encrypted even if the store is opened with a password.
+ Use it for large collections that hold no sensitive data. Default is false.
+ */
+@property (nonatomic) BOOL separateFileUnencrypted;
+
+/**
+ When true, the search fields and the most recent documents of the collection are read into the page cache
+ on a background queue after open, so the first queries do not wait on the disk. See JSONStoreOpenOptions warmUpMemoryBudget. Default is false.
+ */
+@property (nonatomic) BOOL hot;
+
+/**
+ When true, a collection kept in its own file gets its own connection and serial queue, so its operations run
+ at the same time as the operations of other collections instead of waiting for them. Operations that run during
+ a transaction, and collections that keep documents in external files, still wait. Needs storeInSeparateFile. Default is false.
+ */
+@property (nonatomic) BOOL ownWriterLane;
+
+/**
+ Query options whose sort criteria are read a page at a time with page tokens (see JSONStoreQueryOptions usePageTokens).
+ An index on the search fields of each sort is created when the collection is opened, so every page costs the same.
+ Finds never create indexes. Default is nil.
+ */
+@property (nonatomic, strong) NSArray* pageSorts;
+
 /**
  Private. Remove the collection (drop table [collection]) before initializing.
  @private
  */
 @property (nonatomic) BOOL _dropFirst;
 
+/**
+ Private. True when the collection was opened with provisionLazily and has not been provisioned yet.
+ @private
+ */
+@property (nonatomic) BOOL _provisionPending;
+
+/**
+ Private. Error code of the last failed attempt to provision a collection opened with provisionLazily.
+ @private
+ */
+@property (nonatomic) int _provisionError;
+
+/**
+ Private. True when documentFormat was set by the caller.
+ @private
+ */
+@property (nonatomic) BOOL _documentFormatSet;
+
 /**
  Creates a new JSONStoreCollection instance for the collection with the given name.
  @param collectionName the name of the collection
@@ -103,6 +197,21 @@ typedef enum {
    withOptions: (JSONStoreAddOptions*) options
          error: (NSError**) error;
 
+/**
+ Stores documents that are already serialized as JSON text in the collection.
+ The bytes are stored as they are when the collection uses the default document format, search fields are read from them in a single pass.
+ Fails with JSON_STORE_INVALID_JSON_STRUCTURE when an element is not NSData, addData: takes a mix of objects and JSON text.
+ @param data NSArray of NSData, each one with the UTF-8 JSON text of a document
+ @param markDirty Determines if the documents that are added should be marked dirty (true) or not (false)
+ @param options Options for handling things like additional search fields
+ @param error Error
+ @return Number data added, nil if there is a failure
+ */
+-(NSNumber*) addJSONData: (NSArray*) data
+      andMarkDirty: (BOOL) markDirty
+       withOptions: (JSONStoreAddOptions*) options
+             error: (NSError**) error;
+
 /**
 This method is used to modify documents inside a collection by replacing existing documents with given documents. The field that is used to perform the replacement is the document's unique identifier (_id).
  @param documents Array of documents represented as NSDictionaries with the following key value pairs: _id (integer) and json (NSDictionary).
@@ -114,6 +223,46 @@ This method is used to modify documents inside a collection by replacing existin
            andMarkDirty: (BOOL) markDirty
                   error: (NSError**) error;
 
+/**
+ Replaces documents with documents that are already serialized as JSON text.
+ Fails with JSON_STORE_INVALID_JSON_STRUCTURE when a json value is not NSData, replaceDocuments: takes a mix of objects and JSON text.
+ @param documents Array of documents represented as NSDictionaries with the following key value pairs: _id (integer) and json (NSData with UTF-8 JSON text).
+ @param markDirty Determines if the documents that are replaced should be marked dirty (true) or not (false)
+ @param error Error
+ @return Number documents replaced, nil if there is a failure
+ */
+-(NSNumber*) replaceJSONDocuments: (NSArray*) documents
+               andMarkDirty: (BOOL) markDirty
+                      error: (NSError**) error;
+
+/**
+ Changes part of documents by applying a JSON merge patch (RFC 7396): keys in the patch are set, keys with null are removed and dictionaries are merged.
+ Documents stored as JSON text are patched inside the database without reading them, only search fields under the patched keys are updated.
+ @param ids Array of _id values of the documents to patch
+ @param mergePatch Merge patch (e.g. {@"status": @"done", @"address": {@"zip": [NSNull null]}})
+ @param markDirty Determines if the documents that are patched should be marked dirty (true) or not (false)
+ @param error Error
+ @return Number of documents patched, nil if there is a failure
+ */
+-(NSNumber*) patchDocumentsWithIds: (NSArray*) ids
+                        mergePatch: (NSDictionary*) mergePatch
+                      andMarkDirty: (BOOL) markDirty
+                             error: (NSError**) error;
+
+/**
+ Changes part of documents by setting the value at each key path, creating missing dictionaries on the way.
+ Documents stored as JSON text are patched inside the database without reading them, only search fields under the patched paths are updated.
+ @param ids Array of _id values of the documents to patch
+ @param values Values by key path, use dots to separate keys and numbers to index arrays (e.g. {@"phones.0.number": @"555"})
+ @param markDirty Determines if the documents that are patched should be marked dirty (true) or not (false)
+ @param error Error
+ @return Number of documents patched, nil if there is a failure
+ */
+-(NSNumber*) patchDocumentsWithIds: (NSArray*) ids
+                         setValues: (NSDictionary*) values
+                      andMarkDirty: (BOOL) markDirty
+                             error: (NSError**) error;
+
 /**
  Locates documents inside a collection by using one or more query parts.
  @param queryParts Array of JSONStoreQueryPart objects
@@ -125,6 +274,18 @@ This method is used to modify documents inside a collection by replacing existin
                        andOptions:(JSONStoreQueryOptions*) options
                             error:(NSError**) error;
 
+/**
+ Locates documents like findWithQueryParts:andOptions:error: but returns the json of each document as NSData with UTF-8 JSON text
+ instead of decoding it, for callers that forward documents without reading them. Projected paths without a value are null.
+ @param queryParts Array of JSONStoreQueryPart objects
+ @param options Options such as filter, sort, limit, and offset
+ @param error Error
+ @return All documents in the collection that matched the query parts, nil if there is a failure
+ */
+-(NSArray*) findJSONDataWithQueryParts:(NSArray*) queryParts
+                            andOptions:(JSONStoreQueryOptions*) options
+                                 error:(NSError**) error;
+
 /**
  Returns all documents in the collection.
  @param options Options such as filter, sort, limit, and offset
@@ -161,6 +322,18 @@ This method is used to modify documents inside a collection by replacing existin
 -(NSNumber*) countWithQueryParts:(NSArray*)queryParts
                          error:(NSError**) error;
 
+/**
+ Computes aggregates such as count, sum, average, minimum and maximum over the documents that match the query parts.
+ The aggregates are computed by the database, documents are not returned or parsed.
+ @param queryParts Array of JSONStoreQueryPart objects, nil or empty to use all documents
+ @param options Aggregates and group by search fields, count is used when no aggregate is set
+ @param error Error
+ @return Array of summary rows represented as NSDictionaries, one per group, nil if there is a failure
+ */
+-(NSArray*) aggregateWithQueryParts:(NSArray*) queryParts
+                         andOptions:(JSONStoreAggregateOptions*) options
+                              error:(NSError**) error;
+
 /**
  Returns the total number of dirty documents in the collection.
  @param error Error
@@ -218,6 +391,105 @@ withReplaceCriteria: (NSArray*) replaceCriteriaSearchFields
                    andMarkDirty: (BOOL) markDirty
                           error: (NSError**) error;
 
+/**
+ Asynchronous version of addData:andMarkDirty:withOptions:error:. Asynchronous operations run in the order they are submitted
+ on a queue that JSONStore manages, the completion block is called on the main queue.
+ @param data Data to store
+ @param markDirty Determines if the data is marked as dirty (true) or not (false)
+ @param options Options such as additional indexes
+ @param completion Called with the number of documents added, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) addData:(NSArray*) data
+                       andMarkDirty:(BOOL) markDirty
+                        withOptions:(JSONStoreAddOptions*) options
+                         completion:(void (^)(NSNumber* numberAdded, NSError* error)) completion;
+
+/**
+ Asynchronous version of findWithQueryParts:andOptions:error:.
+ @param queryParts Array of JSONStoreQueryPart objects
+ @param options Options such as filter, sort, limit, and offset
+ @param completion Called with the documents found, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) findWithQueryParts:(NSArray*) queryParts
+                                    andOptions:(JSONStoreQueryOptions*) options
+                                    completion:(void (^)(NSArray* results, NSError* error)) completion;
+
+/**
+ Asynchronous version of findAllWithOptions:error:.
+ @param options Options such as filter, sort, limit, and offset
+ @param completion Called with the documents found, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) findAllWithOptions:(JSONStoreQueryOptions*) options
+                                    completion:(void (^)(NSArray* results, NSError* error)) completion;
+
+/**
+ Asynchronous version of findWithIds:andOptions:error:.
+ @param ids Array of _id values
+ @param options Options such as filter, sort, limit, and offset
+ @param completion Called with the documents found, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) findWithIds:(NSArray*) ids
+                             andOptions:(JSONStoreQueryOptions*) options
+                             completion:(void (^)(NSArray* results, NSError* error)) completion;
+
+/**
+ Asynchronous version of replaceDocuments:andMarkDirty:error:.
+ @param documents Documents that are represented as NSDictionaries with _id and json keys
+ @param markDirty Determines if the documents are marked as dirty (true) or not (false)
+ @param completion Called with the number of documents replaced, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) replaceDocuments:(NSArray*) documents
+                                andMarkDirty:(BOOL) markDirty
+                                  completion:(void (^)(NSNumber* numberReplaced, NSError* error)) completion;
+
+/**
+ Asynchronous version of removeWithIds:andMarkDirty:error:.
+ @param ids Array of _id values
+ @param markDirty Determines if the documents that are removed are marked as dirty (true) or not (false)
+ @param completion Called with the number of documents removed, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) removeWithIds:(NSArray*) ids
+                             andMarkDirty:(BOOL) markDirty
+                               completion:(void (^)(NSNumber* numberRemoved, NSError* error)) completion;
+
+/**
+ Asynchronous version of countAllDocumentsAndReturnError:.
+ @param completion Called with the number of documents, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) countAllDocumentsWithCompletion:(void (^)(NSNumber* count, NSError* error)) completion;
+
+/**
+ Asynchronous version of countWithQueryParts:error:.
+ @param queryParts Array of JSONStoreQueryPart objects
+ @param completion Called with the number of documents that match, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) countWithQueryParts:(NSArray*) queryParts
+                                     completion:(void (^)(NSNumber* count, NSError* error)) completion;
+
+/**
+ Asynchronous version of markDocumentsClean:error:.
+ @param documents Documents that are represented as NSDictionaries
+ @param completion Called with the number of documents marked clean, or nil and the error
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) markDocumentsClean:(NSArray*) documents
+                                    completion:(void (^)(NSNumber* numberCleaned, NSError* error)) completion;
+
+
+/**
+ Private. Storage flags (JSON_STORE_STORAGE_FLAG_*) for the options set on the collection.
+ @return Storage flags
+ @private
+ */
+-(int) _storageFlags;
 
 /**
  Privae. Removes documents from the collection using one or more queries. Removed documents are not returned by the different find operations and they do not affect count operations.
@@ -21,6 +21,10 @@
 #import "JSONStore+Private.h"
 #import "JSONStoreQueryPart.h"
 #import "NSData+WLJSON.h"
+#import "JSONStoreLazyResults.h"
+#import "JSONStoreDocumentCodec.h"
+#import "JSONStoreValidator.h"
+#import "JSONStoreExecutor.h"
 
 
 @implementation JSONStoreCollection
@@ -36,6 +40,12 @@
     return self;
 }
 
+-(void) setDocumentFormat:(JSONStoreDocumentFormat) documentFormat
+{
+    _documentFormat = documentFormat;
+    self._documentFormatSet = YES;
+}
+
 -(void) setSearchField: (NSString*) searchField
               withType: (JSONStoreSearchFieldType) type
 {
@@ -60,13 +70,13 @@
     int numAdded = 0;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -93,6 +103,19 @@
     return numAdded >= 0 ? @(numAdded) : nil;
 }
 
+-(NSNumber*) addJSONData: (NSArray*) data
+      andMarkDirty: (BOOL) markDirty
+       withOptions: (JSONStoreAddOptions*) options
+             error: (NSError**) error
+{
+    if (! [self _isJSONData:data forKey:nil error:error]) {
+        return nil;
+    }
+    
+    //The indexer and the codec take JSON text as well as objects
+    return [self addData:data andMarkDirty:markDirty withOptions:options error:error];
+}
+
 -(BOOL) isDirtyWithDocumentId: (int) _id
                         error:(NSError**) error
 {
@@ -100,14 +123,14 @@
     int rc = 0;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
             dirty = NO;
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -135,13 +158,13 @@
     int countResult = 0;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -175,13 +198,13 @@
     
     @try {
         
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -252,14 +275,14 @@
             
         } else {
             
-            JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+            JSONStoreQueue* accessor = [self _accessor];
             
             if (! accessor) {
                 
                 worked = NO;
-                rc = JSON_STORE_DATABASE_NOT_OPEN;
+                rc = [self _accessorErrorCode];
                 
-                NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+                NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
                 
                 if (error != nil) {
                     *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -314,13 +337,13 @@
     int countResult = 0;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -360,6 +383,72 @@
     return countResult >= 0 ? @(countResult) : nil;
 }
 
+-(NSArray*) aggregateWithQueryParts:(NSArray*) queryParts
+                         andOptions:(JSONStoreAggregateOptions*) options
+                              error:(NSError**) error
+{
+    int rc = 0;
+    NSArray* results = nil;
+    
+    @try {
+        JSONStoreQueue* accessor = [self _accessor];
+        
+        if (! accessor) {
+            
+            rc = [self _accessorErrorCode];
+            
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
+            
+            if (error != nil) {
+                *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                             code:rc
+                                         userInfo:nil];
+            }
+            
+        } else if (! [self _isValidAggregateOptions:options]) {
+            
+            rc = JSON_STORE_INVALID_SEARCH_FIELD;
+            
+            NSLog(@"Error: JSON_STORE_INVALID_SEARCH_FIELD, code: %d, collection name: %@, accessor username: %@, JSONStoreAggregateOptions: %@", rc, self.collectionName, accessor.username, options);
+            
+            if (error != nil) {
+                *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                             code:rc
+                                         userInfo:nil];
+            }
+            
+        } else {
+            
+            results = [accessor aggregateCollection:self.collectionName
+                                     withQueryParts:queryParts
+                                andAggregateOptions:options];
+            
+            if (results != nil) {
+                
+                [self _changeAggregateValuesToNumbersWithOptions:options
+                                                        andArray:results];
+                
+            } else {
+                rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
+                
+                NSLog(@"Error: JSON_STORE_PERSISTENT_STORE_FAILURE, code: %d, collection name: %@, accessor username: %@, JSONStoreAggregateOptions: %@", rc, self.collectionName, accessor.username, options);
+                
+                if (error != nil) {
+                    *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                                 code:rc
+                                             userInfo:nil];
+                }
+            }
+        }
+    }
+    @catch (NSException *exception) {
+        rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
+        NSLog(@"Exception: %@", exception);
+    }
+    
+    return results;
+}
+
 -(NSNumber*) removeWithIds: (NSArray*) ids
               andMarkDirty: (BOOL) markDirty
                      error: (NSError**) error
@@ -384,13 +473,13 @@
     int numRemoved = 0;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -451,13 +540,13 @@
     int numReplaced = 0;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -497,6 +586,95 @@
     return numReplaced >= 0 ? @(numReplaced) : nil;
 }
 
+-(NSNumber*) replaceJSONDocuments: (NSArray*) documents
+               andMarkDirty: (BOOL) markDirty
+                      error: (NSError**) error
+{
+    if (! [self _isJSONData:documents forKey:JSON_STORE_FIELD_JSON error:error]) {
+        return nil;
+    }
+    
+    return [self replaceDocuments:documents andMarkDirty:markDirty error:error];
+}
+
+-(NSNumber*) patchDocumentsWithIds: (NSArray*) ids
+                        mergePatch: (NSDictionary*) mergePatch
+                      andMarkDirty: (BOOL) markDirty
+                             error: (NSError**) error
+{
+    return [self _patchDocumentsWithIds:ids mergePatch:mergePatch setValues:nil andMarkDirty:markDirty error:error];
+}
+
+-(NSNumber*) patchDocumentsWithIds: (NSArray*) ids
+                         setValues: (NSDictionary*) values
+                      andMarkDirty: (BOOL) markDirty
+                             error: (NSError**) error
+{
+    NSMutableDictionary* safeValues = [[NSMutableDictionary alloc] init];
+    
+    for (NSString* keyPath in values) {
+        safeValues[[JSONStoreValidator getDatabaseSafeSearchField:keyPath]] = values[keyPath];
+    }
+    
+    return [self _patchDocumentsWithIds:ids mergePatch:nil setValues:safeValues andMarkDirty:markDirty error:error];
+}
+
+-(NSNumber*) _patchDocumentsWithIds: (NSArray*) ids
+                         mergePatch: (NSDictionary*) mergePatch
+                          setValues: (NSDictionary*) values
+                       andMarkDirty: (BOOL) markDirty
+                              error: (NSError**) error
+{
+    int rc = 0;
+    int numPatched = 0;
+    
+    @try {
+        JSONStoreQueue* accessor = [self _accessor];
+        
+        if (! accessor) {
+            
+            rc = [self _accessorErrorCode];
+            numPatched = -1;
+            
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
+            
+            if (error != nil) {
+                *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                             code:rc
+                                         userInfo:nil];
+            }
+            
+        } else if ([ids count] > 0) {
+            
+            numPatched = [accessor patchDocumentsWithIds:ids
+                                            inCollection:self.collectionName
+                                              mergePatch:mergePatch
+                                               setValues:values
+                                               markDirty:markDirty];
+            
+            if (numPatched < 0) {
+                
+                rc = JSON_STORE_PATCH_DOCUMENTS_FAILURE;
+                
+                NSLog(@"Error: JSON_STORE_PATCH_DOCUMENTS_FAILURE, code: %d, collection name: %@, accessor username: %@, ids: %@", rc, self.collectionName, accessor.username, ids);
+                
+                if (error != nil) {
+                    *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                                 code:rc
+                                             userInfo:nil];
+                }
+            }
+        }
+    }
+    @catch (NSException *exception) {
+        rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
+        numPatched = -1;
+        NSLog(@"Exception: %@", exception);
+    }
+    
+    return numPatched >= 0 ? @(numPatched) : nil;
+}
+
 -(NSArray*) findWithIds:(NSArray*) ids
              andOptions:(JSONStoreQueryOptions*) options
                   error:(NSError**) error
@@ -525,18 +703,45 @@
 -(NSArray*) findWithQueryParts:(NSArray*) queryParts
                        andOptions:(JSONStoreQueryOptions*) options
                             error:(NSError**) error
+{
+    return [self _findWithQueryParts:queryParts andOptions:options asJSONData:NO error:error];
+}
+
+-(NSArray*) findJSONDataWithQueryParts:(NSArray*) queryParts
+                            andOptions:(JSONStoreQueryOptions*) options
+                                 error:(NSError**) error
+{
+    return [self _findWithQueryParts:queryParts andOptions:options asJSONData:YES error:error];
+}
+
+-(NSArray*) _findWithQueryParts:(NSArray*) queryParts
+                     andOptions:(JSONStoreQueryOptions*) options
+                     asJSONData:(BOOL) asJSONData
+                          error:(NSError**) error
 {
     int rc = 0;
     NSArray* results = nil;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
+            
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
+            
+            if (error != nil) {
+                *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                             code:rc
+                                         userInfo:nil];
+            }
+            
+        } else if ([options.pageToken length] && [options _pageTokenValues] == nil) {
+            
+            rc = JSON_STORE_INVALID_PAGE_TOKEN;
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: JSON_STORE_INVALID_PAGE_TOKEN, code: %d, collection name: %@, pageToken: %@", rc, self.collectionName, options.pageToken);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -551,7 +756,23 @@
                                  andQueryOptions:options];
             
             
-            if (results != nil) {
+            if (results != nil && asJSONData) {
+                
+                if (! options._count && [JSONStoreCollection _resultsHaveJSONWithOptions:options]) {
+                    [JSONStoreCollection _changeJSONBlobToJSONDataWithArray:results];
+                }
+                
+            } else if (results != nil && options.decodeLazily && ! options._count && [JSONStoreCollection _resultsHaveJSONWithOptions:options]) {
+                
+                BOOL projected = [options._projection count] > 0;
+                
+                results = [[JSONStoreLazyResults alloc] initWithRows:results decoder:^NSDictionary*(NSDictionary* row) {
+                    NSMutableDictionary* md = [row mutableCopy];
+                    [JSONStoreCollection _changeJSONBlobToDictionaryWithDictionary:md projected:projected];
+                    return md;
+                }];
+                
+            } else if (results != nil) {
                 
                 [JSONStoreCollection _changeJSONBlobToDictionaryWithOptions:options
                                                                    andArray:results];
@@ -583,14 +804,14 @@
     int rc = 0;
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
             worked = NO;
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -637,13 +858,13 @@ withReplaceCriteria: (NSArray*) replaceCriteriaSearchFields
     @try {
         NSError* localError = nil;
         
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -725,8 +946,151 @@ withReplaceCriteria: (NSArray*) replaceCriteriaSearchFields
     return numUpdatedOrAdded >= 0 ? @(numUpdatedOrAdded) : nil;
 }
 
+#pragma mark Asynchronous API
+
+-(JSONStoreAsyncOperation*) addData:(NSArray*) data
+                       andMarkDirty:(BOOL) markDirty
+                        withOptions:(JSONStoreAddOptions*) options
+                         completion:(void (^)(NSNumber* numberAdded, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self addData:data andMarkDirty:markDirty withOptions:options error:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) findWithQueryParts:(NSArray*) queryParts
+                                    andOptions:(JSONStoreQueryOptions*) options
+                                    completion:(void (^)(NSArray* results, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self findWithQueryParts:queryParts andOptions:options error:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) findAllWithOptions:(JSONStoreQueryOptions*) options
+                                    completion:(void (^)(NSArray* results, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self findAllWithOptions:options error:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) findWithIds:(NSArray*) ids
+                             andOptions:(JSONStoreQueryOptions*) options
+                             completion:(void (^)(NSArray* results, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self findWithIds:ids andOptions:options error:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) replaceDocuments:(NSArray*) documents
+                                andMarkDirty:(BOOL) markDirty
+                                  completion:(void (^)(NSNumber* numberReplaced, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self replaceDocuments:documents andMarkDirty:markDirty error:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) removeWithIds:(NSArray*) ids
+                             andMarkDirty:(BOOL) markDirty
+                               completion:(void (^)(NSNumber* numberRemoved, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self removeWithIds:ids andMarkDirty:markDirty error:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) countAllDocumentsWithCompletion:(void (^)(NSNumber* count, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self countAllDocumentsAndReturnError:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) countWithQueryParts:(NSArray*) queryParts
+                                     completion:(void (^)(NSNumber* count, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self countWithQueryParts:queryParts error:error];
+    } forCollection:self completion:completion];
+}
+
+-(JSONStoreAsyncOperation*) markDocumentsClean:(NSArray*) documents
+                                    completion:(void (^)(NSNumber* numberCleaned, NSError* error)) completion
+{
+    return [[JSONStoreExecutor sharedInstance] submitWork:^id(NSError** error) {
+        return [self markDocumentsClean:documents error:error];
+    } forCollection:self completion:completion];
+}
+
 #pragma mark Private Helpers
 
+-(BOOL) _isJSONData:(NSArray*) values
+             forKey:(NSString*) key
+              error:(NSError**) error
+{
+    NSMutableArray* failures = [[NSMutableArray alloc] init];
+    
+    for (id value in values) {
+        
+        id data = value;
+        
+        if (key != nil) {
+            data = [value isKindOfClass:[NSDictionary class]] ? [value objectForKey:key] : nil;
+        }
+        
+        if (! [data isKindOfClass:[NSData class]]) {
+            [failures addObject:value];
+        }
+    }
+    
+    if ([failures count] > 0) {
+        
+        NSLog(@"Error: JSON_STORE_INVALID_JSON_STRUCTURE, code: %d, collection: %@, expected NSData: %@", JSON_STORE_INVALID_JSON_STRUCTURE, self.collectionName, failures);
+        
+        if (error != nil) {
+            *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                         code:JSON_STORE_INVALID_JSON_STRUCTURE
+                                     userInfo:@{JSON_STORE_ERROR_OBJ_KEY_DOCS: failures}];
+        }
+        
+        return NO;
+    }
+    
+    return YES;
+}
+
+-(BOOL) _isValidAggregateOptions:(JSONStoreAggregateOptions*) options
+{
+    NSMutableSet* searchFields = [NSMutableSet setWithObject:JSON_STORE_FIELD_ID];
+    
+    //Search field columns are matched without case by SQLite
+    for (NSString* searchField in [[self.searchFields allKeys] arrayByAddingObjectsFromArray:[self.additionalSearchFields allKeys]]) {
+        [searchFields addObject:[[JSONStoreValidator getDatabaseSafeSearchField:searchField] lowercaseString]];
+    }
+    
+    NSMutableArray* fields = [NSMutableArray arrayWithArray:options._groupBy];
+    
+    for (NSDictionary* aggregate in options._aggregates) {
+        
+        NSString* searchField = [[aggregate allValues] firstObject];
+        
+        if (! [searchField isEqualToString:@"*"]) {
+            [fields addObject:searchField];
+        }
+    }
+    
+    for (NSString* field in fields) {
+        if (! [searchFields containsObject:[field lowercaseString]]) {
+            return NO;
+        }
+    }
+    
+    return YES;
+}
+
 +(NSString*) _typeStringFromJSONStoreSeachFieldType:(JSONStoreSearchFieldType) type
 {
     NSString* typeStr;
@@ -751,19 +1115,199 @@ withReplaceCriteria: (NSArray*) replaceCriteriaSearchFields
 +(void) _changeJSONBlobToDictionaryWithOptions:(JSONStoreQueryOptions*) options
                                         andArray:(id) array
 {
-    if (options._filter == nil || [options._filter count] == 0 || [options._filter indexOfObject:@"json"] != NSNotFound) {
-        for (NSMutableDictionary* md in array) {
-            if ([md isKindOfClass:[NSDictionary class]]) {
-                [JSONStoreCollection _changeJSONBlobToDictionaryWithDictionary:md];
+    if ([JSONStoreCollection _resultsHaveJSONWithOptions:options]) {
+        [JSONStoreCollection _changeJSONBlobToDictionaryWithArray:array
+                                                        projected:[options._projection count] > 0];
+    }
+}
+
++(void) _changeJSONBlobToDictionaryWithArray:(NSArray*) array
+                                   projected:(BOOL) projected
+{
+    NSUInteger count = [array count];
+    
+    //Each row is its own mutable dictionary, so rows can be decoded in place from several threads
+    //as long as every row is touched by one thread only
+    NSUInteger chunks = count < (NSUInteger) JSON_STORE_PARALLEL_DECODE_MIN_ROWS ? 1 : [[NSProcessInfo processInfo] activeProcessorCount];
+    NSUInteger chunkSize = (count + chunks - 1) / chunks;
+    
+    void (^decodeChunk)(size_t) = ^(size_t chunk) {
+        
+        NSUInteger end = MIN(count, (chunk + 1) * chunkSize);
+        
+        for (NSUInteger i = chunk * chunkSize; i < end; i++) {
+            
+            NSMutableDictionary* md = array[i];
+            
+            if (! [md isKindOfClass:[NSDictionary class]]) {
+                continue;
+            }
+            
+            //An exception must not leave a dispatch_apply worker, it would terminate the app
+            @try {
+                [JSONStoreCollection _changeJSONBlobToDictionaryWithDictionary:md projected:projected];
             }
+            @catch (NSException* exception) {
+                NSLog(@"Error: failed to decode document, _id: %@, reason: %@", md[JSON_STORE_FIELD_ID], [exception reason]);
+                md[JSON_STORE_FIELD_JSON] = [NSNull null];
+            }
+        }
+    };
+    
+    if (chunks == 1) {
+        decodeChunk(0);
+    } else {
+        dispatch_apply(chunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), decodeChunk);
+    }
+}
+
++(void) _changeJSONBlobToJSONDataWithArray:(NSArray*) array
+{
+    //Plain JSON text comes back untouched, only other storage formats are converted
+    for (NSMutableDictionary* md in array) {
+        
+        NSData* data = md[JSON_STORE_FIELD_JSON];
+        
+        if (data != nil) {
+            NSData* json = [JSONStoreDocumentCodec JSONDataWithData:data];
+            md[JSON_STORE_FIELD_JSON] = json != nil ? json : [NSNull null];
         }
     }
 }
 
++(BOOL) _resultsHaveJSONWithOptions:(JSONStoreQueryOptions*) options
+{
+    return options._filter == nil || [options._filter count] == 0 || [options._filter indexOfObject:@"json"] != NSNotFound || [options._projection count] > 0;
+}
+
++(void) _changeJSONBlobToDictionaryWithDictionary:(NSMutableDictionary*) md
+                                        projected:(BOOL) projected
+{
+    [JSONStoreCollection _changeJSONBlobToDictionaryWithDictionary:md];
+    
+    if (projected && [md[JSON_STORE_FIELD_JSON] isKindOfClass:[NSDictionary class]]) {
+        //Paths without a value come back as null, leave them out
+        NSMutableDictionary* json = [md[JSON_STORE_FIELD_JSON] mutableCopy];
+        [json removeObjectsForKeys:[json allKeysForObject:[NSNull null]]];
+        md[JSON_STORE_FIELD_JSON] = json;
+    }
+}
+
 +(void) _changeJSONBlobToDictionaryWithDictionary:(NSMutableDictionary*) md
 {
     NSData* data =[md objectForKey:JSON_STORE_FIELD_JSON];
-    [md setObject:[data WLJSONValue] forKey:JSON_STORE_FIELD_JSON];
+    id json = [JSONStoreDocumentCodec objectWithData:data];
+    
+    //Documents that can not be decoded come back as null instead of failing the whole find
+    if (json == nil) {
+        NSLog(@"Error: failed to decode document, _id: %@", md[JSON_STORE_FIELD_ID]);
+        json = [NSNull null];
+    }
+    
+    [md setObject:json forKey:JSON_STORE_FIELD_JSON];
+}
+
+-(int) _storageFlags
+{
+    int flags = self.documentFormat == JSONStore_MessagePack ? JSON_STORE_STORAGE_FLAG_MESSAGE_PACK : 0;
+    
+    if (self.compressDocuments) {
+        flags |= JSON_STORE_STORAGE_FLAG_COMPRESSED;
+    }
+    
+    if (self.externalStorageThreshold != nil) {
+        flags |= JSON_STORE_STORAGE_FLAG_EXTERNAL;
+    }
+    
+    if (self.storeDocumentsSeparately) {
+        flags |= JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE;
+    }
+    
+    return flags;
+}
+
+-(JSONStoreQueue*) _accessor
+{
+    //Collections opened with provisionLazily are provisioned by their first operation
+    if (self._provisionPending) {
+        
+        int rc = [[JSONStore sharedInstance] _provisionPendingCollection:self];
+        
+        if (rc != JSON_STORE_RC_OK) {
+            self._provisionError = rc;
+            return nil;
+        }
+    }
+    
+    return [JSONStoreQueue sharedManager];
+}
+
+-(int) _accessorErrorCode
+{
+    //Why the last provision failed, the store is closed otherwise
+    return self._provisionPending && self._provisionError != 0 ? self._provisionError : JSON_STORE_DATABASE_NOT_OPEN;
+}
+
+-(NSString*) _typeStringForSearchField:(NSString*) searchField
+{
+    for (NSDictionary* fields in @[self.searchFields, self.additionalSearchFields]) {
+        for (NSString* key in fields) {
+            if ([key caseInsensitiveCompare:searchField] == NSOrderedSame) {
+                return fields[key];
+            }
+        }
+    }
+    
+    return @"string";
+}
+
+-(void) _changeAggregateValuesToNumbersWithOptions:(JSONStoreAggregateOptions*) options
+                                          andArray:(NSArray*) array
+{
+    //The database returns every column as text, use the search field types to get numbers back
+    NSMutableDictionary* types = [[NSMutableDictionary alloc] init];
+    
+    for (NSString* searchField in options._groupBy) {
+        types[[searchField lowercaseString]] = [self _typeStringForSearchField:searchField];
+    }
+    
+    NSArray* aggregates = [options._aggregates count] ? options._aggregates : @[ @{JSON_STORE_KEY_AGGREGATE_COUNT : @"*"} ];
+    
+    for (NSDictionary* aggregate in aggregates) {
+        
+        NSString* function = [aggregate allKeys][0];
+        NSString* searchField = aggregate[function];
+        NSString* fieldType = [self _typeStringForSearchField:searchField];
+        
+        NSString* key = [searchField isEqualToString:@"*"] ? function : [NSString stringWithFormat:@"%@(%@)", function, searchField];
+        NSString* type;
+        
+        if ([function isEqualToString:JSON_STORE_KEY_AGGREGATE_COUNT]) {
+            type = @"integer";
+        } else if ([function isEqualToString:JSON_STORE_KEY_AGGREGATE_AVG]) {
+            type = @"number";
+        } else if ([function isEqualToString:JSON_STORE_KEY_AGGREGATE_SUM]) {
+            type = [fieldType isEqualToString:@"integer"] || [fieldType isEqualToString:@"boolean"] ? @"integer" : @"number";
+        } else {
+            type = fieldType;
+        }
+        
+        types[[key lowercaseString]] = type;
+    }
+    
+    for (NSMutableDictionary* row in array) {
+        
+        for (NSString* key in [row allKeys]) {
+            
+            NSString* type = types[key];
+            
+            if ([type isEqualToString:@"integer"] || [type isEqualToString:@"boolean"]) {
+                row[key] = @([row[key] longLongValue]);
+            } else if ([type isEqualToString:@"number"]) {
+                row[key] = @([row[key] doubleValue]);
+            }
+        }
+    }
 }
 
 -(NSArray*) _allDirtyWithDocuments:(NSArray*) documents
@@ -774,13 +1318,13 @@ withReplaceCriteria: (NSArray*) replaceCriteriaSearchFields
 
     
     @try {
-        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        JSONStoreQueue* accessor = [self _accessor];
         
         if (! accessor) {
             
-            rc = JSON_STORE_DATABASE_NOT_OPEN;
+            rc = [self _accessorErrorCode];
             
-            NSLog(@"Error: JSON_STORE_DATABASE_NOT_OPEN, code: %d", rc);
+            NSLog(@"Error: unable to access collection: %@, code: %d", self.collectionName, rc);
             
             if (error != nil) {
                 *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
@@ -815,9 +1359,9 @@ withReplaceCriteria: (NSArray*) replaceCriteriaSearchFields
                     } else {
                         [docsToReturn addObject:md];
                     }
-                    
-                    [JSONStoreCollection _changeJSONBlobToDictionaryWithDictionary:md];
                 }
+                
+                [JSONStoreCollection _changeJSONBlobToDictionaryWithArray:docsToReturn projected:NO];
             }
         }
     }
@@ -25,6 +25,10 @@ extern NSString * const JSON_STORE_DEFAULT_USER;
 extern NSString * const JSON_STORE_DEFAULT_SQLITE_FILE;
 extern NSString * const JSON_STORE_DEFAULT_FOLDER_FOR_SQLITE_FILES;
 extern NSString * const JSON_STORE_DB_FILE_EXTENSION;
+extern NSString * const JSON_STORE_BLOB_FOLDER_EXTENSION;
+extern NSString * const JSON_STORE_DOCUMENTS_TABLE_SUFFIX;
+extern NSString * const JSON_STORE_COLLECTION_FOLDER_EXTENSION;
+extern NSString * const JSON_STORE_COLLECTION_SCHEMA_SUFFIX;
 
 extern NSString * const JSON_STORE_FIELD_ID;
 extern NSString * const JSON_STORE_FIELD_JSON;
@@ -32,6 +36,13 @@ extern NSString * const JSON_STORE_FIELD_DIRTY;
 extern NSString * const JSON_STORE_FIELD_OPERATION;
 extern NSString * const JSON_STORE_FIELD_DELETED;
 
+extern NSString * const JSON_STORE_PAGE_COLUMN_PREFIX;
+extern NSString * const JSON_STORE_COUNTS_TABLE;
+extern NSString * const JSON_STORE_STORAGE_TABLE;
+extern NSString * const JSON_STORE_CATALOG_TABLE;
+extern NSString * const JSON_STORE_DOCUMENT_JSON_FUNCTION;
+extern NSString * const JSON_STORE_SEARCH_FIELD_VALUE_FUNCTION;
+
 extern NSString * const JSON_STORE_OP_ADD;
 extern NSString * const JSON_STORE_OP_STORE;
 extern NSString * const JSON_STORE_OP_UPDATE;
@@ -46,6 +57,17 @@ extern int const JSON_STORE_DEFAULT_SALT_SIZE;
 extern int const JSON_STORE_DEFAULT_DPK_SIZE;
 extern int const JSON_STORE_DEFAULT_IV_SIZE;
 extern int const JSON_STORE_DEFAULT_PBKDF2_ITERATIONS;
+extern int const JSON_STORE_PARALLEL_DECODE_MIN_ROWS;
+extern int const JSON_STORE_LAZY_RESULTS_CACHE_SIZE;
+extern int const JSON_STORE_CATALOG_VERSION;
+extern int const JSON_STORE_WRITER_LANE_BUSY_TIMEOUT;
+extern int const JSON_STORE_DEFAULT_GROUP_COMMIT_BATCH_SIZE;
+extern int const JSON_STORE_WARM_UP_CHUNK_ROWS;
+
+extern int const JSON_STORE_STORAGE_FLAG_MESSAGE_PACK;
+extern int const JSON_STORE_STORAGE_FLAG_COMPRESSED;
+extern int const JSON_STORE_STORAGE_FLAG_EXTERNAL;
+extern int const JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE;
 
 extern int const JSON_STORE_RC_OK;
 extern int const JSON_STORE_RC_JS_TRUE;
@@ -84,6 +106,12 @@ extern int const JSON_STORE_STORE_DATA_PROTECTION_KEY_FAILURE;
 extern int const JSON_STORE_REMOVE_WITH_QUERIES_FAILURE;
 extern int const JSON_STORE_REPLACE_DOCUMENTS_FAILURE;
 extern int const JSON_STORE_FILE_INFO_ERROR;
+extern int const JSON_STORE_STORAGE_FORMAT_MIGRATION_FAILURE;
+extern int const JSON_STORE_PATCH_DOCUMENTS_FAILURE;
+extern int const JSON_STORE_INVALID_STORAGE_OPTIONS;
+extern int const JSON_STORE_OPERATION_CANCELLED;
+extern int const JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS;
+extern int const JSON_STORE_INVALID_PAGE_TOKEN;
 
 extern int const DESTROY_FAILED_FILE_ERROR;
 extern int const DESTROY_FAILED_METADATA_REMOVAL_FAILURE;
@@ -117,10 +145,17 @@ extern NSString * const JSON_STORE_KEY_TOUCH_ID;
 extern NSString * const JSON_STORE_KEY_ASC;
 extern NSString * const JSON_STORE_KEY_DESC;
 
+extern NSString * const JSON_STORE_KEY_AGGREGATE_COUNT;
+extern NSString * const JSON_STORE_KEY_AGGREGATE_SUM;
+extern NSString * const JSON_STORE_KEY_AGGREGATE_AVG;
+extern NSString * const JSON_STORE_KEY_AGGREGATE_MIN;
+extern NSString * const JSON_STORE_KEY_AGGREGATE_MAX;
+
 extern NSString * const JSON_STORE_KEY_DPK;
 extern NSString * const JSON_STORE_KEY_SALT;
 extern NSString * const JSON_STORE_KEY_IV;
 extern NSString * const JSON_STORE_KEY_ITERATIONS;
+extern NSString * const JSON_STORE_KEY_PRF;
 extern NSString * const JSON_STORE_KEY_VERSION;
 extern NSString * const JSON_STORE_KEY_VERSION_NUMBER;
 extern NSString * const JSON_STORE_KEY_DOCUMENT_ID;
@@ -129,6 +164,16 @@ extern NSString * const JSON_STORE_KEY_FILE_NAME;
 extern NSString * const JSON_STORE_KEY_FILE_SIZE;
 extern NSString * const JSON_STORE_KEY_FILE_IS_ENCRYPTED;
 
+extern NSString * const JSON_STORE_KEY_CACHE_HITS;
+extern NSString * const JSON_STORE_KEY_CACHE_MISSES;
+extern NSString * const JSON_STORE_KEY_CACHE_HIT_RATE;
+extern NSString * const JSON_STORE_KEY_CACHE_ENTRIES;
+extern NSString * const JSON_STORE_KEY_CACHE_SIZE;
+
+extern NSString * const JSON_STORE_KEY_WARM_UP_DURATION;
+extern NSString * const JSON_STORE_KEY_WARM_UP_CANCELLED;
+extern NSString * const JSON_STORE_KEY_WARM_UP_HIT_RATE_AFTER;
+
 extern NSString * const JSON_STORE_FILE_ENCRYPTED;
 
 extern NSString * const JSON_STORE_KEY_FIND_LIKE;
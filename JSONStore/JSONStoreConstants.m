@@ -29,6 +29,10 @@ NSString * const JSON_STORE_DEFAULT_USER = @"jsonstore";
 NSString * const JSON_STORE_DEFAULT_SQLITE_FILE = @"jsonstore.sqlite";
 NSString * const JSON_STORE_DEFAULT_FOLDER_FOR_SQLITE_FILES = @"wljsonstore";
 NSString * const JSON_STORE_DB_FILE_EXTENSION = @".sqlite";
+NSString * const JSON_STORE_BLOB_FOLDER_EXTENSION = @".blobs";
+NSString * const JSON_STORE_DOCUMENTS_TABLE_SUFFIX = @"-documents";
+NSString * const JSON_STORE_COLLECTION_FOLDER_EXTENSION = @".collections";
+NSString * const JSON_STORE_COLLECTION_SCHEMA_SUFFIX = @"-file";
 
 
 NSString * const JSON_STORE_FIELD_DIRTY = @"_dirty";
@@ -37,6 +41,13 @@ NSString * const JSON_STORE_FIELD_ID = @"_id";
 NSString * const JSON_STORE_FIELD_OPERATION = @"_operation";
 NSString * const JSON_STORE_FIELD_DELETED = @"_deleted";
 
+NSString * const JSON_STORE_PAGE_COLUMN_PREFIX = @"_jsonstore_page_";
+NSString * const JSON_STORE_COUNTS_TABLE = @"_jsonstore_counts";
+NSString * const JSON_STORE_STORAGE_TABLE = @"_jsonstore_storage";
+NSString * const JSON_STORE_CATALOG_TABLE = @"_jsonstore_catalog";
+NSString * const JSON_STORE_DOCUMENT_JSON_FUNCTION = @"jsonstore_json";
+NSString * const JSON_STORE_SEARCH_FIELD_VALUE_FUNCTION = @"jsonstore_search_value";
+
 NSString * const JSON_STORE_OP_ADD = @"add";
 NSString * const JSON_STORE_OP_STORE = @"store";
 NSString * const JSON_STORE_OP_UPDATE = @"replace";
@@ -51,6 +62,17 @@ int const JSON_STORE_DEFAULT_SALT_SIZE = 32;
 int const JSON_STORE_DEFAULT_DPK_SIZE = 32;
 int const JSON_STORE_DEFAULT_IV_SIZE = 16;
 int const JSON_STORE_DEFAULT_PBKDF2_ITERATIONS = 10000;
+int const JSON_STORE_PARALLEL_DECODE_MIN_ROWS = 256;
+int const JSON_STORE_LAZY_RESULTS_CACHE_SIZE = 64;
+int const JSON_STORE_CATALOG_VERSION = 1;
+int const JSON_STORE_WRITER_LANE_BUSY_TIMEOUT = 5000;
+int const JSON_STORE_DEFAULT_GROUP_COMMIT_BATCH_SIZE = 64;
+int const JSON_STORE_WARM_UP_CHUNK_ROWS = 256;
+
+int const JSON_STORE_STORAGE_FLAG_MESSAGE_PACK = 1;
+int const JSON_STORE_STORAGE_FLAG_COMPRESSED = 2;
+int const JSON_STORE_STORAGE_FLAG_EXTERNAL = 4;
+int const JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE = 8;
 
 int const JSON_STORE_RC_OK = 0;
 int const JSON_STORE_RC_JS_TRUE = 1; //Emulates a boolean in JavaScript
@@ -86,6 +108,12 @@ int const JSON_STORE_STORE_DATA_PROTECTION_KEY_FAILURE = -21;
 int const JSON_STORE_REMOVE_WITH_QUERIES_FAILURE = -22;
 int const JSON_STORE_REPLACE_DOCUMENTS_FAILURE = -23;
 int const JSON_STORE_FILE_INFO_ERROR = -24;
+int const JSON_STORE_STORAGE_FORMAT_MIGRATION_FAILURE = -25;
+int const JSON_STORE_PATCH_DOCUMENTS_FAILURE = -26;
+int const JSON_STORE_INVALID_STORAGE_OPTIONS = -27;
+int const JSON_STORE_OPERATION_CANCELLED = -28;
+int const JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS = -29;
+int const JSON_STORE_INVALID_PAGE_TOKEN = -30;
 
 int const DESTROY_FAILED_FILE_ERROR = -18;
 int const DESTROY_FAILED_METADATA_REMOVAL_FAILURE = -19;
@@ -119,10 +147,17 @@ NSString * const JSON_STORE_KEY_TOUCH_ID = @"JSONStoreTouchIdKey";
 NSString * const JSON_STORE_KEY_ASC = @"ASC";
 NSString * const JSON_STORE_KEY_DESC = @"DESC";
 
+NSString * const JSON_STORE_KEY_AGGREGATE_COUNT = @"count";
+NSString * const JSON_STORE_KEY_AGGREGATE_SUM = @"sum";
+NSString * const JSON_STORE_KEY_AGGREGATE_AVG = @"avg";
+NSString * const JSON_STORE_KEY_AGGREGATE_MIN = @"min";
+NSString * const JSON_STORE_KEY_AGGREGATE_MAX = @"max";
+
 NSString * const JSON_STORE_KEY_DPK = @"dpk";
 NSString * const JSON_STORE_KEY_SALT = @"jsonSalt";
 NSString * const JSON_STORE_KEY_IV = @"iv";
 NSString * const JSON_STORE_KEY_ITERATIONS = @"iterations";
+NSString * const JSON_STORE_KEY_PRF = @"prf";
 NSString * const JSON_STORE_KEY_VERSION = @"version";
 NSString * const JSON_STORE_KEY_VERSION_NUMBER = @"1.0";
 NSString * const JSON_STORE_KEY_DOCUMENT_ID = @"JSONStoreKey";
@@ -131,6 +166,16 @@ NSString * const JSON_STORE_KEY_FILE_NAME = @"name";
 NSString * const JSON_STORE_KEY_FILE_SIZE = @"size";
 NSString * const JSON_STORE_KEY_FILE_IS_ENCRYPTED = @"isEncrypted";
 
+NSString * const JSON_STORE_KEY_CACHE_HITS = @"hits";
+NSString * const JSON_STORE_KEY_CACHE_MISSES = @"misses";
+NSString * const JSON_STORE_KEY_CACHE_HIT_RATE = @"hitRate";
+NSString * const JSON_STORE_KEY_CACHE_ENTRIES = @"entries";
+NSString * const JSON_STORE_KEY_CACHE_SIZE = @"size";
+
+NSString * const JSON_STORE_KEY_WARM_UP_DURATION = @"duration";
+NSString * const JSON_STORE_KEY_WARM_UP_CANCELLED = @"cancelled";
+NSString * const JSON_STORE_KEY_WARM_UP_HIT_RATE_AFTER = @"hitRateAfter";
+
 NSString * const JSON_STORE_FILE_ENCRYPTED = @"file is encrypted";
 
 NSString * const JSON_STORE_KEY_FIND_LIKE = @"like";
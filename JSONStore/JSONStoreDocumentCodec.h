@@ -0,0 +1,90 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+@class JSONStoreBlobStore;
+
+/**
+ Encodes documents into the bytes stored in the json column and decodes them back.
+ Plain JSON text is stored as is. Other formats start with a zero byte, which JSON text never starts with,
+ followed by a byte with the JSON_STORE_STORAGE_FLAG_* values used to write the document.
+ Compressed documents hold the uncompressed length as 4 bytes big-endian followed by a zlib stream.
+ Documents kept in a file hold the UTF-8 name of the file, which holds the bytes that would otherwise be stored.
+ @private
+ */
+@interface JSONStoreDocumentCodec : NSObject
+
+/**
+ Encodes a document.
+ @param object JSON object
+ @param flags Storage flags of the collection
+ @return Bytes to store, nil if the object can not be encoded
+ */
++(NSData*) dataWithObject:(id) object
+                    flags:(int) flags;
+
+/**
+ Encodes a document. Flags that do not change the encoding, such as JSON_STORE_STORAGE_FLAG_EXTERNAL, are ignored.
+ @param object JSON object, or NSData with UTF-8 JSON text
+ @param flags Storage flags of the collection
+ @param dictionary Preset dictionary used to compress when flags has JSON_STORE_STORAGE_FLAG_COMPRESSED, can be nil
+ @return Bytes to store, nil if the object can not be encoded
+ */
++(NSData*) dataWithObject:(id) object
+                    flags:(int) flags
+               dictionary:(NSData*) dictionary;
+
+/**
+ Makes a preset dictionary available to decode documents compressed with it.
+ zlib streams carry the checksum of their dictionary, which is used to find it when decoding.
+ @param dictionary Preset dictionary, ignored when empty
+ */
++(void) registerDictionary:(NSData*) dictionary;
+
+/**
+ Sets the store used to read documents kept in files, nil when no store is open.
+ @param blobStore Blob store
+ */
++(void) setBlobStore:(JSONStoreBlobStore*) blobStore;
+
+/**
+ Returns the bytes stored in place of a document kept in a file.
+ @param name Name of the file in the blob store
+ @return Bytes to store
+ */
++(NSData*) dataWithExternalName:(NSString*) name;
+
+/**
+ Returns the name of the file that holds a document.
+ @param data Bytes from the json column
+ @return Name of the file in the blob store, nil if the document is not kept in a file
+ */
++(NSString*) externalNameWithData:(NSData*) data;
+
+/**
+ Decodes a document written with any storage flags.
+ @param data Bytes from the json column
+ @return JSON object, nil if the bytes can not be decoded
+ */
++(id) objectWithData:(NSData*) data;
+
+/**
+ Returns the JSON text of a document written with any storage flags.
+ @param data Bytes from the json column
+ @return UTF-8 JSON text, nil if the bytes can not be decoded
+ */
++(NSData*) JSONDataWithData:(NSData*) data;
+
+@end
@@ -0,0 +1,669 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreDocumentCodec.h"
+#import "JSONStoreConstants.h"
+#import "JSONStoreBlobStore.h"
+#import "NSData+WLJSON.h"
+#import "NSObject+WLJSON.h"
+#import <zlib.h>
+
+//Marker byte and flags byte in front of documents that are not plain JSON text
+static const NSUInteger JSON_STORE_DOCUMENT_HEADER_SIZE = 2;
+
+//Uncompressed length in front of the zlib stream of compressed documents
+static const NSUInteger JSON_STORE_COMPRESSED_LENGTH_SIZE = 4;
+
+//Largest document that is compressed, the length read back is never trusted beyond it
+static const NSUInteger JSON_STORE_MAX_INFLATED_SIZE = 256 * 1024 * 1024;
+
+//Most bytes deflate can produce from one byte of compressed input
+static const NSUInteger JSON_STORE_MAX_DEFLATE_RATIO = 1032;
+
+//Preset dictionaries by their adler32 checksum
+static NSMutableDictionary* jsonStoreDictionaries = nil;
+
+//Store that reads documents kept in files
+static JSONStoreBlobStore* jsonStoreBlobStore = nil;
+
+@implementation JSONStoreDocumentCodec
+
++(NSData*) dataWithObject:(id) object
+                    flags:(int) flags
+{
+    return [JSONStoreDocumentCodec dataWithObject:object flags:flags dictionary:nil];
+}
+
++(NSData*) dataWithObject:(id) object
+                    flags:(int) flags
+               dictionary:(NSData*) dictionary
+{
+    //Only the flags that change the encoding are written in the header
+    flags &= JSON_STORE_STORAGE_FLAG_MESSAGE_PACK | JSON_STORE_STORAGE_FLAG_COMPRESSED;
+    
+    //Documents that are already UTF-8 JSON text are stored without parsing them again
+    if ([object isKindOfClass:[NSData class]]) {
+        
+        if (flags == 0) {
+            return object;
+        }
+        
+        object = [object WLJSONValue];
+        
+        if (object == nil) {
+            return nil;
+        }
+    }
+    
+    if (flags == 0) {
+        return [object WLJSONData];
+    }
+    
+    uint8_t header[JSON_STORE_DOCUMENT_HEADER_SIZE] = { 0, (uint8_t) flags };
+    NSMutableData* data = [NSMutableData dataWithBytes:header length:JSON_STORE_DOCUMENT_HEADER_SIZE];
+    NSMutableData* body = [[NSMutableData alloc] init];
+    
+    if (flags & JSON_STORE_STORAGE_FLAG_MESSAGE_PACK) {
+        
+        if (! [JSONStoreDocumentCodec _packObject:object intoData:body]) {
+            return nil;
+        }
+        
+    } else {
+        
+        NSData* json = [object WLJSONData];
+        
+        if (json == nil) {
+            return nil;
+        }
+        
+        [body appendData:json];
+    }
+    
+    if (flags & JSON_STORE_STORAGE_FLAG_COMPRESSED) {
+        
+        if (! [JSONStoreDocumentCodec _deflateData:body withDictionary:dictionary intoData:data]) {
+            return nil;
+        }
+        
+    } else {
+        
+        [data appendData:body];
+    }
+    
+    return data;
+}
+
++(void) registerDictionary:(NSData*) dictionary
+{
+    if ([dictionary length] == 0) {
+        return;
+    }
+    
+    uLong checksum = adler32(adler32(0L, Z_NULL, 0), [dictionary bytes], (uInt) [dictionary length]);
+    
+    @synchronized([JSONStoreDocumentCodec class]) {
+        
+        if (! jsonStoreDictionaries) {
+            jsonStoreDictionaries = [[NSMutableDictionary alloc] init];
+        }
+        
+        jsonStoreDictionaries[@(checksum)] = [dictionary copy];
+    }
+}
+
++(void) setBlobStore:(JSONStoreBlobStore*) blobStore
+{
+    @synchronized([JSONStoreDocumentCodec class]) {
+        jsonStoreBlobStore = blobStore;
+    }
+}
+
++(NSData*) dataWithExternalName:(NSString*) name
+{
+    uint8_t header[JSON_STORE_DOCUMENT_HEADER_SIZE] = { 0, (uint8_t) JSON_STORE_STORAGE_FLAG_EXTERNAL };
+    NSMutableData* data = [NSMutableData dataWithBytes:header length:JSON_STORE_DOCUMENT_HEADER_SIZE];
+    
+    [data appendData:[name dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    return data;
+}
+
++(NSString*) externalNameWithData:(NSData*) data
+{
+    if (! [JSONStoreDocumentCodec _hasHeader:data] || ! (((const uint8_t*) [data bytes])[1] & JSON_STORE_STORAGE_FLAG_EXTERNAL)) {
+        return nil;
+    }
+    
+    NSData* name = [data subdataWithRange:NSMakeRange(JSON_STORE_DOCUMENT_HEADER_SIZE, [data length] - JSON_STORE_DOCUMENT_HEADER_SIZE)];
+    
+    return [[NSString alloc] initWithData:name encoding:NSUTF8StringEncoding];
+}
+
++(id) objectWithData:(NSData*) data
+{
+    if (! [JSONStoreDocumentCodec _hasHeader:data]) {
+        return [data WLJSONValue];
+    }
+    
+    if ([JSONStoreDocumentCodec externalNameWithData:data] != nil) {
+        data = [JSONStoreDocumentCodec _externalData:data];
+        return data != nil ? [JSONStoreDocumentCodec objectWithData:data] : nil;
+    }
+    
+    const uint8_t* bytes = [data bytes];
+    int flags = bytes[1];
+    NSData* body = [data subdataWithRange:NSMakeRange(JSON_STORE_DOCUMENT_HEADER_SIZE, [data length] - JSON_STORE_DOCUMENT_HEADER_SIZE)];
+    
+    if (flags & JSON_STORE_STORAGE_FLAG_COMPRESSED) {
+        
+        body = [JSONStoreDocumentCodec _inflateData:body];
+        
+        if (body == nil) {
+            return nil;
+        }
+    }
+    
+    if (flags & JSON_STORE_STORAGE_FLAG_MESSAGE_PACK) {
+        
+        NSUInteger offset = 0;
+        id object = [JSONStoreDocumentCodec _unpackBytes:[body bytes] length:[body length] offset:&offset];
+        
+        return offset == [body length] ? object : nil;
+    }
+    
+    return [body WLJSONValue];
+}
+
++(NSData*) JSONDataWithData:(NSData*) data
+{
+    if (! [JSONStoreDocumentCodec _hasHeader:data]) {
+        return data;
+    }
+    
+    //Files of JSON text collections hold the text itself
+    if ([JSONStoreDocumentCodec externalNameWithData:data] != nil) {
+        data = [JSONStoreDocumentCodec _externalData:data];
+        return data != nil ? [JSONStoreDocumentCodec JSONDataWithData:data] : nil;
+    }
+    
+    id object = [JSONStoreDocumentCodec objectWithData:data];
+    
+    return object != nil ? [object WLJSONData] : nil;
+}
+
+#pragma mark Helpers
+
++(BOOL) _hasHeader:(NSData*) data
+{
+    return [data length] >= JSON_STORE_DOCUMENT_HEADER_SIZE && ((const uint8_t*) [data bytes])[0] == 0;
+}
+
++(NSData*) _externalData:(NSData*) data
+{
+    JSONStoreBlobStore* blobStore = nil;
+    
+    @synchronized([JSONStoreDocumentCodec class]) {
+        blobStore = jsonStoreBlobStore;
+    }
+    
+    NSData* fileData = [blobStore dataWithName:[JSONStoreDocumentCodec externalNameWithData:data]];
+    
+    //Files never point to other files
+    return [JSONStoreDocumentCodec externalNameWithData:fileData] == nil ? fileData : nil;
+}
+
+#pragma mark zlib
+
++(BOOL) _deflateData:(NSData*) body
+      withDictionary:(NSData*) dictionary
+            intoData:(NSMutableData*) data
+{
+    if ([body length] > JSON_STORE_MAX_INFLATED_SIZE) {
+        return NO;
+    }
+    
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return NO;
+    }
+    
+    if ([dictionary length] > 0 &&
+        deflateSetDictionary(&stream, [dictionary bytes], (uInt) [dictionary length]) != Z_OK) {
+        deflateEnd(&stream);
+        return NO;
+    }
+    
+    uint32_t length = (uint32_t) [body length];
+    uint8_t lengthBytes[JSON_STORE_COMPRESSED_LENGTH_SIZE] = { (uint8_t) (length >> 24), (uint8_t) (length >> 16), (uint8_t) (length >> 8), (uint8_t) length };
+    [data appendBytes:lengthBytes length:JSON_STORE_COMPRESSED_LENGTH_SIZE];
+    
+    NSUInteger offset = [data length];
+    uLong bound = deflateBound(&stream, length);
+    [data setLength:offset + bound];
+    
+    stream.next_in = (Bytef*) [body bytes];
+    stream.avail_in = length;
+    stream.next_out = (Bytef*) [data mutableBytes] + offset;
+    stream.avail_out = (uInt) bound;
+    
+    int rc = deflate(&stream, Z_FINISH);
+    [data setLength:offset + stream.total_out];
+    deflateEnd(&stream);
+    
+    return rc == Z_STREAM_END;
+}
+
++(NSData*) _inflateData:(NSData*) body
+{
+    if ([body length] < JSON_STORE_COMPRESSED_LENGTH_SIZE) {
+        return nil;
+    }
+    
+    const uint8_t* bytes = [body bytes];
+    uint32_t length = ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) | bytes[3];
+    NSUInteger compressedLength = [body length] - JSON_STORE_COMPRESSED_LENGTH_SIZE;
+    
+    //A corrupt header must not make us allocate more than the stream can possibly hold
+    if (length == 0 || length > JSON_STORE_MAX_INFLATED_SIZE || length > compressedLength * JSON_STORE_MAX_DEFLATE_RATIO) {
+        NSLog(@"Unable to decompress document, invalid length: %u", length);
+        return nil;
+    }
+    
+    NSMutableData* data = [NSMutableData dataWithLength:length];
+    
+    if (data == nil) {
+        return nil;
+    }
+    
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    
+    if (inflateInit(&stream) != Z_OK) {
+        return nil;
+    }
+    
+    stream.next_in = (Bytef*) bytes + JSON_STORE_COMPRESSED_LENGTH_SIZE;
+    stream.avail_in = (uInt) compressedLength;
+    stream.next_out = [data mutableBytes];
+    stream.avail_out = length;
+    
+    int rc = inflate(&stream, Z_FINISH);
+    
+    if (rc == Z_NEED_DICT) {
+        
+        NSData* dictionary = nil;
+        
+        @synchronized([JSONStoreDocumentCodec class]) {
+            dictionary = jsonStoreDictionaries[@(stream.adler)];
+        }
+        
+        if (dictionary == nil) {
+            NSLog(@"Unable to decompress document, dictionary %lu was not registered", stream.adler);
+            inflateEnd(&stream);
+            return nil;
+        }
+        
+        rc = inflateSetDictionary(&stream, [dictionary bytes], (uInt) [dictionary length]);
+        rc = rc == Z_OK ? inflate(&stream, Z_FINISH) : rc;
+    }
+    
+    BOOL worked = rc == Z_STREAM_END && stream.total_out == length;
+    inflateEnd(&stream);
+    
+    return worked ? data : nil;
+}
+
+#pragma mark MessagePack
+
++(void) _appendType:(uint8_t) type
+          bigEndian:(uint64_t) value
+               size:(NSUInteger) size
+             toData:(NSMutableData*) data
+{
+    uint8_t bytes[9];
+    bytes[0] = type;
+    
+    for (NSUInteger i = 0; i < size; i++) {
+        bytes[size - i] = (uint8_t) (value >> (8 * i));
+    }
+    
+    [data appendBytes:bytes length:size + 1];
+}
+
++(void) _appendType:(uint8_t) fixType
+           fixLimit:(NSUInteger) fixLimit
+             type16:(uint8_t) type16
+             type32:(uint8_t) type32
+             length:(NSUInteger) length
+             toData:(NSMutableData*) data
+{
+    if (length < fixLimit) {
+        uint8_t type = fixType | (uint8_t) length;
+        [data appendBytes:&type length:1];
+    } else if (length <= UINT16_MAX) {
+        [JSONStoreDocumentCodec _appendType:type16 bigEndian:length size:2 toData:data];
+    } else {
+        [JSONStoreDocumentCodec _appendType:type32 bigEndian:length size:4 toData:data];
+    }
+}
+
++(BOOL) _packObject:(id) object
+           intoData:(NSMutableData*) data
+{
+    if (object == nil || object == [NSNull null]) {
+        
+        uint8_t type = 0xc0;
+        [data appendBytes:&type length:1];
+        
+    } else if ([object isKindOfClass:[NSString class]]) {
+        
+        NSData* utf8 = [object dataUsingEncoding:NSUTF8StringEncoding];
+        NSUInteger length = [utf8 length];
+        
+        if (length < 32) {
+            uint8_t type = 0xa0 | (uint8_t) length;
+            [data appendBytes:&type length:1];
+        } else if (length <= UINT8_MAX) {
+            [JSONStoreDocumentCodec _appendType:0xd9 bigEndian:length size:1 toData:data];
+        } else if (length <= UINT16_MAX) {
+            [JSONStoreDocumentCodec _appendType:0xda bigEndian:length size:2 toData:data];
+        } else {
+            [JSONStoreDocumentCodec _appendType:0xdb bigEndian:length size:4 toData:data];
+        }
+        
+        [data appendData:utf8];
+        
+    } else if ([object isKindOfClass:[NSNumber class]]) {
+        
+        [JSONStoreDocumentCodec _packNumber:object intoData:data];
+        
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        
+        [JSONStoreDocumentCodec _appendType:0x90 fixLimit:16 type16:0xdc type32:0xdd length:[object count] toData:data];
+        
+        for (id element in object) {
+            if (! [JSONStoreDocumentCodec _packObject:element intoData:data]) {
+                return NO;
+            }
+        }
+        
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        
+        [JSONStoreDocumentCodec _appendType:0x80 fixLimit:16 type16:0xde type32:0xdf length:[object count] toData:data];
+        
+        for (id key in object) {
+            if (! [key isKindOfClass:[NSString class]] ||
+                ! [JSONStoreDocumentCodec _packObject:key intoData:data] ||
+                ! [JSONStoreDocumentCodec _packObject:object[key] intoData:data]) {
+                return NO;
+            }
+        }
+        
+    } else {
+        
+        NSLog(@"Unable to encode object of class %@ as MessagePack", NSStringFromClass([object class]));
+        return NO;
+    }
+    
+    return YES;
+}
+
++(void) _packNumber:(NSNumber*) number
+           intoData:(NSMutableData*) data
+{
+    if ((__bridge CFBooleanRef) number == kCFBooleanTrue || (__bridge CFBooleanRef) number == kCFBooleanFalse) {
+        
+        uint8_t type = [number boolValue] ? 0xc3 : 0xc2;
+        [data appendBytes:&type length:1];
+        
+    } else if (CFNumberIsFloatType((__bridge CFNumberRef) number)) {
+        
+        double value = [number doubleValue];
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        [JSONStoreDocumentCodec _appendType:0xcb bigEndian:bits size:8 toData:data];
+        
+    } else if (strcmp([number objCType], @encode(unsigned long long)) == 0 && [number unsignedLongLongValue] > INT64_MAX) {
+        
+        [JSONStoreDocumentCodec _appendType:0xcf bigEndian:[number unsignedLongLongValue] size:8 toData:data];
+        
+    } else {
+        
+        int64_t value = [number longLongValue];
+        
+        if (value >= 0 && value < 128) {
+            uint8_t type = (uint8_t) value;
+            [data appendBytes:&type length:1];
+        } else if (value >= 0) {
+            if (value <= UINT8_MAX) {
+                [JSONStoreDocumentCodec _appendType:0xcc bigEndian:value size:1 toData:data];
+            } else if (value <= UINT16_MAX) {
+                [JSONStoreDocumentCodec _appendType:0xcd bigEndian:value size:2 toData:data];
+            } else if (value <= UINT32_MAX) {
+                [JSONStoreDocumentCodec _appendType:0xce bigEndian:value size:4 toData:data];
+            } else {
+                [JSONStoreDocumentCodec _appendType:0xcf bigEndian:value size:8 toData:data];
+            }
+        } else if (value >= -32) {
+            int8_t type = (int8_t) value;
+            [data appendBytes:&type length:1];
+        } else if (value >= INT8_MIN) {
+            [JSONStoreDocumentCodec _appendType:0xd0 bigEndian:(uint8_t) value size:1 toData:data];
+        } else if (value >= INT16_MIN) {
+            [JSONStoreDocumentCodec _appendType:0xd1 bigEndian:(uint16_t) value size:2 toData:data];
+        } else if (value >= INT32_MIN) {
+            [JSONStoreDocumentCodec _appendType:0xd2 bigEndian:(uint32_t) value size:4 toData:data];
+        } else {
+            [JSONStoreDocumentCodec _appendType:0xd3 bigEndian:(uint64_t) value size:8 toData:data];
+        }
+    }
+}
+
++(BOOL) _readBigEndian:(uint64_t*) value
+                  size:(NSUInteger) size
+             fromBytes:(const uint8_t*) bytes
+                length:(NSUInteger) length
+                offset:(NSUInteger*) offset
+{
+    if (*offset + size > length) {
+        return NO;
+    }
+    
+    uint64_t result = 0;
+    
+    for (NSUInteger i = 0; i < size; i++) {
+        result = (result << 8) | bytes[*offset + i];
+    }
+    
+    *offset += size;
+    *value = result;
+    
+    return YES;
+}
+
++(id) _unpackBytes:(const uint8_t*) bytes
+            length:(NSUInteger) length
+            offset:(NSUInteger*) offset
+{
+    if (*offset >= length) {
+        return nil;
+    }
+    
+    uint8_t type = bytes[(*offset)++];
+    uint64_t value = 0;
+    NSUInteger count = 0;
+    
+    //Fixed size types keep the value or the length in the type byte
+    if (type <= 0x7f) {
+        return @(type);
+    } else if (type >= 0xe0) {
+        return @((int8_t) type);
+    } else if ((type & 0xe0) == 0xa0) {
+        return [JSONStoreDocumentCodec _unpackStringWithLength:type & 0x1f bytes:bytes length:length offset:offset];
+    } else if ((type & 0xf0) == 0x90) {
+        return [JSONStoreDocumentCodec _unpackArrayWithCount:type & 0x0f bytes:bytes length:length offset:offset];
+    } else if ((type & 0xf0) == 0x80) {
+        return [JSONStoreDocumentCodec _unpackMapWithCount:type & 0x0f bytes:bytes length:length offset:offset];
+    }
+    
+    switch (type) {
+        case 0xc0:
+            return [NSNull null];
+        case 0xc2:
+            return @NO;
+        case 0xc3:
+            return @YES;
+        case 0xca:
+        case 0xcb: {
+            NSUInteger size = type == 0xca ? 4 : 8;
+            
+            if (! [JSONStoreDocumentCodec _readBigEndian:&value size:size fromBytes:bytes length:length offset:offset]) {
+                return nil;
+            }
+            
+            if (size == 4) {
+                uint32_t bits = (uint32_t) value;
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                return @(f);
+            }
+            
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            return @(d);
+        }
+        case 0xcc:
+        case 0xcd:
+        case 0xce:
+        case 0xcf:
+            if (! [JSONStoreDocumentCodec _readBigEndian:&value size:1 << (type - 0xcc) fromBytes:bytes length:length offset:offset]) {
+                return nil;
+            }
+            return value > INT64_MAX ? @(value) : @((int64_t) value);
+        case 0xd0:
+        case 0xd1:
+        case 0xd2:
+        case 0xd3: {
+            NSUInteger size = 1 << (type - 0xd0);
+            
+            if (! [JSONStoreDocumentCodec _readBigEndian:&value size:size fromBytes:bytes length:length offset:offset]) {
+                return nil;
+            }
+            
+            //Sign extend from the encoded size
+            int64_t signedValue = size == 8 ? (int64_t) value : (int64_t) (value << (64 - 8 * size)) >> (64 - 8 * size);
+            return @(signedValue);
+        }
+        case 0xd9:
+        case 0xda:
+        case 0xdb:
+            if (! [JSONStoreDocumentCodec _readBigEndian:&value size:1 << (type - 0xd9) fromBytes:bytes length:length offset:offset]) {
+                return nil;
+            }
+            return [JSONStoreDocumentCodec _unpackStringWithLength:(NSUInteger) value bytes:bytes length:length offset:offset];
+        case 0xdc:
+        case 0xdd:
+            if (! [JSONStoreDocumentCodec _readBigEndian:&value size:type == 0xdc ? 2 : 4 fromBytes:bytes length:length offset:offset]) {
+                return nil;
+            }
+            count = (NSUInteger) value;
+            return [JSONStoreDocumentCodec _unpackArrayWithCount:count bytes:bytes length:length offset:offset];
+        case 0xde:
+        case 0xdf:
+            if (! [JSONStoreDocumentCodec _readBigEndian:&value size:type == 0xde ? 2 : 4 fromBytes:bytes length:length offset:offset]) {
+                return nil;
+            }
+            count = (NSUInteger) value;
+            return [JSONStoreDocumentCodec _unpackMapWithCount:count bytes:bytes length:length offset:offset];
+        default:
+            //bin, ext and the other types are never written for JSON documents
+            return nil;
+    }
+}
+
++(NSString*) _unpackStringWithLength:(NSUInteger) stringLength
+                               bytes:(const uint8_t*) bytes
+                              length:(NSUInteger) length
+                              offset:(NSUInteger*) offset
+{
+    if (*offset + stringLength > length) {
+        return nil;
+    }
+    
+    NSString* string = [[NSString alloc] initWithBytes:bytes + *offset length:stringLength encoding:NSUTF8StringEncoding];
+    *offset += stringLength;
+    
+    return string;
+}
+
++(NSArray*) _unpackArrayWithCount:(NSUInteger) count
+                            bytes:(const uint8_t*) bytes
+                           length:(NSUInteger) length
+                           offset:(NSUInteger*) offset
+{
+    //Every element takes at least one byte, do not trust a count the bytes can not hold
+    if (count > length - *offset) {
+        return nil;
+    }
+    
+    NSMutableArray* array = [[NSMutableArray alloc] initWithCapacity:count];
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        
+        id element = [JSONStoreDocumentCodec _unpackBytes:bytes length:length offset:offset];
+        
+        if (element == nil) {
+            return nil;
+        }
+        
+        [array addObject:element];
+    }
+    
+    return array;
+}
+
++(NSDictionary*) _unpackMapWithCount:(NSUInteger) count
+                               bytes:(const uint8_t*) bytes
+                              length:(NSUInteger) length
+                              offset:(NSUInteger*) offset
+{
+    if (count > (length - *offset) / 2) {
+        return nil;
+    }
+    
+    NSMutableDictionary* dictionary = [[NSMutableDictionary alloc] initWithCapacity:count];
+    
+    for (NSUInteger i = 0; i < count; i++) {
+        
+        id key = [JSONStoreDocumentCodec _unpackBytes:bytes length:length offset:offset];
+        id value = key != nil ? [JSONStoreDocumentCodec _unpackBytes:bytes length:length offset:offset] : nil;
+        
+        if (! [key isKindOfClass:[NSString class]] || value == nil) {
+            return nil;
+        }
+        
+        dictionary[key] = value;
+    }
+    
+    return dictionary;
+}
+
+@end
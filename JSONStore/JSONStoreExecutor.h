@@ -0,0 +1,63 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#import <Foundation/Foundation.h>
+#import "JSONStoreAsyncOperation.h"
+#import "JSONStoreCollection.h"
+
+/**
+ Work of an asynchronous operation, returns its result and sets error on failure.
+ */
+typedef id (^JSONStoreAsyncWork)(NSError** error);
+
+/**
+ Completion of an asynchronous operation, called on the main queue.
+ */
+typedef void (^JSONStoreAsyncCompletion)(id result, NSError* error);
+
+/**
+ Runs the asynchronous JSONStore operations on queues that JSONStore manages. Operations on the same collection run
+ in the order they are submitted, operations on different collections can run at the same time. Operations that are
+ not on a collection, such as transactions, wait for the operations submitted before them and hold back the ones after them.
+ Each collection operation is moved to the queue of the collection in the store, so the store methods it calls run there
+ directly, and the collection queue waits for it suspended instead of blocking a thread.
+ A collection opened with provisionLazily is provisioned before its operation moves to that queue.
+ @private
+ */
+@interface JSONStoreExecutor : NSObject
+
+/**
+ Provides access to the executor.
+ @return self
+ */
++(JSONStoreExecutor*) sharedInstance;
+
+/**
+ Checks if the caller runs on one of the queues of the executor.
+ @return True when called from an asynchronous operation
+ */
++(BOOL) isExecutorQueue;
+
+/**
+ Submits an operation.
+ @param work Work of the operation
+ @param collection Collection the operation works on, nil when it is not on a single collection
+ @param completion Called on the main queue with the result, can be nil
+ @return Operation that can be cancelled until it starts
+ */
+-(JSONStoreAsyncOperation*) submitWork:(JSONStoreAsyncWork) work
+                         forCollection:(JSONStoreCollection*) collection
+                            completion:(JSONStoreAsyncCompletion) completion;
+
+@end
@@ -0,0 +1,215 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreExecutor.h"
+#import "JSONStoreQueue.h"
+#import "JSONStore.h"
+#import "JSONStore+Private.h"
+#import "JSONStoreConstants.h"
+
+//Set on the queues of the executor, so writes that run on them are detected
+static void* const JSONStoreExecutorQueueKey = (void*) &JSONStoreExecutorQueueKey;
+
+@interface JSONStoreExecutor ()
+
+//Serial, keeps the submission order of operations that are not on a collection
+@property (nonatomic) dispatch_queue_t queue;
+
+//Serial queue of each collection. Example: {collection1: queue}
+@property (nonatomic, strong) NSMutableDictionary* collectionQueues;
+
+//Collection queues held back by each operation that is not on a collection, resumed when it finishes, in submission order
+@property (nonatomic, strong) NSMutableArray* pendingGlobalOperations;
+
+@end
+
+@implementation JSONStoreExecutor
+
++(JSONStoreExecutor*) sharedInstance
+{
+    static JSONStoreExecutor* sharedInstance = nil;
+    static dispatch_once_t onceToken;
+    
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [[JSONStoreExecutor alloc] init];
+    });
+    
+    return sharedInstance;
+}
+
++(BOOL) isExecutorQueue
+{
+    return dispatch_get_specific(JSONStoreExecutorQueueKey) != NULL;
+}
+
+-(instancetype) init
+{
+    if (self = [super init]) {
+        
+        dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INITIATED, 0);
+        self.queue = dispatch_queue_create("com.jsonstore.executor", attr);
+        dispatch_queue_set_specific(self.queue, JSONStoreExecutorQueueKey, JSONStoreExecutorQueueKey, NULL);
+        self.collectionQueues = [[NSMutableDictionary alloc] init];
+        self.pendingGlobalOperations = [[NSMutableArray alloc] init];
+    }
+    
+    return self;
+}
+
+-(JSONStoreAsyncOperation*) submitWork:(JSONStoreAsyncWork) work
+                         forCollection:(JSONStoreCollection*) collection
+                            completion:(JSONStoreAsyncCompletion) completion
+{
+    JSONStoreAsyncOperation* operation = [[JSONStoreAsyncOperation alloc] init];
+    NSString* collectionName = collection.collectionName;
+    __block dispatch_queue_t collectionQueue = nil;
+    
+    dispatch_block_t job = ^{
+        
+        __block id result = nil;
+        __block NSError* error = nil;
+        
+        void (^finish)(void) = ^{
+            if (completion != nil) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completion(result, error);
+                });
+            }
+        };
+        
+        if (! [operation _start]) {
+            
+            error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                        code:JSON_STORE_OPERATION_CANCELLED
+                                    userInfo:nil];
+            finish();
+            return;
+        }
+        
+        void (^run)(void) = ^{
+            @autoreleasepool {
+                
+                NSError* workError = nil;
+                result = work(&workError);
+                error = workError;
+            }
+        };
+        
+        //The store is opened again after a close, so its queue is looked up for each operation
+        JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+        
+        //Provisioning holds the collection lock while it waits for the store queue, so it must not start from the queue
+        BOOL pending = collection._provisionPending &&
+            [[JSONStore sharedInstance] _provisionPendingCollection:collection] != JSON_STORE_RC_OK;
+        
+        //Transactions close the writer lanes of the store, so they do not run on one of its queues.
+        //A collection that could not be provisioned reports its error off the store queue.
+        if (accessor == nil || collection == nil || pending) {
+            run();
+            finish();
+            return;
+        }
+        
+        //The work moves to the queue of the collection in the store instead of being waited for here.
+        //The collection queue is suspended until it is done, so the next operation on the collection starts after it.
+        dispatch_suspend(collectionQueue);
+        
+        [accessor performOperationAsync:^{
+            run();
+            finish();
+            dispatch_resume(collectionQueue);
+        } forCollection:collectionName];
+    };
+    
+    @synchronized (self) {
+        
+        if (collection == nil) {
+            [self _submitGlobalJob:job];
+        } else {
+            collectionQueue = [self _queueForCollection:collectionName];
+            dispatch_async(collectionQueue, job);
+        }
+    }
+    
+    return operation;
+}
+
+#pragma mark Helpers
+
+-(void) _submitGlobalJob:(dispatch_block_t) job
+{
+    dispatch_group_t fences = dispatch_group_create();
+    NSMutableArray* heldQueues = [[NSMutableArray alloc] init];
+    
+    //Each collection queue finishes what was submitted before the job, then suspends itself until the job is done.
+    //Nothing waits on a thread meanwhile, the job is queued once every fence ran.
+    for (dispatch_queue_t collectionQueue in [self.collectionQueues allValues]) {
+        
+        dispatch_group_enter(fences);
+        
+        dispatch_async(collectionQueue, ^{
+            dispatch_suspend(collectionQueue);
+            dispatch_group_leave(fences);
+        });
+        
+        [heldQueues addObject:collectionQueue];
+    }
+    
+    [self.pendingGlobalOperations addObject:heldQueues];
+    
+    dispatch_group_notify(fences, self.queue, ^{
+        
+        job();
+        
+        NSArray* queues = nil;
+        
+        @synchronized (self) {
+            [self.pendingGlobalOperations removeObjectIdenticalTo:heldQueues];
+            queues = [heldQueues copy];
+        }
+        
+        for (dispatch_queue_t collectionQueue in queues) {
+            dispatch_resume(collectionQueue);
+        }
+    });
+}
+
+-(dispatch_queue_t) _queueForCollection:(NSString*) collection
+{
+    dispatch_queue_t collectionQueue = self.collectionQueues[collection];
+    
+    if (collectionQueue == nil) {
+        
+        dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INITIATED, 0);
+        NSString* label = [@"com.jsonstore.executor." stringByAppendingString:collection];
+        collectionQueue = dispatch_queue_create([label UTF8String], attr);
+        dispatch_queue_set_specific(collectionQueue, JSONStoreExecutorQueueKey, JSONStoreExecutorQueueKey, NULL);
+        
+        //A new queue is also held back by the jobs that are not on a collection and were submitted before it
+        for (NSMutableArray* heldQueues in self.pendingGlobalOperations) {
+            dispatch_suspend(collectionQueue);
+            [heldQueues addObject:collectionQueue];
+        }
+        
+        self.collectionQueues[collection] = collectionQueue;
+    }
+    
+    return collectionQueue;
+}
+
+@end
@@ -19,6 +19,8 @@
 #import <JSONStore/JSONStoreAddOptions.h>
 #import <JSONStore/JSONStoreQueryPart.h>
 #import <JSONStore/JSONStoreQueryOptions.h>
+#import <JSONStore/JSONStoreAggregateOptions.h>
+#import <JSONStore/JSONStoreAsyncOperation.h>
 #import <JSONStore/JSONStoreConstants.h>
 #import <JSONStore/JSONStoreValidator.h>
 #import <JSONStore/JSONStoreSecurityManager.h>
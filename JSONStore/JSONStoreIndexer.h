@@ -28,7 +28,7 @@
 /**
  Handles indexing for arrays and dictionaries.
  @param schema Schema
- @param jsonObj JSON Object can be an array or a dictionary
+ @param jsonObj JSON Object can be an array, a dictionary or NSData with UTF-8 JSON text
  @param error Error
  @return returnDict property
  */
@@ -36,4 +36,13 @@
                                  forJsonObject:(id) jsonObj
                                          error:(NSError**) error;
 
+/**
+ Returns the values a document has for one search field, the same values findIndexesFromSchema:forJsonObject:error: finds.
+ @param searchField Search field, lowercased
+ @param data UTF-8 JSON text of the document
+ @return Set of values, nil if the data is not a JSON dictionary or array
+ */
+-(NSSet*) valuesForSearchField:(NSString*) searchField
+                    inJSONData:(NSData*) data;
+
 @end
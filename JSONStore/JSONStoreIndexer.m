@@ -20,6 +20,9 @@
 #import "JSONStoreConstants.h"
 #import "JSONStoreValidator.h"
 
+//Deepest nesting accepted when scanning JSON text, deeper documents are rejected instead of exhausting the stack
+static const int JSON_STORE_MAX_JSON_DEPTH = 512;
+
 @implementation JSONStoreIndexer
 
 -(NSMutableDictionary*) findIndexesFromSchema:(JSONStoreSchema*) schema
@@ -34,9 +37,15 @@
     }
     
     NSMutableArray* pathParts = [NSMutableArray new];
+    BOOL valid = YES;
     
     //Walk the json tree, and at each stop, see if it matches an index
-    if ([jsonObj isKindOfClass:[NSArray class]]) {
+    if ([jsonObj isKindOfClass:[NSData class]]) {
+        
+        //JSON text is validated in a single pass over the bytes, values are only built for search fields
+        valid = [self _scanJSONData:jsonObj];
+        
+    } else if ([jsonObj isKindOfClass:[NSArray class]]) {
         
         [self _handleArray:jsonObj withSchema:schema currentPath:pathParts];
         
@@ -46,6 +55,10 @@
         
     } else {
         
+        valid = NO;
+    }
+    
+    if (! valid) {
         
         NSLog(@"Error: JSON_STORE_INVALID_JSON_STRUCTURE, code: %d, schema: %@", JSON_STORE_INVALID_JSON_STRUCTURE, schema);
         NSLog(@"Error: JSON_STORE_INVALID_JSON_STRUCTURE, jsonObject: %@", jsonObj);
@@ -62,8 +75,472 @@
     return self.returnDict;
 }
 
+-(NSSet*) valuesForSearchField:(NSString*) searchField
+                    inJSONData:(NSData*) data
+{
+    NSMutableSet* values = [NSMutableSet new];
+    self.returnDict = [NSMutableDictionary dictionaryWithObject:values forKey:searchField];
+    
+    return [self _scanJSONData:data] ? values : nil;
+}
+
 #pragma mark Helpers
 
+-(BOOL) _scanJSONData:(NSData*) data
+{
+    const uint8_t* bytes = [data bytes];
+    NSUInteger length = [data length];
+    NSUInteger offset = 0;
+    
+    [self _skipWhitespaceInBytes:bytes length:length offset:&offset];
+    
+    //Same rule as objects, the top level value must be a dictionary or an array
+    if (offset >= length || (bytes[offset] != '{' && bytes[offset] != '[')) {
+        return NO;
+    }
+    
+    if (! [self _scanValueAtPath:@"" record:NO depth:0 bytes:bytes length:length offset:&offset]) {
+        return NO;
+    }
+    
+    [self _skipWhitespaceInBytes:bytes length:length offset:&offset];
+    
+    return offset == length;
+}
+
+-(void) _skipWhitespaceInBytes:(const uint8_t*) bytes
+                        length:(NSUInteger) length
+                        offset:(NSUInteger*) offset
+{
+    while (*offset < length &&
+           (bytes[*offset] == ' ' || bytes[*offset] == '\t' || bytes[*offset] == '\n' || bytes[*offset] == '\r')) {
+        (*offset)++;
+    }
+}
+
+-(BOOL) _scanValueAtPath:(NSString*) path
+                  record:(BOOL) record
+                   depth:(int) depth
+                   bytes:(const uint8_t*) bytes
+                  length:(NSUInteger) length
+                  offset:(NSUInteger*) offset
+{
+    [self _skipWhitespaceInBytes:bytes length:length offset:offset];
+    
+    if (*offset >= length || depth > JSON_STORE_MAX_JSON_DEPTH) {
+        return NO;
+    }
+    
+    //Values are only built for paths that are search fields, same as _handleSimpleTypeWithKeyValue
+    NSMutableSet* values = record ? [self.returnDict objectForKey:path] : nil;
+    id value = nil;
+    
+    switch (bytes[*offset]) {
+            
+        case '{':
+            return [self _scanObjectAtPath:path depth:depth + 1 bytes:bytes length:length offset:offset];
+            
+        case '[':
+            return [self _scanArrayAtPath:path depth:depth + 1 bytes:bytes length:length offset:offset];
+            
+        case '"': {
+            NSString* string = nil;
+            
+            if (! [self _scanString:values != nil ? &string : NULL bytes:bytes length:length offset:offset]) {
+                return NO;
+            }
+            
+            value = string;
+            break;
+        }
+            
+        case 't':
+        case 'f':
+        case 'n': {
+            const char* literal = bytes[*offset] == 't' ? "true" : (bytes[*offset] == 'f' ? "false" : "null");
+            size_t literalLength = strlen(literal);
+            
+            if (*offset + literalLength > length || memcmp(bytes + *offset, literal, literalLength) != 0) {
+                return NO;
+            }
+            
+            *offset += literalLength;
+            value = literal[0] == 'n' ? [NSNull null] : (literal[0] == 't' ? @YES : @NO);
+            break;
+        }
+            
+        default: {
+            NSNumber* number = nil;
+            
+            if (! [self _scanNumber:values != nil ? &number : NULL bytes:bytes length:length offset:offset]) {
+                return NO;
+            }
+            
+            value = number;
+            break;
+        }
+    }
+    
+    if (values != nil) {
+        [values addObject:[JSONStoreValidator getDatabaseSafeSearchField:value]];
+    }
+    
+    return YES;
+}
+
+-(BOOL) _scanObjectAtPath:(NSString*) path
+                    depth:(int) depth
+                    bytes:(const uint8_t*) bytes
+                   length:(NSUInteger) length
+                   offset:(NSUInteger*) offset
+{
+    (*offset)++;
+    [self _skipWhitespaceInBytes:bytes length:length offset:offset];
+    
+    if (*offset < length && bytes[*offset] == '}') {
+        (*offset)++;
+        return YES;
+    }
+    
+    while (YES) {
+        
+        NSString* key = nil;
+        
+        [self _skipWhitespaceInBytes:bytes length:length offset:offset];
+        
+        if (*offset >= length || bytes[*offset] != '"' ||
+            ! [self _scanString:&key bytes:bytes length:length offset:offset]) {
+            return NO;
+        }
+        
+        [self _skipWhitespaceInBytes:bytes length:length offset:offset];
+        
+        if (*offset >= length || bytes[(*offset)++] != ':') {
+            return NO;
+        }
+        
+        key = [key lowercaseString];
+        NSString* keyPath = [path length] ? [NSString stringWithFormat:@"%@.%@", path, key] : key;
+        
+        if (! [self _scanValueAtPath:keyPath record:YES depth:depth bytes:bytes length:length offset:offset]) {
+            return NO;
+        }
+        
+        [self _skipWhitespaceInBytes:bytes length:length offset:offset];
+        
+        if (*offset >= length) {
+            return NO;
+        }
+        
+        uint8_t separator = bytes[(*offset)++];
+        
+        if (separator == '}') {
+            return YES;
+        } else if (separator != ',') {
+            return NO;
+        }
+    }
+}
+
+-(BOOL) _scanArrayAtPath:(NSString*) path
+                   depth:(int) depth
+                   bytes:(const uint8_t*) bytes
+                  length:(NSUInteger) length
+                  offset:(NSUInteger*) offset
+{
+    (*offset)++;
+    [self _skipWhitespaceInBytes:bytes length:length offset:offset];
+    
+    if (*offset < length && bytes[*offset] == ']') {
+        (*offset)++;
+        return YES;
+    }
+    
+    while (YES) {
+        
+        //Simple types in an array can not be indexed, same as _handleArray
+        if (! [self _scanValueAtPath:path record:NO depth:depth bytes:bytes length:length offset:offset]) {
+            return NO;
+        }
+        
+        [self _skipWhitespaceInBytes:bytes length:length offset:offset];
+        
+        if (*offset >= length) {
+            return NO;
+        }
+        
+        uint8_t separator = bytes[(*offset)++];
+        
+        if (separator == ']') {
+            return YES;
+        } else if (separator != ',') {
+            return NO;
+        }
+    }
+}
+
+-(BOOL) _scanString:(NSString**) string
+              bytes:(const uint8_t*) bytes
+             length:(NSUInteger) length
+             offset:(NSUInteger*) offset
+{
+    NSUInteger start = ++(*offset);
+    NSMutableData* unescaped = nil;
+    
+    while (*offset < length && bytes[*offset] != '"') {
+        
+        uint8_t c = bytes[*offset];
+        
+        if (c < 0x20) {
+            return NO;
+        }
+        
+        if (c != '\\') {
+            (*offset)++;
+            continue;
+        }
+        
+        //Escapes are rare, the plain bytes before each one are copied only once one is found
+        if (string != NULL) {
+            
+            if (unescaped == nil) {
+                unescaped = [[NSMutableData alloc] init];
+            }
+            
+            [unescaped appendBytes:bytes + start length:*offset - start];
+        }
+        
+        if (*offset + 1 >= length) {
+            return NO;
+        }
+        
+        uint8_t escaped = bytes[*offset + 1];
+        *offset += 2;
+        
+        uint32_t codePoint = 0;
+        
+        switch (escaped) {
+            case '"': codePoint = '"'; break;
+            case '\\': codePoint = '\\'; break;
+            case '/': codePoint = '/'; break;
+            case 'b': codePoint = '\b'; break;
+            case 'f': codePoint = '\f'; break;
+            case 'n': codePoint = '\n'; break;
+            case 'r': codePoint = '\r'; break;
+            case 't': codePoint = '\t'; break;
+            case 'u':
+                if (! [self _scanHex:&codePoint bytes:bytes length:length offset:offset]) {
+                    return NO;
+                }
+                
+                //High surrogate followed by the escaped low surrogate
+                if (codePoint >= 0xd800 && codePoint <= 0xdbff) {
+                    
+                    uint32_t low = 0;
+                    
+                    if (*offset + 2 > length || bytes[*offset] != '\\' || bytes[*offset + 1] != 'u') {
+                        return NO;
+                    }
+                    
+                    *offset += 2;
+                    
+                    if (! [self _scanHex:&low bytes:bytes length:length offset:offset] || low < 0xdc00 || low > 0xdfff) {
+                        return NO;
+                    }
+                    
+                    codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    
+                } else if (codePoint >= 0xdc00 && codePoint <= 0xdfff) {
+                    return NO;
+                }
+                break;
+            default:
+                return NO;
+        }
+        
+        if (unescaped != nil) {
+            [self _appendCodePoint:codePoint toData:unescaped];
+        }
+        
+        start = *offset;
+    }
+    
+    if (*offset >= length) {
+        return NO;
+    }
+    
+    if (string != NULL) {
+        
+        if (unescaped != nil) {
+            [unescaped appendBytes:bytes + start length:*offset - start];
+            *string = [[NSString alloc] initWithData:unescaped encoding:NSUTF8StringEncoding];
+        } else {
+            *string = [[NSString alloc] initWithBytes:bytes + start length:*offset - start encoding:NSUTF8StringEncoding];
+        }
+        
+        if (*string == nil) {
+            return NO;
+        }
+    }
+    
+    //Closing quote
+    (*offset)++;
+    
+    return YES;
+}
+
+-(BOOL) _scanHex:(uint32_t*) value
+           bytes:(const uint8_t*) bytes
+          length:(NSUInteger) length
+          offset:(NSUInteger*) offset
+{
+    if (*offset + 4 > length) {
+        return NO;
+    }
+    
+    uint32_t result = 0;
+    
+    for (NSUInteger i = 0; i < 4; i++) {
+        
+        uint8_t c = bytes[*offset + i];
+        
+        if (c >= '0' && c <= '9') {
+            result = (result << 4) | (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            result = (result << 4) | (c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            result = (result << 4) | (c - 'A' + 10);
+        } else {
+            return NO;
+        }
+    }
+    
+    *offset += 4;
+    *value = result;
+    
+    return YES;
+}
+
+-(void) _appendCodePoint:(uint32_t) codePoint
+                  toData:(NSMutableData*) data
+{
+    uint8_t utf8[4];
+    NSUInteger size;
+    
+    if (codePoint < 0x80) {
+        utf8[0] = (uint8_t) codePoint;
+        size = 1;
+    } else if (codePoint < 0x800) {
+        utf8[0] = (uint8_t) (0xc0 | (codePoint >> 6));
+        utf8[1] = (uint8_t) (0x80 | (codePoint & 0x3f));
+        size = 2;
+    } else if (codePoint < 0x10000) {
+        utf8[0] = (uint8_t) (0xe0 | (codePoint >> 12));
+        utf8[1] = (uint8_t) (0x80 | ((codePoint >> 6) & 0x3f));
+        utf8[2] = (uint8_t) (0x80 | (codePoint & 0x3f));
+        size = 3;
+    } else {
+        utf8[0] = (uint8_t) (0xf0 | (codePoint >> 18));
+        utf8[1] = (uint8_t) (0x80 | ((codePoint >> 12) & 0x3f));
+        utf8[2] = (uint8_t) (0x80 | ((codePoint >> 6) & 0x3f));
+        utf8[3] = (uint8_t) (0x80 | (codePoint & 0x3f));
+        size = 4;
+    }
+    
+    [data appendBytes:utf8 length:size];
+}
+
+-(BOOL) _scanNumber:(NSNumber**) number
+              bytes:(const uint8_t*) bytes
+             length:(NSUInteger) length
+             offset:(NSUInteger*) offset
+{
+    NSUInteger start = *offset;
+    BOOL integer = YES;
+    
+    if (*offset < length && bytes[*offset] == '-') {
+        (*offset)++;
+    }
+    
+    //No leading zeros, 0 is only followed by a fraction or an exponent
+    if (*offset < length && bytes[*offset] == '0') {
+        (*offset)++;
+    } else if (! [self _scanDigitsInBytes:bytes length:length offset:offset]) {
+        return NO;
+    }
+    
+    if (*offset < length && bytes[*offset] == '.') {
+        
+        (*offset)++;
+        integer = NO;
+        
+        if (! [self _scanDigitsInBytes:bytes length:length offset:offset]) {
+            return NO;
+        }
+    }
+    
+    if (*offset < length && (bytes[*offset] == 'e' || bytes[*offset] == 'E')) {
+        
+        (*offset)++;
+        integer = NO;
+        
+        if (*offset < length && (bytes[*offset] == '+' || bytes[*offset] == '-')) {
+            (*offset)++;
+        }
+        
+        if (! [self _scanDigitsInBytes:bytes length:length offset:offset]) {
+            return NO;
+        }
+    }
+    
+    if (number == NULL) {
+        return YES;
+    }
+    
+    //The digits are not terminated, strtoll and strtod need a C string
+    NSUInteger size = *offset - start;
+    char text[64];
+    
+    if (size >= sizeof(text)) {
+        
+        NSString* string = [[NSString alloc] initWithBytes:bytes + start length:size encoding:NSUTF8StringEncoding];
+        *number = @([string doubleValue]);
+        
+        return YES;
+    }
+    
+    memcpy(text, bytes + start, size);
+    text[size] = 0;
+    
+    if (integer) {
+        
+        errno = 0;
+        long long value = strtoll(text, NULL, 10);
+        
+        if (errno != ERANGE) {
+            *number = @(value);
+            return YES;
+        }
+    }
+    
+    *number = @(strtod(text, NULL));
+    
+    return YES;
+}
+
+-(BOOL) _scanDigitsInBytes:(const uint8_t*) bytes
+                    length:(NSUInteger) length
+                    offset:(NSUInteger*) offset
+{
+    NSUInteger start = *offset;
+    
+    while (*offset < length && bytes[*offset] >= '0' && bytes[*offset] <= '9') {
+        (*offset)++;
+    }
+    
+    return *offset > start;
+}
+
 - (void) _handleSimpleTypeWithKeyValue:(id) value
                            currentPath:(NSArray *) path
 {
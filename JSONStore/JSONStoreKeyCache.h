@@ -0,0 +1,65 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Keeps the clear Data Protection Key (DPK) of each user in memory for a limited time, so opening the store again
+ does not derive the password key and decrypt the DPK. A key is only returned for the password it was cached with.
+ Evicted keys are overwritten with zeros.
+ @private
+ */
+@interface JSONStoreKeyCache : NSObject
+
+/**
+ Seconds a key stays cached after it is stored, 0 (default) turns the cache off and evicts every key.
+ */
+@property (nonatomic) NSTimeInterval timeToLive;
+
+/**
+ Provides access to the cache.
+ @return self
+ */
++(JSONStoreKeyCache*) sharedInstance;
+
+/**
+ Returns a cached key.
+ @param username User name
+ @param password Password the key was cached with
+ @return UTF-8 bytes of the DPK, nil if it is not cached, expired or was cached with a different password. The copy belongs to the caller, who zeroes it when done
+ */
+-(NSMutableData*) keyForUsername:(NSString*) username
+                    withPassword:(NSString*) password;
+
+/**
+ Caches a key, does nothing when the cache is off.
+ @param key UTF-8 bytes of the DPK, the cache keeps its own copy
+ @param username User name
+ @param password Password that unlocks the key
+ */
+-(void) setKey:(NSData*) key
+   forUsername:(NSString*) username
+  withPassword:(NSString*) password;
+
+/**
+ Evicts the key of a user.
+ @param username User name
+ */
+-(void) removeKeyForUsername:(NSString*) username;
+
+/**
+ Evicts every key.
+ */
+-(void) removeAllKeys;
+
+@end
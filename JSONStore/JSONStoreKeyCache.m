@@ -0,0 +1,224 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreKeyCache.h"
+#import <CommonCrypto/CommonHMAC.h>
+#import <Security/Security.h>
+
+//Keys of a cache entry
+static NSString* const JSON_STORE_KEY_CACHE_KEY = @"key";
+static NSString* const JSON_STORE_KEY_CACHE_PASSWORD = @"password";
+static NSString* const JSON_STORE_KEY_CACHE_EXPIRES = @"expires";
+
+//Overwrites bytes so they do not stay in freed memory, volatile keeps the compiler from dropping the writes
+static void jsonStoreZeroData(NSMutableData* data)
+{
+    volatile uint8_t* bytes = [data mutableBytes];
+    
+    for (NSUInteger i = 0; i < [data length]; i++) {
+        bytes[i] = 0;
+    }
+}
+
+@interface JSONStoreKeyCache ()
+
+//Entries by user name
+@property (nonatomic, strong) NSMutableDictionary* entries;
+
+//Random key for the password digests, never leaves the process
+@property (nonatomic, strong) NSMutableData* digestKey;
+
+@end
+
+@implementation JSONStoreKeyCache
+
++(JSONStoreKeyCache*) sharedInstance
+{
+    static JSONStoreKeyCache* sharedInstance = nil;
+    static dispatch_once_t onceToken;
+    
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [[JSONStoreKeyCache alloc] init];
+    });
+    
+    return sharedInstance;
+}
+
+-(instancetype) init
+{
+    if (self = [super init]) {
+        
+        self.entries = [[NSMutableDictionary alloc] init];
+        self.digestKey = [NSMutableData dataWithLength:CC_SHA256_DIGEST_LENGTH];
+        
+        if (SecRandomCopyBytes(kSecRandomDefault, [self.digestKey length], [self.digestKey mutableBytes]) != 0) {
+            self.digestKey = nil;
+        }
+    }
+    
+    return self;
+}
+
+-(void) setTimeToLive:(NSTimeInterval) timeToLive
+{
+    @synchronized(self) {
+        _timeToLive = timeToLive;
+    }
+    
+    if (timeToLive <= 0) {
+        [self removeAllKeys];
+    }
+}
+
+-(NSMutableData*) keyForUsername:(NSString*) username
+                    withPassword:(NSString*) password
+{
+    NSMutableData* key = nil;
+    
+    @synchronized(self) {
+        
+        NSDictionary* entry = self.entries[username];
+        
+        if (entry == nil) {
+            return nil;
+        }
+        
+        if ([entry[JSON_STORE_KEY_CACHE_EXPIRES] timeIntervalSinceNow] <= 0) {
+            [self _removeEntryForUsername:username];
+            return nil;
+        }
+        
+        NSData* digest = [self _digestWithPassword:password];
+        
+        if (digest != nil && [self _isData:digest equalToData:entry[JSON_STORE_KEY_CACHE_PASSWORD]]) {
+            key = [entry[JSON_STORE_KEY_CACHE_KEY] mutableCopy];
+        }
+    }
+    
+    return key;
+}
+
+-(void) setKey:(NSData*) key
+   forUsername:(NSString*) username
+  withPassword:(NSString*) password
+{
+    NSTimeInterval timeToLive = 0;
+    
+    @synchronized(self) {
+        
+        timeToLive = self.timeToLive;
+        
+        NSData* digest = [self _digestWithPassword:password];
+        
+        if (timeToLive <= 0 || digest == nil || [key length] == 0) {
+            return;
+        }
+        
+        [self _removeEntryForUsername:username];
+        
+        self.entries[username] = @{ JSON_STORE_KEY_CACHE_KEY : [key mutableCopy],
+                                    JSON_STORE_KEY_CACHE_PASSWORD : digest,
+                                    JSON_STORE_KEY_CACHE_EXPIRES : [NSDate dateWithTimeIntervalSinceNow:timeToLive] };
+    }
+    
+    //Evict on time even if the key is never asked for again
+    __weak JSONStoreKeyCache* weakSelf = self;
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (timeToLive * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        [weakSelf _removeExpiredEntries];
+    });
+}
+
+-(void) removeKeyForUsername:(NSString*) username
+{
+    @synchronized(self) {
+        [self _removeEntryForUsername:username];
+    }
+}
+
+-(void) removeAllKeys
+{
+    @synchronized(self) {
+        for (NSString* username in [self.entries allKeys]) {
+            [self _removeEntryForUsername:username];
+        }
+    }
+}
+
+#pragma mark Helpers
+
+-(void) _removeExpiredEntries
+{
+    @synchronized(self) {
+        for (NSString* username in [self.entries allKeys]) {
+            if ([self.entries[username][JSON_STORE_KEY_CACHE_EXPIRES] timeIntervalSinceNow] <= 0) {
+                [self _removeEntryForUsername:username];
+            }
+        }
+    }
+}
+
+//Callers hold the lock
+-(void) _removeEntryForUsername:(NSString*) username
+{
+    NSDictionary* entry = self.entries[username];
+    
+    if (entry == nil) {
+        return;
+    }
+    
+    jsonStoreZeroData(entry[JSON_STORE_KEY_CACHE_KEY]);
+    jsonStoreZeroData(entry[JSON_STORE_KEY_CACHE_PASSWORD]);
+    
+    [self.entries removeObjectForKey:username];
+}
+
+-(NSMutableData*) _digestWithPassword:(NSString*) password
+{
+    NSData* passwordData = [password dataUsingEncoding:NSUTF8StringEncoding];
+    
+    if (self.digestKey == nil || passwordData == nil) {
+        return nil;
+    }
+    
+    NSMutableData* digest = [NSMutableData dataWithLength:CC_SHA256_DIGEST_LENGTH];
+    
+    CCHmac(kCCHmacAlgSHA256, [self.digestKey bytes], [self.digestKey length], [passwordData bytes], [passwordData length], [digest mutableBytes]);
+    
+    return digest;
+}
+
+-(BOOL) _isData:(NSData*) data
+    equalToData:(NSData*) otherData
+{
+    if ([data length] != [otherData length]) {
+        return NO;
+    }
+    
+    //Compares every byte so the time taken does not tell how much of the digest matched
+    const uint8_t* bytes = [data bytes];
+    const uint8_t* otherBytes = [otherData bytes];
+    uint8_t difference = 0;
+    
+    for (NSUInteger i = 0; i < [data length]; i++) {
+        difference |= bytes[i] ^ otherBytes[i];
+    }
+    
+    return difference == 0;
+}
+
+@end
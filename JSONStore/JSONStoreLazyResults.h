@@ -0,0 +1,34 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#import <Foundation/Foundation.h>
+
+/**
+ Array of find results that keeps the rows returned by the database and decodes the json of a document when it is accessed.
+ Only the most recently accessed documents (JSON_STORE_LAZY_RESULTS_CACHE_SIZE) are kept decoded, the others are decoded
+ again on their next access, so changes made to a document that left the cache are not kept.
+ @private
+ */
+@interface JSONStoreLazyResults : NSArray
+
+/**
+ Returns an instance of self with the rows to decode.
+ @param rows Rows returned by the database, the json key holds the JSON blob
+ @param decoder Block that returns the decoded document for a row
+ @return self
+ */
+-(instancetype) initWithRows:(NSArray*) rows
+                     decoder:(NSDictionary* (^)(NSDictionary* row)) decoder;
+
+@end
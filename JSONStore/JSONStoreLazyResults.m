@@ -0,0 +1,105 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreLazyResults.h"
+#import "JSONStoreConstants.h"
+
+@interface JSONStoreLazyResults ()
+
+/**
+ Rows returned by the database, kept so documents that left the cache can be decoded again.
+ */
+@property (nonatomic, strong) NSArray* rows;
+
+/**
+ Recently decoded documents by index. Example: {0: document}.
+ */
+@property (nonatomic, strong) NSMutableDictionary* cache;
+
+/**
+ Indexes in the cache, least recently accessed first.
+ */
+@property (nonatomic, strong) NSMutableArray* cacheOrder;
+
+/**
+ Decodes a row into the document returned to the caller.
+ */
+@property (nonatomic, copy) NSDictionary* (^decoder)(NSDictionary* row);
+
+@end
+
+@implementation JSONStoreLazyResults
+
+-(instancetype) initWithRows:(NSArray*) rows
+                     decoder:(NSDictionary* (^)(NSDictionary* row)) decoder
+{
+    if (self = [super init]) {
+        self.rows = rows;
+        self.cache = [[NSMutableDictionary alloc] init];
+        self.cacheOrder = [[NSMutableArray alloc] init];
+        self.decoder = decoder;
+    }
+    
+    return self;
+}
+
+-(NSUInteger) count
+{
+    return [self.rows count];
+}
+
+-(id) objectAtIndex:(NSUInteger) index
+{
+    @synchronized (self) {
+        
+        id row = [self.rows objectAtIndex:index];
+        
+        if (! [row isKindOfClass:[NSDictionary class]]) {
+            return row;
+        }
+        
+        NSNumber* key = @(index);
+        id document = self.cache[key];
+        
+        if (document != nil) {
+            
+            [self.cacheOrder removeObject:key];
+            [self.cacheOrder addObject:key];
+            
+            return document;
+        }
+        
+        document = self.decoder(row);
+        
+        if (document == nil) {
+            document = [NSNull null];
+        }
+        
+        if ([self.cacheOrder count] >= JSON_STORE_LAZY_RESULTS_CACHE_SIZE) {
+            [self.cache removeObjectForKey:self.cacheOrder[0]];
+            [self.cacheOrder removeObjectAtIndex:0];
+        }
+        
+        self.cache[key] = document;
+        [self.cacheOrder addObject:key];
+        
+        return document;
+    }
+}
+
+@end
@@ -13,6 +13,12 @@
 
 #import <Foundation/Foundation.h>
 
+typedef enum {
+    JSONStore_PBKDF2_SHA1 = 0,
+    JSONStore_PBKDF2_SHA256 = 1,
+    JSONStore_PBKDF2_SHA512 = 2
+} JSONStoreKeyDerivationFunction;
+
 /**
  Contains JSONStore options that are used to open collections.
  */
@@ -38,6 +44,104 @@
  */
 @property (nonatomic, strong) NSString* secureRandom;
 
+/**
+ Number of queries on the same JSON path (see JSONStoreQueryPart jsonPath:equal:) after which
+ an index is created for that path. Default is nil, which never creates JSON path indexes.
+ Only collections that store documents as plain JSON text in the collection table get these indexes.
+ */
+@property (nonatomic, strong) NSNumber* jsonPathIndexThreshold;
+
+/**
+ Maximum size in bytes of find, count and aggregate results kept in memory. Cached results are dropped
+ when their collection changes. Default is nil, which does not cache results.
+ */
+@property (nonatomic, strong) NSNumber* queryCacheSize;
+
+/**
+ When true, documents kept in files (see JSONStoreCollection externalStorageThreshold) are memory mapped
+ instead of read into memory when the store is not encrypted. Default is false.
+ */
+@property (nonatomic) BOOL mapExternalDocuments;
+
+/**
+ Seconds the decrypted data protection key is kept in memory after an encrypted open, so opens with the same password
+ skip deriving the key from it. The key is evicted and overwritten when it expires, on closeAllCollectionsAndReturnError:,
+ on password change and on destroy. Default is nil, which does not keep the key.
+ */
+@property (nonatomic, strong) NSNumber* keyCacheTimeToLive;
+
+/**
+ Pseudo random function used by PBKDF2 to derive the key that protects the data protection key from the password.
+ Used when the key is first stored and when the password is changed. Default is JSONStore_PBKDF2_SHA1.
+ */
+@property (nonatomic) JSONStoreKeyDerivationFunction keyDerivationFunction;
+
+/**
+ Number of PBKDF2 iterations used when the key is first stored and when the password is changed.
+ Default is nil, which uses keyDerivationTargetTime or 10000 iterations. Values below 10000 are raised to 10000,
+ values below 1 fail the open with JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS.
+ */
+@property (nonatomic, strong) NSNumber* keyDerivationIterations;
+
+/**
+ Seconds a key derivation should take on this device. The number of iterations is calibrated once when the key
+ is first stored or the password is changed, and saved with the salt. Ignored when keyDerivationIterations is set.
+ Never fewer than 10000 iterations are used. Default is nil.
+ */
+@property (nonatomic, strong) NSNumber* keyDerivationTargetTime;
+
+/**
+ When true, open only opens and keys the store and registers the collections. Each collection is created or
+ validated by its first operation instead, so open time does not grow with the number of collections.
+ Errors such as a search field mismatch are then reported by that operation. Default is false.
+ */
+@property (nonatomic) BOOL provisionLazily;
+
+/**
+ When true with provisionLazily, the collections that are not used yet are provisioned on a background queue after open returns. Default is false.
+ */
+@property (nonatomic) BOOL warmUpInBackground;
+
+/**
+ Maximum number of bytes the page cache may hold while collections marked hot are read into it after open.
+ Default is nil, which lets the warm-up fill the whole page cache.
+ */
+@property (nonatomic, strong) NSNumber* warmUpMemoryBudget;
+
+/**
+ Maximum number of bytes of the store file that reads access through memory-mapped I/O instead of copying pages.
+ Helps stores that are mostly read. Not supported with a password, encrypted pages have to be decrypted into the page cache.
+ Default is nil, which does not map the file.
+ */
+@property (nonatomic, strong) NSNumber* mmapSize;
+
+/**
+ Page size in bytes of the store file, a power of two from 512 to 65536. Larger pages make scans of large collections faster.
+ Applied when the store is created, an existing store is rebuilt with the new page size when it is opened, which takes time
+ proportional to its size. Not supported with a password. Default is nil, which keeps the current page size.
+ */
+@property (nonatomic, strong) NSNumber* pageSize;
+
+/**
+ Maximum number of bytes the page cache may hold. Default is nil, which keeps the SQLite default.
+ */
+@property (nonatomic, strong) NSNumber* cacheSize;
+
+/**
+ Seconds an add or replace waits for other adds and replaces on the same collection, so they are committed together
+ in one transaction instead of one transaction each. Each caller still gets its own result and error. Helps when many
+ threads write a few documents at a time. A write commits right away when no commit is in progress on the collection,
+ otherwise it waits for that commit to end, up to this long. Asynchronous operations and writes in a transaction are not grouped.
+ Default is nil, which commits each write on its own.
+ */
+@property (nonatomic, strong) NSNumber* groupCommitWindow;
+
+/**
+ Number of writes that are committed as soon as they are waiting, without waiting for the rest of groupCommitWindow.
+ Default is nil, which commits up to 64 writes together.
+ */
+@property (nonatomic, strong) NSNumber* groupCommitBatchSize;
+
 
 
 @end
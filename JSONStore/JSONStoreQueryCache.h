@@ -0,0 +1,90 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Caches query results per collection. Every collection has a generation number that is incremented
+ on writes, results cached under an older generation are never returned.
+ @private
+ */
+@interface JSONStoreQueryCache : NSObject
+
+/**
+ Maximum estimated size in bytes of the cached results.
+ */
+@property (nonatomic, readonly) NSUInteger maximumSize;
+
+/**
+ Current estimated size in bytes of the cached results.
+ */
+@property (nonatomic, readonly) NSUInteger size;
+
+/**
+ Number of lookups that returned cached results.
+ */
+@property (nonatomic, readonly) NSUInteger hits;
+
+/**
+ Number of lookups that did not find valid cached results.
+ */
+@property (nonatomic, readonly) NSUInteger misses;
+
+/**
+ Returns an instance of self that keeps at most the given number of bytes of results.
+ @param maximumSize Maximum estimated size in bytes
+ @return self
+ */
+-(instancetype) initWithMaximumSize:(NSUInteger) maximumSize;
+
+/**
+ Returns a copy of the cached results for a query.
+ @param collection Name of the collection
+ @param sql SQL statement
+ @param parameters Values bound to the SQL statement
+ @return Array of rows, nil if there are no valid cached results
+ */
+-(NSMutableArray*) resultsForCollection:(NSString*) collection
+                                withSQL:(NSString*) sql
+                             parameters:(NSArray*) parameters;
+
+/**
+ Caches a copy of the results for a query.
+ @param results Array of rows
+ @param collection Name of the collection
+ @param sql SQL statement
+ @param parameters Values bound to the SQL statement
+ */
+-(void) setResults:(NSArray*) results
+     forCollection:(NSString*) collection
+           withSQL:(NSString*) sql
+        parameters:(NSArray*) parameters;
+
+/**
+ Increments the generation of a collection, called after every write to the collection.
+ @param collection Name of the collection
+ */
+-(void) invalidateCollection:(NSString*) collection;
+
+/**
+ Removes all cached results.
+ */
+-(void) removeAllResults;
+
+/**
+ Returns hits, misses, hitRate, entries and size.
+ @return Metrics
+ */
+-(NSDictionary*) metrics;
+
+@end
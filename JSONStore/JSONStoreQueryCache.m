@@ -0,0 +1,224 @@
+/*
+ *     Copyright 2016 IBM Corp.
+ *     Licensed under the Apache License, Version 2.0 (the "License");
+ *     you may not use this file except in compliance with the License.
+ *     You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *     Unless required by applicable law or agreed to in writing, software
+ *     distributed under the License is distributed on an "AS IS" BASIS,
+ *     WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *     See the License for the specific language governing permissions and
+ *     limitations under the License.
+ */
+
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag
+#endif
+
+#import "JSONStoreQueryCache.h"
+#import "JSONStoreConstants.h"
+
+//Rough per column cost of the Foundation objects that hold a row
+static const NSUInteger JSON_STORE_QUERY_CACHE_COLUMN_COST = 64;
+
+@interface JSONStoreQueryCache ()
+
+@property (nonatomic, readwrite) NSUInteger maximumSize;
+@property (nonatomic, readwrite) NSUInteger size;
+@property (nonatomic, readwrite) NSUInteger hits;
+@property (nonatomic, readwrite) NSUInteger misses;
+
+/**
+ Cached entries by key: {results, generation, cost, collection}.
+ */
+@property (nonatomic, strong) NSMutableDictionary* entries;
+
+/**
+ Keys from least to most recently used.
+ */
+@property (nonatomic, strong) NSMutableArray* recentKeys;
+
+/**
+ Current generation by collection name.
+ */
+@property (nonatomic, strong) NSMutableDictionary* generations;
+
+@end
+
+@implementation JSONStoreQueryCache
+
+-(instancetype) initWithMaximumSize:(NSUInteger) maximumSize
+{
+    if (self = [super init]) {
+        self.maximumSize = maximumSize;
+        self.entries = [[NSMutableDictionary alloc] init];
+        self.recentKeys = [[NSMutableArray alloc] init];
+        self.generations = [[NSMutableDictionary alloc] init];
+    }
+    
+    return self;
+}
+
+-(NSMutableArray*) resultsForCollection:(NSString*) collection
+                                withSQL:(NSString*) sql
+                             parameters:(NSArray*) parameters
+{
+    @synchronized(self) {
+        
+        NSString* key = [self _keyForCollection:collection withSQL:sql parameters:parameters];
+        NSDictionary* entry = self.entries[key];
+        
+        if (entry != nil && ! [entry[@"generation"] isEqualToNumber:[self _generationForCollection:collection]]) {
+            [self _removeEntryForKey:key];
+            entry = nil;
+        }
+        
+        if (entry == nil) {
+            self.misses++;
+            return nil;
+        }
+        
+        self.hits++;
+        
+        [self.recentKeys removeObject:key];
+        [self.recentKeys addObject:key];
+        
+        return [JSONStoreQueryCache _copyOfResults:entry[@"results"]];
+    }
+}
+
+-(void) setResults:(NSArray*) results
+     forCollection:(NSString*) collection
+           withSQL:(NSString*) sql
+        parameters:(NSArray*) parameters
+{
+    NSUInteger cost = [JSONStoreQueryCache _costOfResults:results];
+    
+    if (cost > self.maximumSize) {
+        return;
+    }
+    
+    @synchronized(self) {
+        
+        NSString* key = [self _keyForCollection:collection withSQL:sql parameters:parameters];
+        
+        [self _removeEntryForKey:key];
+        
+        while (self.size + cost > self.maximumSize && [self.recentKeys count]) {
+            [self _removeEntryForKey:self.recentKeys[0]];
+        }
+        
+        self.entries[key] = @{ @"results" : [JSONStoreQueryCache _copyOfResults:results],
+                               @"generation" : [self _generationForCollection:collection],
+                               @"cost" : @(cost) };
+        [self.recentKeys addObject:key];
+        self.size += cost;
+    }
+}
+
+-(void) invalidateCollection:(NSString*) collection
+{
+    if (collection == nil) {
+        return;
+    }
+    
+    @synchronized(self) {
+        self.generations[collection] = @([[self _generationForCollection:collection] unsignedLongLongValue] + 1);
+    }
+}
+
+-(void) removeAllResults
+{
+    @synchronized(self) {
+        [self.entries removeAllObjects];
+        [self.recentKeys removeAllObjects];
+        self.size = 0;
+    }
+}
+
+-(NSDictionary*) metrics
+{
+    @synchronized(self) {
+        
+        NSUInteger lookups = self.hits + self.misses;
+        
+        return @{ JSON_STORE_KEY_CACHE_HITS : @(self.hits),
+                  JSON_STORE_KEY_CACHE_MISSES : @(self.misses),
+                  JSON_STORE_KEY_CACHE_HIT_RATE : @(lookups ? (double) self.hits / lookups : 0.0),
+                  JSON_STORE_KEY_CACHE_ENTRIES : @([self.entries count]),
+                  JSON_STORE_KEY_CACHE_SIZE : @(self.size) };
+    }
+}
+
+#pragma mark Helpers
+
+-(NSString*) _keyForCollection:(NSString*) collection
+                       withSQL:(NSString*) sql
+                    parameters:(NSArray*) parameters
+{
+    //Class names keep @1 and @"1" apart, they bind differently
+    NSMutableString* key = [NSMutableString stringWithFormat:@"%@\n%@", collection, sql];
+    
+    for (id parameter in parameters) {
+        [key appendFormat:@"\n%@:%@", NSStringFromClass([parameter class]), parameter];
+    }
+    
+    return key;
+}
+
+-(NSNumber*) _generationForCollection:(NSString*) collection
+{
+    NSNumber* generation = self.generations[collection];
+    return generation != nil ? generation : @0;
+}
+
+-(void) _removeEntryForKey:(NSString*) key
+{
+    NSDictionary* entry = self.entries[key];
+    
+    if (entry != nil) {
+        self.size -= [entry[@"cost"] unsignedIntegerValue];
+        [self.entries removeObjectForKey:key];
+        [self.recentKeys removeObject:key];
+    }
+}
+
++(NSMutableArray*) _copyOfResults:(NSArray*) results
+{
+    //Callers decode the json column in place, every row needs its own dictionary
+    NSMutableArray* copy = [[NSMutableArray alloc] initWithCapacity:[results count]];
+    
+    for (id row in results) {
+        [copy addObject:[row isKindOfClass:[NSDictionary class]] ? [row mutableCopy] : row];
+    }
+    
+    return copy;
+}
+
++(NSUInteger) _costOfResults:(NSArray*) results
+{
+    NSUInteger cost = 0;
+    
+    for (id row in results) {
+        
+        if (! [row isKindOfClass:[NSDictionary class]]) {
+            cost += JSON_STORE_QUERY_CACHE_COLUMN_COST;
+            continue;
+        }
+        
+        for (id value in [row allValues]) {
+            
+            cost += JSON_STORE_QUERY_CACHE_COLUMN_COST;
+            
+            if ([value isKindOfClass:[NSData class]]) {
+                cost += [value length];
+            } else if ([value isKindOfClass:[NSString class]]) {
+                cost += [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+            }
+        }
+    }
+    
+    return cost;
+}
+
+@end
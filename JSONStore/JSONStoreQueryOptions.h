@@ -34,6 +34,12 @@
  */
 @property (nonatomic,strong) NSMutableArray* _filter;
 
+/**
+ Private. NSArray with JSON paths to project (e.g. [@"name", @"address.city"]).
+ @private
+ */
+@property (nonatomic,strong) NSMutableArray* _projection;
+
 /**
  Determines the maximum number of results to return.
  */
@@ -44,6 +50,33 @@
  */
 @property (nonatomic,strong) NSNumber* offset;
 
+/**
+ When true, a find with a positive limit and no offset pages by position instead of skipping documents and sets nextPageToken.
+ Add the options to JSONStoreCollection pageSorts so the sort has an index and every page costs the same. Default is false.
+ */
+@property (nonatomic) BOOL usePageTokens;
+
+/**
+ Page token returned in nextPageToken by a previous find with the same query parts and sort criteria.
+ The find resumes right after the last document of that page instead of skipping documents, so every page costs the same.
+ Only used with a positive limit and no offset, setting it implies usePageTokens. A token that does not match the
+ sort criteria fails the find with JSON_STORE_INVALID_PAGE_TOKEN.
+ */
+@property (nonatomic,strong) NSString* pageToken;
+
+/**
+ Set by find operations that use page tokens (see usePageTokens). Pass it as pageToken to get the next page.
+ It is nil when the last page was returned.
+ */
+@property (nonatomic,strong) NSString* nextPageToken;
+
+/**
+ When true, find returns an array that decodes the json of each document the first time it is accessed
+ instead of decoding every document before returning. Only the most recently accessed documents stay decoded,
+ copy a document before changing it if the changes must outlive the next accesses. Default is false.
+ */
+@property (nonatomic) BOOL decodeLazily;
+
 /**
  Sorts by search field ascending.
  @param searchField Search field
@@ -62,6 +95,21 @@
  */
 -(void) filterSearchField:(NSString*) searchField;
 
+/**
+ Returns only the value at the given JSON path instead of the whole document. The json key of each result
+ holds a dictionary with one key per projected path (e.g. {@"address.city": @"Austin"}), paths without a value are left out.
+ Use dots to separate keys and numbers to index arrays (e.g. @"phones.0.number").
+ @param jsonPath JSON path
+ */
+-(void) projectJSONPath:(NSString*) jsonPath;
+
+/**
+ Private. Returns the values in pageToken, one per sort criteria followed by the _id of the last document of the page.
+ @return NSArray with the values, nil when the token is malformed or was made for other sort criteria
+ @private
+ */
+-(NSArray*) _pageTokenValues;
+
 /**
  String representation of the object.
  */
@@ -17,6 +17,8 @@
 
 #import "JSONStoreQueryOptions.h"
 #import "JSONStoreConstants.h"
+#import "JSONStoreValidator.h"
+#import "NSString+WLJSON.h"
 
 @implementation JSONStoreQueryOptions
 
@@ -47,9 +49,37 @@
     [__filter addObject:searchField];
 }
 
+-(void) projectJSONPath:(NSString*) jsonPath
+{
+    if (! __projection) {
+        __projection = [[NSMutableArray alloc] init];
+    }
+    
+    [__projection addObject:[JSONStoreValidator getDatabaseSafeSearchField:jsonPath]];
+}
+
+-(NSArray*) _pageTokenValues
+{
+    id values = [self.pageToken WLJSONValue];
+    
+    if (! [values isKindOfClass:[NSArray class]] || [values count] != [__sort count] + 1 ||
+        ! [[values lastObject] isKindOfClass:[NSNumber class]]) {
+        return nil;
+    }
+    
+    //Sort values are search field values, never containers
+    for (id value in values) {
+        if (! [value isKindOfClass:[NSString class]] && ! [value isKindOfClass:[NSNumber class]] && value != [NSNull null]) {
+            return nil;
+        }
+    }
+    
+    return values;
+}
+
 -(NSString*) description
 {
-    return [NSString stringWithFormat: @"[JSONStoreQueryOptions: sort=%@ filter=%@, limit=%@, offset=%@]", self._sort, self._filter, self.limit, self.offset];
+    return [NSString stringWithFormat: @"[JSONStoreQueryOptions: sort=%@ filter=%@, projection=%@, limit=%@, offset=%@, usePageTokens=%@, pageToken=%@]", self._sort, self._filter, self._projection, self.limit, self.offset, self.usePageTokens ? @"YES" : @"NO", self.pageToken];
 }
 
 @end
@@ -106,6 +106,11 @@
  */
 @property (nonatomic, retain) NSMutableArray* _notBetween;
 
+/**
+ Private. NSArray with JSON path criteria (e.g. [{address.city: [@"=", @"Austin"]}]).
+ */
+@property (nonatomic, retain) NSMutableArray* _jsonPath;
+
 
 /**
  Add a less than criteria.
@@ -239,4 +244,60 @@
          notBetween:(NSNumber*) number1
                 and:(NSNumber*) number2;
 
+/**
+ Add an equal to criteria on a JSON path that is not a search field. Requires the SQLite JSON1 functions.
+ @param jsonPath JSON path, use dots to separate keys and numbers to index arrays (e.g. @"address.city")
+ @param value String or number
+ */
+-(void) jsonPath:(NSString*) jsonPath
+           equal:(id) value;
+
+/**
+ Add a not equal to criteria on a JSON path that is not a search field. Requires the SQLite JSON1 functions.
+ @param jsonPath JSON path
+ @param value String or number
+ */
+-(void) jsonPath:(NSString*) jsonPath
+        notEqual:(id) value;
+
+/**
+ Add a less than criteria on a JSON path that is not a search field. Requires the SQLite JSON1 functions.
+ @param jsonPath JSON path
+ @param number Number
+ */
+-(void) jsonPath:(NSString*) jsonPath
+        lessThan:(NSNumber*) number;
+
+/**
+ Add a less than or equal to criteria on a JSON path that is not a search field. Requires the SQLite JSON1 functions.
+ @param jsonPath JSON path
+ @param number Number
+ */
+-(void) jsonPath:(NSString*) jsonPath
+ lessOrEqualThan:(NSNumber*) number;
+
+/**
+ Add a greater than criteria on a JSON path that is not a search field. Requires the SQLite JSON1 functions.
+ @param jsonPath JSON path
+ @param number Number
+ */
+-(void) jsonPath:(NSString*) jsonPath
+     greaterThan:(NSNumber*) number;
+
+/**
+ Add a greater than or equal to criteria on a JSON path that is not a search field. Requires the SQLite JSON1 functions.
+ @param jsonPath JSON path
+ @param number Number
+ */
+-(void) jsonPath:(NSString*) jsonPath
+greaterOrEqualThan:(NSNumber*) number;
+
+/**
+ Add a like criteria on a JSON path that is not a search field. Requires the SQLite JSON1 functions.
+ @param jsonPath JSON path
+ @param string String
+ */
+-(void) jsonPath:(NSString*) jsonPath
+            like:(NSString*) string;
+
 @end
@@ -241,5 +241,61 @@
     [__notBetween addObject:@{safeSearchField : @[number1, number2]}];
 }
 
+-(void) jsonPath:(NSString*) jsonPath
+           equal:(id) value
+{
+    [self _addJSONPath:jsonPath withSymbol:@"=" andValue:value];
+}
+
+-(void) jsonPath:(NSString*) jsonPath
+        notEqual:(id) value
+{
+    [self _addJSONPath:jsonPath withSymbol:@"!=" andValue:value];
+}
+
+-(void) jsonPath:(NSString*) jsonPath
+        lessThan:(NSNumber*) number
+{
+    [self _addJSONPath:jsonPath withSymbol:@"<" andValue:number];
+}
+
+-(void) jsonPath:(NSString*) jsonPath
+ lessOrEqualThan:(NSNumber*) number
+{
+    [self _addJSONPath:jsonPath withSymbol:@"<=" andValue:number];
+}
+
+-(void) jsonPath:(NSString*) jsonPath
+     greaterThan:(NSNumber*) number
+{
+    [self _addJSONPath:jsonPath withSymbol:@">" andValue:number];
+}
+
+-(void) jsonPath:(NSString*) jsonPath
+greaterOrEqualThan:(NSNumber*) number
+{
+    [self _addJSONPath:jsonPath withSymbol:@">=" andValue:number];
+}
+
+-(void) jsonPath:(NSString*) jsonPath
+            like:(NSString*) string
+{
+    [self _addJSONPath:jsonPath withSymbol:@"LIKE" andValue:[NSString stringWithFormat:@"%%%@%%", string]];
+}
+
+#pragma mark Helpers
+
+-(void) _addJSONPath:(NSString*) jsonPath
+          withSymbol:(NSString*) symbol
+            andValue:(id) value
+{
+    if (! __jsonPath) {
+        __jsonPath = [[NSMutableArray alloc] init];
+    }
+    
+    NSString* safeJSONPath = [JSONStoreValidator getDatabaseSafeSearchField:jsonPath];
+    
+    [__jsonPath addObject:@{safeJSONPath : @[symbol, value != nil ? value : [NSNull null]]}];
+}
 
 @end
\ No newline at end of file
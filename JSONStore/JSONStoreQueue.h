@@ -15,6 +15,7 @@
 #import "JSONStoreConstants.h"
 #import "JSONStoreQueryOptions.h"
 #import "JSONStoreIndexer.h"
+#import "JSONStoreOpenOptions.h"
 
 /**
  Executes all JSONStore operations in a serial queue.
@@ -22,12 +23,13 @@
 @interface JSONStoreQueue : NSObject
 
 /**
- Instance of a JSONStoreIndexer.
+ Instance of a JSONStoreIndexer. Blocks that run on a writer lane get their own instance.
  */
 @property (nonatomic, strong) JSONStoreIndexer* indexer;
 
 /**
  Instance of a JSONStoreSQLLite object that communicates with the Database Manager.
+ Blocks that run on the writer lane of a collection get the store of that lane.
  */
 @property (nonatomic, strong) JSONStoreSQLLite* store;
 
@@ -39,13 +41,68 @@
 /**
  Holds the schema for the various collections. Example: {collection1: {name: 'string'}}.
  */
-@property (nonatomic, strong) NSMutableDictionary* jsonSchemas;
+@property (atomic, strong) NSMutableDictionary* jsonSchemas;
 
 /**
  Executes operation blocks serially.
  */
 @property (nonatomic) dispatch_queue_t operationQueue;
 
+/**
+ Collections that get their own writer lane. Example: {collection1}.
+ */
+@property (nonatomic, strong) NSMutableSet* writerLaneCollections;
+
+/**
+ Open writer lanes, each with its own serial queue and store. Example: {collection1: {queue: queue, store: store}}.
+ */
+@property (nonatomic, strong) NSMutableDictionary* writerLanes;
+
+/**
+ Collections whose writer lane may not open, NSNull for all of them. Counted, so suspensions can overlap. Example: {collection1, NSNull}.
+ */
+@property (nonatomic, strong) NSCountedSet* suspendedWriterLanes;
+
+/**
+ Key derivation options from the last open, used when the password is changed.
+ */
+@property (nonatomic) JSONStoreKeyDerivationFunction keyDerivationFunction;
+
+/**
+ Number of key derivation iterations from the last open, used when the password is changed.
+ */
+@property (nonatomic, strong) NSNumber* keyDerivationIterations;
+
+/**
+ Key derivation target time from the last open, used when the password is changed.
+ */
+@property (nonatomic, strong) NSNumber* keyDerivationTargetTime;
+
+/**
+ Seconds adds and replaces wait to be committed together, nil or zero commits each one on its own.
+ */
+@property (nonatomic, strong) NSNumber* groupCommitWindow;
+
+/**
+ Number of waiting adds and replaces that are committed without waiting for the rest of the window.
+ */
+@property (nonatomic, strong) NSNumber* groupCommitBatchSize;
+
+/**
+ Adds and replaces waiting to be committed together. Example: {collection1: [request1, request2]}.
+ */
+@property (nonatomic, strong) NSMutableDictionary* pendingGroupCommits;
+
+/**
+ Collections with a group commit in progress, counted per commit. Example: {collection1}.
+ */
+@property (nonatomic, strong) NSCountedSet* activeGroupCommits;
+
+/**
+ Entered while a collection has a group commit in progress.
+ */
+@property (nonatomic) dispatch_group_t groupCommitsInFlight;
+
 /**
  Returns an instance of self that is initialized with a specific user name. This method must be called first to set the user name, otherwise you will get an exception from sharedManager.
  @param username User name that is tied to the singleton
@@ -99,6 +156,17 @@ additionalIndexes:(NSDictionary*) additionalIndexes
               withQueryParts: (NSArray*) queryParts
              andQueryOptions: (JSONStoreQueryOptions*) options;
 
+/**
+ Computes aggregates over the documents inside a collection that match the query parts.
+ @param collection Name of the collection
+ @param queryParts Array of JSONStoreQuery objects
+ @param options Aggregates and group by search fields
+ @return Array of summary rows as results
+ */
+-(NSArray*) aggregateCollection: (NSString*) collection
+                 withQueryParts: (NSArray*) queryParts
+            andAggregateOptions: (JSONStoreAggregateOptions*) options;
+
 /**
  Removes documents that match the query from a collection.
  @param collection Name of the collection
@@ -112,6 +180,22 @@ additionalIndexes:(NSDictionary*) additionalIndexes
                       exact:(BOOL) exact
                   markDirty:(BOOL) markDirty;
 
+/**
+ Patches documents inside a collection. Documents stored as JSON text are patched in the database with one statement,
+ recomputing only the search fields under the patched paths, other documents are decoded, patched and replaced.
+ @param ids Array of _id values
+ @param collection Name of the collection
+ @param mergePatch JSON merge patch, can be nil
+ @param values Values by key path, set after the merge patch is applied, can be nil
+ @param markDirty Determines if the documents that are patched are marked as dirty (true) or not (false)
+ @return Number of documents patched, JSON_STORE_PERSISTENT_STORE_FAILURE if there is a failure
+ */
+-(int) patchDocumentsWithIds:(NSArray*) ids
+                inCollection:(NSString*) collection
+                  mergePatch:(NSDictionary*) mergePatch
+                   setValues:(NSDictionary*) values
+                   markDirty:(BOOL) markDirty;
+
 /**
  Replaces documents inside a collection.
  @param documents Array of documents as dictionaries
@@ -188,6 +272,133 @@ additionalIndexes:(NSDictionary*) additionalIndexes
  */
 -(BOOL) clearTable: (NSString*) collection;
 
+/**
+ Returns the flags used to write documents to a collection.
+ @param collection Name of the collection
+ @return Storage flags (JSON_STORE_STORAGE_FLAG_*), 0 for JSON text
+ */
+-(int) storageFlagsForCollection:(NSString*) collection;
+
+/**
+ Changes the flags used to write documents to a collection, existing documents are rewritten with the new flags.
+ @param flags Storage flags (JSON_STORE_STORAGE_FLAG_*), 0 for JSON text
+ @param dictionary Preset dictionary used with JSON_STORE_STORAGE_FLAG_COMPRESSED, can be nil
+ @param collection Name of the collection
+ @return Success (true) or failure (false)
+ */
+-(BOOL) setStorageFlags:(int) flags
+             dictionary:(NSData*) dictionary
+          forCollection:(NSString*) collection;
+
+/**
+ Sets the size from which documents written to a collection are kept in files.
+ @param threshold Size in bytes of the encoded document, nil to keep every document in the collection
+ @param collection Name of the collection
+ */
+-(void) setExternalStorageThreshold:(NSNumber*) threshold
+                      forCollection:(NSString*) collection;
+
+/**
+ Attaches the database file of a collection kept in its own file.
+ @param collection Name of the collection
+ @param encrypted When true and the store is encrypted, the file is encrypted
+ @return JSON_STORE_RC_OK or the error code
+ */
+-(int) attachFileForCollection:(NSString*) collection
+                      encrypted:(BOOL) encrypted;
+
+/**
+ Creates the index used by finds that page with page tokens on a sort.
+ @param sort Sort criteria of JSONStoreQueryOptions
+ @param collection Name of the collection
+ @return Success (true) or failure (false)
+ */
+-(BOOL) createPageIndexForSort:(NSArray*) sort
+                  inCollection:(NSString*) collection;
+
+/**
+ Tunes how the store file is read. Does nothing for the values that are nil.
+ @param pageSize Page size in bytes
+ @param mmapSize Bytes of the file read through memory-mapped I/O
+ @param cacheSize Bytes the page cache may hold
+ @return Success (true) or failure (false)
+ */
+-(BOOL) setPageSize:(NSNumber*) pageSize
+           mmapSize:(NSNumber*) mmapSize
+          cacheSize:(NSNumber*) cacheSize;
+
+/**
+ Returns the select statements that warm up the page cache for a collection.
+ @param collection Name of the collection
+ @return NSArray with select statements, empty when the collection is not open
+ */
+-(NSArray*) warmUpStatementsForCollection:(NSString*) collection;
+
+/**
+ Reads the pages touched by a warm-up statement into the page cache, one chunk of rows at a time.
+ @param sql Select statement from warmUpStatementsForCollection:
+ @param budget Bytes the page cache may hold
+ @param shouldStop Block that returns true to stop early
+ @return Success (true) or failure (false)
+ */
+-(BOOL) readIntoCache:(NSString*) sql
+         memoryBudget:(NSUInteger) budget
+           shouldStop:(BOOL (^)(void)) shouldStop;
+
+/**
+ Returns page cache statistics.
+ @return NSDictionary with hits, misses and size, nil when the store is closed
+ */
+-(NSDictionary*) cacheStatus;
+
+/**
+ Runs a block on the operation queue. The methods of this class that are called from the block run on it directly.
+ @param block Block to run
+ */
+-(void) performOperation:(dispatch_block_t) block;
+
+/**
+ Runs a block on the writer lane of a collection, or on the operation queue when the collection has no writer lane.
+ @param block Block to run
+ @param collection Name of the collection
+ */
+-(void) performOperation:(dispatch_block_t) block
+           forCollection:(NSString*) collection;
+
+/**
+ Submits a block to the writer lane of a collection, or to the operation queue when the collection has no writer lane,
+ and returns without waiting for it.
+ @param block Block to run
+ @param collection Name of the collection
+ */
+-(void) performOperationAsync:(dispatch_block_t) block
+                forCollection:(NSString*) collection;
+
+/**
+ Gives a collection kept in its own file a writer lane: a serial queue with its own connection to the file,
+ so its operations do not wait for the operations of other collections. The lane is opened on first use.
+ @param writerLane True to give the collection a writer lane, false to use the operation queue
+ @param collection Name of the collection
+ */
+-(void) setWriterLane:(BOOL) writerLane
+        forCollection:(NSString*) collection;
+
+/**
+ Waits for the operations on the writer lanes and closes them. They do not open again until resumeWriterLanes.
+ */
+-(void) suspendWriterLanes;
+
+/**
+ Lets the writer lanes closed by suspendWriterLanes open again on next use.
+ */
+-(void) resumeWriterLanes;
+
+/**
+ Commits the writes waiting for a group commit and waits for the group commits in progress.
+ Called once a transaction is marked in progress, so no write joins a group after it.
+ */
+-(void) flushGroupCommits;
+
 /**
  Closes the store.
  @return Success (true) or failure (false)
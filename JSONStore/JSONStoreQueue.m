@@ -19,9 +19,34 @@
 #import "JSONStore+Private.h"
 #import "JSONStoreQueue.h"
 #import "JSONStoreSecurityManager.h"
+#import "JSONStoreKeyCache.h"
+#import "JSONStoreQueryPart.h"
+#import "JSONStoreDocumentCodec.h"
+#import "JSONStoreExecutor.h"
 
 static JSONStoreQueue* _jsqSingleton = nil;
 
+//Set on the operation queue, so code that already runs on it is detected
+static void* const JSONStoreOperationQueueKey = (void*) &JSONStoreOperationQueueKey;
+
+//Set on writer lane queues to the store of the lane
+static void* const JSONStoreWriterLaneKey = (void*) &JSONStoreWriterLaneKey;
+
+//Runs a block on the operation queue, inline when the caller already runs on it (see performOperation:)
+static void jsonStoreQueueSync(dispatch_queue_t queue, dispatch_block_t block)
+{
+    if (dispatch_get_specific(JSONStoreOperationQueueKey) == (__bridge void*) queue) {
+        block();
+    } else {
+        dispatch_sync(queue, block);
+    }
+}
+
+static void jsonStoreReleaseWriterLaneStore(void* store)
+{
+    CFRelease(store);
+}
+
 @implementation JSONStoreQueue
 
 +(instancetype) sharedManager
@@ -54,7 +79,7 @@ static JSONStoreQueue* _jsqSingleton = nil;
 {
     __block int rc = 0;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
         
         rc = [self.store remove:query
                    inCollection:collection
@@ -66,11 +91,86 @@ static JSONStoreQueue* _jsqSingleton = nil;
     return rc;
 }
 
+-(void) performOperation:(dispatch_block_t) block
+{
+    jsonStoreQueueSync(self.operationQueue, block);
+}
+
+-(void) performOperation:(dispatch_block_t) block
+           forCollection:(NSString*) collection
+{
+    jsonStoreQueueSync([self _queueForCollection:collection], block);
+}
+
+-(void) performOperationAsync:(dispatch_block_t) block
+                forCollection:(NSString*) collection
+{
+    dispatch_async([self _queueForCollection:collection], block);
+}
+
+-(void) setWriterLane:(BOOL) writerLane
+        forCollection:(NSString*) collection
+{
+    if (writerLane) {
+        
+        @synchronized (self.writerLanes) {
+            [self.writerLaneCollections addObject:collection];
+        }
+        
+    } else {
+        
+        @synchronized (self.writerLanes) {
+            [self.writerLaneCollections removeObject:collection];
+        }
+        
+        [self _closeWriterLaneForCollection:collection];
+    }
+}
+
+-(void) suspendWriterLanes
+{
+    NSDictionary* lanes = nil;
+    
+    @synchronized (self.writerLanes) {
+        [self.suspendedWriterLanes addObject:[NSNull null]];
+        lanes = [self.writerLanes copy];
+        [self.writerLanes removeAllObjects];
+    }
+    
+    [lanes enumerateKeysAndObjectsUsingBlock:^(NSString* collection, NSDictionary* lane, BOOL *stop) {
+        [self _closeWriterLane:lane forCollection:collection];
+    }];
+}
+
+-(void) resumeWriterLanes
+{
+    @synchronized (self.writerLanes) {
+        [self.suspendedWriterLanes removeObject:[NSNull null]];
+    }
+}
+
+-(JSONStoreIndexer*) indexer
+{
+    //The indexer keeps the indexes of the document it walks, so lanes that run at the same time do not share it
+    if (dispatch_get_specific(JSONStoreWriterLaneKey) != NULL) {
+        return [[JSONStoreIndexer alloc] init];
+    }
+    
+    return _indexer;
+}
+
+-(JSONStoreSQLLite*) store
+{
+    void* laneStore = dispatch_get_specific(JSONStoreWriterLaneKey);
+    
+    return laneStore != NULL ? (__bridge JSONStoreSQLLite*) laneStore : _store;
+}
+
 -(BOOL) isOpen
 {
     __block BOOL setKeyWorked = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync(self.operationQueue, ^{
         setKeyWorked = [self.store isOpen];
     });
     
@@ -81,24 +181,45 @@ static JSONStoreQueue* _jsqSingleton = nil;
 {
     __block BOOL setKeyWorked = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync(self.operationQueue, ^{
         
         //Need to derive the key from clear text
         JSONStoreSecurityManager *jsonsecmanager = [[JSONStoreSecurityManager alloc]
                                                     initWithUsername:self.username];
         
-        NSString* key = [jsonsecmanager getDPK:password];
+        //A cached key skips the password key derivation
+        JSONStoreKeyCache* keyCache = [JSONStoreKeyCache sharedInstance];
+        NSMutableData* key = [keyCache keyForUsername:self.username withPassword:password];
+        BOOL cached = key != nil;
+        
+        if (! cached) {
+            
+            //Only the bytes are passed on, the store and the cache keep their own copies
+            NSString* dpk = [jsonsecmanager getDPK:password];
+            
+            if ([dpk length] > 0) {
+                key = [NSMutableData dataWithLength:[dpk lengthOfBytesUsingEncoding:NSUTF8StringEncoding]];
+                [dpk getBytes:[key mutableBytes] maxLength:[key length] usedLength:NULL encoding:NSUTF8StringEncoding
+                      options:0 range:NSMakeRange(0, [dpk length]) remainingRange:NULL];
+            }
+        }
         
         if (key != nil && [key length] > 0) {
             
             setKeyWorked = [self.store setDatabaseKey:key];
             
+            if (setKeyWorked && ! cached) {
+                [keyCache setKey:key forUsername:self.username withPassword:password];
+            }
+            
         } else {
             
             NSLog(@"Invalid password, pwd length: %d, security manager username: %@, username: %@", [password length], jsonsecmanager != nil ? jsonsecmanager.username : @"nil", self.username);
             
             setKeyWorked = NO;
         }
+        
+        [key resetBytesInRange:NSMakeRange(0, [key length])];
     });
     
     return setKeyWorked;
@@ -111,17 +232,20 @@ static JSONStoreQueue* _jsqSingleton = nil;
 {
     __block int rc = 0;
     
-    dispatch_sync(self.operationQueue, ^{
+    [self _performWithWriterLaneSuspended:collectionName block:^{
         
         JSONStoreSchema* jsch = [[JSONStoreSchema alloc] initWithSearchFields:schema
                                                        additionalSearchFields:addFields];
         
-        [self.jsonSchemas setValue:jsch
-                            forKey:collectionName];
+        //Writer lanes read the schemas while this runs, so the dictionary is replaced instead of changed
+        NSMutableDictionary* schemas = [self.jsonSchemas mutableCopy];
+        [schemas setValue:jsch
+                   forKey:collectionName];
+        self.jsonSchemas = schemas;
         
         rc = [self.store provision:jsch
                         inDatabase:collectionName];
-    });
+    }];
     
     return rc;
 }
@@ -132,7 +256,7 @@ static JSONStoreQueue* _jsqSingleton = nil;
 {
     __block NSArray* results = nil;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
         results = [self.store findWithQueryParts:queryParts
                                     inCollection:collection
                                      withOptions:options];
@@ -141,71 +265,111 @@ static JSONStoreQueue* _jsqSingleton = nil;
     return results;
 }
 
+-(NSArray*) aggregateCollection: (NSString*) collection
+                 withQueryParts: (NSArray*) queryParts
+            andAggregateOptions: (JSONStoreAggregateOptions*) options
+{
+    __block NSArray* results = nil;
+    
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
+        results = [self.store aggregateWithQueryParts:queryParts
+                                         inCollection:collection
+                                          withOptions:options];
+    });
+    
+    return results;
+}
+
 -(int) replaceDocument:(NSArray*) documents
           inCollection:(NSString*) collection
               failures:(NSMutableArray*) failures
              markDirty:(BOOL) markDirty
 {
     __block int rc = 0;
+    __block NSArray* lastFailures = nil;
     
-    dispatch_sync(self.operationQueue, ^{
+    //A grouped write runs again on its own when another write in its group fails, so failures are collected per run
+    int (^write)(void) = ^int {
+        
+        NSMutableArray* runFailures = [[NSMutableArray alloc] init];
+        int replaced = [self _replaceDocuments:documents inCollection:collection failures:runFailures markDirty:markDirty];
+        
+        lastFailures = runFailures;
         
-        if (! [[JSONStore sharedInstance] _isTransactionInProgress]) {
+        return replaced;
+    };
+    
+    int grouped = 0;
+    
+    if ([self _shouldGroupCommit] && [self _groupCommitWrite:write inCollection:collection result:&grouped]) {
+        
+        rc = grouped;
+        
+    } else {
+        
+        jsonStoreQueueSync([self _queueForCollection:collection], ^{
+            rc = [self _runWriteInTransaction:write];
+        });
+    }
+    
+    if (failures != nil && lastFailures != nil) {
+        [failures addObjectsFromArray:lastFailures];
+    }
+    
+    return rc;
+}
+
+-(int) patchDocumentsWithIds:(NSArray*) ids
+                inCollection:(NSString*) collection
+                  mergePatch:(NSDictionary*) mergePatch
+                   setValues:(NSDictionary*) values
+                   markDirty:(BOOL) markDirty
+{
+    __block int rc = 0;
+    
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
+        
+        //Read once, a transaction can be marked in progress while this runs
+        BOOL inTransaction = [self _isTransactionInProgress];
+        
+        if (! inTransaction) {
             [self.store startTransaction];
         }
         
+        JSONStoreSchema* jsonSchema = [self.jsonSchemas objectForKey:collection];
         
-        for (NSDictionary* doc in documents) {
-            
-            JSONStoreSchema* jsonSchema = [self.jsonSchemas objectForKey:collection];
+        if ([self.store isPatchAvailableForCollection:collection]) {
             
-            id jsonObj = [doc objectForKey:JSON_STORE_FIELD_JSON];
+            NSMutableArray* paths = [NSMutableArray arrayWithArray:[values allKeys]];
+            [self _addKeyPathsOfMergePatch:mergePatch withPrefix:nil toArray:paths];
             
-            NSError* error;
-            NSDictionary* indexesAndValues = [self.indexer findIndexesFromSchema:jsonSchema
-                                                                   forJsonObject:jsonObj
-                                                                           error:&error];
-            if (error) {
-                rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
-                break;
-            }
+            rc = [self.store patchDocumentsWithIds:ids
+                                      inCollection:collection
+                                        mergePatch:mergePatch
+                                         setValues:values
+                                      searchFields:[self _searchFieldsInSchema:jsonSchema touchedByPaths:paths]
+                                         markDirty:markDirty];
+        } else {
             
-            BOOL worked = [self.store replace:doc
+            rc = [self _patchDocumentsWithIds:ids
                                  inCollection:collection
-                                 usingIndexes:indexesAndValues
+                                   withSchema:jsonSchema
+                                   mergePatch:mergePatch
+                                    setValues:values
                                     markDirty:markDirty];
-            
-            
-            if (worked) {
-                
-                //It worked, increment the number of docs replaced
-                rc++;
-                
-            } else {
-                
-                //If we can't store all the data, we rollback and go
-                //to the error callback
-                rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
-                
-                //Pass back the object that we failed on
-                if (failures != nil) {
-                    
-                    [failures addObject:doc];
-                }
-                
-                break;
-            }
         }
         
-        //if any of the updates failed, we need to rollback the transaction, otherwise commit it
-        if (rc == JSON_STORE_PERSISTENT_STORE_FAILURE) {
+        if (rc < 0) {
+            
+            rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
             
-            if (! [[JSONStore sharedInstance] _isTransactionInProgress]) {
+            if (! inTransaction) {
                 [self.store rollbackTransaction];
             }
+            
         } else {
             
-            if (! [[JSONStore sharedInstance] _isTransactionInProgress]) {
+            if (! inTransaction) {
                 [self.store commitTransaction];
             }
         }
@@ -219,7 +383,7 @@ static JSONStoreQueue* _jsqSingleton = nil;
 {
     __block BOOL isDirty = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
         isDirty = [self.store isDirty:docId
                          inCollection:collection];
     });
@@ -235,7 +399,7 @@ static JSONStoreQueue* _jsqSingleton = nil;
     
     __block BOOL worked = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
         worked =  [self.store markClean:docId
                            inCollection:collection
                            forOperation:operation];
@@ -252,63 +416,31 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block int numWorked = 0;
     
-    dispatch_sync(self.operationQueue, ^{
+    int (^write)(void) = ^int {
+        return [self _storeObjects:jsonArr
+                      inCollection:collectionName
+                             isAdd:isAdd
+                 additionalIndexes:additionalIndexes];
+    };
+    
+    int grouped = 0;
+    
+    if ([self _shouldGroupCommit] && [self _groupCommitWrite:write inCollection:collectionName result:&grouped]) {
         
-        if (! [[JSONStore sharedInstance] _isTransactionInProgress]) {
-            [self.store startTransaction];
-        }
+        numWorked = grouped;
         
-        for (NSDictionary* dict in jsonArr) {
-            
-            BOOL worked =  [self _storeObject: dict
-                                 inCollection: collectionName
-                                        isAdd: isAdd
-                            additionalIndexes: additionalIndexes];
-            
-            if (worked) {
-                
-                numWorked++;
-                
-            } else {
-                
-                NSLog(@"Error: JSON_STORE_PERSISTENT_STORE_FAILURE, code: %d, collection name: %@, accessor username: %@, numWorked: %d, markDirty: %@, additionalSearchFields: %@, using transaction API: %@",
-                                     JSON_STORE_PERSISTENT_STORE_FAILURE,
-                                     collectionName,
-                                     self.username,
-                                     numWorked,
-                                     isAdd ? @"YES" : @"NO",
-                                     additionalIndexes,
-                                     [[JSONStore sharedInstance] _isTransactionInProgress] ? @"YES" : @"NO");
-                NSLog(@"Error: JSON_STORE_PERSISTENT_STORE_FAILURE, object to store: %@", dict);
-                
-                if (error != nil) {
-                    *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
-                                                 code:JSON_STORE_PERSISTENT_STORE_FAILURE
-                                             userInfo:nil];
-                }
-                
-                //If we can't store all the data, we rollback and go
-                //to the error callback
-                numWorked = -1;
-                
-                break;
-            }
-        }
+    } else {
         
-        //if any of the inserts failed, we need to rollback the transaction, otherwise commit it
-        if (numWorked == JSON_STORE_PERSISTENT_STORE_FAILURE) {
-            
-            if (! [[JSONStore sharedInstance] _isTransactionInProgress]) {
-                [self.store rollbackTransaction];
-            }
-            
-        } else {
-            
-            if (! [[JSONStore sharedInstance] _isTransactionInProgress]) {
-                [self.store commitTransaction];
-            }
-        }
-    });
+        jsonStoreQueueSync([self _queueForCollection:collectionName], ^{
+            numWorked = [self _runWriteInTransaction:write];
+        });
+    }
+    
+    if (numWorked == JSON_STORE_PERSISTENT_STORE_FAILURE && error != nil) {
+        *error = [NSError errorWithDomain:JSON_STORE_EXCEPTION
+                                     code:JSON_STORE_PERSISTENT_STORE_FAILURE
+                                 userInfo:nil];
+    }
     
     return numWorked;
 }
@@ -320,11 +452,15 @@ additionalIndexes:(NSDictionary*) additionalIndexes
     
     __block BOOL result = NO;
     
-    dispatch_sync(self.operationQueue, ^{
-        result =  [[[JSONStoreSecurityManager alloc] initWithUsername:username]
-                   changeOldPassword:oldPwClear
-                   toNewPassword:newPwClear];
-    });
+    [self _performWithWriterLaneSuspended:nil block:^{
+        JSONStoreSecurityManager* secMgr = [[JSONStoreSecurityManager alloc] initWithUsername:username];
+        secMgr.keyDerivationFunction = self.keyDerivationFunction;
+        secMgr.keyDerivationIterations = self.keyDerivationIterations;
+        secMgr.keyDerivationTargetTime = self.keyDerivationTargetTime;
+        
+        result = [secMgr changeOldPassword:oldPwClear
+                             toNewPassword:newPwClear];
+    }];
     
     return result;
 }
@@ -333,7 +469,9 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block BOOL result = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    [self setWriterLane:NO forCollection:collection];
+    
+    jsonStoreQueueSync(self.operationQueue, ^{
         result =  [self.store dropTable:collection];
     });
     
@@ -345,19 +483,141 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block BOOL result = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    [self _performWithWriterLaneSuspended:collection block:^{
         result =  [self.store clearTable:collection];
+    }];
+    
+    return result;
+    
+}
+
+-(int) storageFlagsForCollection:(NSString*) collection
+{
+    __block int result = 0;
+    
+    jsonStoreQueueSync(self.operationQueue, ^{
+        result = [self.store storageFlagsForCollection:collection];
+    });
+    
+    return result;
+}
+
+-(BOOL) setStorageFlags:(int) flags
+             dictionary:(NSData*) dictionary
+          forCollection:(NSString*) collection
+{
+    __block BOOL result = NO;
+    
+    [self _performWithWriterLaneSuspended:collection block:^{
+        result = [self.store setStorageFlags:flags dictionary:dictionary forCollection:collection];
+    }];
+    
+    return result;
+}
+
+-(void) setExternalStorageThreshold:(NSNumber*) threshold
+                      forCollection:(NSString*) collection
+{
+    [self _performWithWriterLaneSuspended:collection block:^{
+        [self.store setExternalStorageThreshold:threshold forCollection:collection];
+    }];
+}
+
+-(int) attachFileForCollection:(NSString*) collection
+                     encrypted:(BOOL) encrypted
+{
+    __block int result = JSON_STORE_PROVISION_TABLE_FAILURE;
+    
+    [self _performWithWriterLaneSuspended:collection block:^{
+        result = [self.store attachFileForCollection:collection encrypted:encrypted];
+    }];
+    
+    return result;
+}
+
+-(BOOL) createPageIndexForSort:(NSArray*) sort
+                  inCollection:(NSString*) collection
+{
+    __block BOOL result = NO;
+    
+    [self _performWithWriterLaneSuspended:collection block:^{
+        result = [self.store createPageIndexForSort:sort inCollection:collection];
+    }];
+    
+    return result;
+}
+
+-(BOOL) setPageSize:(NSNumber*) pageSize
+           mmapSize:(NSNumber*) mmapSize
+          cacheSize:(NSNumber*) cacheSize
+{
+    __block BOOL result = NO;
+    
+    jsonStoreQueueSync(self.operationQueue, ^{
+        result = [self.store setPageSize:pageSize mmapSize:mmapSize cacheSize:cacheSize];
     });
     
     return result;
+}
+
+-(NSArray*) warmUpStatementsForCollection:(NSString*) collection
+{
+    __block NSArray* result = @[];
     
+    jsonStoreQueueSync(self.operationQueue, ^{
+        
+        JSONStoreSchema* schema = [self.jsonSchemas objectForKey:collection];
+        
+        if (schema != nil) {
+            result = [self.store warmUpStatementsForCollection:collection
+                                                  searchFields:[[schema getCombinedDictionary] allKeys]];
+        }
+    });
+    
+    return result;
+}
+
+-(BOOL) readIntoCache:(NSString*) sql
+         memoryBudget:(NSUInteger) budget
+           shouldStop:(BOOL (^)(void)) shouldStop
+{
+    __block long long lastId = LLONG_MAX;
+    __block int rows = 0;
+    
+    //One chunk per turn on the queue, so other operations can run between chunks
+    do {
+        
+        if (shouldStop && shouldStop()) {
+            return YES;
+        }
+        
+        jsonStoreQueueSync(self.operationQueue, ^{
+            rows = self.store != nil ? [self.store readIntoCache:sql belowId:&lastId memoryBudget:budget shouldStop:shouldStop] : -1;
+        });
+        
+    } while (rows > 0);
+    
+    return rows == 0;
+}
+
+-(NSDictionary*) cacheStatus
+{
+    __block NSDictionary* result = nil;
+    
+    jsonStoreQueueSync(self.operationQueue, ^{
+        if ([self.store isOpen]) {
+            result = [self.store cacheStatus];
+        }
+    });
+    
+    return result;
 }
 
 -(int) dirtyCount: (NSString*) document
 {
     __block int result = 0;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync([self _queueForCollection:document], ^{
         result = [self.store dirtyCount:document];
     });
     
@@ -368,7 +628,7 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block int result = 0;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync([self _queueForCollection:document], ^{
         result = [self.store count:document];
     });
     
@@ -379,7 +639,7 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block NSArray* retArr = nil;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
         retArr = [self.store allDirtyInCollection:collection];
     });
     
@@ -390,7 +650,7 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block int result = 0;
     
-    dispatch_sync(self.operationQueue, ^{
+    [self _performWithWriterLaneSuspended:nil block:^{
         
      //   clearKeychainWorked = [[JSONStoreSecurityManager new] clearKeyChain];
     
@@ -401,7 +661,7 @@ additionalIndexes:(NSDictionary*) additionalIndexes
                 result = JSON_STORE_DESTROY_REMOVE_FILE_FAILED;
             }
         
-    });
+    }];
     
     return result;
 }
@@ -410,14 +670,14 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block BOOL connectionClosed = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    [self _performWithWriterLaneSuspended:nil block:^{
         connectionClosed = [self.store close];
         self.username = nil;
         self.store = nil;
         self.indexer = nil;
         self.jsonSchemas = nil;
         _jsqSingleton = nil;
-    });
+    }];
     
     return connectionClosed;
 }
@@ -426,7 +686,7 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 {
     __block BOOL isEnc = NO;
     
-    dispatch_sync(self.operationQueue, ^{
+    jsonStoreQueueSync(self.operationQueue, ^{
         isEnc = [self.store isStoreEncrypted];
     });
     
@@ -435,6 +695,467 @@ additionalIndexes:(NSDictionary*) additionalIndexes
 
 #pragma mark Helpers
 
+-(BOOL) _isTransactionInProgress
+{
+    //Writer lanes never join the transaction, it runs on the connection of the operation queue
+    if (dispatch_get_specific(JSONStoreWriterLaneKey) != NULL) {
+        return NO;
+    }
+    
+    return [[JSONStore sharedInstance] _isTransactionInProgress];
+}
+
+-(dispatch_queue_t) _queueForCollection:(NSString*) collection
+{
+    NSDictionary* lane = nil;
+    BOOL hasWriterLane = NO;
+    
+    //Transactions span collections, so their operations stay on the operation queue
+    if (collection == nil || [[JSONStore sharedInstance] _isTransactionInProgress]) {
+        return self.operationQueue;
+    }
+    
+    @synchronized (self.writerLanes) {
+        lane = self.writerLanes[collection];
+        hasWriterLane = [self.writerLaneCollections containsObject:collection] && ! [self _isWriterLaneSuspended:collection];
+    }
+    
+    if (lane != nil) {
+        return lane[@"queue"];
+    }
+    
+    if (! hasWriterLane) {
+        return self.operationQueue;
+    }
+    
+    __block JSONStoreSQLLite* laneStore = nil;
+    
+    jsonStoreQueueSync(self.operationQueue, ^{
+        laneStore = [self.store storeForWriterLane:collection];
+    });
+    
+    if (laneStore == nil) {
+        
+        @synchronized (self.writerLanes) {
+            [self.writerLaneCollections removeObject:collection];
+        }
+        
+        return self.operationQueue;
+    }
+    
+    @synchronized (self.writerLanes) {
+        
+        lane = self.writerLanes[collection];
+        
+        //Checked again under the lock, a suspension or a transaction may have started since
+        if (lane == nil && [self.writerLaneCollections containsObject:collection] &&
+            ! [self _isWriterLaneSuspended:collection] && ! [[JSONStore sharedInstance] _isTransactionInProgress]) {
+            
+            NSString* label = [@"com.jsonstore.lane." stringByAppendingString:collection];
+            dispatch_queue_t queue = dispatch_queue_create([label UTF8String], DISPATCH_QUEUE_SERIAL);
+            
+            dispatch_queue_set_specific(queue, JSONStoreOperationQueueKey, (__bridge void*) queue, NULL);
+            dispatch_queue_set_specific(queue, JSONStoreWriterLaneKey, (__bridge_retained void*) laneStore, jsonStoreReleaseWriterLaneStore);
+            
+            lane = @{@"queue" : queue, @"store" : laneStore};
+            self.writerLanes[collection] = lane;
+            laneStore = nil;
+        }
+    }
+    
+    //Another thread opened the lane first, or it was closed meanwhile
+    [laneStore closeWriterLane];
+    
+    return lane != nil ? lane[@"queue"] : self.operationQueue;
+}
+
+-(BOOL) _isWriterLaneSuspended:(NSString*) collection
+{
+    //Called with the writerLanes lock held
+    return [self.suspendedWriterLanes countForObject:collection] > 0 || [self.suspendedWriterLanes countForObject:[NSNull null]] > 0;
+}
+
+-(void) _performWithWriterLaneSuspended:(NSString*) collection
+                                  block:(dispatch_block_t) block
+{
+    //Suspended before the lane closes, so no operation opens it again until the block ran on the operation queue
+    if (collection == nil) {
+        
+        [self suspendWriterLanes];
+        
+    } else {
+        
+        @synchronized (self.writerLanes) {
+            [self.suspendedWriterLanes addObject:collection];
+        }
+        
+        [self _closeWriterLaneForCollection:collection];
+    }
+    
+    jsonStoreQueueSync(self.operationQueue, block);
+    
+    @synchronized (self.writerLanes) {
+        [self.suspendedWriterLanes removeObject:collection ?: [NSNull null]];
+    }
+}
+
+-(void) _closeWriterLaneForCollection:(NSString*) collection
+{
+    NSDictionary* lane = nil;
+    
+    @synchronized (self.writerLanes) {
+        lane = self.writerLanes[collection];
+        [self.writerLanes removeObjectForKey:collection];
+    }
+    
+    [self _closeWriterLane:lane forCollection:collection];
+}
+
+-(void) _closeWriterLane:(NSDictionary*) lane
+           forCollection:(NSString*) collection
+{
+    if (lane == nil) {
+        return;
+    }
+    
+    JSONStoreSQLLite* laneStore = lane[@"store"];
+    
+    //Waits for the operations already on the lane
+    jsonStoreQueueSync(lane[@"queue"], ^{
+        [laneStore closeWriterLane];
+    });
+    
+    //Results cached by the main connection may predate writes made on the lane
+    [_store.queryCache invalidateCollection:collection];
+}
+
+-(BOOL) _shouldGroupCommit
+{
+    //Writes from a store queue would wait for a commit that runs after them on the same queue.
+    //The executor runs the writes of a collection one at a time, so they would only wait for the window.
+    return [self.groupCommitWindow doubleValue] > 0 &&
+           dispatch_get_specific(JSONStoreOperationQueueKey) == NULL &&
+           ! [JSONStoreExecutor isExecutorQueue] &&
+           ! [[JSONStore sharedInstance] _isTransactionInProgress];
+}
+
+-(int) _runWriteInTransaction:(int (^)(void)) write
+{
+    //Read once, a transaction can be marked in progress while the write runs
+    BOOL inTransaction = [self _isTransactionInProgress];
+    
+    if (! inTransaction) {
+        [self.store startTransaction];
+    }
+    
+    int rc = write();
+    
+    //if any of the writes failed, we need to rollback the transaction, otherwise commit it
+    if (! inTransaction) {
+        
+        if (rc < 0) {
+            [self.store rollbackTransaction];
+        } else {
+            [self.store commitTransaction];
+        }
+    }
+    
+    return rc;
+}
+
+-(BOOL) _groupCommitWrite:(int (^)(void)) write
+             inCollection:(NSString*) collection
+                   result:(int*) result
+{
+    __block int rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
+    dispatch_semaphore_t committed = dispatch_semaphore_create(0);
+    
+    void (^done)(int) = ^(int writeRc) {
+        rc = writeRc;
+        dispatch_semaphore_signal(committed);
+    };
+    
+    NSDictionary* request = @{@"write" : [write copy], @"done" : [done copy]};
+    NSUInteger batchSize = [self.groupCommitBatchSize unsignedIntegerValue];
+    NSMutableArray* pending = nil;
+    NSArray* ready = nil;
+    BOOL first = NO;
+    
+    if (batchSize == 0) {
+        batchSize = JSON_STORE_DEFAULT_GROUP_COMMIT_BATCH_SIZE;
+    }
+    
+    @synchronized (self.pendingGroupCommits) {
+        
+        //Checked again under the lock, flushGroupCommits sets the transaction before it takes the lock
+        if ([[JSONStore sharedInstance] _isTransactionInProgress]) {
+            return NO;
+        }
+        
+        if ([self.activeGroupCommits countForObject:collection] == 0) {
+            
+            //Nothing is being committed, so there is nothing to wait for
+            ready = @[request];
+            
+        } else {
+            
+            //Waits for the commit in progress, the writes that arrive meanwhile are committed after it
+            pending = self.pendingGroupCommits[collection];
+            
+            if (pending == nil) {
+                pending = [[NSMutableArray alloc] init];
+                self.pendingGroupCommits[collection] = pending;
+                first = YES;
+            }
+            
+            [pending addObject:request];
+            
+            if ([pending count] >= batchSize) {
+                [self.pendingGroupCommits removeObjectForKey:collection];
+                ready = pending;
+            }
+        }
+        
+        if (ready != nil) {
+            [self _beginGroupCommitInCollection:collection];
+        }
+    }
+    
+    if (ready != nil) {
+        
+        [self _runGroupCommit:ready inCollection:collection];
+        
+    } else if (first) {
+        
+        dispatch_time_t deadline = dispatch_time(DISPATCH_TIME_NOW, (int64_t) ([self.groupCommitWindow doubleValue] * NSEC_PER_SEC));
+        
+        dispatch_after(deadline, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            
+            NSArray* expired = nil;
+            
+            //The group may have been committed already because it filled up or the commit before it ended
+            @synchronized (self.pendingGroupCommits) {
+                if (self.pendingGroupCommits[collection] == pending) {
+                    [self.pendingGroupCommits removeObjectForKey:collection];
+                    [self _beginGroupCommitInCollection:collection];
+                    expired = pending;
+                }
+            }
+            
+            if (expired != nil) {
+                [self _runGroupCommit:expired inCollection:collection];
+            }
+        });
+    }
+    
+    dispatch_semaphore_wait(committed, DISPATCH_TIME_FOREVER);
+    
+    *result = rc;
+    
+    return YES;
+}
+
+-(void) flushGroupCommits
+{
+    NSDictionary* groups = nil;
+    
+    @synchronized (self.pendingGroupCommits) {
+        
+        groups = [self.pendingGroupCommits copy];
+        [self.pendingGroupCommits removeAllObjects];
+        
+        for (NSString* collection in groups) {
+            [self _beginGroupCommitInCollection:collection];
+        }
+    }
+    
+    [groups enumerateKeysAndObjectsUsingBlock:^(NSString* collection, NSArray* group, BOOL *stop) {
+        [self _runGroupCommit:group inCollection:collection];
+    }];
+    
+    dispatch_group_wait(self.groupCommitsInFlight, DISPATCH_TIME_FOREVER);
+}
+
+-(void) _beginGroupCommitInCollection:(NSString*) collection
+{
+    //Called with the pendingGroupCommits lock held
+    [self.activeGroupCommits addObject:collection];
+    dispatch_group_enter(self.groupCommitsInFlight);
+}
+
+-(void) _runGroupCommit:(NSArray*) group
+           inCollection:(NSString*) collection
+{
+    while (group != nil) {
+        
+        [self _commitGroup:group inCollection:collection];
+        
+        @synchronized (self.pendingGroupCommits) {
+            
+            //The writes that arrived during the commit go next, unless another commit still runs for them to wait on
+            group = nil;
+            
+            if ([self.activeGroupCommits countForObject:collection] == 1) {
+                group = self.pendingGroupCommits[collection];
+                [self.pendingGroupCommits removeObjectForKey:collection];
+            }
+            
+            if (group == nil) {
+                [self.activeGroupCommits removeObject:collection];
+                dispatch_group_leave(self.groupCommitsInFlight);
+            }
+        }
+    }
+}
+
+-(void) _commitGroup:(NSArray*) group
+        inCollection:(NSString*) collection
+{
+    if ([group count] == 0) {
+        return;
+    }
+    
+    //A transaction that starts meanwhile waits for the group in flushGroupCommits, so the group keeps its own transaction
+    jsonStoreQueueSync([self _queueForCollection:collection], ^{
+        
+        NSMutableArray* results = [[NSMutableArray alloc] init];
+        BOOL worked = [self.store startTransaction];
+        
+        for (NSDictionary* request in group) {
+            
+            if (! worked) {
+                break;
+            }
+            
+            int (^write)(void) = request[@"write"];
+            int rc = write();
+            
+            worked = rc >= 0;
+            [results addObject:@(rc)];
+        }
+        
+        if (worked && [self.store commitTransaction]) {
+            
+            [group enumerateObjectsUsingBlock:^(NSDictionary* request, NSUInteger index, BOOL *stop) {
+                void (^done)(int) = request[@"done"];
+                done([results[index] intValue]);
+            }];
+            
+            return;
+        }
+        
+        if (self.store.transactionInProgress) {
+            [self.store rollbackTransaction];
+        }
+        
+        //Each write runs again in its own transaction, so only the ones that fail get an error
+        for (NSDictionary* request in group) {
+            
+            int (^write)(void) = request[@"write"];
+            void (^done)(int) = request[@"done"];
+            int rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
+            
+            //Same as _runWriteInTransaction:, the caller gets the error of its own write
+            if ([self.store startTransaction]) {
+                
+                rc = write();
+                
+                if (rc < 0) {
+                    
+                    [self.store rollbackTransaction];
+                    
+                } else if (! [self.store commitTransaction]) {
+                    
+                    rc = JSON_STORE_PERSISTENT_STORE_FAILURE;
+                    [self.store rollbackTransaction];
+                }
+            }
+            
+            done(rc);
+        }
+    });
+}
+
+-(int) _storeObjects:(NSArray*) jsonArr
+        inCollection:(NSString*) collectionName
+               isAdd:(BOOL) isAdd
+   additionalIndexes:(NSDictionary*) additionalIndexes
+{
+    int numWorked = 0;
+    
+    for (NSDictionary* dict in jsonArr) {
+        
+        BOOL worked =  [self _storeObject: dict
+                             inCollection: collectionName
+                                    isAdd: isAdd
+                        additionalIndexes: additionalIndexes];
+        
+        if (worked) {
+            
+            numWorked++;
+            
+        } else {
+            
+            NSLog(@"Error: JSON_STORE_PERSISTENT_STORE_FAILURE, code: %d, collection name: %@, accessor username: %@, numWorked: %d, markDirty: %@, additionalSearchFields: %@, using transaction API: %@",
+                                 JSON_STORE_PERSISTENT_STORE_FAILURE,
+                                 collectionName,
+                                 self.username,
+                                 numWorked,
+                                 isAdd ? @"YES" : @"NO",
+                                 additionalIndexes,
+                                 [self _isTransactionInProgress] ? @"YES" : @"NO");
+            NSLog(@"Error: JSON_STORE_PERSISTENT_STORE_FAILURE, object to store: %@", dict);
+            
+            //If we can't store all the data, we rollback and go
+            //to the error callback
+            return JSON_STORE_PERSISTENT_STORE_FAILURE;
+        }
+    }
+    
+    return numWorked;
+}
+
+-(int) _replaceDocuments:(NSArray*) documents
+            inCollection:(NSString*) collection
+                failures:(NSMutableArray*) failures
+               markDirty:(BOOL) markDirty
+{
+    int rc = 0;
+    
+    for (NSDictionary* doc in documents) {
+        
+        JSONStoreSchema* jsonSchema = [self.jsonSchemas objectForKey:collection];
+        
+        id jsonObj = [doc objectForKey:JSON_STORE_FIELD_JSON];
+        
+        NSError* error;
+        NSDictionary* indexesAndValues = [self.indexer findIndexesFromSchema:jsonSchema
+                                                               forJsonObject:jsonObj
+                                                                       error:&error];
+        if (error) {
+            return JSON_STORE_PERSISTENT_STORE_FAILURE;
+        }
+        
+        BOOL worked = [self.store replace:doc
+                             inCollection:collection
+                             usingIndexes:indexesAndValues
+                                markDirty:markDirty];
+        
+        if (! worked) {
+            
+            //Pass back the object that we failed on
+            [failures addObject:doc];
+            
+            return JSON_STORE_PERSISTENT_STORE_FAILURE;
+        }
+        
+        //It worked, increment the number of docs replaced
+        rc++;
+    }
+    
+    return rc;
+}
+
 -(BOOL) _storeObject:(id)jsonObj
         inCollection:(NSString*) collectionName
                isAdd:(BOOL) isAdd
@@ -484,6 +1205,108 @@ additionalIndexes:(NSDictionary*) additionalIndexes
     return worked;
 }
 
+-(int) _patchDocumentsWithIds:(NSArray*) ids
+                 inCollection:(NSString*) collection
+                   withSchema:(JSONStoreSchema*) jsonSchema
+                   mergePatch:(NSDictionary*) mergePatch
+                    setValues:(NSDictionary*) values
+                    markDirty:(BOOL) markDirty
+{
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    queryPart._ids = [ids mutableCopy];
+    
+    NSArray* rows = [self.store findWithQueryParts:@[queryPart] inCollection:collection withOptions:nil];
+    
+    if (rows == nil) {
+        return -1;
+    }
+    
+    int patched = 0;
+    
+    for (NSDictionary* row in rows) {
+        
+        id jsonObj = [JSONStoreDocumentCodec objectWithData:[row objectForKey:JSON_STORE_FIELD_JSON]];
+        
+        if (mergePatch != nil) {
+            jsonObj = [JSONStoreSQLLite documentByApplyingMergePatch:mergePatch toDocument:jsonObj];
+        }
+        
+        jsonObj = [JSONStoreSQLLite documentBySettingValues:values inDocument:jsonObj];
+        
+        NSError* error = nil;
+        NSDictionary* indexesAndValues = [self.indexer findIndexesFromSchema:jsonSchema
+                                                               forJsonObject:jsonObj
+                                                                       error:&error];
+        
+        if (error || ! [self.store replace:@{JSON_STORE_FIELD_ID : [row objectForKey:JSON_STORE_FIELD_ID], JSON_STORE_FIELD_JSON : jsonObj}
+                               inCollection:collection
+                               usingIndexes:indexesAndValues
+                                  markDirty:markDirty]) {
+            return -1;
+        }
+        
+        patched++;
+    }
+    
+    return patched;
+}
+
+-(void) _addKeyPathsOfMergePatch:(id) mergePatch
+                      withPrefix:(NSString*) prefix
+                         toArray:(NSMutableArray*) paths
+{
+    if (! [mergePatch isKindOfClass:[NSDictionary class]]) {
+        return;
+    }
+    
+    for (NSString* key in mergePatch) {
+        
+        NSString* path = prefix != nil ? [NSString stringWithFormat:@"%@.%@", prefix, key] : key;
+        
+        [paths addObject:path];
+        [self _addKeyPathsOfMergePatch:mergePatch[key] withPrefix:path toArray:paths];
+    }
+}
+
+-(NSArray*) _searchFieldsInSchema:(JSONStoreSchema*) jsonSchema
+                   touchedByPaths:(NSArray*) paths
+{
+    NSMutableArray* searchFields = [[NSMutableArray alloc] init];
+    NSCharacterSet* nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+    NSMutableArray* fieldPaths = [[NSMutableArray alloc] init];
+    
+    //Search fields skip array indexes, so phones.0.number feeds the phones.number search field
+    for (NSString* path in paths) {
+        
+        NSMutableArray* segments = [[NSMutableArray alloc] init];
+        
+        for (NSString* segment in [[path lowercaseString] componentsSeparatedByString:@"."]) {
+            if ([segment length] == 0 || [segment rangeOfCharacterFromSet:nonDigits].location != NSNotFound) {
+                [segments addObject:segment];
+            }
+        }
+        
+        [fieldPaths addObject:[segments componentsJoinedByString:@"."]];
+    }
+    
+    for (NSString* searchField in [jsonSchema getKeys]) {
+        
+        NSString* field = [searchField lowercaseString];
+        
+        for (NSString* path in fieldPaths) {
+            
+            //Changing a path changes the search fields below it, and a search field on an object that became a value
+            if ([field isEqualToString:path] || [field hasPrefix:[path stringByAppendingString:@"."]] ||
+                [path hasPrefix:[field stringByAppendingString:@"."]]) {
+                [searchFields addObject:searchField];
+                break;
+            }
+        }
+    }
+    
+    return searchFields;
+}
+
 -(instancetype) _initWithUsername:(NSString*) username
                    withEncryption:(BOOL) encrypt
 
@@ -493,9 +1316,16 @@ additionalIndexes:(NSDictionary*) additionalIndexes
         self.username = username;
         self.indexer = [[JSONStoreIndexer alloc] init];
         self.jsonSchemas = [[NSMutableDictionary alloc] init];
+        self.writerLaneCollections = [[NSMutableSet alloc] init];
+        self.writerLanes = [[NSMutableDictionary alloc] init];
+        self.suspendedWriterLanes = [[NSCountedSet alloc] init];
+        self.pendingGroupCommits = [[NSMutableDictionary alloc] init];
+        self.activeGroupCommits = [[NSCountedSet alloc] init];
+        self.groupCommitsInFlight = dispatch_group_create();
         self.store = [[JSONStoreSQLLite alloc] initWithUsername:username withEncryption:encrypt];
 
         self.operationQueue = dispatch_queue_create("com.jsonstore.operation", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(self.operationQueue, JSONStoreOperationQueueKey, (__bridge void*) self.operationQueue, NULL);
     }
     
     return self;
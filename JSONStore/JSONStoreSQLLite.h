@@ -14,6 +14,9 @@
 #import <Foundation/Foundation.h>
 #import "JSONStoreSchema.h"
 #import "JSONStoreQueryOptions.h"
+#import "JSONStoreAggregateOptions.h"
+#import "JSONStoreQueryCache.h"
+#import "JSONStoreBlobStore.h"
 
 /**
  Query builder that communicates with the Database Manager.
@@ -41,6 +44,68 @@ True when using encryption
 */
 @property (nonatomic) BOOL isEncrypt;
 
+/**
+ UTF-8 bytes of the key the database was opened with, used to attach the files of collections kept in their own file.
+ The only copy the store keeps, the blob store shares it and it is zeroed on close. Nil until the store is keyed.
+ */
+@property (nonatomic, strong) NSMutableData* databaseKeyData;
+
+/**
+ Cached result of the check for the SQLite JSON1 functions (json_extract, json_object), nil until checked.
+ */
+@property (nonatomic, strong) NSNumber* jsonFunctionsAvailable;
+
+/**
+ Number of queries on the same JSON path after which an index is created for it, nil to never create one.
+ */
+@property (nonatomic, strong) NSNumber* jsonPathIndexThreshold;
+
+/**
+ Number of queries per collection and JSON path, used with jsonPathIndexThreshold.
+ */
+@property (nonatomic, strong) NSMutableDictionary* jsonPathUses;
+
+/**
+ Cache for find, count and aggregate results, nil when results are not cached.
+ */
+@property (nonatomic, strong) JSONStoreQueryCache* queryCache;
+
+/**
+ Storage flags by collection name, loaded from the storage table on first use.
+ */
+@property (nonatomic, strong) NSMutableDictionary* storageFlags;
+
+/**
+ Preset compression dictionaries by collection name, loaded with the storage flags.
+ */
+@property (nonatomic, strong) NSMutableDictionary* compressionDictionaries;
+
+/**
+ Size in bytes from which documents are kept in files instead of the collection, by collection name.
+ */
+@property (nonatomic, strong) NSMutableDictionary* externalStorageThresholds;
+
+/**
+ Store for the files of documents kept outside their collection, created on first use.
+ */
+@property (nonatomic, strong) JSONStoreBlobStore* blobStore;
+
+/**
+ True between startTransaction and its commit or rollback.
+ */
+@property (nonatomic) BOOL transactionInProgress;
+
+/**
+ Path and encryption of the database files attached for collections kept in their own file, by collection name.
+ */
+@property (nonatomic, strong) NSMutableDictionary* attachedCollections;
+
+/**
+ Schema hashes by collection name, read from the catalog table once per open.
+ */
+@property (nonatomic, strong) NSMutableDictionary* catalog;
+
+
 /**
  Returns an instance of self that is initialized with a specific user name.
  @param username User name that is tied to the singleton
@@ -63,6 +128,17 @@ inCollection:(NSString*) collection
   withIdexes:(NSDictionary*) idx
        isAdd:(BOOL) isAdd;
 
+/**
+ Attaches the database file of a collection kept in its own file, creating it if needed. Must be called before the collection is provisioned.
+ A collection that already has a table in the main database file stays there.
+ @param collection Name of the collection
+ @param encrypted When true and the store is encrypted, the file is encrypted with the same key as the store
+ @return JSON_STORE_RC_OK, JSON_STORE_PROVISION_KEY_FAILURE when the file must be encrypted and the store has not been keyed,
+ or JSON_STORE_PROVISION_TABLE_FAILURE
+ */
+-(int) attachFileForCollection:(NSString*) collection
+                     encrypted:(BOOL) encrypted;
+
 /**
  Provisions a collection with a search fields (schema).
  @param collection Name of the collection
@@ -83,6 +159,17 @@ inCollection:(NSString*) collection
                   inCollection:(NSString*) collection
                    withOptions:(JSONStoreQueryOptions*) options;
 
+/**
+ Computes aggregates over the documents inside a collection that match the query parts.
+ @param queryParts Array of JSONStoreQuery objects
+ @param collection Name of the collection
+ @param options Aggregates and group by search fields
+ @return Array of summary rows as results
+ */
+-(NSArray*) aggregateWithQueryParts:(NSArray*) queryParts
+                       inCollection:(NSString*) collection
+                        withOptions:(JSONStoreAggregateOptions*) options;
+
 /**
  Replaces a document inside a collection.
  @param document Documents as a dictionary
@@ -96,6 +183,48 @@ inCollection:(NSString*) collection
    usingIndexes:(NSDictionary*) idx
       markDirty:(BOOL) markDirty;
 
+/**
+ Returns true when documents in a collection can be patched by patchDocumentsWithIds:inCollection:mergePatch:setValues:searchFields:markDirty:.
+ @param collection Name of the collection
+ @return Documents are JSON text and the database has the JSON1 and search field value functions
+ */
+-(BOOL) isPatchAvailableForCollection:(NSString*) collection;
+
+/**
+ Patches documents with a single update statement, without reading them.
+ @param ids Array of _id values
+ @param collection Name of the collection
+ @param mergePatch JSON merge patch applied with json_patch, can be nil
+ @param values Values by key path applied with json_set after the merge patch, can be nil
+ @param searchFields Search fields whose values may change, the other search field columns are left as they are
+ @param markDirty Determines if the documents that are patched are marked as dirty (true) or not (false)
+ @return Number of documents patched, -1 if there is a failure
+ */
+-(int) patchDocumentsWithIds:(NSArray*) ids
+                inCollection:(NSString*) collection
+                  mergePatch:(NSDictionary*) mergePatch
+                   setValues:(NSDictionary*) values
+                searchFields:(NSArray*) searchFields
+                   markDirty:(BOOL) markDirty;
+
+/**
+ Applies a JSON merge patch (RFC 7396) to a document.
+ @param mergePatch Merge patch
+ @param document JSON object
+ @return Patched copy of the document
+ */
++(id) documentByApplyingMergePatch:(id) mergePatch
+                        toDocument:(id) document;
+
+/**
+ Sets values in a document, creating the dictionaries on the way like json_set.
+ @param values Values by key path (e.g. {@"address.city": @"Austin"})
+ @param document JSON object
+ @return Patched copy of the document
+ */
++(id) documentBySettingValues:(NSDictionary*) values
+                   inDocument:(id) document;
+
 /**
  Removes documents that match the query from a collection.
  @param query Query
@@ -166,10 +295,10 @@ inCollection:(NSString*) collection
 
 /**
  Sets an encryption key to access the store.
- @param encKey Encryption key
+ @param encKey UTF-8 bytes of the encryption key, the store keeps its own copy
  @return Success (true) or failure (false)
  */
--(BOOL) setDatabaseKey:(NSString*) encKey;
+-(BOOL) setDatabaseKey:(NSData*) encKey;
 
 /**
  Closes the store.
@@ -213,4 +342,98 @@ inCollection:(NSString*) collection
  */
 -(BOOL) rollbackTransaction;
 
+/**
+ Returns the flags (JSON_STORE_STORAGE_FLAG_*) used to write documents to a collection.
+ @param collection Name of the collection
+ @return Storage flags, 0 for JSON text
+ */
+-(int) storageFlagsForCollection:(NSString*) collection;
+
+/**
+ Returns the preset dictionary used to compress documents in a collection.
+ @param collection Name of the collection
+ @return Dictionary, nil when documents are not compressed or compressed without one
+ */
+-(NSData*) compressionDictionaryForCollection:(NSString*) collection;
+
+/**
+ Changes the flags used to write documents to a collection, existing documents are rewritten with the new flags.
+ @param flags Storage flags, 0 for JSON text
+ @param dictionary Preset dictionary used with JSON_STORE_STORAGE_FLAG_COMPRESSED, can be nil
+ @param collection Name of the collection
+ @return Success (true) or failure (false)
+ */
+-(BOOL) setStorageFlags:(int) flags
+             dictionary:(NSData*) dictionary
+          forCollection:(NSString*) collection;
+
+/**
+ Creates the index on the search fields of a sort that finds paging with page tokens walk, does nothing if it exists.
+ @param sort Sort criteria of JSONStoreQueryOptions
+ @param collection Name of the collection
+ @return Success (true) or failure (false)
+ */
+-(BOOL) createPageIndexForSort:(NSArray*) sort
+                  inCollection:(NSString*) collection;
+
+/**
+ Sets the size from which documents written to a collection with JSON_STORE_STORAGE_FLAG_EXTERNAL are kept in files.
+ @param threshold Size in bytes of the encoded document, nil to keep every document in the collection
+ @param collection Name of the collection
+ */
+-(void) setExternalStorageThreshold:(NSNumber*) threshold
+                      forCollection:(NSString*) collection;
+
+/**
+ Opens a store on its own connection to the file of a collection kept in its own file, so writes to the collection
+ do not wait for the connection of this store. The new store shares the storage settings and external document files of this one.
+ @param collection Name of the collection
+ @return Store for the collection, nil when the collection is not in its own file or keeps documents in external files
+ */
+-(JSONStoreSQLLite*) storeForWriterLane:(NSString*) collection;
+
+/**
+ Closes a store returned by storeForWriterLane:, leaving the store it was opened from untouched.
+ */
+-(void) closeWriterLane;
+
+/**
+ Tunes how the store file is read. Does nothing for the values that are nil.
+ @param pageSize Page size in bytes, the store is rebuilt when it already has pages of another size
+ @param mmapSize Bytes of the file read through memory-mapped I/O
+ @param cacheSize Bytes the page cache may hold
+ @return Success (true) or failure (false)
+ */
+-(BOOL) setPageSize:(NSNumber*) pageSize
+           mmapSize:(NSNumber*) mmapSize
+          cacheSize:(NSNumber*) cacheSize;
+
+/**
+ Returns the select statements that read the search fields and the most recent documents of a collection.
+ @param collection Name of the collection
+ @param searchFields Search fields of the collection
+ @return NSArray with one select statement for the search fields followed by one for the documents, both read newest first in chunks below an _id
+ */
+-(NSArray*) warmUpStatementsForCollection:(NSString*) collection
+                             searchFields:(NSArray*) searchFields;
+
+/**
+ Reads the pages touched by one chunk of a select statement into the page cache.
+ @param sql Select statement from warmUpStatementsForCollection:searchFields:
+ @param lastId Reads the rows below this _id, set to the _id of the last row read
+ @param budget Bytes the page cache may hold, capped at the size of the page cache
+ @param shouldStop Block that returns true to stop early
+ @return Number of rows read, 0 when there is nothing left to read or the page cache size is unknown, -1 on failure
+ */
+-(int) readIntoCache:(NSString*) sql
+             belowId:(long long*) lastId
+        memoryBudget:(NSUInteger) budget
+          shouldStop:(BOOL (^)(void)) shouldStop;
+
+/**
+ Returns page cache statistics.
+ @return NSDictionary with hits, misses and size, nil when the store is closed
+ */
+-(NSDictionary*) cacheStatus;
+
 @end
@@ -19,9 +19,43 @@
 #import "JSONStoreConstants.h"
 #import "JSONStoreQueryPart.h"
 #import "JSONStoreValidator.h"
+#import "JSONStoreDocumentCodec.h"
 #import "NSObject+WLJSON.h"
+#import "NSData+WLJSON.h"
+#import "NSString+WLJSON.h"
 #import "SQLiteDatabase.h"
+#import <CommonCrypto/CommonDigest.h>
 
+static NSString* jsonStoreSHA256Hex(NSString* string)
+{
+    NSData* data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    
+    CC_SHA256(data.bytes, (CC_LONG) data.length, digest);
+    
+    NSMutableString* hash = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+    
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [hash appendFormat:@"%02x", digest[i]];
+    }
+    
+    return hash;
+}
+
+//Statement text with the key between a prefix and a suffix, built in one buffer so zeroing it leaves no copy of the key
+static NSMutableData* jsonStoreKeyText(NSString* prefix, NSData* key, NSString* suffix)
+{
+    NSData* prefixData = [prefix dataUsingEncoding:NSUTF8StringEncoding];
+    NSData* suffixData = [suffix dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData* text = [NSMutableData dataWithLength:[prefixData length] + [key length] + [suffixData length]];
+    uint8_t* bytes = [text mutableBytes];
+    
+    memcpy(bytes, [prefixData bytes], [prefixData length]);
+    memcpy(bytes + [prefixData length], [key bytes], [key length]);
+    memcpy(bytes + [prefixData length] + [key length], [suffixData bytes], [suffixData length]);
+    
+    return text;
+}
 
 @implementation JSONStoreSQLLite
 
@@ -61,12 +95,25 @@
         }
     }
     
-    NSString* createPref = [NSString stringWithFormat:@"create table '%@' ( _id INTEGER primary key autoincrement, ", collection];
+    NSString* tableDef = [NSString stringWithFormat:@"'%@' ( _id INTEGER primary key autoincrement, ", collection];
+    NSString* createPref = [@"create table " stringByAppendingString:tableDef];
     NSString* createSuf = @" json BLOB, _dirty REAL default 0, _deleted INTEGER default 0, _operation TEXT)";
     NSString* indexedColumns = [self _schemaFromDict:[schema getCombinedDictionary]];
-    NSString* stmt = [NSString stringWithFormat:@"%@%@%@;", createPref, indexedColumns, createSuf];
     
-
+    //SQLite keeps the create statement without the schema, so it is only added to the statement that runs
+    NSString* stmt = [NSString stringWithFormat:@"create table [%@].%@%@%@;", [self _schemaForCollection:collection], tableDef, indexedColumns, createSuf];
+    
+    NSString* schemaHash = [JSONStoreSQLLite _hashForColumns:indexedColumns];
+    NSString* catalogedHash = [[self _loadCatalog] objectForKey:collection];
+    
+    //Cataloged collections were created with their counts, only the search fields are compared.
+    //A table dropped or lost behind the catalog's back is provisioned again.
+    if (catalogedHash != nil && [self _tableExists:collection inSchema:[self _schemaForCollection:collection]]) {
+        return [catalogedHash isEqualToString:schemaHash] ? JSON_STORE_PROVISION_TABLE_EXISTS : JSON_STORE_PROVISION_TABLE_SCHEMA_MISMATCH;
+    }
+    
+    //The table, its indexes, counts and catalog row are written together
+    [self.dbMgr execute:@"SAVEPOINT jsonstore_provision"];
     
     if (! [self.dbMgr executeSchemaCreation:stmt]) {
         
@@ -103,9 +150,76 @@
         }
     }
     
+    if (rc == 0 || rc == JSON_STORE_PROVISION_TABLE_EXISTS) {
+        
+        //Only a complete collection is trusted without looking at it on the next open
+        if ([self _createCountsForCollection:collection]) {
+            [self _catalogCollection:collection withHash:schemaHash];
+        } else {
+            [self _uncatalogCollection:collection];
+        }
+        
+        [self.dbMgr execute:@"RELEASE SAVEPOINT jsonstore_provision"];
+        
+    } else {
+        
+        [self.dbMgr execute:@"ROLLBACK TO SAVEPOINT jsonstore_provision"];
+        [self.dbMgr execute:@"RELEASE SAVEPOINT jsonstore_provision"];
+    }
+    
     return rc;
 }
 
+-(int) attachFileForCollection:(NSString*) collection
+                     encrypted:(BOOL) encrypted
+{
+    if (self.attachedCollections[collection] != nil) {
+        return JSON_STORE_RC_OK;
+    }
+    
+    //Unqualified names resolve to the main file first, a table there would hide the one in the attached file
+    NSString* mainTableStmt = @"select count(*) from main.sqlite_master where type = 'table' and name = ?";
+    NSMutableDictionary* results = [[NSMutableDictionary alloc] init];
+    
+    if (! [self.dbMgr selectInto:results withSQL:mainTableStmt, @[collection]]) {
+        return JSON_STORE_PROVISION_TABLE_FAILURE;
+    }
+    
+    if ([[results objectForKey:@"count(*)"] intValue] > 0) {
+        NSLog(@"Collection %@ already exists in the main database file, it is not moved to its own file", collection);
+        return JSON_STORE_RC_OK;
+    }
+    
+    NSString* path = [self _fileForCollection:collection];
+    NSError* error = nil;
+    
+    if (! [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                                    withIntermediateDirectories:YES
+                                                     attributes:nil
+                                                          error:&error]) {
+        
+        NSLog(@"Unable to create directory for collection files, error: %@", error);
+        return JSON_STORE_PROVISION_TABLE_FAILURE;
+    }
+    
+    if (self.isEncrypt && encrypted && [self.databaseKeyData length] == 0) {
+        NSLog(@"Unable to attach encrypted file for collection: %@, the store has not been keyed", collection);
+        return JSON_STORE_PROVISION_KEY_FAILURE;
+    }
+    
+    if (! [self _attachFile:path withSchema:[collection stringByAppendingString:JSON_STORE_COLLECTION_SCHEMA_SUFFIX] encrypted:encrypted]) {
+        return JSON_STORE_PROVISION_TABLE_FAILURE;
+    }
+    
+    if (! self.attachedCollections) {
+        self.attachedCollections = [[NSMutableDictionary alloc] init];
+    }
+    
+    self.attachedCollections[collection] = @{ @"path" : path, @"encrypted" : @(encrypted) };
+    
+    return JSON_STORE_RC_OK;
+}
+
 -(BOOL) dropTable:(NSString*)collection
 {
     // If the database has been closed, re-open it.  We do this because provision could be called
@@ -123,13 +237,84 @@
     }
     
     NSString* dropStmt = [NSString stringWithFormat:@"drop table if exists '%@'", collection];
-    return [self.dbMgr execute:dropStmt];
+    [self.queryCache invalidateCollection:collection];
+    
+    //A collection kept in its own file is dropped with the file, files can not be detached inside a transaction
+    BOOL removeFile = self.attachedCollections[collection] != nil && ! self.transactionInProgress;
+    
+    //The triggers go away with the table, the counts row does not
+    NSString* deleteCountsStmt = [NSString stringWithFormat:@"delete from [%@].'%@' where collection = ?",
+                                  [self _schemaForCollection:collection], JSON_STORE_COUNTS_TABLE];
+    
+    if (! removeFile) {
+        [self.dbMgr execute:deleteCountsStmt, @[collection]];
+    }
+    
+    NSString* deleteStorageStmt = [NSString stringWithFormat:@"delete from '%@' where collection = ?", JSON_STORE_STORAGE_TABLE];
+    [self.dbMgr execute:deleteStorageStmt, @[collection]];
+    
+    NSString* deleteCatalogStmt = [NSString stringWithFormat:@"delete from '%@' where collection = ?", JSON_STORE_CATALOG_TABLE];
+    [self.dbMgr execute:deleteCatalogStmt, @[collection]];
+    [self.catalog removeObjectForKey:collection];
+    [self.storageFlags removeObjectForKey:collection];
+    [self.compressionDictionaries removeObjectForKey:collection];
+    
+    BOOL worked = NO;
+    
+    if (removeFile) {
+        
+        worked = [self _removeFileForCollection:collection];
+        
+    } else if ((worked = [self.dbMgr execute:dropStmt]) && self.attachedCollections[collection] == nil) {
+        
+        //A file left by an earlier open would be attached again with its documents
+        NSString* path = [self _fileForCollection:collection];
+        
+        if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            worked = [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        }
+    }
+    
+    if (worked && ! removeFile) {
+        NSString* dropDocumentsStmt = [NSString stringWithFormat:@"drop table if exists '%@'", [self _documentsTableForCollection:collection]];
+        worked = [self.dbMgr execute:dropDocumentsStmt];
+    }
+    
+    if (worked) {
+        [self.blobStore removeCollection:collection];
+        
+        if (! self.transactionInProgress) {
+            [self.blobStore commit];
+        }
+    }
+    
+    return worked;
 }
 
 -(BOOL) clearTable:(NSString*)collection
 {
     NSString* dropStmt = [NSString stringWithFormat:@"DELETE FROM '%@' WHERE 1", collection];
-    return [self.dbMgr execute:dropStmt];
+    [self.queryCache invalidateCollection:collection];
+    
+    BOOL worked = NO;
+    
+    //Replacing the file of a collection kept in its own file does not read every row
+    if (self.attachedCollections[collection] != nil && ! self.transactionInProgress) {
+        worked = [self _recreateFileForCollection:collection];
+    } else {
+        worked = [self.dbMgr execute:dropStmt];
+    }
+    
+    //Unlinking the folder is cheaper than removing the files of each document, in a transaction it waits for the commit
+    if (worked) {
+        [self.blobStore removeCollection:collection];
+        
+        if (! self.transactionInProgress) {
+            [self.blobStore commit];
+        }
+    }
+    
+    return worked;
 }
 
 -(BOOL) replace:(NSDictionary*) document
@@ -140,10 +325,6 @@
     
     int docId = [[document objectForKey:JSON_STORE_FIELD_ID] intValue];
     
-    if ([self _isRemoved:docId inCollection:collection]) {
-        return NO;
-    }
-    
     NSMutableDictionary* setClauseDict = [NSMutableDictionary new];
     
     [idx enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
@@ -158,35 +339,174 @@
         }
     }];
     
-    [setClauseDict setObject:[[document objectForKey:JSON_STORE_FIELD_JSON] WLJSONData]
-                      forKey:JSON_STORE_FIELD_JSON];
+    //One read of the stored row replaces the removed and added checks and tells which columns change
+    NSDictionary* stored = [self _storedColumns:[setClauseDict allKeys] forId:docId inCollection:collection];
+    
+    // If no document found, it is deleted or was never there
+    if (stored == nil || [[stored objectForKey:JSON_STORE_FIELD_DELETED] floatValue] != 0) {
+        return NO;
+    }
+    
+    NSData* jsonData = [self _dataWithDocument:[document objectForKey:JSON_STORE_FIELD_JSON] inCollection:collection];
+    
+    if (jsonData == nil) {
+        return NO;
+    }
+    
+    [setClauseDict setObject:jsonData forKey:JSON_STORE_FIELD_JSON];
     
     if (markDirty) {
         
         NSDate *d = [NSDate new];
         [setClauseDict setObject:d forKey:JSON_STORE_FIELD_DIRTY];
         
-    } else {
+    } else if ([[stored objectForKey:JSON_STORE_FIELD_DIRTY] doubleValue] != 0) {
         
         [setClauseDict setObject:[NSNumber numberWithInt:0] forKey:JSON_STORE_FIELD_DIRTY];
     }
     
     // If the previous operation was an add, leave that operation so the Document gets added
-    if (! [self _isAdded:docId inCollection:collection]) {
+    if (! [[stored objectForKey:JSON_STORE_FIELD_OPERATION] isEqualToString:JSON_STORE_OP_ADD]) {
         [setClauseDict setObject:JSON_STORE_OP_UPDATE forKey:JSON_STORE_FIELD_OPERATION];
     }
     
-    NSString* whereStr = [self _whereClauseForId:docId];
-    NSString* setClauseStr = [self _queryFromDict:setClauseDict delimiter:@", "];
+    //Columns that keep their value are left out, so their indexes are not touched
+    for (NSString* key in [setClauseDict allKeys]) {
+        
+        id storedValue = [stored objectForKey:[key lowercaseString]];
+        id value = [setClauseDict objectForKey:key];
+        
+        if (storedValue != nil && ([value isKindOfClass:[NSString class]] || [value isKindOfClass:[NSData class]]) && [value isEqual:storedValue]) {
+            [setClauseDict removeObjectForKey:key];
+        }
+    }
+    
+    //Documents kept in their own table are written there, the row is only updated when other columns change
+    NSData* separateJSON = nil;
+    
+    if ([self _hasDocumentsTableForCollection:collection]) {
+        separateJSON = [setClauseDict objectForKey:JSON_STORE_FIELD_JSON];
+        [setClauseDict removeObjectForKey:JSON_STORE_FIELD_JSON];
+    }
+    
+    BOOL jsonChanged = separateJSON != nil || [setClauseDict objectForKey:JSON_STORE_FIELD_JSON] != nil;
+    
+    if (! [setClauseDict count] && separateJSON == nil) {
+        return YES;
+    }
+    
+    int rowsUpdated = 1;
+    
+    if ([setClauseDict count]) {
+        
+        NSString* whereStr = [self _whereClauseForId:docId];
+        NSString* setClauseStr = [self _queryFromDict:setClauseDict delimiter:@", "];
+        
+        NSString* updateStmt = [NSString stringWithFormat:@"update '%@' set %@ where( %@ )",
+                                collection, setClauseStr, whereStr];
+        
+        rowsUpdated = [self.dbMgr update:updateStmt, [setClauseDict allValues]];
+    }
+    
+    if (rowsUpdated > 0 && separateJSON != nil) {
+        
+        NSString* updateJSONStmt = [NSString stringWithFormat:@"update '%@' set json = ? where _id = ?",
+                                    [self _documentsTableForCollection:collection]];
+        
+        rowsUpdated = [self.dbMgr update:updateJSONStmt, @[separateJSON, @(docId)]];
+    }
     
-    NSString* updateStmt = [NSString stringWithFormat:@"update '%@' set %@ where( %@ )",
-                            collection, setClauseStr, whereStr];
+    [self.queryCache invalidateCollection:collection];
     
-    int rowsUpdated = [self.dbMgr update:updateStmt, [setClauseDict allValues]];
+    if (rowsUpdated > 0 && jsonChanged) {
+        [self _removeExternalData:[stored objectForKey:JSON_STORE_FIELD_JSON]];
+    } else if (rowsUpdated <= 0) {
+        [self _removeExternalData:jsonData];
+    }
     
     return rowsUpdated > 0;
 }
 
+-(BOOL) isPatchAvailableForCollection:(NSString*) collection
+{
+    if ([self storageFlagsForCollection:collection] != 0 || ! [self _isJSONFunctionsAvailable]) {
+        return NO;
+    }
+    
+    //Connections opened by another database manager may not have the search field value function
+    NSMutableDictionary* checkDict = [NSMutableDictionary new];
+    NSString* checkStmt = [NSString stringWithFormat:@"select %@(NULL, NULL);", JSON_STORE_SEARCH_FIELD_VALUE_FUNCTION];
+    
+    return [self.dbMgr selectInto:checkDict withSQL:checkStmt];
+}
+
+-(int) patchDocumentsWithIds:(NSArray*) ids
+                inCollection:(NSString*) collection
+                  mergePatch:(NSDictionary*) mergePatch
+                   setValues:(NSDictionary*) values
+                searchFields:(NSArray*) searchFields
+                   markDirty:(BOOL) markDirty
+{
+    //Numbered parameters let the new document expression be used by every column it feeds
+    NSMutableArray* parameters = [[NSMutableArray alloc] init];
+    NSString* document = [self _documentTextForCollection:collection];
+    
+    if (mergePatch != nil) {
+        [parameters addObject:[mergePatch WLJSONRepresentation]];
+        document = [NSString stringWithFormat:@"json_patch(%@, ?%lu)", document, (unsigned long) [parameters count]];
+    }
+    
+    if ([values count] > 0) {
+        
+        NSMutableArray* pathsAndValues = [[NSMutableArray alloc] init];
+        
+        for (NSString* keyPath in values) {
+            
+            //Values go through json() so strings, objects and booleans keep their JSON type
+            NSString* array = [@[values[keyPath]] WLJSONRepresentation];
+            [parameters addObject:[array substringWithRange:NSMakeRange(1, [array length] - 2)]];
+            
+            [pathsAndValues addObject:[NSString stringWithFormat:@"'%@', json(?%lu)", [self _jsonPathFromKeyPath:keyPath], (unsigned long) [parameters count]]];
+        }
+        
+        document = [NSString stringWithFormat:@"json_set(%@, %@)", document, [pathsAndValues componentsJoinedByString:@", "]];
+    }
+    
+    NSMutableArray* assignments = [NSMutableArray arrayWithObject:[NSString stringWithFormat:@"[%@] = CAST(%@ AS BLOB)", JSON_STORE_FIELD_JSON, document]];
+    
+    for (NSString* searchField in searchFields) {
+        [assignments addObject:[NSString stringWithFormat:@"[%@] = %@(%@, '%@')", searchField, JSON_STORE_SEARCH_FIELD_VALUE_FUNCTION, document, [searchField lowercaseString]]];
+    }
+    
+    [parameters addObject:markDirty ? [NSDate new] : @0];
+    [assignments addObject:[NSString stringWithFormat:@"%@ = ?%lu", JSON_STORE_FIELD_DIRTY, (unsigned long) [parameters count]]];
+    
+    //If the previous operation was an add, leave that operation so the document gets added, same as replace
+    [assignments addObject:[NSString stringWithFormat:@"%@ = CASE WHEN %@ = '%@' THEN %@ ELSE '%@' END",
+                            JSON_STORE_FIELD_OPERATION, JSON_STORE_FIELD_OPERATION, JSON_STORE_OP_ADD, JSON_STORE_FIELD_OPERATION, JSON_STORE_OP_UPDATE]];
+    
+    NSMutableArray* idParameters = [[NSMutableArray alloc] init];
+    
+    for (NSNumber* docId in ids) {
+        [parameters addObject:docId];
+        [idParameters addObject:[NSString stringWithFormat:@"?%lu", (unsigned long) [parameters count]]];
+    }
+    
+    NSString* updateStmt = [NSString stringWithFormat:@"update '%@' set %@ where %@ IN (%@) AND %@ = 0",
+                            collection, [assignments componentsJoinedByString:@", "], JSON_STORE_FIELD_ID,
+                            [idParameters componentsJoinedByString:@", "], JSON_STORE_FIELD_DELETED];
+    
+    int rowsUpdated = [self.dbMgr update:updateStmt, parameters];
+    
+    [self.queryCache invalidateCollection:collection];
+    
+    if (rowsUpdated < 0) {
+        NSLog(@"Patch operation failed, collection: %@, message: %@", collection, [self.dbMgr lastErrorMsg]);
+    }
+    
+    return rowsUpdated;
+}
+
 -(int) destroyDbDirectory
 {
     if (self.dbMgr == nil) {
@@ -229,8 +549,23 @@ collection withDocId:(int) docId
     NSString* deleteStmt = [NSString stringWithFormat:@"delete from '%@' where ( %@ )",
                             collection, whereClause];
     
+    NSMutableDictionary* stored = [NSMutableDictionary new];
+    
+    //Only collections that keep documents in files need the json before the row is gone
+    if ([self storageFlagsForCollection:collection] & JSON_STORE_STORAGE_FLAG_EXTERNAL) {
+        NSString* selectStmt = [NSString stringWithFormat:@"select %@ AS [json] from '%@' where ( %@ )",
+                                [self _jsonColumnForCollection:collection], collection, whereClause];
+        [self.dbMgr selectInto:stored withSQL:selectStmt];
+    }
+    
     numDeleted  = [self.dbMgr deleteFromDatabase:deleteStmt];
     
+    [self.queryCache invalidateCollection:collection];
+    
+    if (numDeleted > 0) {
+        [self _removeExternalData:[stored objectForKey:JSON_STORE_FIELD_JSON]];
+    }
+    
     return numDeleted;
 }
 
@@ -298,6 +633,7 @@ collection withDocId:(int) docId
             
             if ([self.dbMgr update:updateStmt, [setClauseDict allValues]]) {
                 
+                [self.queryCache invalidateCollection:collection];
                 numMarkedDeleted++;
                 
             } else {
@@ -330,10 +666,18 @@ collection withDocId:(int) docId
     //Filter:
     NSString* selectStatement ;
     
+    BOOL projectInDatabase = NO;
+    
     if (options._count) {
         selectStatement = @"count(*)";
+    } else if ([options._projection count]) {
+        projectInDatabase = [self _isJSONFunctionsAvailableForCollection:collection];
+        selectStatement = [self _selectStatementForProjection:options._projection
+                                                   withFilter:options._filter
+                                                 inCollection:collection
+                                                   inDatabase:projectInDatabase];
     } else {
-        selectStatement = [self _selectStatement:options._filter];
+        selectStatement = [self _selectStatement:options._filter inCollection:collection];
     }
     
     
@@ -343,6 +687,11 @@ collection withDocId:(int) docId
     
     NSString* orderByClause;
     
+    //Keyset pagination, a positive limit without an offset resumes after the last (sort key, _id) seen
+    BOOL keysetPaging = ! options._count && (options.usePageTokens || [options.pageToken length]) &&
+                        options.limit != nil && [options.limit intValue] > 0 && options.offset == nil;
+    NSArray* pageValues = nil;
+    
     if (limitAndOffsetClause == nil) {
         
         //Negative limit edge case
@@ -358,171 +707,143 @@ collection withDocId:(int) docId
         }
         
         
+    } else if (keysetPaging) {
+        
+        orderByClause = [self _orderByClauseForKeyset:options._sort];
+        selectStatement = [selectStatement stringByAppendingString:[self _selectStatementForKeyset:options._sort]];
+        
+        if ([options.pageToken length]) {
+            
+            pageValues = [options _pageTokenValues];
+            
+            if (pageValues == nil) {
+                NSLog(@"Invalid page token, collection: %@, pageToken: %@", collection, options.pageToken);
+                return nil;
+            }
+        }
+        
     } else {
         
         orderByClause = [self _orderByClause:options._sort];
     }
     
-    NSMutableString* whereClauseStr = [[NSMutableString alloc] init];
+    NSMutableArray* parameters = [[NSMutableArray alloc] init];
     
-    //Only add the where if a query was passed
-    if ([queryParts count]) {
-        [whereClauseStr appendFormat:@"where "];
-    } else {
-        [whereClauseStr appendString:[NSString stringWithFormat:@"where %@", [JSON_STORE_FIELD_DELETED stringByAppendingString:@" = 0"]]];
+    NSMutableString* whereClauseStr = [self _whereClauseForQueryParts:queryParts
+                                                         inCollection:collection
+                                                           parameters:parameters];
+    
+    if (pageValues != nil) {
+        [whereClauseStr replaceCharactersInRange:NSMakeRange(0, [@"where " length]) withString:@"where ( "];
+        [whereClauseStr appendFormat:@" ) AND %@", [self _whereClauseForKeyset:options._sort
+                                                                    afterValues:pageValues
+                                                                     parameters:parameters]];
     }
     
-    NSMutableArray* allQueryParts = [[NSMutableArray alloc] init];
+    NSString* findQuery = [NSString stringWithFormat:@"select %@ from '%@' %@ %@ %@",
+                           selectStatement, collection, whereClauseStr, orderByClause, limitAndOffsetClause];
     
-    for (JSONStoreQueryPart* queryPart in queryParts) {
+    NSMutableArray* results = [self _selectAllWithSQL:findQuery parameters:parameters inCollection:collection];
+    
+    if (results == nil) {
+        return nil;
+    }
+    
+    if (options._count) {
         
-        NSMutableArray* singleQueryPart = [[NSMutableArray alloc] init];
+        results = (NSMutableArray*) @[ results[0][@"count(*)"] ];
         
-        //LessThan
-        NSString* lessThanStr = [self _whereClauseDictWithSymbol:@"<" andArray:queryPart._lessThan];
-        if ([lessThanStr length]) {
-            [singleQueryPart addObject:lessThanStr];
-        }
+    }
+    
+    if (! options._count && [options._projection count] && ! projectInDatabase) {
         
-        //lessOrEqualThan
-        NSString* lessOrEqualThanStr = [self _whereClauseDictWithSymbol:@"<=" andArray:queryPart._lessOrEqualThan];
-        if ([lessOrEqualThanStr length]) {
-            [singleQueryPart addObject:lessOrEqualThanStr];
-        }
+        //No JSON1 functions in this SQLite build, walk the paths in the decoded documents
+        [self _projectResults:results withPaths:options._projection];
+    }
+    
+    if (keysetPaging) {
         
-        //greaterThan
-        NSString* greaterThanStr = [self _whereClauseDictWithSymbol:@">" andArray:queryPart._greaterThan];
-        if ([greaterThanStr length]) {
-            [singleQueryPart addObject:greaterThanStr];
-        }
+        options.nextPageToken = [self _nextPageTokenFromResults:results
+                                                        forSort:options._sort
+                                                          limit:[options.limit intValue]];
+    }
+    
+    return results;
+}
+
+
+-(NSArray*) aggregateWithQueryParts:(NSArray*) queryParts
+                       inCollection:(NSString*) collection
+                        withOptions:(JSONStoreAggregateOptions*) options
+{
+    NSMutableArray* selectColumns = [[NSMutableArray alloc] init];
+    NSMutableArray* groupByColumns = [[NSMutableArray alloc] init];
+    
+    for (NSString* searchField in options._groupBy) {
+        [selectColumns addObject:[NSString stringWithFormat:@"[%@]", searchField]];
+        [groupByColumns addObject:[NSString stringWithFormat:@"[%@]", searchField]];
+    }
+    
+    NSArray* aggregates = [options._aggregates count] ? options._aggregates : @[ @{JSON_STORE_KEY_AGGREGATE_COUNT : @"*"} ];
+    
+    for (NSDictionary* aggregate in aggregates) {
         
-        //greaterOrEqualThan
-        NSString* greaterOrEqualThanStr = [self _whereClauseDictWithSymbol:@">=" andArray:queryPart._greaterOrEqualThan];
-        if ([greaterOrEqualThanStr length]) {
-            [singleQueryPart addObject:greaterOrEqualThanStr];
-        }
+        NSString* function = [aggregate allKeys][0];
+        NSString* searchField = aggregate[function];
         
-        //like
-        NSString* likeStr = [self _whereClauseWithStrFormat:@"[%@] LIKE '%%%@%%'" andArray:queryPart._like exact:NO];
-        if([likeStr length]) {
-            [singleQueryPart addObject:likeStr];
+        if ([searchField isEqualToString:@"*"]) {
+            [selectColumns addObject:[NSString stringWithFormat:@"%@(*) AS [%@]", function, function]];
+        } else {
+            [selectColumns addObject:[NSString stringWithFormat:@"%@([%@]) AS [%@(%@)]", function, searchField, function, searchField]];
         }
-        
-        //not like
-        NSString* notLikeStr = [self _whereClauseWithStrFormat:@"[%@] NOT LIKE '%%%@%%'" andArray:queryPart._notLike exact:NO];
-        if([notLikeStr length]) {
-            [singleQueryPart addObject:notLikeStr];
-        }
-        
-        //rightLike
-        NSString* rightLikeStr = [self _whereClauseWithStrFormat:@"[%@] LIKE '%@%%\'" andArray:queryPart._rightLike exact:NO];
-        if ([rightLikeStr length]) {
-            [singleQueryPart addObject:rightLikeStr];
-        }
-        
-        //not rightLike
-        NSString* notRightLikeStr = [self _whereClauseWithStrFormat:@"[%@] NOT LIKE '%@%%\'" andArray:queryPart._notRightLike exact:NO];
-        if ([notRightLikeStr length]) {
-            [singleQueryPart addObject:notRightLikeStr];
-        }
-        
-        //leftLike
-        NSString* leftLikeStr = [self _whereClauseWithStrFormat:@"[%@] LIKE '%%%@'" andArray:queryPart._leftLike exact:NO];
-        if ([leftLikeStr length]) {
-            [singleQueryPart addObject:leftLikeStr];
-        }
-        
-        //notLeftLike
-        NSString* notLeftLikeStr = [self _whereClauseWithStrFormat:@"[%@] NOT LIKE '%%%@'" andArray:queryPart._notLeftLike exact:NO];
-        if ([notLeftLikeStr length]) {
-            [singleQueryPart addObject:notLeftLikeStr];
-        }
-        
-        //equal
-        NSString* equalStr = [self _whereClauseWithStrFormat:@"( [%@] = '%@' OR [%@] LIKE '%%-@-%@-@-%%' OR [%@] LIKE '%%-@-%@' OR [%@] LIKE '%@-@-%%' )" andArray:queryPart._equal exact:YES];
-        if ([equalStr length]) {
-            [singleQueryPart addObject:equalStr];
-        }
-        
-        //notEqual
-        NSString* notEqualStr = [self _whereClauseWithStrFormat:@"( [%@] != '%@' AND [%@] NOT LIKE '%%-@-%@-@-%%' AND [%@] NOT LIKE '%%-@-%@' AND [%@] NOT LIKE '%@-@-%%' )" andArray:queryPart._notEqual exact:YES];
-        if ([notEqualStr length]) {
-            [singleQueryPart addObject:notEqualStr];
-        }
-        
-        //in
-        NSString* inStr = [self _whereClauseInWithArray:queryPart._inside not:NO];
-        if ([inStr length]) {
-            [singleQueryPart addObject:inStr];
-        }
-        
-        //not in
-        NSString* notInStr = [self _whereClauseInWithArray:queryPart._notInside not:YES];
-        if ([notInStr length]) {
-            [singleQueryPart addObject:notInStr];
-        }
-        
-        //between
-        NSString* betweenStr = [self _whereClauseBetweenWithArray:queryPart._between not:NO];
-        if ([betweenStr length]) {
-            [singleQueryPart addObject:betweenStr];
-        }
-        
-        //not between
-        NSString* notBetweenStr = [self _whereClauseBetweenWithArray:queryPart._notBetween not:YES];
-        if ([notBetweenStr length]) {
-            [singleQueryPart addObject:notBetweenStr];
-        }
-        
-        //ids
-        NSString* idsStr = [self _whereClauseForMultipleIds:queryPart._ids];
-        if ([idsStr length]) {
-            [singleQueryPart addObject:idsStr];
-        }
-        
-        [singleQueryPart addObject:[JSON_STORE_FIELD_DELETED stringByAppendingString:@" = 0"]];
-        
-        [allQueryParts addObject:[singleQueryPart componentsJoinedByString:@" AND "]];
-    }
-    
-    if ([allQueryParts count]) {
-        [whereClauseStr appendFormat:@"%@", [allQueryParts componentsJoinedByString:@" OR "]];
-    }
-    
-    NSString* findQuery = [NSString stringWithFormat:@"select %@ from '%@' %@ %@ %@",
-                           selectStatement, collection, whereClauseStr, orderByClause, limitAndOffsetClause];
-    
-    NSMutableArray* results = [[NSMutableArray alloc] init];
-    
-    BOOL validSelect = [self.dbMgr selectAllInto:results withSQL:findQuery];
-    
-    if (! validSelect) {
-        return nil;
-    }
-    
-    if (options._count) {
-        results = (NSMutableArray*) @[ results[0][@"count(*)"] ];
-    }
-    
-    return results;
-}
-
-
--(int) store:(id) jsonObj
-inCollection:(NSString*) collection
-  withIdexes:(NSDictionary*) idx
-       isAdd:(BOOL) isAdd
-{
-    int rc = 0;
-    NSData* jsonData = [jsonObj WLJSONData];;
-    NSString* fieldsStr = nil;
-    
-    //Note, these are associative arrays, they need to stay in sync, we don't use a hash because order matters
-    //and there are nice tricks we can do with arrays to build our statements
-    NSMutableArray* fieldNames = [NSMutableArray new];
-    NSMutableArray* fieldValues = [NSMutableArray new];
-    
-    [idx enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+    }
+    
+    NSMutableArray* parameters = [[NSMutableArray alloc] init];
+    
+    NSString* whereClauseStr = [self _whereClauseForQueryParts:queryParts
+                                                  inCollection:collection
+                                                    parameters:parameters];
+    
+    NSString* groupByClause = @"";
+    
+    if ([groupByColumns count]) {
+        NSString* groupByColumnsStr = [groupByColumns componentsJoinedByString:@", "];
+        groupByClause = [NSString stringWithFormat:@"GROUP BY %@ ORDER BY %@", groupByColumnsStr, groupByColumnsStr];
+    }
+    
+    NSString* aggregateQuery = [NSString stringWithFormat:@"select %@ from '%@' %@ %@",
+                                [selectColumns componentsJoinedByString:@", "], collection, whereClauseStr, groupByClause];
+    
+    NSMutableArray* results = [self _selectAllWithSQL:aggregateQuery parameters:parameters inCollection:collection];
+    
+    if (results == nil) {
+        NSLog(@"Aggregate operation failed, collection: %@, message: %@", collection, [self.dbMgr lastErrorMsg]);
+        return nil;
+    }
+    
+    return results;
+}
+
+-(int) store:(id) jsonObj
+inCollection:(NSString*) collection
+  withIdexes:(NSDictionary*) idx
+       isAdd:(BOOL) isAdd
+{
+    int rc = 0;
+    NSData* jsonData = [self _dataWithDocument:jsonObj inCollection:collection];
+    NSString* fieldsStr = nil;
+    
+    if (jsonData == nil) {
+        NSLog(@"Store operation failed encoding document, collection: %@", collection);
+        return -1;
+    }
+    
+    //Note, these are associative arrays, they need to stay in sync, we don't use a hash because order matters
+    //and there are nice tricks we can do with arrays to build our statements
+    NSMutableArray* fieldNames = [NSMutableArray new];
+    NSMutableArray* fieldValues = [NSMutableArray new];
+    
+    [idx enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
         
         [fieldNames addObject:[NSString stringWithFormat:@"'%@'" ,key]];
         
@@ -531,8 +852,12 @@ inCollection:(NSString*) collection
         }
     }];
     
-    [fieldNames addObject:JSON_STORE_FIELD_JSON];
-    [fieldValues addObject:jsonData];
+    BOOL separate = [self _hasDocumentsTableForCollection:collection];
+    
+    if (! separate) {
+        [fieldNames addObject:JSON_STORE_FIELD_JSON];
+        [fieldValues addObject:jsonData];
+    }
     
     //Store operations should not set the dirty flag, add operations should
     if (isAdd) {
@@ -556,8 +881,20 @@ inCollection:(NSString*) collection
     
     BOOL worked = [self.dbMgr insertStmt:insertStmt, fieldValues];
     
+    //last_insert_rowid() is the _id of the row above, rows inserted by triggers do not change it
+    if (worked && separate) {
+        
+        NSString* insertJSONStmt = [NSString stringWithFormat:@"insert into '%@' (_id, json) values (last_insert_rowid(), ?)",
+                                    [self _documentsTableForCollection:collection]];
+        
+        worked = [self.dbMgr insertStmt:insertJSONStmt, @[jsonData]];
+    }
+    
+    [self.queryCache invalidateCollection:collection];
+    
     if (! worked) {
         NSLog(@"Store operation failed, collection: %@", collection);
+        [self _removeExternalData:jsonData];
         rc =-1;
     } else {
         rc = 0;
@@ -568,6 +905,12 @@ inCollection:(NSString*) collection
 
 -(int) dirtyCount:(NSString*) collection
 {
+    NSNumber* maintainedCount = [self _maintainedCount:@"dirty" inCollection:collection];
+    
+    if (maintainedCount != nil) {
+        return [maintainedCount intValue];
+    }
+    
     int count = 0;
     
     NSString* whereClause = [self _whereClauseForDirty];
@@ -586,6 +929,12 @@ inCollection:(NSString*) collection
 
 -(int) count:(NSString*) collection
 {
+    NSNumber* maintainedCount = [self _maintainedCount:@"live" inCollection:collection];
+    
+    if (maintainedCount != nil) {
+        return [maintainedCount intValue];
+    }
+    
     int count = 0;
     
     NSString* selectStmt =[NSString stringWithFormat:@"select count(*) from '%@' where _deleted = 0", collection];
@@ -625,9 +974,9 @@ inCollection:(NSString*) collection
     NSString* whereClause = [self _whereClauseForDirty];
     NSString* orderByClause = [self _orderByDirty];
     
-    NSString* selectStmt = [NSString stringWithFormat: @"select %@, %@, %@, %@ from '%@' where %@ %@",
+    NSString* selectStmt = [NSString stringWithFormat: @"select %@, %@ AS [json], %@, %@ from '%@' where %@ %@",
                             JSON_STORE_FIELD_ID,
-                            JSON_STORE_FIELD_JSON,
+                            [self _jsonColumnForCollection:collection],
                             JSON_STORE_FIELD_OPERATION,
                             JSON_STORE_FIELD_DIRTY,
                             collection,
@@ -642,219 +991,1562 @@ inCollection:(NSString*) collection
         NSLog(@"All dirty operation failed, collection: %@", collection);
     }
     
-    return retArr;
+    return retArr;
+}
+
+-(BOOL) markClean: (int) docId
+     inCollection: (NSString*) collection
+     forOperation: (NSString*) operation
+{
+    if ([operation isEqualToString:JSON_STORE_OP_DELETE]) {
+        
+        return [self deleteFromCollection:collection withDocId:docId] > 0;
+        
+    } else {
+        
+        NSDictionary* setClauseDict = @{ JSON_STORE_FIELD_DIRTY : @0,
+                                         JSON_STORE_FIELD_DELETED: @0,
+                                         JSON_STORE_FIELD_OPERATION: @"" };
+        
+        NSString* setClauseStr =[self _queryFromDict:setClauseDict delimiter:@", "];
+        NSString* whereClauseStr = [self _whereClauseForId:docId];
+        
+        NSString* updateStmt = [NSString stringWithFormat:@"update '%@' set %@ where %@",
+                                collection, setClauseStr, whereClauseStr];
+        
+        BOOL worked = [self.dbMgr update:updateStmt, [setClauseDict allValues]] > 0;
+        
+        [self.queryCache invalidateCollection:collection];
+        
+        if (! worked) {
+            NSLog(@"markClean operation failed, collection: %@, docId: %d, operation: %@", collection, docId, operation);
+        }
+        
+        return worked;
+    }
+}
+
+-(int) storageFlagsForCollection:(NSString*) collection
+{
+    if (self.storageFlags[collection] == nil) {
+        [self _loadStorageForCollection:collection];
+    }
+    
+    return [self.storageFlags[collection] intValue];
+}
+
+-(NSData*) compressionDictionaryForCollection:(NSString*) collection
+{
+    if (self.storageFlags[collection] == nil) {
+        [self _loadStorageForCollection:collection];
+    }
+    
+    return self.compressionDictionaries[collection];
+}
+
+-(BOOL) setStorageFlags:(int) flags
+             dictionary:(NSData*) dictionary
+          forCollection:(NSString*) collection
+{
+    NSString* upsertStmt = [NSString stringWithFormat:@"INSERT OR REPLACE INTO '%@' (collection, flags, dictionary) VALUES (?, ?, ?)", JSON_STORE_STORAGE_TABLE];
+    
+    if (! (flags & JSON_STORE_STORAGE_FLAG_COMPRESSED) || [dictionary length] == 0) {
+        dictionary = nil;
+    }
+    
+    if (! [self _createStorageTable]) {
+        return NO;
+    }
+    
+    NSData* currentDictionary = [self compressionDictionaryForCollection:collection];
+    int currentFlags = [self storageFlagsForCollection:collection];
+    BOOL sameDictionary = currentDictionary == dictionary || [currentDictionary isEqualToData:dictionary];
+    
+    if (currentFlags == flags && sameDictionary) {
+        return YES;
+    }
+    
+    //Moving documents between tables leaves their bytes as they are
+    BOOL moveDocuments = ((currentFlags ^ flags) & JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE) != 0;
+    BOOL rewriteDocuments = ((currentFlags ^ flags) & ~JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE) != 0 || ! sameDictionary;
+    
+    //Documents compressed with the new dictionary must be readable as soon as they are written
+    [JSONStoreDocumentCodec registerDictionary:dictionary];
+    
+    //Savepoint so a failure leaves every document in the old format
+    BOOL worked = [self.dbMgr execute:@"SAVEPOINT jsonstore_storage"];
+    
+    worked = worked && [self _dropJSONPathIndexesInCollection:collection];
+    worked = worked && (! moveDocuments || [self _moveDocumentsInCollection:collection toDocumentsTable:(flags & JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE) != 0]);
+    worked = worked && (! rewriteDocuments || [self _rewriteDocumentsInCollection:collection withFlags:flags dictionary:dictionary]);
+    worked = worked && [self.dbMgr execute:upsertStmt, @[collection, @(flags), dictionary != nil ? dictionary : [NSNull null]]];
+    
+    if (worked) {
+        
+        [self.dbMgr execute:@"RELEASE SAVEPOINT jsonstore_storage"];
+        self.storageFlags[collection] = @(flags);
+        
+        if (! self.transactionInProgress) {
+            [self.blobStore commit];
+        }
+        
+        if (dictionary != nil) {
+            self.compressionDictionaries[collection] = dictionary;
+        } else {
+            [self.compressionDictionaries removeObjectForKey:collection];
+        }
+        
+    } else {
+        
+        NSLog(@"Storage format change failed, collection: %@, flags: %d, message: %@", collection, flags, [self.dbMgr lastErrorMsg]);
+        
+        [self.dbMgr execute:@"ROLLBACK TO SAVEPOINT jsonstore_storage"];
+        [self.dbMgr execute:@"RELEASE SAVEPOINT jsonstore_storage"];
+        
+        if (! self.transactionInProgress) {
+            [self.blobStore rollback];
+        }
+    }
+    
+    [self.queryCache invalidateCollection:collection];
+    
+    return worked;
+}
+
+-(BOOL) createPageIndexForSort:(NSArray*) sort
+                  inCollection:(NSString*) collection
+{
+    //Pages sorted by _id only walk the table itself
+    if (! [sort count]) {
+        return YES;
+    }
+    
+    //The rowid is the last key of every index, so the index also covers the _id tie break
+    NSString* columns = [[self _orderByClause:sort] substringFromIndex:[@"ORDER BY " length]];
+    NSString* indexName = [NSString stringWithFormat:@"%@_page_%@_idx", collection, [jsonStoreSHA256Hex(columns) substringToIndex:16]];
+    
+    NSString* indexStmt = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS [%@].[%@] ON '%@' (%@)",
+                           [self _schemaForCollection:collection], indexName, collection, columns];
+    
+    if (! [self.dbMgr execute:indexStmt]) {
+        NSLog(@"Unable to create page index, collection: %@, sort: %@, message: %@", collection, columns, [self.dbMgr lastErrorMsg]);
+        return NO;
+    }
+    
+    return YES;
+}
+
+-(void) setExternalStorageThreshold:(NSNumber*) threshold
+                      forCollection:(NSString*) collection
+{
+    if (! self.externalStorageThresholds) {
+        self.externalStorageThresholds = [[NSMutableDictionary alloc] init];
+    }
+    
+    if (threshold != nil) {
+        self.externalStorageThresholds[collection] = threshold;
+    } else {
+        [self.externalStorageThresholds removeObjectForKey:collection];
+    }
+}
+
+-(JSONStoreSQLLite*) storeForWriterLane:(NSString*) collection
+{
+    NSDictionary* attached = self.attachedCollections[collection];
+    
+    //External documents are tracked by the blob store of this connection until its transactions end
+    if (attached == nil || self.dbMgr == nil ||
+        ([self storageFlagsForCollection:collection] & JSON_STORE_STORAGE_FLAG_EXTERNAL) || self.externalStorageThresholds[collection] != nil) {
+        return nil;
+    }
+    
+    JSONStoreSQLLite* lane = [[JSONStoreSQLLite alloc] init];
+    lane.username = self.username;
+    lane.isEncrypt = self.isEncrypt;
+    lane.dbMgr = [[[self.dbMgr class] alloc] initWithUserName:self.username filePath:attached[@"path"]];
+    
+    if (self.isEncrypt && [attached[@"encrypted"] boolValue]) {
+        
+        if ([self.databaseKeyData length] == 0) {
+            [lane closeWriterLane];
+            return nil;
+        }
+        
+        if (! [JSONStoreSQLLite _keyDatabase:lane.dbMgr withKey:self.databaseKeyData]) {
+            
+            NSLog(@"Unable to key writer lane for collection: %@", collection);
+            [lane closeWriterLane];
+            return nil;
+        }
+        
+        lane.dbHasBeenKeyed = YES;
+    }
+    
+    lane.blobStore = self.blobStore;
+    lane.jsonFunctionsAvailable = self.jsonFunctionsAvailable;
+    lane.jsonPathIndexThreshold = self.jsonPathIndexThreshold;
+    lane.storageFlags = [NSMutableDictionary dictionaryWithObject:@([self storageFlagsForCollection:collection]) forKey:collection];
+    lane.compressionDictionaries = [[NSMutableDictionary alloc] init];
+    
+    if (self.compressionDictionaries[collection] != nil) {
+        lane.compressionDictionaries[collection] = self.compressionDictionaries[collection];
+    }
+    
+    return lane;
+}
+
+-(void) closeWriterLane
+{
+    //Not close, it would also drop the blob store shared with the main connection
+    [self.dbMgr closeDB];
+    self.dbMgr = nil;
+    self.blobStore = nil;
+}
+
+-(BOOL) setPageSize:(NSNumber*) pageSize
+           mmapSize:(NSNumber*) mmapSize
+          cacheSize:(NSNumber*) cacheSize
+{
+    if (self.dbMgr == nil) {
+        return NO;
+    }
+    
+    if (pageSize != nil) {
+        
+        NSMutableDictionary* current = [[NSMutableDictionary alloc] init];
+        NSMutableDictionary* pageCount = [[NSMutableDictionary alloc] init];
+        
+        if (! [self.dbMgr selectInto:current withSQL:@"PRAGMA page_size"] ||
+            ! [self.dbMgr selectInto:pageCount withSQL:@"PRAGMA page_count"]) {
+            return NO;
+        }
+        
+        if ([[[current allValues] firstObject] longLongValue] != [pageSize longLongValue]) {
+            
+            NSString* pageSizeStmt = [NSString stringWithFormat:@"PRAGMA page_size = %lld", [pageSize longLongValue]];
+            
+            //A new page size only applies to a file that has no pages yet, existing files are rebuilt
+            if (! [self.dbMgr execute:pageSizeStmt] ||
+                ([[[pageCount allValues] firstObject] longLongValue] > 0 && ! [self.dbMgr execute:@"VACUUM"])) {
+                
+                NSLog(@"Failed to change page size, message: %@", [self.dbMgr lastErrorMsg]);
+                return NO;
+            }
+        }
+    }
+    
+    if (mmapSize != nil) {
+        
+        //Returns the size that was set as a row
+        NSMutableDictionary* result = [[NSMutableDictionary alloc] init];
+        NSString* mmapStmt = [NSString stringWithFormat:@"PRAGMA mmap_size = %lld", [mmapSize longLongValue]];
+        
+        if (! [self.dbMgr selectInto:result withSQL:mmapStmt]) {
+            
+            NSLog(@"Failed to set mmap size, message: %@", [self.dbMgr lastErrorMsg]);
+            return NO;
+        }
+    }
+    
+    if (cacheSize != nil) {
+        
+        //A negative cache_size is in KiB instead of pages, so it does not depend on the page size
+        NSString* cacheStmt = [NSString stringWithFormat:@"PRAGMA cache_size = -%lld", MAX([cacheSize longLongValue] / 1024, 1)];
+        
+        if (! [self.dbMgr execute:cacheStmt]) {
+            
+            NSLog(@"Failed to set cache size, message: %@", [self.dbMgr lastErrorMsg]);
+            return NO;
+        }
+    }
+    
+    return YES;
+}
+
+-(NSArray*) warmUpStatementsForCollection:(NSString*) collection
+                             searchFields:(NSArray*) searchFields
+{
+    NSMutableArray* statements = [[NSMutableArray alloc] init];
+    NSMutableArray* columns = [[NSMutableArray alloc] init];
+    
+    for (NSString* searchField in searchFields) {
+        [columns addObject:[NSString stringWithFormat:@"[%@]", searchField]];
+    }
+    
+    //Search fields are columns of the collection table, a scan reads them without depending on an index
+    if ([columns count]) {
+        [columns insertObject:JSON_STORE_FIELD_ID atIndex:0];
+        [statements addObject:[NSString stringWithFormat:@"select %@ from '%@' where %@ < ? order by %@ desc limit %d",
+                               [columns componentsJoinedByString:@", "], collection,
+                               JSON_STORE_FIELD_ID, JSON_STORE_FIELD_ID, JSON_STORE_WARM_UP_CHUNK_ROWS]];
+    }
+    
+    //Newest documents first, they are the ones most likely to be read again
+    [statements addObject:[NSString stringWithFormat:@"select %@, %@ from '%@' where %@ < ? order by %@ desc limit %d",
+                           JSON_STORE_FIELD_ID, [self _jsonColumnForCollection:collection], collection,
+                           JSON_STORE_FIELD_ID, JSON_STORE_FIELD_ID, JSON_STORE_WARM_UP_CHUNK_ROWS]];
+    
+    return statements;
+}
+
+-(int) readIntoCache:(NSString*) sql
+              belowId:(long long*) lastId
+         memoryBudget:(NSUInteger) budget
+           shouldStop:(BOOL (^)(void)) shouldStop
+{
+    NSUInteger capacity = [self _pageCacheCapacity];
+    
+    //Without the size of the page cache there is no way to tell when reading more only evicts what was read
+    if (capacity == 0) {
+        NSLog(@"Skipping page cache warm-up, unable to read the page cache size, message: %@", [self.dbMgr lastErrorMsg]);
+        return 0;
+    }
+    
+    budget = MIN(budget, capacity);
+    
+    int rows = [self.dbMgr readIntoCache:sql belowId:lastId memoryBudget:budget shouldStop:shouldStop];
+    
+    if (rows < 0) {
+        NSLog(@"Failed to read into page cache, statement: %@, message: %@", sql, [self.dbMgr lastErrorMsg]);
+    }
+    
+    return rows;
+}
+
+-(NSDictionary*) cacheStatus
+{
+    return [self.dbMgr cacheStatus];
+}
+
+-(JSONStoreBlobStore*) blobStore
+{
+    if (! _blobStore && self.dbMgr != nil) {
+        
+        NSString* folder = [self.username stringByAppendingString:JSON_STORE_BLOB_FOLDER_EXTENSION];
+        
+        _blobStore = [[JSONStoreBlobStore alloc] initWithDirectory:[[self.dbMgr getJsonStoreDirectoryPath] stringByAppendingPathComponent:folder]];
+        [JSONStoreDocumentCodec setBlobStore:_blobStore];
+    }
+    
+    return _blobStore;
+}
+
+-(BOOL) setDatabaseKey:(NSData*)encKey
+{
+    BOOL worked = NO;
+
+    if (encKey != nil && [encKey length] > 0) {
+
+        if (!self.dbHasBeenKeyed) {
+
+            if (self.dbMgr == nil) {
+                id sqlite = [NSClassFromString(@"SQLCipherDatabase")alloc];
+                self.dbMgr = [sqlite performSelector:NSSelectorFromString(@"initWithUserName:") withObject:self.username];
+            }
+
+            worked = [JSONStoreSQLLite _keyDatabase:self.dbMgr withKey:encKey];
+
+            if (worked) {
+
+                BOOL queryWorked = [self _checkSetKeyWorked];
+
+                if (queryWorked) {
+                    self.dbHasBeenKeyed = YES;
+                    
+                    //Kept for the files attached to this connection, side files use the same data protection key
+                    self.databaseKeyData = [encKey mutableCopy];
+                    self.blobStore.key = self.databaseKeyData;
+                }
+            }
+        } else {
+
+            //User gave us a good PW, but we've already keyed, so return true and no-op
+            worked = YES;
+        }
+    }
+    return  worked;
+}
+
+-(BOOL) isOpen
+{
+    return self.dbMgr != nil;
+}
+
+-(BOOL) close
+{
+    BOOL closed = [self.dbMgr closeDB];
+    self.dbMgr = nil;
+    self.dbHasBeenKeyed = NO;
+    
+    //The blob store shares the bytes, zeroing them clears its key too
+    [self.databaseKeyData resetBytesInRange:NSMakeRange(0, [self.databaseKeyData length])];
+    self.databaseKeyData = nil;
+    _blobStore.key = nil;
+    
+    self.jsonFunctionsAvailable = nil;
+    self.jsonPathUses = nil;
+    self.storageFlags = nil;
+    self.compressionDictionaries = nil;
+    self.externalStorageThresholds = nil;
+    self.transactionInProgress = NO;
+    self.attachedCollections = nil;
+    self.catalog = nil;
+    self.blobStore = nil;
+    [JSONStoreDocumentCodec setBlobStore:nil];
+    return closed;
+}
+
+-(BOOL) isStoreEncrypted
+{
+    NSData* searchData = [@"sqlite" dataUsingEncoding:NSUTF8StringEncoding];
+    
+    NSString* path = [self.dbMgr getDbFilePath];
+    
+    NSData* fileData = [NSData dataWithContentsOfFile:path];
+    
+    NSRange locatedRange = [fileData rangeOfData:searchData
+                                         options:NSDataSearchBackwards
+                                           range:NSMakeRange(0, [fileData length])];
+    
+    if (locatedRange.location == NSNotFound) {
+        
+        return YES;
+        
+    } else {
+        
+        return NO;
+    }
+}
+
+#pragma mark Helpers
+
+-(BOOL) _checkSetKeyWorked
+{
+    NSMutableDictionary* checkDict = [NSMutableDictionary new];
+    BOOL worked = [self.dbMgr selectInto:checkDict withSQL:@"select count(*) from sqlite_master;"];
+    return worked;
+}
+
++(BOOL) _keyDatabase:(id) dbMgr
+             withKey:(NSData*) key
+{
+    BOOL worked = NO;
+    NSMutableData* pragmaText = jsonStoreKeyText(@"PRAGMA key = \"x'", key, @"'\";");
+    
+    @autoreleasepool {
+        
+        //Shares the bytes of the text instead of copying the key
+        NSString* pragmaKey = [[NSString alloc] initWithBytesNoCopy:[pragmaText mutableBytes]
+                                                             length:[pragmaText length]
+                                                           encoding:NSUTF8StringEncoding
+                                                       freeWhenDone:NO];
+        
+        worked = [dbMgr execute:pragmaKey];
+    }
+    
+    [pragmaText resetBytesInRange:NSMakeRange(0, [pragmaText length])];
+    
+    return worked;
+}
+
++(NSDictionary*) _getJsonToSqlSchemaDict{
+    //SQLLite types taken from here: http://www.sqlite.org/datatype3.html
+    //JSON types taken from here: http://tools.ietf.org/html/draft-zyp-json-schema-03#section-5.1
+    //Note: No object or array b/c we say you can't index those.
+    
+    return @{ @"string" : @"TEXT",
+              @"number" : @"REAL",
+              @"integer" : @"INTEGER",
+              @"boolean" : @"INTEGER"};
+}
+
+
+- (NSString *)_schemaFromDict:(NSDictionary *)schema
+{
+    
+    NSDictionary* mapper = [JSONStoreSQLLite _getJsonToSqlSchemaDict];
+    
+    NSMutableString* retVal = [NSMutableString stringWithString:@""];
+    [schema enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+        
+        [retVal appendFormat:@" '%@' %@,", key, [mapper objectForKey:obj]];
+    }];
+    
+    return retVal;
+}
+
+-(NSString*)_queryFromDict:(NSDictionary *)query
+                 delimiter:(NSString *)delimiter
+                     exact:(BOOL)exact
+{
+    __strong NSMutableArray *retArray = [NSMutableArray new];
+    
+    [query enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+        
+        if (! exact) {
+            
+            [retArray addObject:[NSString stringWithFormat:@"[%@] LIKE \"%%%@%%\"", key, obj]];
+            
+        } else {
+            /*
+             (
+             [customers.fn] =  "carlos"
+             or [customers.fn] like "%-@-carlos-@-%"
+             or [customers.fn] like "%-@-carlos"
+             or [customers.fn] like "carlos-@-%"
+             )
+             */
+            NSString* exactMatch = @"( [%@] = \"%@\"  or [%@] LIKE \"%%-@-%@-@-%%\" or [%@] LIKE \"%%-@-%@\" or [%@] LIKE \"%@-@-%%\" )";
+            [retArray addObject:[NSString stringWithFormat:exactMatch, key, obj, key, obj, key, obj, key, obj]];
+        }
+    }];
+    
+    NSString *retVal = [retArray componentsJoinedByString:[NSString stringWithFormat:@" %@ ", delimiter]];
+    
+    return retVal;
+}
+
+-(NSString*) _selectStatement:(NSArray*) filter
+                  inCollection:(NSString*) collection
+{
+    if (filter == nil || [filter count] == 0) {
+        
+        //Default select columns
+        return [NSString stringWithFormat:@"[_id], %@ AS [json]", [self _jsonColumnForCollection:collection]];
+        
+    }
+    
+    NSString* last = [filter lastObject];
+    
+    NSMutableString* mutableSelectStmt = [[NSMutableString alloc] init];
+    
+    for (NSString* str in filter) {
+        if ([str isEqualToString:JSON_STORE_FIELD_JSON]) {
+            [mutableSelectStmt appendString:[NSString stringWithFormat:@"%@ AS [json]", [self _jsonColumnForCollection:collection]]];
+        } else {
+            [mutableSelectStmt appendString:[NSString stringWithFormat:@"[%@]", str]];
+        }
+        if (str != last) {
+            [mutableSelectStmt appendString:@", "];
+        }
+    }
+    
+    return [NSString stringWithString:mutableSelectStmt];
+}
+
+-(NSMutableArray*) _selectAllWithSQL:(NSString*) sql
+                          parameters:(NSArray*) parameters
+                        inCollection:(NSString*) collection
+{
+    NSMutableArray* results = [self.queryCache resultsForCollection:collection withSQL:sql parameters:parameters];
+    
+    if (results != nil) {
+        return results;
+    }
+    
+    results = [[NSMutableArray alloc] init];
+    
+    if (! [self.dbMgr selectAllInto:results withSQL:sql, parameters]) {
+        return nil;
+    }
+    
+    [self.queryCache setResults:results forCollection:collection withSQL:sql parameters:parameters];
+    
+    return results;
+}
+
+-(NSString*) _selectStatementForProjection:(NSArray*) projection
+                                withFilter:(NSArray*) filter
+                              inCollection:(NSString*) collection
+                                inDatabase:(BOOL) inDatabase
+{
+    NSMutableArray* columns = [[NSMutableArray alloc] init];
+    
+    if ([filter count] == 0) {
+        [columns addObject:@"[_id]"];
+    }
+    
+    for (NSString* str in filter) {
+        if (! [str isEqualToString:JSON_STORE_FIELD_JSON]) {
+            [columns addObject:[NSString stringWithFormat:@"[%@]", str]];
+        }
+    }
+    
+    if (! inDatabase) {
+        [columns addObject:[NSString stringWithFormat:@"%@ AS [json]", [self _jsonColumnForCollection:collection]]];
+        return [columns componentsJoinedByString:@", "];
+    }
+    
+    NSMutableArray* pairs = [[NSMutableArray alloc] init];
+    
+    for (NSString* path in projection) {
+        [pairs addObject:[NSString stringWithFormat:@"'%@', %@", path, [self _jsonProjectionForPath:path inCollection:collection]]];
+    }
+    
+    [columns addObject:[NSString stringWithFormat:@"json_object(%@) AS [json]", [pairs componentsJoinedByString:@", "]]];
+    
+    return [columns componentsJoinedByString:@", "];
+}
+
+-(NSString*) _documentTextForCollection:(NSString*) collection
+{
+    NSString* json = [self _jsonColumnForCollection:collection];
+    
+    if ([self storageFlagsForCollection:collection] & ~JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE) {
+        return [NSString stringWithFormat:@"%@(%@)", JSON_STORE_DOCUMENT_JSON_FUNCTION, json];
+    }
+    
+    //JSON1 functions reject BLOB arguments, the json column holds UTF-8 text
+    return [NSString stringWithFormat:@"CAST(%@ AS TEXT)", json];
+}
+
+-(NSUInteger) _pageCacheCapacity
+{
+    NSMutableDictionary* cacheSize = [[NSMutableDictionary alloc] init];
+    NSMutableDictionary* pageSize = [[NSMutableDictionary alloc] init];
+    
+    if (! [self.dbMgr selectInto:cacheSize withSQL:@"PRAGMA cache_size"] ||
+        ! [self.dbMgr selectInto:pageSize withSQL:@"PRAGMA page_size"]) {
+        return 0;
+    }
+    
+    long long pages = [[[cacheSize allValues] firstObject] longLongValue];
+    
+    //A negative cache_size is in KiB instead of pages
+    if (pages < 0) {
+        return (NSUInteger) (-pages * 1024);
+    }
+    
+    return (NSUInteger) (pages * [[[pageSize allValues] firstObject] longLongValue]);
+}
+
+-(BOOL) _hasDocumentsTableForCollection:(NSString*) collection
+{
+    return ([self storageFlagsForCollection:collection] & JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE) != 0;
+}
+
+-(NSString*) _documentsTableForCollection:(NSString*) collection
+{
+    return [collection stringByAppendingString:JSON_STORE_DOCUMENTS_TABLE_SUFFIX];
+}
+
+-(NSString*) _jsonColumnForCollection:(NSString*) collection
+{
+    if (! [self _hasDocumentsTableForCollection:collection]) {
+        return @"[json]";
+    }
+    
+    //Correlated subquery, so the documents table is only read for the rows that are returned
+    return [NSString stringWithFormat:@"(select [json] from '%@' where _id = [%@]._id)",
+            [self _documentsTableForCollection:collection], collection];
+}
+
+-(NSString*) _schemaForCollection:(NSString*) collection
+{
+    if (self.attachedCollections[collection] == nil) {
+        return @"main";
+    }
+    
+    return [collection stringByAppendingString:JSON_STORE_COLLECTION_SCHEMA_SUFFIX];
+}
+
+-(NSString*) _fileForCollection:(NSString*) collection
+{
+    NSString* folder = [self.username stringByAppendingString:JSON_STORE_COLLECTION_FOLDER_EXTENSION];
+    
+    return [[[self.dbMgr getJsonStoreDirectoryPath] stringByAppendingPathComponent:folder]
+            stringByAppendingPathComponent:[collection stringByAppendingString:JSON_STORE_DB_FILE_EXTENSION]];
+}
+
+-(BOOL) _attachFile:(NSString*) path
+         withSchema:(NSString*) schema
+          encrypted:(BOOL) encrypted
+{
+    BOOL worked = NO;
+    
+    if (self.isEncrypt && encrypted) {
+        
+        //Without the key the file would silently be created unencrypted
+        if ([self.databaseKeyData length] == 0) {
+            NSLog(@"Unable to attach encrypted file: %@, the store has not been keyed", schema);
+            return NO;
+        }
+        
+        NSString* attachStmt = [NSString stringWithFormat:@"ATTACH DATABASE ? AS [%@] KEY ?", schema];
+        NSMutableData* keyText = jsonStoreKeyText(@"x'", self.databaseKeyData, @"'");
+        
+        @autoreleasepool {
+            
+            //Shares the bytes of the text instead of copying the key
+            NSString* keyArgument = [[NSString alloc] initWithBytesNoCopy:[keyText mutableBytes]
+                                                                   length:[keyText length]
+                                                                 encoding:NSUTF8StringEncoding
+                                                             freeWhenDone:NO];
+            
+            worked = [self.dbMgr execute:attachStmt, @[path, keyArgument]];
+        }
+        
+        [keyText resetBytesInRange:NSMakeRange(0, [keyText length])];
+        
+    } else if (self.isEncrypt) {
+        
+        //An empty key leaves the attached file unencrypted
+        NSString* attachStmt = [NSString stringWithFormat:@"ATTACH DATABASE ? AS [%@] KEY ?", schema];
+        
+        worked = [self.dbMgr execute:attachStmt, @[path, @""]];
+        
+    } else {
+        
+        NSString* attachStmt = [NSString stringWithFormat:@"ATTACH DATABASE ? AS [%@]", schema];
+        
+        worked = [self.dbMgr execute:attachStmt, @[path]];
+    }
+    
+    if (! worked) {
+        NSLog(@"Unable to attach file: %@, message: %@", schema, [self.dbMgr lastErrorMsg]);
+    }
+    
+    return worked;
+}
+
+-(BOOL) _removeFileForCollection:(NSString*) collection
+{
+    NSString* detachStmt = [NSString stringWithFormat:@"DETACH DATABASE [%@]", [self _schemaForCollection:collection]];
+    NSString* path = self.attachedCollections[collection][@"path"];
+    NSError* error = nil;
+    
+    if (! [self.dbMgr execute:detachStmt]) {
+        NSLog(@"Unable to detach file for collection: %@, message: %@", collection, [self.dbMgr lastErrorMsg]);
+        return NO;
+    }
+    
+    [self.attachedCollections removeObjectForKey:collection];
+    
+    if (! [[NSFileManager defaultManager] removeItemAtPath:path error:&error]) {
+        NSLog(@"Unable to remove file for collection: %@, error: %@", collection, error);
+        return NO;
+    }
+    
+    return YES;
+}
+
+-(BOOL) _recreateFileForCollection:(NSString*) collection
+{
+    NSString* schema = [self _schemaForCollection:collection];
+    NSDictionary* file = self.attachedCollections[collection];
+    NSString* path = file[@"path"];
+    BOOL encrypted = [file[@"encrypted"] boolValue];
+    
+    //The new file is built next to the old one, so a failure leaves the collection as it was
+    NSString* newPath = [path stringByAppendingString:@".new"];
+    NSString* newSchema = [schema stringByAppendingString:@"_new"];
+    
+    //Tables first, indexes and triggers are created on them
+    NSString* selectStmt = [NSString stringWithFormat:@"select sql from [%@].sqlite_master where sql is not null and name not like 'sqlite_%%' order by type = 'table' desc", schema];
+    NSMutableArray* rows = [[NSMutableArray alloc] init];
+    
+    //A file left by a crash in the middle of a rebuild is never attached as the collection
+    [[NSFileManager defaultManager] removeItemAtPath:newPath error:nil];
+    
+    if (! [self.dbMgr selectAllInto:rows withSQL:selectStmt] ||
+        ! [self _attachFile:newPath withSchema:newSchema encrypted:encrypted]) {
+        
+        [[NSFileManager defaultManager] removeItemAtPath:newPath error:nil];
+        return NO;
+    }
+    
+    //SQLite keeps create statements without the schema, it is put back so they run against the new file
+    NSRegularExpression* createExpr = [NSRegularExpression regularExpressionWithPattern:@"^CREATE (TABLE|INDEX|TRIGGER) "
+                                                                                options:NSRegularExpressionCaseInsensitive
+                                                                                  error:nil];
+    NSString* template = [NSString stringWithFormat:@"CREATE $1 [%@].", [NSRegularExpression escapedTemplateForString:newSchema]];
+    BOOL worked = YES;
+    
+    for (NSDictionary* row in rows) {
+        
+        NSString* sql = row[@"sql"];
+        NSString* createStmt = [createExpr stringByReplacingMatchesInString:sql options:0 range:NSMakeRange(0, [sql length]) withTemplate:template];
+        
+        if (! [self.dbMgr execute:createStmt]) {
+            NSLog(@"Unable to recreate collection: %@, message: %@", collection, [self.dbMgr lastErrorMsg]);
+            worked = NO;
+            break;
+        }
+    }
+    
+    worked = [self.dbMgr execute:[NSString stringWithFormat:@"DETACH DATABASE [%@]", newSchema]] && worked;
+    worked = worked && [self.dbMgr execute:[NSString stringWithFormat:@"DETACH DATABASE [%@]", schema]];
+    
+    if (! worked) {
+        [[NSFileManager defaultManager] removeItemAtPath:newPath error:nil];
+        return NO;
+    }
+    
+    //rename replaces the old file in one step, the collection is never left without a file
+    BOOL replaced = rename([newPath fileSystemRepresentation], [path fileSystemRepresentation]) == 0;
+    
+    if (! replaced) {
+        NSLog(@"Unable to replace file for collection: %@, errno: %d", collection, errno);
+        [[NSFileManager defaultManager] removeItemAtPath:newPath error:nil];
+    }
+    
+    if (! [self _attachFile:path withSchema:schema encrypted:encrypted]) {
+        [self.attachedCollections removeObjectForKey:collection];
+        return NO;
+    }
+    
+    if (! replaced) {
+        return NO;
+    }
+    
+    //The counts row went with the old file
+    return [self _createCountsForCollection:collection];
+}
+
+-(NSString*) _jsonPathFromKeyPath:(NSString*) keyPath
+{
+    //address.phones.0 -> $."address"."phones"[0]
+    NSMutableString* jsonPath = [NSMutableString stringWithString:@"$"];
+    NSCharacterSet* nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+    
+    for (NSString* segment in [keyPath componentsSeparatedByString:@"."]) {
+        
+        if ([segment length] > 0 && [segment rangeOfCharacterFromSet:nonDigits].location == NSNotFound) {
+            [jsonPath appendFormat:@"[%@]", segment];
+        } else {
+            [jsonPath appendFormat:@".\"%@\"", [segment stringByReplacingOccurrencesOfString:@"\"" withString:@""]];
+        }
+    }
+    
+    return jsonPath;
+}
+
+-(NSString*) _whereClauseForJSONPaths:(NSArray*) jsonPaths
+                         inCollection:(NSString*) collection
+                           parameters:(NSMutableArray*) parameters
+{
+    NSMutableArray* conditions = [[NSMutableArray alloc] init];
+    
+    for (NSDictionary* criteria in jsonPaths) {
+        
+        NSString* path = [criteria allKeys][0];
+        NSArray* symbolAndValue = criteria[path];
+        
+        [self _recordUseOfJSONPath:path inCollection:collection];
+        
+        [conditions addObject:[NSString stringWithFormat:@"%@ %@ ?", [self _jsonExtractForPath:path inCollection:collection], symbolAndValue[0]]];
+        [parameters addObject:symbolAndValue[1]];
+    }
+    
+    return [conditions componentsJoinedByString:@" AND "];
+}
+
+-(NSString*) _jsonExtractForPath:(NSString*) path
+                    inCollection:(NSString*) collection
+{
+    //Query conditions and expression indexes must use the exact same expression for the index to be picked
+    return [NSString stringWithFormat:@"json_extract(%@, '%@')", [self _documentTextForCollection:collection], [self _jsonPathFromKeyPath:path]];
+}
+
+-(NSString*) _jsonProjectionForPath:(NSString*) path
+                       inCollection:(NSString*) collection
+{
+    //json_extract returns booleans as 1 and 0, they are put back as JSON so they decode like the documents do
+    return [NSString stringWithFormat:@"CASE json_type(%@, '%@') WHEN 'true' THEN json('true') WHEN 'false' THEN json('false') ELSE %@ END",
+            [self _documentTextForCollection:collection], [self _jsonPathFromKeyPath:path], [self _jsonExtractForPath:path inCollection:collection]];
+}
+
+-(void) _recordUseOfJSONPath:(NSString*) path
+                inCollection:(NSString*) collection
+{
+    if (self.jsonPathIndexThreshold == nil) {
+        return;
+    }
+    
+    if (! self.jsonPathUses) {
+        self.jsonPathUses = [[NSMutableDictionary alloc] init];
+    }
+    
+    NSString* key = [NSString stringWithFormat:@"%@ %@", collection, path];
+    int uses = [self.jsonPathUses[key] intValue] + 1;
+    self.jsonPathUses[key] = @(uses);
+    
+    //Expression indexes can not read the documents table, and an index on jsonstore_json would make the
+    //schema unreadable to connections that do not register the function, so only JSON text is indexed
+    if (uses != [self.jsonPathIndexThreshold intValue] || [self storageFlagsForCollection:collection] != 0) {
+        return;
+    }
+    
+    //Named after a hash of the path, names built from its characters collide (a.b and a_b)
+    NSString* indexName = [jsonStoreSHA256Hex(path) substringToIndex:16];
+    
+    NSString* createIndex = [NSString stringWithFormat:@"CREATE INDEX IF NOT EXISTS [%@].[%@_json_%@_idx] ON '%@' (%@)",
+                             [self _schemaForCollection:collection], collection, indexName, collection,
+                             [self _jsonExtractForPath:path inCollection:collection]];
+    
+    if (! [self.dbMgr execute:createIndex]) {
+        NSLog(@"Failed to create index for JSON path, collection: %@, path: %@, message: %@", collection, path, [self.dbMgr lastErrorMsg]);
+    }
+}
+
+-(BOOL) _isJSONFunctionsAvailable
+{
+    if (self.jsonFunctionsAvailable == nil) {
+        NSMutableDictionary* checkDict = [NSMutableDictionary new];
+        BOOL available = [self.dbMgr selectInto:checkDict withSQL:@"select json('{}');"];
+        self.jsonFunctionsAvailable = @(available);
+    }
+    
+    return [self.jsonFunctionsAvailable boolValue];
+}
+
+-(BOOL) _isJSONFunctionsAvailableForCollection:(NSString*) collection
+{
+    if (! [self _isJSONFunctionsAvailable]) {
+        return NO;
+    }
+    
+    if (([self storageFlagsForCollection:collection] & ~JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE) == 0) {
+        return YES;
+    }
+    
+    //Connections opened by another database manager may not have the document function
+    NSMutableDictionary* checkDict = [NSMutableDictionary new];
+    NSString* checkStmt = [NSString stringWithFormat:@"select %@(NULL);", JSON_STORE_DOCUMENT_JSON_FUNCTION];
+    
+    return [self.dbMgr selectInto:checkDict withSQL:checkStmt];
+}
+
+-(void) _projectResults:(NSMutableArray*) results
+              withPaths:(NSArray*) projection
+{
+    for (NSMutableDictionary* row in results) {
+        
+        id document = [JSONStoreDocumentCodec objectWithData:row[JSON_STORE_FIELD_JSON]];
+        NSMutableDictionary* projected = [[NSMutableDictionary alloc] init];
+        
+        for (NSString* path in projection) {
+            
+            id value = [JSONStoreSQLLite _valueAtKeyPath:path inObject:document];
+            
+            if (value != nil) {
+                projected[path] = value;
+            }
+        }
+        
+        row[JSON_STORE_FIELD_JSON] = [[projected WLJSONRepresentation] dataUsingEncoding:NSUTF8StringEncoding];
+    }
+}
+
++(id) documentByApplyingMergePatch:(id) mergePatch
+                        toDocument:(id) document
+{
+    if (! [mergePatch isKindOfClass:[NSDictionary class]]) {
+        return mergePatch;
+    }
+    
+    NSMutableDictionary* result = [document isKindOfClass:[NSDictionary class]] ? [document mutableCopy] : [[NSMutableDictionary alloc] init];
+    
+    for (NSString* key in mergePatch) {
+        
+        id value = mergePatch[key];
+        
+        if (value == [NSNull null]) {
+            [result removeObjectForKey:key];
+        } else {
+            result[key] = [JSONStoreSQLLite documentByApplyingMergePatch:value toDocument:result[key]];
+        }
+    }
+    
+    return result;
+}
+
++(id) documentBySettingValues:(NSDictionary*) values
+                   inDocument:(id) document
+{
+    for (NSString* keyPath in values) {
+        document = [JSONStoreSQLLite _document:document bySettingValue:values[keyPath] atPath:[keyPath componentsSeparatedByString:@"."]];
+    }
+    
+    return document;
+}
+
++(id) _document:(id) document
+ bySettingValue:(id) value
+         atPath:(NSArray*) path
+{
+    if (! [path count]) {
+        return value;
+    }
+    
+    NSString* segment = path[0];
+    NSArray* rest = [path subarrayWithRange:NSMakeRange(1, [path count] - 1)];
+    NSCharacterSet* nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+    BOOL index = [segment length] > 0 && [segment rangeOfCharacterFromSet:nonDigits].location == NSNotFound;
+    
+    //Like json_set, array elements are replaced or appended right after the last one, and missing dictionaries are created
+    if ([document isKindOfClass:[NSArray class]] && index && (NSUInteger) [segment integerValue] <= [document count]) {
+        
+        NSMutableArray* result = [document mutableCopy];
+        NSUInteger i = (NSUInteger) [segment integerValue];
+        id child = [JSONStoreSQLLite _document:i < [result count] ? result[i] : nil bySettingValue:value atPath:rest];
+        
+        if (i < [result count]) {
+            result[i] = child;
+        } else {
+            [result addObject:child];
+        }
+        
+        return result;
+    }
+    
+    if (index || (document != nil && ! [document isKindOfClass:[NSDictionary class]])) {
+        return document;
+    }
+    
+    NSMutableDictionary* result = document != nil ? [document mutableCopy] : [[NSMutableDictionary alloc] init];
+    result[segment] = [JSONStoreSQLLite _document:result[segment] bySettingValue:value atPath:rest];
+    
+    return result;
+}
+
++(id) _valueAtKeyPath:(NSString*) keyPath
+             inObject:(id) object
+{
+    NSCharacterSet* nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+    
+    for (NSString* segment in [keyPath componentsSeparatedByString:@"."]) {
+        
+        if ([object isKindOfClass:[NSArray class]]) {
+            
+            if ([segment length] == 0 || [segment rangeOfCharacterFromSet:nonDigits].location != NSNotFound ||
+                [segment integerValue] >= [object count]) {
+                return nil;
+            }
+            
+            object = object[[segment integerValue]];
+            
+        } else if ([object isKindOfClass:[NSDictionary class]]) {
+            
+            object = object[segment];
+            
+        } else {
+            return nil;
+        }
+    }
+    
+    return object;
+}
+
+-(NSString*)_orderByClause:(NSArray*)sort
+{
+    if (! [sort count]) {
+        return @"";
+    }
+    
+    NSMutableString* sortStr = [NSMutableString new];
+    
+    [sortStr appendString:@"ORDER BY "];
+    
+    for (NSDictionary* curr in sort) {
+        
+        NSString* key = [curr allKeys][0];
+        NSString* value = curr[key];
+        
+        [sortStr appendString:[NSString stringWithFormat:@"[%@] %@", key, value]];
+        
+        if (curr != [sort lastObject]) {
+            [sortStr appendString:@", "];
+        }
+    }
+    
+    return sortStr;
+}
+
+-(NSMutableString*) _whereClauseForQueryParts:(NSArray*) queryParts
+                                  inCollection:(NSString*) collection
+                                    parameters:(NSMutableArray*) parameters
+{
+    NSMutableString* whereClauseStr = [[NSMutableString alloc] init];
+    
+    //Only add the where if a query was passed
+    if ([queryParts count]) {
+        [whereClauseStr appendFormat:@"where "];
+    } else {
+        [whereClauseStr appendString:[NSString stringWithFormat:@"where %@", [JSON_STORE_FIELD_DELETED stringByAppendingString:@" = 0"]]];
+    }
+    
+    NSMutableArray* allQueryParts = [[NSMutableArray alloc] init];
+    
+    for (JSONStoreQueryPart* queryPart in queryParts) {
+        
+        NSMutableArray* singleQueryPart = [[NSMutableArray alloc] init];
+        
+        //LessThan
+        NSString* lessThanStr = [self _whereClauseDictWithSymbol:@"<" andArray:queryPart._lessThan];
+        if ([lessThanStr length]) {
+            [singleQueryPart addObject:lessThanStr];
+        }
+        
+        //lessOrEqualThan
+        NSString* lessOrEqualThanStr = [self _whereClauseDictWithSymbol:@"<=" andArray:queryPart._lessOrEqualThan];
+        if ([lessOrEqualThanStr length]) {
+            [singleQueryPart addObject:lessOrEqualThanStr];
+        }
+        
+        //greaterThan
+        NSString* greaterThanStr = [self _whereClauseDictWithSymbol:@">" andArray:queryPart._greaterThan];
+        if ([greaterThanStr length]) {
+            [singleQueryPart addObject:greaterThanStr];
+        }
+        
+        //greaterOrEqualThan
+        NSString* greaterOrEqualThanStr = [self _whereClauseDictWithSymbol:@">=" andArray:queryPart._greaterOrEqualThan];
+        if ([greaterOrEqualThanStr length]) {
+            [singleQueryPart addObject:greaterOrEqualThanStr];
+        }
+        
+        //like
+        NSString* likeStr = [self _whereClauseWithStrFormat:@"[%@] LIKE '%%%@%%'" andArray:queryPart._like exact:NO];
+        if([likeStr length]) {
+            [singleQueryPart addObject:likeStr];
+        }
+        
+        //not like
+        NSString* notLikeStr = [self _whereClauseWithStrFormat:@"[%@] NOT LIKE '%%%@%%'" andArray:queryPart._notLike exact:NO];
+        if([notLikeStr length]) {
+            [singleQueryPart addObject:notLikeStr];
+        }
+        
+        //rightLike
+        NSString* rightLikeStr = [self _whereClauseWithStrFormat:@"[%@] LIKE '%@%%\'" andArray:queryPart._rightLike exact:NO];
+        if ([rightLikeStr length]) {
+            [singleQueryPart addObject:rightLikeStr];
+        }
+        
+        //not rightLike
+        NSString* notRightLikeStr = [self _whereClauseWithStrFormat:@"[%@] NOT LIKE '%@%%\'" andArray:queryPart._notRightLike exact:NO];
+        if ([notRightLikeStr length]) {
+            [singleQueryPart addObject:notRightLikeStr];
+        }
+        
+        //leftLike
+        NSString* leftLikeStr = [self _whereClauseWithStrFormat:@"[%@] LIKE '%%%@'" andArray:queryPart._leftLike exact:NO];
+        if ([leftLikeStr length]) {
+            [singleQueryPart addObject:leftLikeStr];
+        }
+        
+        //notLeftLike
+        NSString* notLeftLikeStr = [self _whereClauseWithStrFormat:@"[%@] NOT LIKE '%%%@'" andArray:queryPart._notLeftLike exact:NO];
+        if ([notLeftLikeStr length]) {
+            [singleQueryPart addObject:notLeftLikeStr];
+        }
+        
+        //equal
+        NSString* equalStr = [self _whereClauseWithStrFormat:@"( [%@] = '%@' OR [%@] LIKE '%%-@-%@-@-%%' OR [%@] LIKE '%%-@-%@' OR [%@] LIKE '%@-@-%%' )" andArray:queryPart._equal exact:YES];
+        if ([equalStr length]) {
+            [singleQueryPart addObject:equalStr];
+        }
+        
+        //notEqual
+        NSString* notEqualStr = [self _whereClauseWithStrFormat:@"( [%@] != '%@' AND [%@] NOT LIKE '%%-@-%@-@-%%' AND [%@] NOT LIKE '%%-@-%@' AND [%@] NOT LIKE '%@-@-%%' )" andArray:queryPart._notEqual exact:YES];
+        if ([notEqualStr length]) {
+            [singleQueryPart addObject:notEqualStr];
+        }
+        
+        //in
+        NSString* inStr = [self _whereClauseInWithArray:queryPart._inside not:NO];
+        if ([inStr length]) {
+            [singleQueryPart addObject:inStr];
+        }
+        
+        //not in
+        NSString* notInStr = [self _whereClauseInWithArray:queryPart._notInside not:YES];
+        if ([notInStr length]) {
+            [singleQueryPart addObject:notInStr];
+        }
+        
+        //between
+        NSString* betweenStr = [self _whereClauseBetweenWithArray:queryPart._between not:NO];
+        if ([betweenStr length]) {
+            [singleQueryPart addObject:betweenStr];
+        }
+        
+        //not between
+        NSString* notBetweenStr = [self _whereClauseBetweenWithArray:queryPart._notBetween not:YES];
+        if ([notBetweenStr length]) {
+            [singleQueryPart addObject:notBetweenStr];
+        }
+        
+        //ids
+        NSString* idsStr = [self _whereClauseForMultipleIds:queryPart._ids];
+        if ([idsStr length]) {
+            [singleQueryPart addObject:idsStr];
+        }
+        
+        //json paths
+        NSString* jsonPathStr = [self _whereClauseForJSONPaths:queryPart._jsonPath inCollection:collection parameters:parameters];
+        if ([jsonPathStr length]) {
+            [singleQueryPart addObject:jsonPathStr];
+        }
+        
+        [singleQueryPart addObject:[JSON_STORE_FIELD_DELETED stringByAppendingString:@" = 0"]];
+        
+        [allQueryParts addObject:[singleQueryPart componentsJoinedByString:@" AND "]];
+    }
+    
+    if ([allQueryParts count]) {
+        [whereClauseStr appendFormat:@"%@", [allQueryParts componentsJoinedByString:@" OR "]];
+    }
+    
+    return whereClauseStr;
+}
+
+-(NSString*) _orderByClauseForKeyset:(NSArray*) sort
+{
+    //_id breaks ties so that (sort key, _id) identifies a single position in the result
+    NSString* idOrder = [NSString stringWithFormat:@"[%@] %@", JSON_STORE_FIELD_ID, JSON_STORE_KEY_ASC];
+    
+    if (! [sort count]) {
+        return [NSString stringWithFormat:@"ORDER BY %@", idOrder];
+    }
+    
+    return [NSString stringWithFormat:@"%@, %@", [self _orderByClause:sort], idOrder];
+}
+
+-(NSString*) _selectStatementForKeyset:(NSArray*) sort
+{
+    NSMutableString* selectStr = [NSMutableString new];
+    
+    for (int i = 0; i < (int)[sort count]; i++) {
+        [selectStr appendFormat:@", [%@] AS [%@%d]", [sort[i] allKeys][0], JSON_STORE_PAGE_COLUMN_PREFIX, i];
+    }
+    
+    [selectStr appendFormat:@", [%@] AS [%@id]", JSON_STORE_FIELD_ID, JSON_STORE_PAGE_COLUMN_PREFIX];
+    
+    return selectStr;
+}
+
+-(NSString*) _whereClauseForKeyset:(NSArray*) sort
+                       afterValues:(NSArray*) values
+                        parameters:(NSMutableArray*) parameters
+{
+    //Expands (k1, k2, ..., _id) > (v1, v2, ..., id) honoring the direction of every sort key.
+    //NULL sorts first, so it is the smallest value ascending and the largest descending.
+    NSMutableArray* disjuncts = [NSMutableArray new];
+    NSMutableArray* equalities = [NSMutableArray new];
+    NSMutableArray* equalityParams = [NSMutableArray new];
+    
+    for (int i = 0; i <= (int)[sort count]; i++) {
+        
+        NSString* key = i < (int)[sort count] ? [sort[i] allKeys][0] : JSON_STORE_FIELD_ID;
+        NSString* direction = i < (int)[sort count] ? sort[i][key] : JSON_STORE_KEY_ASC;
+        id value = values[i];
+        BOOL isNull = (value == [NSNull null]);
+        BOOL descending = [direction caseInsensitiveCompare:JSON_STORE_KEY_DESC] == NSOrderedSame;
+        
+        NSString* after = nil;
+        
+        if (isNull) {
+            after = descending ? nil : [NSString stringWithFormat:@"[%@] IS NOT NULL", key];
+        } else if (descending) {
+            after = [NSString stringWithFormat:@"( [%@] < ? OR [%@] IS NULL )", key, key];
+        } else {
+            after = [NSString stringWithFormat:@"[%@] > ?", key];
+        }
+        
+        if (after != nil) {
+            
+            [equalities addObject:after];
+            [disjuncts addObject:[NSString stringWithFormat:@"( %@ )", [equalities componentsJoinedByString:@" AND "]]];
+            [equalities removeLastObject];
+            
+            [parameters addObjectsFromArray:equalityParams];
+            
+            if (! isNull) {
+                [parameters addObject:value];
+            }
+        }
+        
+        [equalities addObject:isNull ? [NSString stringWithFormat:@"[%@] IS NULL", key] : [NSString stringWithFormat:@"[%@] = ?", key]];
+        
+        if (! isNull) {
+            [equalityParams addObject:value];
+        }
+    }
+    
+    return [NSString stringWithFormat:@"( %@ )", [disjuncts count] ? [disjuncts componentsJoinedByString:@" OR "] : @"0"];
 }
 
--(BOOL) markClean: (int) docId
-     inCollection: (NSString*) collection
-     forOperation: (NSString*) operation
+-(NSString*) _nextPageTokenFromResults:(NSMutableArray*) results
+                               forSort:(NSArray*) sort
+                                 limit:(int) limit
 {
-    if ([operation isEqualToString:JSON_STORE_OP_DELETE]) {
-        
-        return [self deleteFromCollection:collection withDocId:docId] > 0;
-        
-    } else {
-        
-        NSDictionary* setClauseDict = @{ JSON_STORE_FIELD_DIRTY : @0,
-                                         JSON_STORE_FIELD_DELETED: @0,
-                                         JSON_STORE_FIELD_OPERATION: @"" };
+    NSMutableArray* pageValues = nil;
+    
+    if ((int)[results count] >= limit) {
         
-        NSString* setClauseStr =[self _queryFromDict:setClauseDict delimiter:@", "];
-        NSString* whereClauseStr = [self _whereClauseForId:docId];
+        NSDictionary* last = [results lastObject];
+        pageValues = [NSMutableArray new];
         
-        NSString* updateStmt = [NSString stringWithFormat:@"update '%@' set %@ where %@",
-                                collection, setClauseStr, whereClauseStr];
+        for (int i = 0; i < (int)[sort count]; i++) {
+            id value = last[[NSString stringWithFormat:@"%@%d", JSON_STORE_PAGE_COLUMN_PREFIX, i]];
+            [pageValues addObject:value != nil ? value : [NSNull null]];
+        }
         
-        BOOL worked = [self.dbMgr update:updateStmt, [setClauseDict allValues]] > 0;
+        [pageValues addObject:@([last[[JSON_STORE_PAGE_COLUMN_PREFIX stringByAppendingString:@"id"]] longLongValue])];
+    }
+    
+    //The keyset columns are only used to build the token
+    for (NSMutableDictionary* row in results) {
         
-        if (! worked) {
-            NSLog(@"markClean operation failed, collection: %@, docId: %d, operation: %@", collection, docId, operation);
+        for (int i = 0; i < (int)[sort count]; i++) {
+            [row removeObjectForKey:[NSString stringWithFormat:@"%@%d", JSON_STORE_PAGE_COLUMN_PREFIX, i]];
         }
         
-        return worked;
+        [row removeObjectForKey:[JSON_STORE_PAGE_COLUMN_PREFIX stringByAppendingString:@"id"]];
     }
+    
+    return pageValues != nil ? [pageValues WLJSONRepresentation] : nil;
 }
 
--(BOOL) setDatabaseKey:(NSString*)encKey
+-(BOOL) _createCountsForCollection:(NSString*) collection
 {
-    BOOL worked = NO;
-
-    if (encKey != nil && [encKey length] > 0) {
-
-        if (!self.dbHasBeenKeyed) {
-
-            if (self.dbMgr == nil) {
-                id sqlite = [NSClassFromString(@"SQLCipherDatabase")alloc];
-                self.dbMgr = [sqlite performSelector:NSSelectorFromString(@"initWithUserName:") withObject:self.username];
-            }
-
-            NSString* pragmaKey = [NSString stringWithFormat:@"PRAGMA key = \"x'%@'\";", encKey];
-            worked = [self.dbMgr execute:pragmaKey];
-
-            if (worked) {
-
-                BOOL queryWorked = [self _checkSetKeyWorked];
-
-                if (queryWorked) {
-                    self.dbHasBeenKeyed = YES;
-                }
-            }
-        } else {
-
-            //User gave us a good PW, but we've already keyed, so return true and no-op
-            worked = YES;
+    //Live (_deleted = 0) and dirty (_dirty > 0) counts are kept by triggers, so they change in the same
+    //statement, and the same transaction, as the rows they count
+    NSString* live = @"ifnull(%@_deleted = 0, 0)";
+    NSString* dirty = @"ifnull(%@_dirty > 0, 0)";
+    
+    NSString* newLive = [NSString stringWithFormat:live, @"NEW."];
+    NSString* oldLive = [NSString stringWithFormat:live, @"OLD."];
+    NSString* newDirty = [NSString stringWithFormat:dirty, @"NEW."];
+    NSString* oldDirty = [NSString stringWithFormat:dirty, @"OLD."];
+    
+    NSString* updateCounts = [NSString stringWithFormat:@"UPDATE '%@' SET live = live + %%@, dirty = dirty + %%@ WHERE collection = '%@';",
+                              JSON_STORE_COUNTS_TABLE, collection];
+    
+    //Triggers can only change tables in their own file, so a collection kept in its own file has its counts there
+    NSString* schema = [self _schemaForCollection:collection];
+    
+    NSArray* stmts = @[
+        [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS [%@].'%@' (collection TEXT PRIMARY KEY, live INTEGER NOT NULL DEFAULT 0, dirty INTEGER NOT NULL DEFAULT 0)",
+         schema, JSON_STORE_COUNTS_TABLE],
+        
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS [%@].[%@_counts_insert] AFTER INSERT ON '%@' BEGIN %@ END",
+         schema, collection, collection, [NSString stringWithFormat:updateCounts, newLive, newDirty]],
+        
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS [%@].[%@_counts_delete] AFTER DELETE ON '%@' BEGIN %@ END",
+         schema, collection, collection, [NSString stringWithFormat:updateCounts,
+                                          [@"-" stringByAppendingString:oldLive], [@"-" stringByAppendingString:oldDirty]]],
+        
+        [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS [%@].[%@_counts_update] AFTER UPDATE OF _deleted, _dirty ON '%@' BEGIN %@ END",
+         schema, collection, collection, [NSString stringWithFormat:updateCounts,
+                                          [NSString stringWithFormat:@"%@ - %@", newLive, oldLive],
+                                          [NSString stringWithFormat:@"%@ - %@", newDirty, oldDirty]]],
+        
+        //Existing collections are counted once, after that only the triggers change the row
+        [NSString stringWithFormat:@"INSERT OR IGNORE INTO [%@].'%@' (collection, live, dirty) SELECT '%@', ifnull(sum(%@), 0), ifnull(sum(%@), 0) FROM '%@'",
+         schema, JSON_STORE_COUNTS_TABLE, collection, [NSString stringWithFormat:live, @""], [NSString stringWithFormat:dirty, @""], collection]
+    ];
+    
+    for (NSString* stmt in stmts) {
+        if (! [self.dbMgr execute:stmt]) {
+            NSLog(@"Unable to create document counts, collection: %@, message: %@", collection, [self.dbMgr lastErrorMsg]);
+            return NO;
         }
     }
-    return  worked;
-}
-
--(BOOL) isOpen
-{
-    return self.dbMgr != nil;
+    
+    return YES;
 }
 
--(BOOL) close
+-(BOOL) _rewriteDocumentsInCollection:(NSString*) collection
+                            withFlags:(int) flags
+                           dictionary:(NSData*) dictionary
 {
-    BOOL closed = [self.dbMgr closeDB];
-    self.dbMgr = nil;
-    self.dbHasBeenKeyed = NO;
-    return closed;
+    NSString* table = (flags & JSON_STORE_STORAGE_FLAG_SEPARATE_TABLE) ? [self _documentsTableForCollection:collection] : collection;
+    NSString* selectStmt = [NSString stringWithFormat:@"select _id, json from '%@' where _id > ? order by _id limit 500", table];
+    NSString* updateStmt = [NSString stringWithFormat:@"update '%@' set json = ? where _id = ?", table];
+    NSNumber* lastId = @0;
+    
+    while (YES) {
+        
+        NSMutableArray* rows = [[NSMutableArray alloc] init];
+        
+        if (! [self.dbMgr selectAllInto:rows withSQL:selectStmt, @[lastId]]) {
+            return NO;
+        }
+        
+        if (! [rows count]) {
+            return YES;
+        }
+        
+        for (NSDictionary* row in rows) {
+            
+            id document = [JSONStoreDocumentCodec objectWithData:row[JSON_STORE_FIELD_JSON]];
+            NSData* data = document != nil ? [self _dataWithDocument:document inCollection:collection flags:flags dictionary:dictionary] : nil;
+            
+            if (data == nil || [self.dbMgr update:updateStmt, @[data, row[JSON_STORE_FIELD_ID]]] <= 0) {
+                return NO;
+            }
+            
+            NSString* name = [JSONStoreDocumentCodec externalNameWithData:row[JSON_STORE_FIELD_JSON]];
+            
+            if (name != nil) {
+                [self.blobStore removeDataWithName:name];
+            }
+        }
+        
+        lastId = [rows lastObject][JSON_STORE_FIELD_ID];
+    }
 }
 
--(BOOL) isStoreEncrypted
+-(BOOL) _moveDocumentsInCollection:(NSString*) collection
+                  toDocumentsTable:(BOOL) toDocumentsTable
 {
-    NSData* searchData = [@"sqlite" dataUsingEncoding:NSUTF8StringEncoding];
-    
-    NSString* path = [self.dbMgr getDbFilePath];
-    
-    NSData* fileData = [NSData dataWithContentsOfFile:path];
+    NSString* documentsTable = [self _documentsTableForCollection:collection];
+    NSString* schema = [self _schemaForCollection:collection];
+    NSArray* statements = nil;
     
-    NSRange locatedRange = [fileData rangeOfData:searchData
-                                         options:NSDataSearchBackwards
-                                           range:NSMakeRange(0, [fileData length])];
-    
-    if (locatedRange.location == NSNotFound) {
+    if (toDocumentsTable) {
         
-        return YES;
+        //The json column stays in the collection table, NULL takes no space in its rows
+        statements = @[[NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS [%@].'%@' (_id INTEGER PRIMARY KEY, json BLOB)", schema, documentsTable],
+                       [NSString stringWithFormat:@"INSERT OR REPLACE INTO '%@' (_id, json) SELECT _id, json FROM '%@'", documentsTable, collection],
+                       [NSString stringWithFormat:@"UPDATE '%@' SET json = NULL", collection],
+                       [NSString stringWithFormat:@"CREATE TRIGGER IF NOT EXISTS [%@].[%@_delete] AFTER DELETE ON '%@' BEGIN DELETE FROM '%@' WHERE _id = old._id; END",
+                        schema, documentsTable, collection, documentsTable]];
         
     } else {
         
-        return NO;
+        statements = @[[NSString stringWithFormat:@"UPDATE '%@' SET json = (SELECT json FROM '%@' WHERE _id = [%@]._id)", collection, documentsTable, collection],
+                       [NSString stringWithFormat:@"DROP TRIGGER IF EXISTS [%@].[%@_delete]", schema, documentsTable],
+                       [NSString stringWithFormat:@"DROP TABLE IF EXISTS '%@'", documentsTable]];
+    }
+    
+    for (NSString* statement in statements) {
+        if (! [self.dbMgr execute:statement]) {
+            return NO;
+        }
     }
+    
+    return YES;
 }
 
-#pragma mark Helpers
-
--(BOOL) _checkSetKeyWorked
+-(NSData*) _dataWithDocument:(id) document
+                 inCollection:(NSString*) collection
 {
-    NSMutableDictionary* checkDict = [NSMutableDictionary new];
-    BOOL worked = [self.dbMgr selectInto:checkDict withSQL:@"select count(*) from sqlite_master;"];
-    return worked;
+    return [self _dataWithDocument:document
+                      inCollection:collection
+                             flags:[self storageFlagsForCollection:collection]
+                        dictionary:[self compressionDictionaryForCollection:collection]];
 }
 
-+(NSDictionary*) _getJsonToSqlSchemaDict{
-    //SQLLite types taken from here: http://www.sqlite.org/datatype3.html
-    //JSON types taken from here: http://tools.ietf.org/html/draft-zyp-json-schema-03#section-5.1
-    //Note: No object or array b/c we say you can't index those.
+-(NSData*) _dataWithDocument:(id) document
+                inCollection:(NSString*) collection
+                       flags:(int) flags
+                  dictionary:(NSData*) dictionary
+{
+    NSData* data = [JSONStoreDocumentCodec dataWithObject:document flags:flags dictionary:dictionary];
+    NSNumber* threshold = self.externalStorageThresholds[collection];
     
-    return @{ @"string" : @"TEXT",
-              @"number" : @"REAL",
-              @"integer" : @"INTEGER",
-              @"boolean" : @"INTEGER"};
+    if (data == nil || ! (flags & JSON_STORE_STORAGE_FLAG_EXTERNAL) || threshold == nil || [data length] < [threshold unsignedIntegerValue]) {
+        return data;
+    }
+    
+    NSString* name = [self.blobStore writeData:data inCollection:collection];
+    
+    return name != nil ? [JSONStoreDocumentCodec dataWithExternalName:name] : nil;
 }
 
-
-- (NSString *)_schemaFromDict:(NSDictionary *)schema
+-(void) _removeExternalData:(NSData*) data
 {
+    NSString* name = [JSONStoreDocumentCodec externalNameWithData:data];
     
-    NSDictionary* mapper = [JSONStoreSQLLite _getJsonToSqlSchemaDict];
+    if (name == nil) {
+        return;
+    }
     
-    NSMutableString* retVal = [NSMutableString stringWithString:@""];
-    [schema enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
-        
-        [retVal appendFormat:@" '%@' %@,", key, [mapper objectForKey:obj]];
-    }];
+    [self.blobStore removeDataWithName:name];
     
-    return retVal;
+    //Outside a transaction the row is already gone for good
+    if (! self.transactionInProgress) {
+        [self.blobStore commit];
+    }
 }
 
--(NSString*)_queryFromDict:(NSDictionary *)query
-                 delimiter:(NSString *)delimiter
-                     exact:(BOOL)exact
+-(BOOL) _createStorageTable
 {
-    __strong NSMutableArray *retArray = [NSMutableArray new];
-    
-    [query enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
-        
-        if (! exact) {
-            
-            [retArray addObject:[NSString stringWithFormat:@"[%@] LIKE \"%%%@%%\"", key, obj]];
-            
-        } else {
-            /*
-             (
-             [customers.fn] =  "carlos"
-             or [customers.fn] like "%-@-carlos-@-%"
-             or [customers.fn] like "%-@-carlos"
-             or [customers.fn] like "carlos-@-%"
-             )
-             */
-            NSString* exactMatch = @"( [%@] = \"%@\"  or [%@] LIKE \"%%-@-%@-@-%%\" or [%@] LIKE \"%%-@-%@\" or [%@] LIKE \"%@-@-%%\" )";
-            [retArray addObject:[NSString stringWithFormat:exactMatch, key, obj, key, obj, key, obj, key, obj]];
-        }
-    }];
+    NSString* createStmt = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS '%@' (collection TEXT PRIMARY KEY, flags INTEGER NOT NULL DEFAULT 0, dictionary BLOB)", JSON_STORE_STORAGE_TABLE];
     
-    NSString *retVal = [retArray componentsJoinedByString:[NSString stringWithFormat:@" %@ ", delimiter]];
-    
-    return retVal;
+    return [self.dbMgr execute:createStmt];
 }
 
--(NSString*) _selectStatement:(NSArray*) filter
+-(void) _loadStorageForCollection:(NSString*) collection
 {
-    if (filter == nil || [filter count] == 0) {
-        
-        //Default select columns
-        return @"[_id], [json]";
-        
-    }
+    NSString* selectStmt = [NSString stringWithFormat:@"select flags, dictionary from '%@' where collection = ?", JSON_STORE_STORAGE_TABLE];
+    NSMutableDictionary* results = [[NSMutableDictionary alloc] init];
     
-    NSString* last = [filter lastObject];
+    //A missing table or row means the collection was always written as JSON text
+    [self.dbMgr selectInto:results withSQL:selectStmt, @[collection]];
     
-    NSMutableString* mutableSelectStmt = [[NSMutableString alloc] init];
+    NSData* dictionary = [results[@"dictionary"] isKindOfClass:[NSData class]] && [results[@"dictionary"] length] > 0 ? results[@"dictionary"] : nil;
     
-    for (NSString* str in filter) {
-        [mutableSelectStmt appendString:[NSString stringWithFormat:@"[%@]", str]];
-        if (str != last) {
-            [mutableSelectStmt appendString:@", "];
-        }
+    if (! self.storageFlags) {
+        self.storageFlags = [[NSMutableDictionary alloc] init];
     }
     
-    return [NSString stringWithString:mutableSelectStmt];
+    if (! self.compressionDictionaries) {
+        self.compressionDictionaries = [[NSMutableDictionary alloc] init];
+    }
+    
+    self.storageFlags[collection] = @([results[@"flags"] intValue]);
+    
+    if (dictionary != nil) {
+        [JSONStoreDocumentCodec registerDictionary:dictionary];
+        self.compressionDictionaries[collection] = dictionary;
+    } else {
+        [self.compressionDictionaries removeObjectForKey:collection];
+    }
 }
 
--(NSString*)_orderByClause:(NSArray*)sort
+-(BOOL) _dropJSONPathIndexesInCollection:(NSString*) collection
 {
-    if (! [sort count]) {
-        return @"";
-    }
-    
-    NSMutableString* sortStr = [NSMutableString new];
+    //Expression indexes read the document through the old format, they are created again on use
+    NSString* schema = [self _schemaForCollection:collection];
+    NSString* selectStmt = [NSString stringWithFormat:@"select name from [%@].sqlite_master where type = 'index' and tbl_name = ? and sql like '%%json_extract(%%'", schema];
+    NSMutableArray* indexes = [[NSMutableArray alloc] init];
     
-    [sortStr appendString:@"ORDER BY "];
+    if (! [self.dbMgr selectAllInto:indexes withSQL:selectStmt, @[collection]]) {
+        return NO;
+    }
     
-    for (NSDictionary* curr in sort) {
+    for (NSDictionary* index in indexes) {
         
-        NSString* key = [curr allKeys][0];
-        NSString* value = curr[key];
-        
-        [sortStr appendString:[NSString stringWithFormat:@"[%@] %@", key, value]];
+        NSString* dropStmt = [NSString stringWithFormat:@"DROP INDEX IF EXISTS [%@].[%@]", schema, index[@"name"]];
         
-        if (curr != [sort lastObject]) {
-            [sortStr appendString:@", "];
+        if (! [self.dbMgr execute:dropStmt]) {
+            return NO;
         }
     }
     
-    return sortStr;
+    [self.jsonPathUses removeAllObjects];
+    
+    return YES;
+}
+
+-(NSNumber*) _maintainedCount:(NSString*) column
+                 inCollection:(NSString*) collection
+{
+    NSString* selectStmt = [NSString stringWithFormat:@"select %@ from [%@].'%@' where collection = ?",
+                            column, [self _schemaForCollection:collection], JSON_STORE_COUNTS_TABLE];
+    
+    NSMutableDictionary* results = [[NSMutableDictionary alloc] init];
+    
+    if (! [self.dbMgr selectInto:results withSQL:selectStmt, @[collection]] || results[column] == nil) {
+        return nil;
+    }
+    
+    return @([results[column] intValue]);
 }
 
 -(NSString*)_whereClauseNotDeleted:(NSDictionary *)query
@@ -878,6 +2570,70 @@ inCollection:(NSString*) collection
     return retQuery;
 }
 
+-(NSDictionary*) _loadCatalog
+{
+    if (self.catalog != nil) {
+        return self.catalog;
+    }
+    
+    NSString* createStmt = [NSString stringWithFormat:@"CREATE TABLE IF NOT EXISTS '%@' (collection TEXT PRIMARY KEY, version INTEGER NOT NULL, hash TEXT NOT NULL)", JSON_STORE_CATALOG_TABLE];
+    NSString* selectStmt = [NSString stringWithFormat:@"select collection, version, hash from '%@'", JSON_STORE_CATALOG_TABLE];
+    NSMutableArray* rows = [[NSMutableArray alloc] init];
+    
+    //Not kept when it can not be read (e.g. the key is wrong), provision reports why
+    if (! [self.dbMgr execute:createStmt] || ! [self.dbMgr selectAllInto:rows withSQL:selectStmt]) {
+        return nil;
+    }
+    
+    self.catalog = [[NSMutableDictionary alloc] init];
+    
+    for (NSDictionary* row in rows) {
+        
+        //Rows from another catalog version are validated against the table again
+        if ([row[@"version"] intValue] == JSON_STORE_CATALOG_VERSION) {
+            self.catalog[row[@"collection"]] = row[@"hash"];
+        }
+    }
+    
+    return self.catalog;
+}
+
+-(void) _catalogCollection:(NSString*) collection
+                  withHash:(NSString*) schemaHash
+{
+    NSString* insertStmt = [NSString stringWithFormat:@"INSERT OR REPLACE INTO '%@' (collection, version, hash) VALUES (?, ?, ?)", JSON_STORE_CATALOG_TABLE];
+    
+    if ([self.dbMgr execute:insertStmt, @[collection, @(JSON_STORE_CATALOG_VERSION), schemaHash]]) {
+        self.catalog[collection] = schemaHash;
+    }
+}
+
+-(void) _uncatalogCollection:(NSString*) collection
+{
+    NSString* deleteStmt = [NSString stringWithFormat:@"DELETE FROM '%@' WHERE collection = ?", JSON_STORE_CATALOG_TABLE];
+    
+    if ([self.dbMgr execute:deleteStmt, @[collection]]) {
+        [self.catalog removeObjectForKey:collection];
+    }
+}
+
+-(BOOL) _tableExists:(NSString*) table
+            inSchema:(NSString*) schema
+{
+    NSString* selectStmt = [NSString stringWithFormat:@"select count(*) from [%@].sqlite_master where type = 'table' and name = ?", schema];
+    NSMutableDictionary* results = [[NSMutableDictionary alloc] init];
+    
+    return [self.dbMgr selectInto:results withSQL:selectStmt, @[table]] && [results[@"count(*)"] intValue] > 0;
+}
+
++(NSString*) _hashForColumns:(NSString*) indexedColumns
+{
+    //Column order and case do not matter, like in _validateExistingSchemaAgainst:
+    NSArray* columns = [[[indexedColumns uppercaseString] componentsSeparatedByString:@","] sortedArrayUsingSelector:@selector(compare:)];
+    
+    return jsonStoreSHA256Hex([columns componentsJoinedByString:@","]);
+}
+
 -(BOOL) _validateExistingSchemaAgainst:(NSString *) indexedColumns
                                inTable:(NSString *) db
                             withPrefix:(NSString *) createPref
@@ -887,7 +2643,7 @@ inCollection:(NSString*) collection
     
     // Get the create statement used to create the existing table using a special select statement
     NSString* schemaSelect =
-    [NSString stringWithFormat:@"SELECT sql FROM sqlite_master WHERE type='table' AND name = '%@'", db];
+    [NSString stringWithFormat:@"SELECT sql FROM [%@].sqlite_master WHERE type='table' AND name = '%@'", [self _schemaForCollection:db], db];
     
     NSMutableDictionary* resultsDict = [NSMutableDictionary new];
     
@@ -973,6 +2729,27 @@ inCollection:(NSString*) collection
     return [NSString stringWithFormat:@"order by %@", JSON_STORE_FIELD_DIRTY];
 }
 
+-(NSDictionary*) _storedColumns:(NSArray*) searchFields
+                          forId:(int) docId
+                   inCollection:(NSString*) collection
+{
+    NSMutableArray* columns = [NSMutableArray arrayWithObjects:JSON_STORE_FIELD_DELETED, JSON_STORE_FIELD_OPERATION,
+                               JSON_STORE_FIELD_DIRTY, [NSString stringWithFormat:@"%@ AS [json]", [self _jsonColumnForCollection:collection]], nil];
+    
+    for (NSString* searchField in searchFields) {
+        [columns addObject:[NSString stringWithFormat:@"[%@] AS [%@]", searchField, searchField]];
+    }
+    
+    NSString* selectStmt = [NSString stringWithFormat:@"select %@ from '%@' where %@",
+                            [columns componentsJoinedByString:@", "], collection, [self _whereClauseForId:docId]];
+    
+    NSMutableDictionary* resultDict = [NSMutableDictionary new];
+    
+    [self.dbMgr selectInto:resultDict withSQL:selectStmt];
+    
+    return [resultDict count] > 0 ? resultDict : nil;
+}
+
 -(BOOL) _isRemoved:(int) docId
       inCollection:(NSString*) document
 {
@@ -1208,17 +2985,39 @@ inCollection:(NSString*) collection
 
 - (BOOL) startTransaction
 {
-    return  [self.dbMgr startTransaction];
+    BOOL worked = [self.dbMgr startTransaction];
+    
+    if (worked) {
+        self.transactionInProgress = YES;
+    }
+    
+    return worked;
 }
 
 - (BOOL) commitTransaction
 {
-    return  [self.dbMgr commitTransaction];
+    BOOL worked = [self.dbMgr commitTransaction];
+    
+    //Files of removed documents are unlinked once no rollback can bring the rows back
+    if (worked) {
+        self.transactionInProgress = NO;
+        [self.blobStore commit];
+    }
+    
+    return worked;
 }
 
 - (BOOL) rollbackTransaction
 {
-    return [self.dbMgr rollbackTransaction];
+    //Results read inside the transaction can include the changes that are rolled back
+    [self.queryCache removeAllResults];
+    
+    BOOL worked = [self.dbMgr rollbackTransaction];
+    
+    self.transactionInProgress = NO;
+    [self.blobStore rollback];
+    
+    return worked;
 }
 
 @end
@@ -12,6 +12,7 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "JSONStoreOpenOptions.h"
 
 /**
  Contains JSONStore methods to handle security.
@@ -23,6 +24,21 @@
  */
 @property (nonatomic, readonly, strong) NSString* username;
 
+/**
+ Pseudo random function used when the Data Protection Key (DPK) is stored or its password changed.
+ */
+@property (nonatomic) JSONStoreKeyDerivationFunction keyDerivationFunction;
+
+/**
+ Number of iterations used when the DPK is stored or its password changed, nil to use keyDerivationTargetTime.
+ */
+@property (nonatomic, strong) NSNumber* keyDerivationIterations;
+
+/**
+ Seconds one key derivation should take, used to calibrate the iterations when keyDerivationIterations is nil.
+ */
+@property (nonatomic, strong) NSNumber* keyDerivationTargetTime;
+
 /**
  Initialization method.
  @param username User name that is tied to the instance
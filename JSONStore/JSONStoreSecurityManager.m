@@ -115,7 +115,7 @@
     
     NSString* dpk = [storedDict objectForKey:JSON_STORE_KEY_DPK];
     NSString* salt = [storedDict objectForKey:JSON_STORE_KEY_SALT];
-    NSString* pwKey = [self _passwordToKey:password withSalt:salt];
+    NSString* pwKey = [self _passwordToKey:password withSalt:salt parameters:storedDict];
     NSString* iv = [storedDict objectForKey:JSON_STORE_KEY_IV];
     NSString* decryptedKey = [JSONStoreSecurityUtils _decryptWithKey:pwKey
                                                withCipherText:dpk
@@ -223,6 +223,48 @@
                                        andIterations:JSON_STORE_DEFAULT_PBKDF2_ITERATIONS];
 }
 
+-(NSString*) _passwordToKey:(NSString*) password
+                   withSalt:(NSString*) salt
+                 parameters:(NSDictionary*) parameters
+{
+    //Documents stored before the function was configurable have no prf and used SHA1
+    return [JSONStoreSecurityUtils generateKeyWithPassword:password
+                                                   andSalt:salt
+                                             andIterations:[[parameters objectForKey:JSON_STORE_KEY_ITERATIONS] integerValue]
+                                   andPseudoRandomFunction:[[parameters objectForKey:JSON_STORE_KEY_PRF] intValue]];
+}
+
+-(NSDictionary*) _keyDerivationParametersForPassword:(NSString*) password
+                                            withSalt:(NSString*) salt
+                                   currentParameters:(NSDictionary*) current
+{
+    BOOL configured = self.keyDerivationFunction != JSONStore_PBKDF2_SHA1 ||
+                      self.keyDerivationIterations != nil ||
+                      self.keyDerivationTargetTime != nil;
+    
+    if (current != nil && ! configured) {
+        
+        //Nothing was asked for, keep the parameters the DPK is already wrapped with
+        return @{ JSON_STORE_KEY_PRF : [NSNumber numberWithInt:[[current objectForKey:JSON_STORE_KEY_PRF] intValue]],
+                  JSON_STORE_KEY_ITERATIONS : [current objectForKey:JSON_STORE_KEY_ITERATIONS] };
+    }
+    
+    NSInteger iterations = JSON_STORE_DEFAULT_PBKDF2_ITERATIONS;
+    
+    if (self.keyDerivationIterations != nil) {
+        iterations = MAX([self.keyDerivationIterations integerValue], JSON_STORE_DEFAULT_PBKDF2_ITERATIONS);
+        
+    } else if (self.keyDerivationTargetTime != nil) {
+        iterations = [JSONStoreSecurityUtils iterationsForPassword:password
+                                                           andSalt:salt
+                                           andPseudoRandomFunction:self.keyDerivationFunction
+                                                     andTargetTime:[self.keyDerivationTargetTime doubleValue]];
+    }
+    
+    return @{ JSON_STORE_KEY_PRF : [NSNumber numberWithInt:self.keyDerivationFunction],
+              JSON_STORE_KEY_ITERATIONS : [NSNumber numberWithInteger:iterations] };
+}
+
 -(NSMutableDictionary*) _getGenericPwLookupDict:(NSString*) identifier
 {
     
@@ -275,12 +317,13 @@
         
         if (jsonDoc != nil && [jsonDoc isKindOfClass:[NSDictionary class]]) {
             
-            //Ensure the num derivations saved, matches what we have
-            int iters = [[(NSDictionary*) jsonDoc objectForKey:JSON_STORE_KEY_ITERATIONS]intValue];
+            //Ensure the key derivation parameters saved can be used
+            NSInteger iters = [[(NSDictionary*) jsonDoc objectForKey:JSON_STORE_KEY_ITERATIONS] integerValue];
+            int prf = [[(NSDictionary*) jsonDoc objectForKey:JSON_STORE_KEY_PRF] intValue];
             
-            if (iters != JSON_STORE_DEFAULT_PBKDF2_ITERATIONS) {
+            if (iters < 1 || prf < JSONStore_PBKDF2_SHA1 || prf > JSONStore_PBKDF2_SHA512) {
                 
-                NSLog(@"Number of iterations stored, does NOT match the constant value %u", JSON_STORE_DEFAULT_PBKDF2_ITERATIONS);
+                NSLog(@"Key derivation parameters stored are not valid, iterations: %ld, prf: %d", (long) iters, prf);
                 return nil;
             }
             
@@ -333,7 +376,11 @@ dpkRequiresKeyDerivation:(BOOL) dpkRequiresKeyDerivation
         dpk = [self _passwordToKey:clearDPK withSalt:salt];
     }
     
-    NSString* pwKey = [self _passwordToKey:password withSalt:salt];
+    NSDictionary* parameters = [self _keyDerivationParametersForPassword:password
+                                                                withSalt:salt
+                                                       currentParameters:isUpdate ? [self _getDpKDocFromKeyChain] : nil];
+    
+    NSString* pwKey = [self _passwordToKey:password withSalt:salt parameters:parameters];
     
     NSString* hexEncodedIv  = [JSONStoreSecurityUtils generateRandomStringWithBytes:JSON_STORE_DEFAULT_IV_SIZE];
     
@@ -345,7 +392,8 @@ dpkRequiresKeyDerivation:(BOOL) dpkRequiresKeyDerivation
     NSDictionary* jsonEntriesDict = @{ JSON_STORE_KEY_IV : hexEncodedIv,
                                        JSON_STORE_KEY_SALT : salt,
                                        JSON_STORE_KEY_DPK : encyptedDPK,
-                                       JSON_STORE_KEY_ITERATIONS : [NSNumber numberWithInt:JSON_STORE_DEFAULT_PBKDF2_ITERATIONS],
+                                       JSON_STORE_KEY_ITERATIONS : [parameters objectForKey:JSON_STORE_KEY_ITERATIONS],
+                                       JSON_STORE_KEY_PRF : [parameters objectForKey:JSON_STORE_KEY_PRF],
                                        JSON_STORE_KEY_VERSION : JSON_STORE_KEY_VERSION_NUMBER };
     
     NSString* jsonStr = [jsonEntriesDict WLJSONRepresentation];
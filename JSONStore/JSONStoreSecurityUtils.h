@@ -12,6 +12,7 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "JSONStoreOpenOptions.h"
 
 @interface JSONStoreSecurityUtils : NSObject
 
@@ -60,6 +61,32 @@ covertBase64BeforeEncryption:(BOOL) covertBase64BeforeEncryptionFlag;
                              andSalt: (NSString *) salt
                        andIterations: (NSInteger) iterations;
 
+/**
+ Generates a key by using the PBKDF2 algorithm with the given pseudo random function.
+ @param pass The password that is used to generate the key
+ @param salt The salt that is used to generate the key
+ @param iterations The number of iterations that is passed to the key generation algorithm
+ @param prf The pseudo random function
+ @return The generated key
+ */
++(NSString*) generateKeyWithPassword: (NSString *) pass
+                             andSalt: (NSString *) salt
+                       andIterations: (NSInteger) iterations
+             andPseudoRandomFunction: (JSONStoreKeyDerivationFunction) prf;
+
+/**
+ Measures the number of PBKDF2 iterations that take the given time on this device.
+ @param pass The password that will be used to generate the key
+ @param salt The salt that will be used to generate the key
+ @param prf The pseudo random function
+ @param seconds Target time for one key derivation
+ @return The number of iterations, at least JSON_STORE_DEFAULT_PBKDF2_ITERATIONS
+ */
++(NSInteger) iterationsForPassword: (NSString *) pass
+                           andSalt: (NSString *) salt
+           andPseudoRandomFunction: (JSONStoreKeyDerivationFunction) prf
+                     andTargetTime: (NSTimeInterval) seconds;
+
 /**
  Encrypts text with a key.
  @param text The text to encrypt
@@ -82,4 +109,23 @@ covertBase64BeforeEncryption:(BOOL) covertBase64BeforeEncryptionFlag;
 +(NSString*) decryptWithKey: (NSString*) key
               andDictionary:(NSDictionary*) encryptedObj
                       error: (NSError**) error;
+
+/**
+ Encrypts binary data with AES-256 and authenticates it with HMAC-SHA256. Separate encryption and authentication keys
+ are derived from the key with HKDF. A random IV is written in front of the cipher text and the HMAC of both after it.
+ @param data The data to encrypt
+ @param key The UTF-8 bytes of the key used for encryption
+ @return The IV, the cipher text and the HMAC, nil if the operation fails
+ */
++(NSData*) encryptData:(NSData*) data
+               withKey:(NSData*) key;
+
+/**
+ Decrypts binary data returned from encryptData:withKey:.
+ @param data The IV, the cipher text and the HMAC
+ @param key The UTF-8 bytes of the key used for decryption
+ @return The decrypted data, nil if the HMAC does not match or the operation fails
+ */
++(NSData*) decryptData:(NSData*) data
+               withKey:(NSData*) key;
 @end
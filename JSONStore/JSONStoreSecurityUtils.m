@@ -13,9 +13,12 @@
 
 #import "JSONStoreSecurityUtils.h"
 #import "JSONStoreSecurityConstants.h"
+#import "JSONStoreConstants.h"
 
 #import <CommonCrypto/CommonCryptor.h>
 #import <CommonCrypto/CommonKeyDerivation.h>
+#import <CommonCrypto/CommonDigest.h>
+#import <CommonCrypto/CommonHMAC.h>
 
 
 
@@ -26,6 +29,11 @@ const CCAlgorithm kAlgorithm = kCCAlgorithmAES128;
 const NSUInteger kAlgorithmKeySize = kCCKeySizeAES128;
 const NSUInteger kAlgorithmBlockSize = kCCBlockSizeAES128;
 const NSUInteger kAlgorithmIVSize = kCCBlockSizeAES128;
+const NSUInteger kAlgorithmMACSize = CC_SHA256_DIGEST_LENGTH;
+
+//HKDF labels, so the data is never encrypted and authenticated with the same key
+static NSString* const kDataEncryptionKeyLabel = @"jsonstore-data-encryption";
+static NSString* const kDataAuthenticationKeyLabel = @"jsonstore-data-authentication";
 
 
 
@@ -137,6 +145,17 @@ static NSData *aes_decrypt(NSData *key, NSData *iv, NSData *ciphertext){
 +(NSString*) generateKeyWithPassword: (NSString *) pass
                               andSalt: (NSString *) salt
                         andIterations: (NSInteger) iterations
+{
+    return [self generateKeyWithPassword:pass
+                                 andSalt:salt
+                           andIterations:iterations
+                 andPseudoRandomFunction:JSONStore_PBKDF2_SHA1];
+}
+
++(NSString*) generateKeyWithPassword: (NSString *) pass
+                              andSalt: (NSString *) salt
+                        andIterations: (NSInteger) iterations
+              andPseudoRandomFunction: (JSONStoreKeyDerivationFunction) prf
 {
     if (iterations < 1) {
         [NSException raise:JSONStore_ERROR_LABEL_KEYGEN format:@"%@", JSONStore_ERROR_MSG_INVALID_ITERATIONS];
@@ -155,12 +174,15 @@ static NSData *aes_decrypt(NSData *key, NSData *iv, NSData *ciphertext){
     
     NSMutableData *derivedKey = [NSMutableData dataWithLength:kCCKeySizeAES256];
     
+    //Keys derived with SHA1 were always given the character counts, keep them so existing keys still match
+    BOOL legacyLengths = prf == JSONStore_PBKDF2_SHA1;
+    
     int retVal = CCKeyDerivationPBKDF(kCCPBKDF2,
                                       passData.bytes,
-                                      pass.length,
+                                      legacyLengths ? pass.length : passData.length,
                                       saltData.bytes,
-                                      salt.length,
-                                      kCCPRFHmacAlgSHA1,
+                                      legacyLengths ? salt.length : saltData.length,
+                                      [self _pseudoRandomAlgorithm:prf],
                                       (int)iterations,
                                       derivedKey.mutableBytes,
                                       kCCKeySizeAES256);
@@ -182,6 +204,43 @@ static NSData *aes_decrypt(NSData *key, NSData *iv, NSData *ciphertext){
     return [NSString stringWithString:derivedKeyStr];
 }
 
++(NSInteger) iterationsForPassword: (NSString *) pass
+                           andSalt: (NSString *) salt
+           andPseudoRandomFunction: (JSONStoreKeyDerivationFunction) prf
+                     andTargetTime: (NSTimeInterval) seconds
+{
+    uint32_t msec = seconds * 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t) MAX(seconds * 1000, 1);
+    
+    size_t passLength = [[pass dataUsingEncoding:NSUTF8StringEncoding] length];
+    size_t saltLength = [[salt dataUsingEncoding:NSUTF8StringEncoding] length];
+    
+    uint rounds = CCCalibratePBKDF(kCCPBKDF2,
+                                   passLength,
+                                   saltLength,
+                                   [self _pseudoRandomAlgorithm:prf],
+                                   kCCKeySizeAES256,
+                                   msec);
+    
+    //Slow devices and short targets never get fewer iterations than the default
+    if (rounds < JSON_STORE_DEFAULT_PBKDF2_ITERATIONS || rounds > INT_MAX) {
+        return JSON_STORE_DEFAULT_PBKDF2_ITERATIONS;
+    }
+    
+    return rounds;
+}
+
++(CCPseudoRandomAlgorithm) _pseudoRandomAlgorithm:(JSONStoreKeyDerivationFunction) prf
+{
+    switch (prf) {
+        case JSONStore_PBKDF2_SHA256:
+            return kCCPRFHmacAlgSHA256;
+        case JSONStore_PBKDF2_SHA512:
+            return kCCPRFHmacAlgSHA512;
+        default:
+            return kCCPRFHmacAlgSHA1;
+    }
+}
+
 +(NSDictionary*) _buildErrorObjectWithException:(NSException*) exception
                                       andFormat:(NSString*) format
 {
@@ -357,6 +416,113 @@ covertBase64BeforeEncryption:(BOOL) covertBase64BeforeEncryptionFlag
     return returnText;
 }
 
++(NSData*) _dataKeyFromKey:(NSData*) keyData
+                     label:(NSString*) label
+{
+    //HKDF (RFC 5869) with SHA-256, an empty salt and one block of output
+    NSMutableData* info = [[label dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+    uint8_t counter = 1;
+    uint8_t salt[CC_SHA256_DIGEST_LENGTH] = { 0 };
+    uint8_t prk[CC_SHA256_DIGEST_LENGTH];
+    NSMutableData* dataKey = [NSMutableData dataWithLength:CC_SHA256_DIGEST_LENGTH];
+    
+    [info appendBytes:&counter length:1];
+    
+    CCHmac(kCCHmacAlgSHA256, salt, sizeof(salt), keyData.bytes, keyData.length, prk);
+    CCHmac(kCCHmacAlgSHA256, prk, sizeof(prk), info.bytes, info.length, dataKey.mutableBytes);
+    
+    memset(prk, 0, sizeof(prk));
+    
+    return dataKey;
+}
+
++(NSData*) _authenticationCodeForData:(const void*) bytes
+                               length:(size_t) length
+                              withKey:(NSData*) key
+{
+    NSData* macKey = [JSONStoreSecurityUtils _dataKeyFromKey:key label:kDataAuthenticationKeyLabel];
+    NSMutableData* mac = [NSMutableData dataWithLength:kAlgorithmMACSize];
+    
+    CCHmac(kCCHmacAlgSHA256, macKey.bytes, macKey.length, bytes, length, mac.mutableBytes);
+    
+    return mac;
+}
+
++(NSData*) encryptData:(NSData*) data
+               withKey:(NSData*) key
+{
+    if (data == nil || ! [key isKindOfClass:[NSData class]] || [key length] < 1) {
+        return nil;
+    }
+    
+    NSMutableData* iv = [NSMutableData dataWithLength:kAlgorithmIVSize];
+    
+    if (SecRandomCopyBytes(kSecRandomDefault, kAlgorithmIVSize, iv.mutableBytes) != 0) {
+        return nil;
+    }
+    
+    NSData* dataKey = [JSONStoreSecurityUtils _dataKeyFromKey:key label:kDataEncryptionKeyLabel];
+    NSMutableData* ciphertext = [NSMutableData dataWithLength:kAlgorithmIVSize + data.length + kAlgorithmBlockSize];
+    size_t cipherOutputLength = 0;
+    
+    memcpy(ciphertext.mutableBytes, iv.bytes, kAlgorithmIVSize);
+    
+    CCCryptorStatus result = CCCrypt(kCCEncrypt, kAlgorithm, kCCOptionPKCS7Padding, dataKey.bytes, dataKey.length, iv.bytes,
+                                     data.bytes, data.length, (uint8_t*) ciphertext.mutableBytes + kAlgorithmIVSize,
+                                     ciphertext.length - kAlgorithmIVSize, &cipherOutputLength);
+    
+    if (result != kCCSuccess) {
+        return nil;
+    }
+    
+    [ciphertext setLength:kAlgorithmIVSize + cipherOutputLength];
+    
+    //Encrypt then MAC, the tag covers the IV and the cipher text
+    [ciphertext appendData:[JSONStoreSecurityUtils _authenticationCodeForData:ciphertext.bytes length:ciphertext.length withKey:key]];
+    
+    return ciphertext;
+}
+
++(NSData*) decryptData:(NSData*) data
+               withKey:(NSData*) key
+{
+    if (data.length < kAlgorithmIVSize + kAlgorithmBlockSize + kAlgorithmMACSize || ! [key isKindOfClass:[NSData class]] || [key length] < 1) {
+        return nil;
+    }
+    
+    size_t ciphertextLength = data.length - kAlgorithmMACSize;
+    NSData* mac = [JSONStoreSecurityUtils _authenticationCodeForData:data.bytes length:ciphertextLength withKey:key];
+    const uint8_t* expected = mac.bytes;
+    const uint8_t* actual = (const uint8_t*) data.bytes + ciphertextLength;
+    uint8_t difference = 0;
+    
+    //Constant time, data that was changed or written with another key is never decrypted
+    for (NSUInteger i = 0; i < kAlgorithmMACSize; i++) {
+        difference |= expected[i] ^ actual[i];
+    }
+    
+    if (difference != 0) {
+        NSLog(@"Unable to decrypt data, authentication failed");
+        return nil;
+    }
+    
+    NSData* dataKey = [JSONStoreSecurityUtils _dataKeyFromKey:key label:kDataEncryptionKeyLabel];
+    NSMutableData* plaintext = [NSMutableData dataWithLength:ciphertextLength];
+    size_t plainOutputLength = 0;
+    
+    CCCryptorStatus result = CCCrypt(kCCDecrypt, kAlgorithm, kCCOptionPKCS7Padding, dataKey.bytes, dataKey.length, data.bytes,
+                                     (const uint8_t*) data.bytes + kAlgorithmIVSize, ciphertextLength - kAlgorithmIVSize,
+                                     plaintext.mutableBytes, plaintext.length, &plainOutputLength);
+    
+    if (result != kCCSuccess) {
+        return nil;
+    }
+    
+    [plaintext setLength:plainOutputLength];
+    
+    return plaintext;
+}
+
 #pragma mark Base64
 
 const static char base64EncodingTable[64] = {
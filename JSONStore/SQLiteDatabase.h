@@ -42,6 +42,16 @@
  */
 -(id) initWithUserName: (NSString*) username;
 
+/**
+ Initialization method for a connection to another database file of the user, such as the file of a collection kept in its own file.
+ Waits up to JSON_STORE_WRITER_LANE_BUSY_TIMEOUT milliseconds for locks held by other connections to the file.
+ @param username The user name that is used to init the database manager
+ @param path Path to the database file
+ @return self
+ */
+-(id) initWithUserName: (NSString*) username
+              filePath: (NSString*) path;
+
 /**
  Returns the path to the actual database storage file on disk.
  @return Path to the DB file
@@ -137,4 +147,23 @@
  */
 -(NSString*) lastErrorMsg;
 
+/**
+ Steps through the rows of a select statement without copying them so the pages it touches end up in the page cache.
+ @param sql The select SQL statement as a string, its first column is the _id and its only parameter the _id to read below
+ @param lastId The _id to read below, set to the _id of the last row read
+ @param budget Reads nothing once the page cache holds this many bytes
+ @param shouldStop Block that is checked before reading, returns true to read nothing
+ @return Number of rows read, 0 when stopped or there are no more rows, -1 on failure
+ */
+-(int) readIntoCache:(NSString*) sql
+             belowId:(long long*) lastId
+        memoryBudget:(NSUInteger) budget
+          shouldStop:(BOOL (^)(void)) shouldStop;
+
+/**
+ Returns page cache statistics for the connection.
+ @return NSDictionary with hits, misses and size (bytes used by the page cache)
+ */
+-(NSDictionary*) cacheStatus;
+
 @end
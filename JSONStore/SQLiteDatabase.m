@@ -16,8 +16,59 @@
 #endif
 
 #import "JSONStoreConstants.h"
+#import "JSONStoreDocumentCodec.h"
+#import "JSONStoreIndexer.h"
 #import "SQLiteDatabase.h"
 
+//jsonstore_json(blob) returns the JSON text of a document in any storage format, for the JSON1 functions
+static void jsonStoreDocumentJSON(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    
+    @autoreleasepool {
+        
+        const void* bytes = sqlite3_value_blob(argv[0]);
+        NSData* data = [NSData dataWithBytesNoCopy:(void*) bytes length:sqlite3_value_bytes(argv[0]) freeWhenDone:NO];
+        NSData* json = [JSONStoreDocumentCodec JSONDataWithData:data];
+        
+        if (json == nil) {
+            sqlite3_result_error(context, "malformed JSONStore document", -1);
+            return;
+        }
+        
+        sqlite3_result_text(context, [json bytes], (int) [json length], SQLITE_TRANSIENT);
+    }
+}
+
+//jsonstore_search_value(text, field) returns the value stored in the column of a search field for a JSON document
+static void jsonStoreSearchFieldValue(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    
+    @autoreleasepool {
+        
+        const void* bytes = sqlite3_value_blob(argv[0]);
+        NSData* data = [NSData dataWithBytesNoCopy:(void*) bytes length:sqlite3_value_bytes(argv[0]) freeWhenDone:NO];
+        NSString* searchField = [NSString stringWithUTF8String:(const char*) sqlite3_value_text(argv[1])];
+        NSSet* values = [[[JSONStoreIndexer alloc] init] valuesForSearchField:searchField inJSONData:data];
+        
+        if (values == nil) {
+            sqlite3_result_error(context, "malformed JSON document", -1);
+            return;
+        }
+        
+        //Same format the store and replace operations write
+        NSString* value = [[values allObjects] componentsJoinedByString:@"-@-"];
+        sqlite3_result_text(context, [value UTF8String], -1, SQLITE_TRANSIENT);
+    }
+}
+
 @implementation SQLiteDatabase : NSObject
 
 -(id) initWithUserName: (NSString*) username
@@ -27,6 +78,30 @@
         self.username = username;
         _db = [self _openOrCreate];
         
+        //Collection files are also written by writer lanes, so locks on them are waited for
+        if (_db != nil) {
+            sqlite3_busy_timeout(_db, JSON_STORE_WRITER_LANE_BUSY_TIMEOUT);
+        }
+        
+        _databaseQueue = dispatch_queue_create("com.jsonstore.database", DISPATCH_QUEUE_SERIAL);
+    }
+    
+    return self;
+}
+
+-(id) initWithUserName: (NSString*) username
+              filePath: (NSString*) path
+{
+    if (self = [super init]) {
+        
+        self.username = username;
+        self.dbfilePath = path;
+        _db = [self _openOrCreate];
+        
+        if (_db != nil) {
+            sqlite3_busy_timeout(_db, JSON_STORE_WRITER_LANE_BUSY_TIMEOUT);
+        }
+        
         _databaseQueue = dispatch_queue_create("com.jsonstore.database", DISPATCH_QUEUE_SERIAL);
     }
     
@@ -372,6 +447,76 @@
     return mRC;
 }
 
+-(int) readIntoCache:(NSString*) sql
+             belowId:(long long*) lastId
+        memoryBudget:(NSUInteger) budget
+          shouldStop:(BOOL (^)(void)) shouldStop
+{
+    __block int rows = -1;
+    
+    dispatch_sync(_databaseQueue, ^{
+        
+        int used = 0;
+        int highwater = 0;
+        sqlite3_db_status(_db, SQLITE_DBSTATUS_CACHE_USED, &used, &highwater, 0);
+        
+        if ((NSUInteger) used >= budget || (shouldStop && shouldStop())) {
+            rows = 0;
+            return;
+        }
+        
+        sqlite3_stmt *stmt = [self _createStatement:sql];
+        
+        if (nil == stmt) {
+            return;
+        }
+        
+        sqlite3_bind_int64(stmt, 1, *lastId);
+        
+        int count = 0;
+        int sqliteRc = sqlite3_step(stmt);
+        
+        while (SQLITE_ROW == sqliteRc) {
+            
+            //The first column is the _id, the next chunk starts below it
+            *lastId = sqlite3_column_int64(stmt, 0);
+            count++;
+            
+            sqliteRc = sqlite3_step(stmt);
+        }
+        
+        sqlite3_finalize(stmt);
+        
+        if (SQLITE_DONE == sqliteRc) {
+            rows = count;
+        }
+    });
+    
+    return rows;
+}
+
+-(NSDictionary*) cacheStatus
+{
+    __block NSDictionary* status = nil;
+    
+    dispatch_sync(_databaseQueue, ^{
+        
+        if (NULL == _db) {
+            return;
+        }
+        
+        int hits = 0, misses = 0, used = 0, highwater = 0;
+        
+        sqlite3_db_status(_db, SQLITE_DBSTATUS_CACHE_HIT, &hits, &highwater, 0);
+        sqlite3_db_status(_db, SQLITE_DBSTATUS_CACHE_MISS, &misses, &highwater, 0);
+        sqlite3_db_status(_db, SQLITE_DBSTATUS_CACHE_USED, &used, &highwater, 0);
+        
+        status = @{JSON_STORE_KEY_CACHE_HITS : @(hits), JSON_STORE_KEY_CACHE_MISSES : @(misses), JSON_STORE_KEY_CACHE_SIZE : @(used)};
+    });
+    
+    return status;
+}
+
 -(NSString*) lastErrorMsg
 {
     return [NSString stringWithUTF8String:sqlite3_errmsg(_db)];
@@ -440,6 +585,16 @@
             
             NSLog(@"Failed opening JSONStore database, path: %@", dbPath);
             _dbHandle = nil;
+            
+        } else if (sqlite3_create_function_v2(_dbHandle, [JSON_STORE_DOCUMENT_JSON_FUNCTION UTF8String], 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                              NULL, jsonStoreDocumentJSON, NULL, NULL, NULL) != SQLITE_OK) {
+            
+            NSLog(@"Failed registering %@ function, message: [%s]", JSON_STORE_DOCUMENT_JSON_FUNCTION, sqlite3_errmsg(_dbHandle));
+            
+        } else if (sqlite3_create_function_v2(_dbHandle, [JSON_STORE_SEARCH_FIELD_VALUE_FUNCTION UTF8String], 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                              NULL, jsonStoreSearchFieldValue, NULL, NULL, NULL) != SQLITE_OK) {
+            
+            NSLog(@"Failed registering %@ function, message: [%s]", JSON_STORE_SEARCH_FIELD_VALUE_FUNCTION, sqlite3_errmsg(_dbHandle));
         }
         
         return _dbHandle;
@@ -564,7 +719,8 @@
         NSString *colName = [[NSString stringWithUTF8String:sqlite3_column_name(stmt, i)] lowercaseString];
         
         //This should probably be better.  But we basically know that our json column is always a blob, so we force it.
-        if ([colName isEqualToString:JSON_STORE_FIELD_JSON]) {
+        //Other columns are read as data only when they hold a blob, like compression dictionaries.
+        if ([colName isEqualToString:JSON_STORE_FIELD_JSON] || sqlite3_column_type(stmt, i) == SQLITE_BLOB) {
             
             NSData* data = [[NSData alloc] initWithBytes:sqlite3_column_blob(stmt, i)
                                                   length:(NSUInteger) sqlite3_column_bytes(stmt, i)];
@@ -17,6 +17,11 @@
 #import "JSONStore+Private.h"
 #import "JSONStoreConstants.h"
 #import "JSONStoreCollection.h"
+#import "JSONStoreKeyCache.h"
+#import "JSONStoreSecurityUtils.h"
+#import "JSONStoreQueue.h"
+#import "SQLiteDatabase.h"
+#import "JSONStoreDocumentCodec.h"
 
 
 
@@ -775,151 +780,1481 @@
     XCTAssertTrue(docsThatMatchQuery3 == 1, @"query2");
 }
 
+-(void) testMaintainedCounts
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    [col1 addData:@[ @{ @"name" : @"name1"}, @{ @"name" : @"name2"}, @{ @"name" : @"name3"} ] andMarkDirty:NO withOptions:nil error:nil];
+    [col1 addData:@[ @{ @"name" : @"name4"} ] andMarkDirty:YES withOptions:nil error:nil];
+
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 4, @"count after add");
+    XCTAssertTrue([[col1 countAllDirtyDocumentsWithError:nil] intValue] == 1, @"dirty count after add");
+
+    [col1 removeWithIds:@[@1] andMarkDirty:YES error:nil];
+
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 3, @"count after remove");
+    XCTAssertTrue([[col1 countAllDirtyDocumentsWithError:nil] intValue] == 2, @"removed document is dirty");
+
+    [col1 markDocumentsClean:[col1 allDirtyAndReturnError:nil] error:nil];
+
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 3, @"count after mark clean");
+    XCTAssertTrue([[col1 countAllDirtyDocumentsWithError:nil] intValue] == 0, @"dirty count after mark clean");
+
+    [col1 clearCollectionWithError:nil];
+
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 0, @"count after clear");
+}
+
 -(void) testFindById
 {
-    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
-    [col1 setSearchField:@"name" withType:JSONStore_String];
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+    
+    int numAdded = [[col1 addData:@[ @{ @"name" : @"hello-world"}, @{ @"name" : @"hey-world"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    
+    XCTAssertTrue(numAdded == 2, @"check added");
+    
+    NSArray* doc1 = [col1 findWithIds:@[@1] andOptions:nil error:nil][0];
+    
+    XCTAssertTrue([[doc1 valueForKeyPath:@"json.name"] isEqualToString:@"hello-world"], @"find1");
+    
+    NSArray* doc2 = [col1 findWithIds:@[@2] andOptions:nil error:nil][0];
+    
+    XCTAssertTrue([[doc2 valueForKeyPath:@"json.name"] isEqualToString:@"hey-world"], @"find2");
+}
+
+-(void) testRemoveCollection
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
+    [col1 setSearchField:@"first*Name" withType:JSONStore_String];
+    
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+    
+    int numAdded = [[col1 addData:@[ @{ @"first*Name" : @"hello-*world"}, @{ @"first*Name" : @"hey*-world"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    
+    XCTAssertTrue(numAdded == 2, @"add count");
+    
+    NSArray* results = [col1 findAllWithOptions:nil error:nil];
+    
+    XCTAssertTrue([results count] == 2, @"findAll count");
+    
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 2, @"count");
+    
+    [col1 removeCollectionWithError:nil];
+    
+    @try {
+        [col1 addData:@[ @{ @"first*Name" : @"hello-*world"}, @{ @"first*Name" : @"hey*-world"} ] andMarkDirty:NO withOptions:nil error:nil];
+    }
+    @catch (NSException *exception) {
+        NSString* name = exception.reason;
+        
+        XCTAssertTrue([name isEqualToString:@"JSON_STORE_ADD_FAILURE"], @"exception name");
+        
+        int errorCode = [[exception.userInfo objectForKey:JSON_STORE_ERROR_OBJ_KEY_ERR] integerValue];
+        
+        XCTAssertTrue(errorCode == JSON_STORE_PERSISTENT_STORE_FAILURE, @"exception rc");
+    }
+    
+    JSONStoreOpenOptions* ops2 = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops2 error:nil];
+    
+    int numAdded2 = [[col1 addData:@[ @{ @"first*Name" : @"hello-*world"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    
+    XCTAssertTrue(numAdded2 == 1, @"add count");
+    
+    NSArray* results2 = [col1 findAllWithOptions:nil error:nil];
+    
+    XCTAssertTrue([results2 count] == 1, @"findAll count");
+    
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 1, @"count");
+}
+
+-(void) testFindWithLimit
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+    
+    int numAdded = [[col1 addData:@[ @{ @"name" : @"world1"}, @{ @"name" : @"world2"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    
+    XCTAssertTrue(numAdded == 2, @"add count");
+    
+    JSONStoreQueryOptions* qops = [[JSONStoreQueryOptions alloc] init];
+    qops.limit = @2;
+    qops.offset = @0;
+    
+    JSONStoreQueryPart* q1 = [[JSONStoreQueryPart alloc] init];
+    q1._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    
+    NSArray* results0 = [col1 findWithQueryParts:@[q1] andOptions:qops error:nil];
+    
+    XCTAssertTrue([results0 count] == 2, @"results0 count");
+    
+    XCTAssertTrue([[[results0 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world1"], @"results0 name1");
+    XCTAssertTrue([[[results0 objectAtIndex:1] valueForKeyPath:@"json.name"] isEqualToString:@"world2"], @"results0 name2");
+    
+    JSONStoreQueryOptions* qops2 = [[JSONStoreQueryOptions alloc] init];
+    qops2.limit = @1;
+    qops2.offset = @0;
+    
+    JSONStoreQueryPart* q2 = [[JSONStoreQueryPart alloc] init];
+    q2._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    
+    NSArray* results1 = [col1 findWithQueryParts:@[q2] andOptions:qops2 error:nil];
+    
+    XCTAssertTrue([results1 count] == 1, @"results0 count");
+    
+    XCTAssertTrue([[[results1 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world1"], @"results0 name1");
+    
+    JSONStoreQueryOptions* qops3 = [[JSONStoreQueryOptions alloc] init];
+    qops3.limit = @1;
+    qops3.offset = @1;
+    
+    JSONStoreQueryPart* q3 = [[JSONStoreQueryPart alloc] init];
+    q3._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    
+    NSArray* results2 = [col1 findWithQueryParts:@[q3] andOptions:qops3 error:nil];
+    
+    XCTAssertTrue([results2 count] == 1, @"results2 count");
+    
+    XCTAssertTrue([[[results2 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world2"], @"results2 name1");
+    
+    JSONStoreQueryOptions* qops4 = [[JSONStoreQueryOptions alloc] init];
+    qops4.limit = @1;
+    qops4.offset = nil;
+    
+    JSONStoreQueryPart* q4 = [[JSONStoreQueryPart alloc] init];
+    q4._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    
+    NSArray* results3 = [col1 findWithQueryParts:@[q4] andOptions:qops4 error:nil];
+    
+    XCTAssertTrue([results3 count] == 1, @"results3 count");
+    
+    XCTAssertTrue([[[results3 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world1"], @"results3 name1");
+    
+    JSONStoreQueryOptions* qops5 = [[JSONStoreQueryOptions alloc] init];
+    qops5.limit = @-1;
+    qops5.offset = nil;
+    
+    JSONStoreQueryPart* q5 = [[JSONStoreQueryPart alloc] init];
+    q5._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    
+    NSArray* results4 = [col1 findWithQueryParts:@[q4] andOptions:qops5 error:nil];
+    
+    XCTAssertTrue([results4 count] == 1, @"results4 count");
+    
+    XCTAssertTrue([[[results4 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world2"], @"results4 name1");
+}
+
+-(void) testFindWithPageToken
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    [col1 setSearchField:@"age" withType:JSONStore_Integer];
+
+    JSONStoreQueryOptions* pageSort = [[JSONStoreQueryOptions alloc] init];
+    [pageSort sortBySearchFieldDescending:@"age"];
+    col1.pageSorts = @[pageSort];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open with a page sort");
+
+    int numAdded = [[col1 addData:@[ @{ @"name" : @"carlos", @"age" : @20},
+                                     @{ @"name" : @"mike", @"age" : @30},
+                                     @{ @"name" : @"dgonz", @"age" : @30},
+                                     @{ @"name" : @"nana", @"age" : @10},
+                                     @{ @"name" : @"tim", @"age" : @30} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+
+    XCTAssertTrue(numAdded == 5, @"add count");
+
+    JSONStoreQueryOptions* qops = [[JSONStoreQueryOptions alloc] init];
+    [qops sortBySearchFieldDescending:@"age"];
+    qops.limit = @2;
+
+    XCTAssertTrue([[col1 findAllWithOptions:qops error:nil] count] == 2, @"limit without page tokens");
+    XCTAssertNil(qops.nextPageToken, @"page tokens are opt-in");
+
+    qops.usePageTokens = YES;
+
+    NSArray* page1 = [col1 findAllWithOptions:qops error:nil];
+
+    XCTAssertTrue([page1 count] == 2, @"page1 count");
+    XCTAssertTrue([[[page1 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"mike"], @"page1 doc1");
+    XCTAssertTrue([[[page1 objectAtIndex:1] valueForKeyPath:@"json.name"] isEqualToString:@"dgonz"], @"page1 doc2");
+    XCTAssertTrue([[[page1 objectAtIndex:0] allKeys] count] == 2, @"keyset columns are not returned");
+    XCTAssertNotNil(qops.nextPageToken, @"page1 token");
+
+    qops.pageToken = qops.nextPageToken;
+
+    NSArray* page2 = [col1 findAllWithOptions:qops error:nil];
+
+    XCTAssertTrue([page2 count] == 2, @"page2 count");
+    XCTAssertTrue([[[page2 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"tim"], @"page2 doc1");
+    XCTAssertTrue([[[page2 objectAtIndex:1] valueForKeyPath:@"json.name"] isEqualToString:@"carlos"], @"page2 doc2");
+
+    qops.pageToken = qops.nextPageToken;
+
+    NSArray* page3 = [col1 findAllWithOptions:qops error:nil];
+
+    XCTAssertTrue([page3 count] == 1, @"page3 count");
+    XCTAssertTrue([[[page3 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"nana"], @"page3 doc1");
+    XCTAssertNil(qops.nextPageToken, @"no more pages");
+
+    NSError* error = nil;
+    qops.pageToken = @"not a token";
+
+    XCTAssertNil([col1 findAllWithOptions:qops error:&error], @"malformed token");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_PAGE_TOKEN, @"malformed token error");
+
+    error = nil;
+    qops.pageToken = @"[30, \"mike\", 2]";
+
+    XCTAssertNil([col1 findAllWithOptions:qops error:&error], @"token for other sort criteria");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_PAGE_TOKEN, @"stale token error");
+}
+
+-(void) testFindWithProjection
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    int numAdded = [[col1 addData:@[ @{ @"name" : @"carlos",
+                                        @"active" : @YES,
+                                        @"address" : @{ @"city" : @"Austin", @"zip" : @"78758"},
+                                        @"phones" : @[ @{ @"number" : @"555-1234"} ] } ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+
+    XCTAssertTrue(numAdded == 1, @"add count");
+
+    JSONStoreQueryOptions* qops = [[JSONStoreQueryOptions alloc] init];
+    [qops projectJSONPath:@"address.city"];
+    [qops projectJSONPath:@"phones.0.number"];
+    [qops projectJSONPath:@"address.country"];
+    [qops projectJSONPath:@"active"];
+
+    NSArray* results = [col1 findAllWithOptions:qops error:nil];
+
+    XCTAssertTrue([results count] == 1, @"find count");
+
+    NSDictionary* json = [[results objectAtIndex:0] objectForKey:@"json"];
+
+    XCTAssertTrue([json count] == 3, @"only projected paths with a value");
+    XCTAssertTrue([json[@"address.city"] isEqualToString:@"Austin"], @"nested key");
+    XCTAssertTrue([json[@"phones.0.number"] isEqualToString:@"555-1234"], @"array index");
+    XCTAssertTrue(json[@"active"] == (id) kCFBooleanTrue, @"booleans projected as booleans");
+    XCTAssertNotNil([[results objectAtIndex:0] objectForKey:@"_id"], @"_id is returned");
+
+    [qops filterSearchField:@"name"];
+
+    results = [col1 findAllWithOptions:qops error:nil];
+
+    XCTAssertTrue([[[results objectAtIndex:0] objectForKey:@"name"] isEqualToString:@"carlos"], @"filter with projection");
+    XCTAssertTrue([[[[results objectAtIndex:0] objectForKey:@"json"] objectForKey:@"address.city"] isEqualToString:@"Austin"], @"projection with filter");
+}
+
+-(void) testFindWithJSONPath
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    ops.jsonPathIndexThreshold = @1;
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    int numAdded = [[col1 addData:@[ @{ @"name" : @"carlos", @"address" : @{ @"city" : @"Austin", @"floor" : @3} },
+                                     @{ @"name" : @"mike", @"address" : @{ @"city" : @"Austin", @"floor" : @8} },
+                                     @{ @"name" : @"dgonz", @"address" : @{ @"city" : @"Raleigh", @"floor" : @5} } ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+
+    XCTAssertTrue(numAdded == 3, @"add count");
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart jsonPath:@"address.city" equal:@"Austin"];
+    [queryPart jsonPath:@"address.floor" greaterThan:@4];
+
+    NSError* error = nil;
+    NSArray* results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:&error];
+
+    XCTAssertNil(error, @"find error");
+    XCTAssertTrue([results count] == 1, @"find count");
+    XCTAssertTrue([[[results objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"mike"], @"found doc");
+
+    JSONStoreQueryPart* likePart = [[JSONStoreQueryPart alloc] init];
+    [likePart jsonPath:@"address.city" like:@"aleig"];
+    [likePart searchField:@"name" equal:@"dgonz"];
+
+    results = [col1 findWithQueryParts:@[likePart] andOptions:nil error:&error];
+
+    XCTAssertTrue([results count] == 1, @"json path with search field");
+
+    int count = [[col1 countWithQueryParts:@[queryPart] error:&error] intValue];
+
+    XCTAssertTrue(count == 1, @"count with json path after the path was indexed");
+}
+
+-(void) testFindWithDecodeLazily
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    [col1 addData:@[ @{ @"name" : @"carlos"}, @{ @"name" : @"mike"}, @{ @"name" : @"dgonz"} ] andMarkDirty:NO withOptions:nil error:nil];
+
+    JSONStoreQueryOptions* qops = [[JSONStoreQueryOptions alloc] init];
+    qops.decodeLazily = YES;
+    [qops sortBySearchFieldAscending:@"name"];
+
+    NSArray* results = [col1 findAllWithOptions:qops error:nil];
+
+    XCTAssertTrue([results count] == 3, @"find count");
+    XCTAssertTrue([[[results objectAtIndex:2] valueForKeyPath:@"json.name"] isEqualToString:@"mike"], @"decoded on access");
+    XCTAssertTrue([results objectAtIndex:2] == [results objectAtIndex:2], @"decoded document is cached");
+
+    NSMutableArray* names = [[NSMutableArray alloc] init];
+
+    for (NSDictionary* doc in results) {
+        [names addObject:[doc valueForKeyPath:@"json.name"]];
+    }
+
+    XCTAssertEqualObjects(names, (@[@"carlos", @"dgonz", @"mike"]), @"fast enumeration decodes");
+    
+    NSMutableArray* many = [[NSMutableArray alloc] init];
+    
+    for (int i = 0; i < 200; i++) {
+        [many addObject:@{@"name" : [NSString stringWithFormat:@"name%d", i]}];
+    }
+    
+    [col1 addData:many andMarkDirty:NO withOptions:nil error:nil];
+    
+    results = [col1 findAllWithOptions:qops error:nil];
+    
+    NSMutableDictionary* first = [results objectAtIndex:0];
+    [first setObject:@YES forKey:@"changed"];
+    
+    XCTAssertTrue([results objectAtIndex:0] == first, @"recently accessed document is kept");
+    
+    for (NSDictionary* doc in results) {
+        XCTAssertNotNil([doc valueForKeyPath:@"json.name"], @"decoded");
+    }
+    
+    //Enumerating more documents than the cache holds evicts the first one, it is decoded again from its row
+    XCTAssertTrue([results objectAtIndex:0] != first, @"cache is bounded");
+    XCTAssertEqualObjects([[results objectAtIndex:0] valueForKeyPath:@"json.name"], [first valueForKeyPath:@"json.name"], @"decoded again");
+    XCTAssertNil([[results objectAtIndex:0] objectForKey:@"changed"], @"changes to evicted documents are not kept");
+}
+
+-(void) testFindWithQueryCache
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    ops.queryCacheSize = @(1024 * 1024);
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    [col1 addData:@[ @{ @"name" : @"carlos"}, @{ @"name" : @"mike"} ] andMarkDirty:NO withOptions:nil error:nil];
+
+    NSArray* results = [col1 findAllWithOptions:nil error:nil];
+    NSUInteger hits = [[[JSONStore sharedInstance] queryCacheMetrics][JSON_STORE_KEY_CACHE_HITS] unsignedIntegerValue];
+
+    XCTAssertTrue([results count] == 2, @"first find");
+
+    results = [col1 findAllWithOptions:nil error:nil];
+    NSDictionary* metrics = [[JSONStore sharedInstance] queryCacheMetrics];
+
+    XCTAssertTrue([results count] == 2, @"cached find");
+    XCTAssertTrue([[[results objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"carlos"], @"cached find decodes json");
+    XCTAssertTrue([metrics[JSON_STORE_KEY_CACHE_HITS] unsignedIntegerValue] == hits + 1, @"second find is a hit");
+    XCTAssertTrue([metrics[JSON_STORE_KEY_CACHE_SIZE] unsignedIntegerValue] > 0, @"cache size");
+
+    [col1 addData:@[ @{ @"name" : @"dgonz"} ] andMarkDirty:NO withOptions:nil error:nil];
+
+    results = [col1 findAllWithOptions:nil error:nil];
+
+    XCTAssertTrue([results count] == 3, @"add invalidates cached results");
+    XCTAssertTrue([[[[JSONStore sharedInstance] queryCacheMetrics] objectForKey:JSON_STORE_KEY_CACHE_HITS] unsignedIntegerValue] == hits + 1, @"find after add is a miss");
+}
+
+-(void) testMessagePackDocumentFormat
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    col1.documentFormat = JSONStore_MessagePack;
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open");
+
+    NSDictionary* doc = @{ @"name" : @"carlos",
+                           @"bio" : @"A string that is longer than thirty one bytes, with unicode: \u00e9\u4e2d",
+                           @"age" : @30,
+                           @"balance" : @-70000,
+                           @"big" : @5000000000,
+                           @"rate" : @1.5,
+                           @"active" : @YES,
+                           @"nothing" : [NSNull null],
+                           @"tags" : @[ @"a", @1, @NO ],
+                           @"address" : @{ @"city" : @"Austin" } };
+
+    [col1 addData:@[doc] andMarkDirty:NO withOptions:nil error:nil];
+
+    NSArray* results = [col1 findAllWithOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], doc, @"MessagePack round trip");
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart jsonPath:@"address.city" equal:@"Austin"];
+
+    results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertTrue([results count] == 1, @"JSON path query on MessagePack documents");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    JSONStoreCollection* col2 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col2 setSearchField:@"name" withType:JSONStore_String];
+
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col2] withOptions:ops error:nil], @"reopen without a format");
+    XCTAssertTrue(([[JSONStoreQueue sharedManager] storageFlagsForCollection:@"people"] & JSON_STORE_STORAGE_FLAG_MESSAGE_PACK) != 0, @"stored format is kept");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    JSONStoreCollection* col3 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col3 setSearchField:@"name" withType:JSONStore_String];
+    col3.documentFormat = JSONStore_JSON;
+
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col3] withOptions:ops error:nil], @"reopen as JSON");
+    XCTAssertTrue([[JSONStoreQueue sharedManager] storageFlagsForCollection:@"people"] == 0, @"format changed explicitly");
+
+    results = [col3 findAllWithOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], doc, @"documents migrated back to JSON");
+}
+
+-(void) testCompressedDocuments
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    col1.compressDocuments = YES;
+    col1.compressionDictionary = [@"{\"name\":\"\",\"bio\":\"\",\"address\":{\"city\":\"\"}}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open");
+
+    NSDictionary* doc = @{ @"name" : @"carlos",
+                           @"bio" : @"repeated repeated repeated repeated repeated repeated repeated",
+                           @"address" : @{ @"city" : @"Austin" } };
+
+    [col1 addData:@[doc] andMarkDirty:NO withOptions:nil error:nil];
+
+    JSONStoreQueryPart* namePart = [[JSONStoreQueryPart alloc] init];
+    [namePart searchField:@"name" equal:@"carlos"];
+
+    NSArray* results = [col1 findWithQueryParts:@[namePart] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], doc, @"compressed round trip with search field query");
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart jsonPath:@"address.city" equal:@"Austin"];
+
+    results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertTrue([results count] == 1, @"JSON path query on compressed documents");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    JSONStoreCollection* col2 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col2 setSearchField:@"name" withType:JSONStore_String];
+    col2.documentFormat = JSONStore_MessagePack;
+    col2.compressDocuments = YES;
+
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col2] withOptions:ops error:nil], @"reopen without dictionary");
+
+    results = [col2 findAllWithOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], doc, @"documents compressed again as MessagePack");
+
+    NSMutableData* corrupt = [[JSONStoreDocumentCodec dataWithObject:doc flags:JSON_STORE_STORAGE_FLAG_COMPRESSED] mutableCopy];
+    uint8_t hugeLength[4] = { 0xff, 0xff, 0xff, 0xff };
+    [corrupt replaceBytesInRange:NSMakeRange(2, 4) withBytes:hugeLength];
+
+    XCTAssertNil([JSONStoreDocumentCodec objectWithData:corrupt], @"invalid length header is rejected");
+}
+
+-(void) testAddJSONData
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    [col1 setSearchField:@"address.city" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    NSData* json = [@"{\"Name\":\"ca\\u0072los\",\"tags\":[1,\"x\"],\"address\":{\"city\":\"Austin\"},\"age\":-1.5e2}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData* invalid = [@"{\"name\":\"carlos\"" dataUsingEncoding:NSUTF8StringEncoding];
+
+    XCTAssertEqual([[col1 addJSONData:@[json] andMarkDirty:NO withOptions:nil error:nil] intValue], 1, @"add JSON text");
+    XCTAssertNil([col1 addJSONData:@[invalid] andMarkDirty:NO withOptions:nil error:nil], @"truncated JSON text is rejected");
+    
+    NSError* error = nil;
+    XCTAssertNil([col1 addJSONData:@[json, @{@"name" : @"carlos"}] andMarkDirty:NO withOptions:nil error:&error], @"objects are rejected");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_JSON_STRUCTURE, @"invalid input error");
+    XCTAssertEqual([[error.userInfo objectForKey:JSON_STORE_ERROR_OBJ_KEY_DOCS] count], 1, @"failing element reported");
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart searchField:@"name" equal:@"carlos"];
+    [queryPart searchField:@"address.city" equal:@"Austin"];
+
+    NSArray* results = [col1 findJSONDataWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertTrue([results count] == 1, @"search fields extracted from JSON text");
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], json, @"same bytes returned");
+
+    NSNumber* docId = [[results objectAtIndex:0] objectForKey:@"_id"];
+    NSData* replacement = [@"{\"name\":\"mike\"}" dataUsingEncoding:NSUTF8StringEncoding];
+
+    error = nil;
+    XCTAssertNil([col1 replaceJSONDocuments:@[@{@"_id" : docId, @"json" : @{@"name" : @"mike"}}] andMarkDirty:NO error:&error], @"objects are rejected");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_JSON_STRUCTURE, @"invalid input error");
+    XCTAssertEqual([[col1 countAllDocumentsAndReturnError:nil] intValue], 1, @"nothing added by the rejected call");
+    
+    XCTAssertEqual([[col1 replaceJSONDocuments:@[@{@"_id" : docId, @"json" : replacement}] andMarkDirty:NO error:nil] intValue], 1, @"replace with JSON text");
+
+    results = [col1 findWithIds:@[docId] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], @{@"name" : @"mike"}, @"replaced document decodes");
+}
+
+-(void) testPatchDocuments
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    [col1 setSearchField:@"status" withType:JSONStore_String];
+    [col1 setSearchField:@"address.city" withType:JSONStore_String];
+
+    JSONStoreCollection* col2 = [[JSONStoreCollection alloc] initWithName:@"orders"];
+    [col2 setSearchField:@"status" withType:JSONStore_String];
+    col2.documentFormat = JSONStore_MessagePack;
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1, col2] withOptions:ops error:nil];
+
+    [col1 addData:@[@{@"name" : @"carlos", @"status" : @"new", @"address" : @{@"city" : @"Austin", @"zip" : @"78701"}}] andMarkDirty:NO withOptions:nil error:nil];
+    [col2 addData:@[@{@"status" : @"new", @"items" : @[@1, @2]}] andMarkDirty:NO withOptions:nil error:nil];
+
+    NSError* error = nil;
+    NSNumber* numPatched = [col1 patchDocumentsWithIds:@[@1] mergePatch:@{@"status" : @"done", @"address" : @{@"zip" : [NSNull null]}} andMarkDirty:YES error:&error];
+
+    XCTAssertNil(error, @"no error");
+    XCTAssertEqual([numPatched intValue], 1, @"merge patch");
+
+    numPatched = [col1 patchDocumentsWithIds:@[@1, @99] setValues:@{@"address.city" : @"Dallas", @"tags" : @[@"a"]} andMarkDirty:YES error:nil];
+
+    XCTAssertEqual([numPatched intValue], 1, @"set values, missing ids are skipped");
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart searchField:@"status" equal:@"done"];
+    [queryPart searchField:@"address.city" equal:@"Dallas"];
+
+    NSArray* results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+    NSDictionary* expected = @{@"name" : @"carlos", @"status" : @"done", @"address" : @{@"city" : @"Dallas"}, @"tags" : @[@"a"]};
+
+    XCTAssertTrue([results count] == 1, @"patched search fields");
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], expected, @"patched document");
+    XCTAssertTrue([col1 isDirtyWithDocumentId:1 error:nil], @"marked dirty");
+
+    XCTAssertEqual([[col2 patchDocumentsWithIds:@[@1] setValues:@{@"status" : @"done", @"items.2" : @3} andMarkDirty:NO error:nil] intValue], 1, @"patch MessagePack documents");
+
+    queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart searchField:@"status" equal:@"done"];
+
+    results = [col2 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], (@{@"status" : @"done", @"items" : @[@1, @2, @3]}), @"patched MessagePack document");
+}
+
+-(void) testReplaceOnlyChangedColumns
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    [col1 setSearchField:@"age" withType:JSONStore_Integer];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    [col1 addData:@[@{@"name" : @"carlos", @"age" : @10, @"bio" : @"a"}] andMarkDirty:NO withOptions:nil error:nil];
+
+    NSNumber* numReplaced = [col1 replaceDocuments:@[@{@"_id" : @1, @"json" : @{@"name" : @"carlos", @"age" : @10, @"bio" : @"a"}}] andMarkDirty:NO error:nil];
+
+    XCTAssertEqual([numReplaced intValue], 1, @"unchanged document counts as replaced");
+    XCTAssertFalse([col1 isDirtyWithDocumentId:1 error:nil], @"unchanged document stays clean");
+
+    [col1 replaceDocuments:@[@{@"_id" : @1, @"json" : @{@"name" : @"carlos", @"age" : @10, @"bio" : @"b"}}] andMarkDirty:NO error:nil];
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart searchField:@"name" equal:@"carlos"];
+
+    NSArray* results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[[results objectAtIndex:0] objectForKey:@"json"] objectForKey:@"bio"], @"b", @"only the document changed");
+
+    [col1 replaceDocuments:@[@{@"_id" : @1, @"json" : @{@"name" : @"mike", @"age" : @10, @"bio" : @"b"}}] andMarkDirty:YES error:nil];
+
+    XCTAssertEqual([[col1 countWithQueryParts:@[queryPart] error:nil] intValue], 0, @"old search field value is gone");
+    XCTAssertTrue([col1 isDirtyWithDocumentId:1 error:nil], @"marked dirty");
+}
+
+-(void) testExternalDocuments
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    col1.externalStorageThreshold = @64;
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    ops.mapExternalDocuments = YES;
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open");
+
+    NSDictionary* small = @{ @"name" : @"mike" };
+    NSDictionary* large = @{ @"name" : @"carlos",
+                             @"bio" : @"a biography that is long enough to be kept in its own file next to the database" };
+
+    [col1 addData:@[small, large] andMarkDirty:NO withOptions:nil error:nil];
+
+    NSURL* documents = [[NSFileManager defaultManager] URLsForDirectory:NSDocumentDirectory inDomains:NSUserDomainMask][0];
+    NSString* folder = [[documents URLByAppendingPathComponent:[NSString stringWithFormat:@"%@/%@%@/people", JSON_STORE_DEFAULT_FOLDER_FOR_SQLITE_FILES, JSON_STORE_DEFAULT_USER, JSON_STORE_BLOB_FOLDER_EXTENSION]] path];
+
+    XCTAssertEqual([[[NSFileManager defaultManager] contentsOfDirectoryAtPath:folder error:nil] count], 1, @"only the large document is in a file");
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart searchField:@"name" equal:@"carlos"];
+
+    NSArray* results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], large, @"external round trip with search field query");
+
+    NSNumber* docId = [[results objectAtIndex:0] objectForKey:@"_id"];
+    NSMutableDictionary* replacement = [large mutableCopy];
+    replacement[@"bio"] = @"another biography that is also long enough to be kept in its own file";
+
+    [col1 replaceDocuments:@[@{@"_id" : docId, @"json" : replacement}] andMarkDirty:NO error:nil];
+
+    results = [col1 findWithIds:@[docId] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], replacement, @"replaced document read from its new file");
+    XCTAssertEqual([[[NSFileManager defaultManager] contentsOfDirectoryAtPath:folder error:nil] count], 1, @"old file removed on replace");
+
+    [col1 removeWithIds:@[docId] andMarkDirty:NO error:nil];
+
+    XCTAssertEqual([[[NSFileManager defaultManager] contentsOfDirectoryAtPath:folder error:nil] count], 0, @"file removed with its document");
+
+    [col1 addData:@[large] andMarkDirty:NO withOptions:nil error:nil];
+
+    XCTAssertTrue([[JSONStore sharedInstance] startTransactionAndReturnError:nil], @"start transaction");
+    XCTAssertTrue([col1 clearCollectionWithError:nil], @"clear in transaction");
+    XCTAssertTrue([[JSONStore sharedInstance] rollbackTransactionAndReturnError:nil], @"rollback");
+
+    results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], large, @"file kept when the clear is rolled back");
+
+    [col1 clearCollectionWithError:nil];
+
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:folder], @"files removed on clear");
+}
+
+-(void) testStoreDocumentsSeparately
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    NSDictionary* doc = @{ @"name" : @"carlos", @"address" : @{ @"city" : @"Austin" } };
+    [col1 addData:@[doc] andMarkDirty:NO withOptions:nil error:nil];
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    col1.storeDocumentsSeparately = YES;
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"documents moved to their own table");
+
+    [col1 addData:@[@{@"name" : @"mike"}] andMarkDirty:YES withOptions:nil error:nil];
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart searchField:@"name" equal:@"carlos"];
+
+    NSArray* results = [col1 findWithQueryParts:@[queryPart] andOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], doc, @"moved document found by search field");
+    XCTAssertEqual([[col1 countAllDocumentsAndReturnError:nil] intValue], 2, @"count");
+    XCTAssertEqualObjects([[[col1 allDirtyAndReturnError:nil] objectAtIndex:0] objectForKey:@"json"], @{@"name" : @"mike"}, @"dirty documents read their json");
+
+    NSNumber* docId = [[results objectAtIndex:0] objectForKey:@"_id"];
+    NSDictionary* replacement = @{ @"name" : @"carlos", @"address" : @{ @"city" : @"Dallas" } };
+
+    [col1 replaceDocuments:@[@{@"_id" : docId, @"json" : replacement}] andMarkDirty:NO error:nil];
+
+    JSONStoreQueryPart* pathPart = [[JSONStoreQueryPart alloc] init];
+    [pathPart jsonPath:@"address.city" equal:@"Dallas"];
+
+    XCTAssertEqual([[col1 countWithQueryParts:@[pathPart] error:nil] intValue], 1, @"only the json changed");
+
+    [col1 removeWithIds:@[docId] andMarkDirty:NO error:nil];
+
+    XCTAssertEqual([[col1 countAllDocumentsAndReturnError:nil] intValue], 1, @"removed with its json");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    col1.storeDocumentsSeparately = NO;
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"documents moved back");
+
+    results = [col1 findAllWithOptions:nil error:nil];
+
+    XCTAssertEqualObjects([[results objectAtIndex:0] objectForKey:@"json"], @{@"name" : @"mike"}, @"moved back document decodes");
+}
+
+-(void) testSchemaCatalog
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    [col1 setSearchField:@"age" withType:JSONStore_Integer];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"created");
+    XCTAssertFalse(col1.reopened, @"new collection");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    JSONStoreCollection* sameFields = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [sameFields setSearchField:@"AGE" withType:JSONStore_Integer];
+    [sameFields setSearchField:@"name" withType:JSONStore_String];
+
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[sameFields] withOptions:ops error:nil], @"validated by the catalog");
+    XCTAssertTrue(sameFields.reopened, @"existing collection");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    JSONStoreCollection* otherFields = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [otherFields setSearchField:@"name" withType:JSONStore_String];
+
+    NSError* error = nil;
+    XCTAssertFalse([[JSONStore sharedInstance] openCollections:@[otherFields] withOptions:ops error:&error], @"mismatch");
+    XCTAssertEqual([error code], JSON_STORE_PROVISION_TABLE_SCHEMA_MISMATCH, @"mismatch error");
+}
+
+-(void) testProvisionLazily
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreCollection* col2 = [[JSONStoreCollection alloc] initWithName:@"orders"];
+    [col2 setSearchField:@"total" withType:JSONStore_Number];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    ops.provisionLazily = YES;
+
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1, col2] withOptions:ops error:nil], @"open");
+    XCTAssertTrue(col1._provisionPending && col2._provisionPending, @"nothing provisioned by open");
+
+    int numAdded = [[col1 addData:@[@{@"name" : @"carlos"}] andMarkDirty:NO withOptions:nil error:nil] intValue];
+
+    XCTAssertEqual(numAdded, 1, @"provisioned by first use");
+    XCTAssertFalse(col1._provisionPending, @"used collection provisioned");
+    XCTAssertTrue(col2._provisionPending, @"unused collection still pending");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    NSError* error = nil;
+    [col2 countAllDocumentsAndReturnError:&error];
+
+    XCTAssertEqual([error code], JSON_STORE_DATABASE_NOT_OPEN, @"not provisioned after close");
+
+    ops.warmUpInBackground = YES;
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1, col2] withOptions:ops error:nil], @"open with warm-up");
+
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+
+    while ((col1._provisionPending || col2._provisionPending) && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+
+    XCTAssertFalse(col1._provisionPending || col2._provisionPending, @"provisioned in the background");
+    XCTAssertTrue(col1.reopened, @"existing collection");
+    XCTAssertEqual([[col1 countAllDocumentsAndReturnError:nil] intValue], 1, @"count");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    JSONStoreCollection* col3 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col3 setSearchField:@"age" withType:JSONStore_Integer];
+
+    JSONStoreCollection* col4 = [[JSONStoreCollection alloc] initWithName:@"items"];
+    [col4 setSearchField:@"name" withType:JSONStore_String];
+
+    ops.warmUpInBackground = NO;
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col3, col4] withOptions:ops error:nil], @"open with another schema");
+
+    error = nil;
+    [col3 countAllDocumentsAndReturnError:&error];
+
+    XCTAssertEqual([error code], JSON_STORE_PROVISION_TABLE_SCHEMA_MISMATCH, @"provision error reported");
+
+    XCTAssertTrue([[JSONStore sharedInstance] startTransactionAndReturnError:nil], @"start transaction");
+    XCTAssertFalse(col4._provisionPending, @"provisioned before the transaction");
+
+    error = nil;
+    [col3 countAllDocumentsAndReturnError:&error];
+
+    XCTAssertEqual([error code], JSON_STORE_PROVISION_TABLE_SCHEMA_MISMATCH, @"same error during the transaction");
+    XCTAssertTrue([[JSONStore sharedInstance] rollbackTransactionAndReturnError:nil], @"rollback");
+
+    error = nil;
+    XCTAssertEqual([[col4 countAllDocumentsAndReturnError:&error] intValue], 0, @"count");
+    XCTAssertNil(error, @"collection kept after rollback");
+}
+
+-(void) testWarmUpHotCollections
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    col1.hot = YES;
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open");
+
+    NSMutableArray* docs = [[NSMutableArray alloc] init];
+
+    for (int i = 0; i < 500; i++) {
+        [docs addObject:@{@"name" : [NSString stringWithFormat:@"name%d", i]}];
+    }
+
+    [col1 addData:docs andMarkDirty:NO withOptions:nil error:nil];
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    ops.warmUpMemoryBudget = @(1024 * 1024);
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open with warm-up");
+
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+
+    while (! [[JSONStore sharedInstance] warmUpMetrics] && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+
+    NSDictionary* metrics = [[JSONStore sharedInstance] warmUpMetrics];
+
+    XCTAssertNotNil(metrics[JSON_STORE_KEY_WARM_UP_DURATION], @"duration");
+    XCTAssertFalse([metrics[JSON_STORE_KEY_WARM_UP_CANCELLED] boolValue], @"not cancelled");
+    XCTAssertTrue([metrics[JSON_STORE_KEY_CACHE_SIZE] unsignedIntegerValue] > 0, @"pages read into the cache");
+    XCTAssertTrue([metrics[JSON_STORE_KEY_CACHE_SIZE] unsignedIntegerValue] <= 1024 * 1024 + 64 * 4096, @"within the budget");
+
+    JSONStoreQueryPart* query = [[JSONStoreQueryPart alloc] init];
+    [query searchField:@"name" like:@"name1"];
+
+    XCTAssertTrue([[col1 findWithQueryParts:@[query] andOptions:nil error:nil] count] > 0, @"find");
+    XCTAssertTrue([[[JSONStore sharedInstance] warmUpMetrics][JSON_STORE_KEY_WARM_UP_HIT_RATE_AFTER] doubleValue] > 0, @"find hits the warm cache");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open again");
+    [[JSONStore sharedInstance] cancelWarmUp];
+
+    deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+
+    while (! [[JSONStore sharedInstance] warmUpMetrics] && [deadline timeIntervalSinceNow] > 0) {
+        [NSThread sleepForTimeInterval:0.01];
+    }
+
+    XCTAssertNotNil([[JSONStore sharedInstance] warmUpMetrics], @"metrics after cancel");
+}
+
+-(JSONStoreCollection*) _referenceCollectionWithOptions:(JSONStoreOpenOptions*) options
+                                               documents:(int) documents
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"reference"];
+    [col1 setSearchField:@"code" withType:JSONStore_String];
+    
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:[[JSONStoreOpenOptions alloc] init] error:nil], @"open");
+    
+    NSMutableArray* docs = [[NSMutableArray alloc] init];
     
+    for (int i = 0; i < documents; i++) {
+        [docs addObject:@{@"code" : [NSString stringWithFormat:@"code%d", i], @"description" : [@"" stringByPaddingToLength:300 withString:@"reference data " startingAtIndex:0]}];
+    }
+    
+    [col1 addData:docs andMarkDirty:NO withOptions:nil error:nil];
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+    
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:options error:nil], @"open with options");
+    
+    return col1;
+}
+
+-(void) _scanAndLookupCollection:(JSONStoreCollection*) collection
+                       documents:(int) documents
+{
+    for (int i = 0; i < 5; i++) {
+        XCTAssertTrue([[collection findAllWithOptions:nil error:nil] count] == documents, @"scan");
+    }
+    
+    for (int i = 1; i <= documents; i += 7) {
+        XCTAssertTrue([[collection findWithIds:@[@(i)] andOptions:nil error:nil] count] == 1, @"point lookup");
+    }
+}
+
+-(void) testStorageTuning
+{
     JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
-    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+    ops.pageSize = @16384;
+    ops.mmapSize = @(64 * 1024 * 1024);
+    ops.cacheSize = @(8 * 1024 * 1024);
     
-    int numAdded = [[col1 addData:@[ @{ @"name" : @"hello-world"}, @{ @"name" : @"hey-world"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    JSONStoreCollection* col1 = [self _referenceCollectionWithOptions:ops documents:100];
     
-    XCTAssertTrue(numAdded == 2, @"check added");
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 100, @"documents kept by the rebuild");
     
-    NSArray* doc1 = [col1 findWithIds:@[@1] andOptions:nil error:nil][0];
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
     
-    XCTAssertTrue([[doc1 valueForKeyPath:@"json.name"] isEqualToString:@"hello-world"], @"find1");
+    //The page size is a big-endian 16 bit value at offset 16 of the database header
+    NSURL* documents = [[NSFileManager defaultManager] URLsForDirectory:NSDocumentDirectory inDomains:NSUserDomainMask][0];
+    NSString* path = [[documents URLByAppendingPathComponent:[NSString stringWithFormat:@"%@/%@", JSON_STORE_DEFAULT_FOLDER_FOR_SQLITE_FILES, JSON_STORE_DEFAULT_SQLITE_FILE]] path];
+    NSData* header = [[NSFileHandle fileHandleForReadingAtPath:path] readDataOfLength:18];
+    const unsigned char* bytes = [header bytes];
     
-    NSArray* doc2 = [col1 findWithIds:@[@2] andOptions:nil error:nil][0];
+    XCTAssertEqual([header length], 18, @"database header");
+    XCTAssertEqual((bytes[16] << 8) | bytes[17], 16384, @"store rebuilt with the new page size");
     
-    XCTAssertTrue([[doc2 valueForKeyPath:@"json.name"] isEqualToString:@"hey-world"], @"find2");
+    NSError* error = nil;
+    ops.pageSize = @1000;
+    
+    XCTAssertFalse([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:&error], @"page size not a power of two");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_STORAGE_OPTIONS, @"invalid page size");
+    
+    error = nil;
+    ops.pageSize = nil;
+    ops.password = @"secret";
+    
+    XCTAssertFalse([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:&error], @"mmap with a password");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_STORAGE_OPTIONS, @"mmap not supported when encrypted");
 }
 
--(void) testRemoveCollection
+-(void) testScanAndLookupPerformance
 {
-    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
-    [col1 setSearchField:@"first*Name" withType:JSONStore_String];
+    JSONStoreCollection* col1 = [self _referenceCollectionWithOptions:[[JSONStoreOpenOptions alloc] init] documents:3000];
     
+    [self measureBlock:^{
+        [self _scanAndLookupCollection:col1 documents:3000];
+    }];
+}
+
+-(void) testScanAndLookupPerformanceWithStorageTuning
+{
     JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
-    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
-    
-    int numAdded = [[col1 addData:@[ @{ @"first*Name" : @"hello-*world"}, @{ @"first*Name" : @"hey*-world"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    ops.pageSize = @16384;
+    ops.mmapSize = @(64 * 1024 * 1024);
+    ops.cacheSize = @(8 * 1024 * 1024);
     
-    XCTAssertTrue(numAdded == 2, @"add count");
+    JSONStoreCollection* col1 = [self _referenceCollectionWithOptions:ops documents:3000];
     
-    NSArray* results = [col1 findAllWithOptions:nil error:nil];
+    [self measureBlock:^{
+        [self _scanAndLookupCollection:col1 documents:3000];
+    }];
+}
+
+-(void) testAsyncOperations
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
     
-    XCTAssertTrue([results count] == 2, @"findAll count");
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
     
-    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 2, @"count");
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open");
     
-    [col1 removeCollectionWithError:nil];
+    NSMutableArray* docs = [[NSMutableArray alloc] init];
     
-    @try {
-        [col1 addData:@[ @{ @"first*Name" : @"hello-*world"}, @{ @"first*Name" : @"hey*-world"} ] andMarkDirty:NO withOptions:nil error:nil];
+    for (int i = 0; i < 2000; i++) {
+        [docs addObject:@{@"name" : [NSString stringWithFormat:@"name%d", i]}];
     }
-    @catch (NSException *exception) {
-        NSString* name = exception.reason;
-        
-        XCTAssertTrue([name isEqualToString:@"JSON_STORE_ADD_FAILURE"], @"exception name");
-        
-        int errorCode = [[exception.userInfo objectForKey:JSON_STORE_ERROR_OBJ_KEY_ERR] integerValue];
-        
-        XCTAssertTrue(errorCode == JSON_STORE_PERSISTENT_STORE_FAILURE, @"exception rc");
+    
+    NSMutableArray* order = [[NSMutableArray alloc] init];
+    
+    XCTestExpectation* added = [self expectationWithDescription:@"add"];
+    [col1 addData:docs andMarkDirty:NO withOptions:nil completion:^(NSNumber* numberAdded, NSError* error) {
+        XCTAssertTrue([numberAdded intValue] == 2000, @"added");
+        [order addObject:@"add"];
+        [added fulfill];
+    }];
+    
+    XCTestExpectation* counted = [self expectationWithDescription:@"cancelled count"];
+    JSONStoreAsyncOperation* count = [col1 countAllDocumentsWithCompletion:^(NSNumber* number, NSError* error) {
+        XCTAssertTrue([error code] == JSON_STORE_OPERATION_CANCELLED, @"cancelled error");
+        [order addObject:@"count"];
+        [counted fulfill];
+    }];
+    
+    //The add is still running, so the count has not started
+    XCTAssertTrue([count cancel], @"cancelled before it started");
+    
+    XCTestExpectation* found = [self expectationWithDescription:@"find"];
+    JSONStoreQueryPart* query = [[JSONStoreQueryPart alloc] init];
+    [query searchField:@"name" equal:@"name7"];
+    
+    [col1 findWithQueryParts:@[query] andOptions:nil completion:^(NSArray* results, NSError* error) {
+        XCTAssertTrue([results count] == 1, @"find sees the add");
+        [order addObject:@"find"];
+        [found fulfill];
+    }];
+    
+    XCTestExpectation* rolledBack = [self expectationWithDescription:@"rollback"];
+    [[JSONStore sharedInstance] startTransactionWithCompletion:nil];
+    [col1 removeWithIds:@[@1] andMarkDirty:NO completion:nil];
+    [[JSONStore sharedInstance] rollbackTransactionWithCompletion:^(BOOL worked, NSError* error) {
+        XCTAssertTrue(worked, @"rollback");
+        [order addObject:@"rollback"];
+        [rolledBack fulfill];
+    }];
+    
+    XCTestExpectation* countedAgain = [self expectationWithDescription:@"count"];
+    [col1 countAllDocumentsWithCompletion:^(NSNumber* number, NSError* error) {
+        XCTAssertTrue([number intValue] == 2000, @"remove rolled back");
+        [order addObject:@"count"];
+        [countedAgain fulfill];
+    }];
+    
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    
+    XCTAssertTrue(count.cancelled, @"cancelled");
+    XCTAssertEqualObjects(order, (@[@"add", @"count", @"find", @"rollback", @"count"]), @"submission order");
+}
+
+-(void) testAsyncTransactionWithManyCollections
+{
+    //More collection queues than GCD has worker threads, a transaction must not hold a thread for each of them
+    NSMutableArray* collections = [[NSMutableArray alloc] init];
+    
+    for (int i = 0; i < 100; i++) {
+        JSONStoreCollection* collection = [[JSONStoreCollection alloc] initWithName:[NSString stringWithFormat:@"people%d", i]];
+        [collection setSearchField:@"name" withType:JSONStore_String];
+        [collections addObject:collection];
     }
     
-    JSONStoreOpenOptions* ops2 = [[JSONStoreOpenOptions alloc] init];
-    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops2 error:nil];
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
     
-    int numAdded2 = [[col1 addData:@[ @{ @"first*Name" : @"hello-*world"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:collections withOptions:ops error:nil], @"open");
     
-    XCTAssertTrue(numAdded2 == 1, @"add count");
+    NSMutableArray* order = [[NSMutableArray alloc] init];
     
-    NSArray* results2 = [col1 findAllWithOptions:nil error:nil];
+    for (JSONStoreCollection* collection in collections) {
+        [collection addData:@[@{@"name" : @"carlos"}] andMarkDirty:NO withOptions:nil completion:^(NSNumber* numberAdded, NSError* error) {
+            XCTAssertTrue([numberAdded intValue] == 1, @"added");
+            [order addObject:@"add"];
+        }];
+    }
     
-    XCTAssertTrue([results2 count] == 1, @"findAll count");
+    [[JSONStore sharedInstance] startTransactionWithCompletion:nil];
     
-    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 1, @"count");
+    XCTestExpectation* committed = [self expectationWithDescription:@"commit"];
+    [[JSONStore sharedInstance] commitTransactionWithCompletion:^(BOOL worked, NSError* error) {
+        XCTAssertTrue(worked, @"commit");
+        [order addObject:@"commit"];
+        [committed fulfill];
+    }];
+    
+    for (JSONStoreCollection* collection in collections) {
+        
+        XCTestExpectation* counted = [self expectationWithDescription:collection.collectionName];
+        [collection countAllDocumentsWithCompletion:^(NSNumber* number, NSError* error) {
+            XCTAssertTrue([number intValue] == 1, @"count");
+            [order addObject:@"count"];
+            [counted fulfill];
+        }];
+    }
+    
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    
+    XCTAssertTrue([order count] == 201, @"every operation finished");
+    XCTAssertTrue([order indexOfObject:@"commit"] == 100, @"transaction ran after the operations submitted before it");
 }
 
--(void) testFindWithLimit
+-(void) testWriterLanes
 {
-    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"peeps"];
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
     [col1 setSearchField:@"name" withType:JSONStore_String];
+    col1.storeInSeparateFile = YES;
+    col1.ownWriterLane = YES;
+    
+    JSONStoreCollection* col2 = [[JSONStoreCollection alloc] initWithName:@"orders"];
+    [col2 setSearchField:@"item" withType:JSONStore_String];
+    col2.storeInSeparateFile = YES;
+    col2.ownWriterLane = YES;
     
     JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
-    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
     
-    int numAdded = [[col1 addData:@[ @{ @"name" : @"world1"}, @{ @"name" : @"world2"} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1, col2] withOptions:ops error:nil], @"open");
     
-    XCTAssertTrue(numAdded == 2, @"add count");
+    NSMutableArray* people = [[NSMutableArray alloc] init];
+    NSMutableArray* orders = [[NSMutableArray alloc] init];
     
-    JSONStoreQueryOptions* qops = [[JSONStoreQueryOptions alloc] init];
-    qops.limit = @2;
-    qops.offset = @0;
+    for (int i = 0; i < 2000; i++) {
+        [people addObject:@{@"name" : [NSString stringWithFormat:@"name%d", i]}];
+        [orders addObject:@{@"item" : [NSString stringWithFormat:@"item%d", i]}];
+    }
     
-    JSONStoreQueryPart* q1 = [[JSONStoreQueryPart alloc] init];
-    q1._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    //Each collection writes on its own connection, so both adds run at the same time
+    for (int i = 0; i < 5; i++) {
+        
+        XCTestExpectation* peopleAdded = [self expectationWithDescription:@"people"];
+        [col1 addData:people andMarkDirty:NO withOptions:nil completion:^(NSNumber* numberAdded, NSError* error) {
+            XCTAssertTrue([numberAdded intValue] == 2000, @"people added");
+            [peopleAdded fulfill];
+        }];
+        
+        XCTestExpectation* ordersAdded = [self expectationWithDescription:@"orders"];
+        [col2 addData:orders andMarkDirty:NO withOptions:nil completion:^(NSNumber* numberAdded, NSError* error) {
+            XCTAssertTrue([numberAdded intValue] == 2000, @"orders added");
+            [ordersAdded fulfill];
+        }];
+    }
     
-    NSArray* results0 = [col1 findWithQueryParts:@[q1] andOptions:qops error:nil];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
     
-    XCTAssertTrue([results0 count] == 2, @"results0 count");
+    XCTAssertTrue([[JSONStoreQueue sharedManager].writerLanes count] == 2, @"lanes opened");
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 10000, @"people count");
+    XCTAssertTrue([[col2 countAllDocumentsAndReturnError:nil] intValue] == 10000, @"orders count");
     
-    XCTAssertTrue([[[results0 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world1"], @"results0 name1");
-    XCTAssertTrue([[[results0 objectAtIndex:1] valueForKeyPath:@"json.name"] isEqualToString:@"world2"], @"results0 name2");
+    //Transactions run on the main connection, they close the lanes and see what was written on them
+    XCTAssertTrue([[JSONStore sharedInstance] startTransactionAndReturnError:nil], @"start transaction");
+    XCTAssertTrue([[JSONStoreQueue sharedManager].writerLanes count] == 0, @"lanes closed");
     
-    JSONStoreQueryOptions* qops2 = [[JSONStoreQueryOptions alloc] init];
-    qops2.limit = @1;
-    qops2.offset = @0;
+    [col1 removeWithIds:@[@1, @2] andMarkDirty:NO error:nil];
+    [col2 addData:@[@{@"item" : @"rolled back"}] andMarkDirty:NO withOptions:nil error:nil];
     
-    JSONStoreQueryPart* q2 = [[JSONStoreQueryPart alloc] init];
-    q2._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    XCTAssertTrue([[JSONStore sharedInstance] rollbackTransactionAndReturnError:nil], @"rollback");
     
-    NSArray* results1 = [col1 findWithQueryParts:@[q2] andOptions:qops2 error:nil];
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 10000, @"people remove rolled back");
+    XCTAssertTrue([[col2 countAllDocumentsAndReturnError:nil] intValue] == 10000, @"orders add rolled back");
+    XCTAssertTrue([[JSONStoreQueue sharedManager].writerLanes count] == 2, @"lanes opened again");
     
-    XCTAssertTrue([results1 count] == 1, @"results0 count");
+    XCTAssertTrue([col1 removeCollectionWithError:nil], @"remove");
+    XCTAssertNil([JSONStoreQueue sharedManager].writerLanes[@"people"], @"lane closed on remove");
+}
+
+-(void) testGroupCommit
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
     
-    XCTAssertTrue([[[results1 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world1"], @"results0 name1");
+    //A window the test never waits for and a batch it never fills, a group is committed when the commit before it ends
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    ops.groupCommitWindow = @30;
+    ops.groupCommitBatchSize = @4;
     
-    JSONStoreQueryOptions* qops3 = [[JSONStoreQueryOptions alloc] init];
-    qops3.limit = @1;
-    qops3.offset = @1;
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open with group commit");
     
-    JSONStoreQueryPart* q3 = [[JSONStoreQueryPart alloc] init];
-    q3._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    //Nothing else is pending, so the write commits without waiting for the window
+    NSDate* start = [NSDate date];
+    XCTAssertTrue([[col1 addData:@[@{@"name" : @"carlos"}, @{@"name" : @"mike"}] andMarkDirty:NO withOptions:nil error:nil] intValue] == 2, @"added");
+    XCTAssertTrue([[NSDate date] timeIntervalSinceDate:start] < 10, @"single write committed right away");
     
-    NSArray* results2 = [col1 findWithQueryParts:@[q3] andOptions:qops3 error:nil];
+    NSArray* people = [col1 findAllWithOptions:nil error:nil];
+    JSONStoreQueue* accessor = [JSONStoreQueue sharedManager];
+    dispatch_queue_t background = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+    dispatch_group_t writers = dispatch_group_create();
+    dispatch_semaphore_t holding = dispatch_semaphore_create(0);
+    dispatch_semaphore_t unblock = dispatch_semaphore_create(0);
     
-    XCTAssertTrue([results2 count] == 1, @"results2 count");
+    BOOL (^waitFor)(BOOL (^)(void)) = ^BOOL(BOOL (^condition)(void)) {
+        
+        NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:10];
+        
+        while (! condition()) {
+            
+            if ([deadline timeIntervalSinceNow] < 0) {
+                return NO;
+            }
+            
+            [NSThread sleepForTimeInterval:0.01];
+        }
+        
+        return YES;
+    };
     
-    XCTAssertTrue([[[results2 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world2"], @"results2 name1");
+    //Holds the store queue, so the commit of the first write stays open
+    dispatch_group_async(writers, background, ^{
+        [accessor performOperation:^{
+            dispatch_semaphore_signal(holding);
+            dispatch_semaphore_wait(unblock, DISPATCH_TIME_FOREVER);
+        }];
+    });
     
-    JSONStoreQueryOptions* qops4 = [[JSONStoreQueryOptions alloc] init];
-    qops4.limit = @1;
-    qops4.offset = nil;
+    dispatch_semaphore_wait(holding, DISPATCH_TIME_FOREVER);
     
-    JSONStoreQueryPart* q4 = [[JSONStoreQueryPart alloc] init];
-    q4._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    __block NSNumber* firstAdded = nil;
     
-    NSArray* results3 = [col1 findWithQueryParts:@[q4] andOptions:qops4 error:nil];
+    dispatch_group_async(writers, background, ^{
+        firstAdded = [col1 addData:@[@{@"name" : @"dgonz"}] andMarkDirty:NO withOptions:nil error:nil];
+    });
     
-    XCTAssertTrue([results3 count] == 1, @"results3 count");
+    XCTAssertTrue(waitFor(^BOOL {
+        @synchronized (accessor.pendingGroupCommits) {
+            return [accessor.activeGroupCommits countForObject:@"people"] == 1;
+        }
+    }), @"first commit open");
+    
+    //The writes that arrive while it is open wait for it, then share one transaction
+    __block NSNumber* replaced = nil;
+    __block NSError* replaceError = nil;
+    __block NSNumber* added = nil;
+    __block NSError* addError = nil;
+    __block NSNumber* missing = nil;
+    __block NSError* missingError = nil;
+    
+    dispatch_group_async(writers, background, ^{
+        NSError* error = nil;
+        NSDictionary* doc = @{JSON_STORE_FIELD_ID : people[0][JSON_STORE_FIELD_ID], JSON_STORE_FIELD_JSON : @{@"name" : @"replaced"}};
+        replaced = [col1 replaceDocuments:@[doc] andMarkDirty:NO error:&error];
+        replaceError = error;
+    });
+    
+    dispatch_group_async(writers, background, ^{
+        NSError* error = nil;
+        added = [col1 addData:@[@{@"name" : @"tim"}] andMarkDirty:NO withOptions:nil error:&error];
+        addError = error;
+    });
+    
+    //Fails inside the write, there is no document with this _id
+    dispatch_group_async(writers, background, ^{
+        NSError* error = nil;
+        NSDictionary* doc = @{JSON_STORE_FIELD_ID : @99999, JSON_STORE_FIELD_JSON : @{@"name" : @"missing"}};
+        missing = [col1 replaceDocuments:@[doc] andMarkDirty:NO error:&error];
+        missingError = error;
+    });
+    
+    XCTAssertTrue(waitFor(^BOOL {
+        @synchronized (accessor.pendingGroupCommits) {
+            return [accessor.pendingGroupCommits[@"people"] count] == 3;
+        }
+    }), @"writes grouped behind the open commit");
     
-    XCTAssertTrue([[[results3 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world1"], @"results3 name1");
+    dispatch_semaphore_signal(unblock);
     
-    JSONStoreQueryOptions* qops5 = [[JSONStoreQueryOptions alloc] init];
-    qops5.limit = @-1;
-    qops5.offset = nil;
+    XCTAssertEqual(dispatch_group_wait(writers, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)), 0, @"group committed when the commit before it ended");
     
-    JSONStoreQueryPart* q5 = [[JSONStoreQueryPart alloc] init];
-    q5._like = (NSMutableArray*) @[@{ @"name" : @"world"}];
+    XCTAssertTrue([firstAdded intValue] == 1, @"first write committed");
+    XCTAssertTrue([replaced intValue] == 1 && replaceError == nil, @"replace in the group committed");
+    XCTAssertTrue([added intValue] == 1 && addError == nil, @"add in the group committed");
+    XCTAssertNil(missing, @"failed write");
+    XCTAssertEqual([missingError code], JSON_STORE_REPLACE_DOCUMENTS_FAILURE, @"only the failing write gets an error");
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 4, @"writes that did not fail stored");
+    XCTAssertEqualObjects([col1 findWithIds:@[people[0][JSON_STORE_FIELD_ID]] andOptions:nil error:nil][0][JSON_STORE_FIELD_JSON][@"name"], @"replaced", @"replace stored");
     
-    NSArray* results4 = [col1 findWithQueryParts:@[q4] andOptions:qops5 error:nil];
+    //Writes in a transaction are not grouped, they are rolled back with it
+    XCTAssertTrue([[JSONStore sharedInstance] startTransactionAndReturnError:nil], @"start");
+    XCTAssertTrue([[col1 addData:@[@{@"name" : @"lisa"}] andMarkDirty:NO withOptions:nil error:nil] intValue] == 1, @"add in the transaction");
+    XCTAssertTrue([[JSONStore sharedInstance] rollbackTransactionAndReturnError:nil], @"rollback");
+    XCTAssertTrue([[col1 countAllDocumentsAndReturnError:nil] intValue] == 4, @"add in the transaction rolled back");
+}
+
+-(void) testGroupCommitPerformance
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
     
-    XCTAssertTrue([results4 count] == 1, @"results4 count");
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    ops.groupCommitWindow = @0.005;
+    ops.groupCommitBatchSize = @32;
     
-    XCTAssertTrue([[[results4 objectAtIndex:0] valueForKeyPath:@"json.name"] isEqualToString:@"world2"], @"results4 name1");
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil], @"open with group commit");
+    
+    //Many writers at once, the ones that arrive during a commit share the next one
+    [self measureBlock:^{
+        dispatch_apply(200, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+            [col1 addData:@[@{@"name" : [NSString stringWithFormat:@"name%zu", i]}] andMarkDirty:NO withOptions:nil error:nil];
+        });
+    }];
+}
+
+-(void) testStoreInSeparateFile
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreCollection* col2 = [[JSONStoreCollection alloc] initWithName:@"countries"];
+    [col2 setSearchField:@"code" withType:JSONStore_String];
+    col2.storeInSeparateFile = YES;
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    XCTAssertTrue([[JSONStore sharedInstance] openCollections:@[col1, col2] withOptions:ops error:nil], @"open");
+
+    NSURL* documents = [[[NSFileManager defaultManager] URLsForDirectory:NSDocumentDirectory inDomains:NSUserDomainMask] firstObject];
+    NSString* path = [[documents URLByAppendingPathComponent:@"wljsonstore/jsonstore.collections/countries.sqlite"] path];
+
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:path], @"collection file created");
+
+    [col1 addData:@[@{@"name" : @"carlos"}] andMarkDirty:NO withOptions:nil error:nil];
+    [col2 addData:@[@{@"code" : @"US"}, @{@"code" : @"MX"}] andMarkDirty:YES withOptions:nil error:nil];
+
+    JSONStoreQueryPart* queryPart = [[JSONStoreQueryPart alloc] init];
+    [queryPart searchField:@"code" equal:@"MX"];
+
+    XCTAssertEqual([[col2 countAllDocumentsAndReturnError:nil] intValue], 2, @"count");
+    XCTAssertEqual([[col2 countAllDirtyDocumentsWithError:nil] intValue], 2, @"dirty count");
+    XCTAssertEqual([[col2 findWithQueryParts:@[queryPart] andOptions:nil error:nil] count], 1, @"find by search field");
+
+    XCTAssertTrue([col2 clearCollectionWithError:nil], @"clear");
+    XCTAssertEqual([[col2 countAllDocumentsAndReturnError:nil] intValue], 0, @"cleared");
+
+    [col2 addData:@[@{@"code" : @"CA"}] andMarkDirty:NO withOptions:nil error:nil];
+
+    XCTAssertEqual([[col2 findAllWithOptions:nil error:nil] count], 1, @"usable after clear");
+    XCTAssertEqual([[col1 countAllDocumentsAndReturnError:nil] intValue], 1, @"other collection untouched");
+
+    XCTAssertTrue([col2 removeCollectionWithError:nil], @"remove");
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path], @"collection file removed");
+}
+
+-(void) testKeyCache
+{
+    JSONStoreKeyCache* keyCache = [JSONStoreKeyCache sharedInstance];
+    NSData* key = [@"abcdef" dataUsingEncoding:NSUTF8StringEncoding];
+
+    keyCache.timeToLive = 0;
+    [keyCache setKey:key forUsername:@"carlos" withPassword:@"123"];
+
+    XCTAssertNil([keyCache keyForUsername:@"carlos" withPassword:@"123"], @"nothing cached while off");
+
+    keyCache.timeToLive = 60;
+    [keyCache setKey:key forUsername:@"carlos" withPassword:@"123"];
+
+    XCTAssertEqualObjects([keyCache keyForUsername:@"carlos" withPassword:@"123"], key, @"cached key");
+    XCTAssertNil([keyCache keyForUsername:@"carlos" withPassword:@"1234"], @"wrong password");
+    XCTAssertNil([keyCache keyForUsername:@"mike" withPassword:@"123"], @"other user");
+
+    [[JSONStore sharedInstance] closeAllCollectionsKeepingCachedKeyAndReturnError:nil];
+
+    XCTAssertEqualObjects([keyCache keyForUsername:@"carlos" withPassword:@"123"], key, @"kept on close keeping the key");
+
+    [[JSONStore sharedInstance] closeAllCollectionsAndReturnError:nil];
+
+    XCTAssertNil([keyCache keyForUsername:@"carlos" withPassword:@"123"], @"evicted on close");
+
+    keyCache.timeToLive = 0.1;
+    [keyCache setKey:key forUsername:@"carlos" withPassword:@"123"];
+    [NSThread sleepForTimeInterval:0.2];
+
+    XCTAssertNil([keyCache keyForUsername:@"carlos" withPassword:@"123"], @"expired");
+
+    keyCache.timeToLive = 0;
+}
+
+-(void) testKeyDerivationFunction
+{
+    NSString* sha1Key = [JSONStoreSecurityUtils generateKeyWithPassword:@"123" andSalt:@"abc" andIterations:1000];
+    NSString* legacyKey = [JSONStoreSecurityUtils generateKeyWithPassword:@"123" andSalt:@"abc" andIterations:1000 andPseudoRandomFunction:JSONStore_PBKDF2_SHA1];
+    NSString* sha256Key = [JSONStoreSecurityUtils generateKeyWithPassword:@"123" andSalt:@"abc" andIterations:1000 andPseudoRandomFunction:JSONStore_PBKDF2_SHA256];
+    NSString* sha512Key = [JSONStoreSecurityUtils generateKeyWithPassword:@"123" andSalt:@"abc" andIterations:1000 andPseudoRandomFunction:JSONStore_PBKDF2_SHA512];
+
+    XCTAssertEqualObjects(sha1Key, legacyKey, @"default is SHA1");
+    XCTAssertTrue([sha256Key length] == 64 && [sha512Key length] == 64, @"256 bit keys");
+    XCTAssertFalse([sha1Key isEqualToString:sha256Key], @"SHA256 key differs");
+    XCTAssertFalse([sha256Key isEqualToString:sha512Key], @"SHA512 key differs");
+
+    NSInteger tiny = [JSONStoreSecurityUtils iterationsForPassword:@"123" andSalt:@"abc" andPseudoRandomFunction:JSONStore_PBKDF2_SHA256 andTargetTime:0.0001];
+    NSInteger fast = [JSONStoreSecurityUtils iterationsForPassword:@"123" andSalt:@"abc" andPseudoRandomFunction:JSONStore_PBKDF2_SHA256 andTargetTime:0.1];
+    NSInteger slow = [JSONStoreSecurityUtils iterationsForPassword:@"123" andSalt:@"abc" andPseudoRandomFunction:JSONStore_PBKDF2_SHA256 andTargetTime:0.5];
+
+    XCTAssertTrue(tiny == JSON_STORE_DEFAULT_PBKDF2_ITERATIONS, @"calibrated iterations never go below the default");
+    XCTAssertTrue(slow > fast, @"more iterations for a longer target");
+
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"people"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    ops.password = @"123";
+    ops.keyDerivationIterations = @0;
+
+    NSError* error = nil;
+
+    XCTAssertFalse([[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:&error], @"zero iterations");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_KEY_DERIVATION_OPTIONS, @"invalid key derivation options");
+}
+
+-(void) testEncryptData
+{
+    NSData* data = [@"{\"name\":\"carlos\"}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData* key = [@"abcdef" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData* encrypted = [JSONStoreSecurityUtils encryptData:data withKey:key];
+
+    XCTAssertEqualObjects([JSONStoreSecurityUtils decryptData:encrypted withKey:key], data, @"round trip");
+    XCTAssertNil([JSONStoreSecurityUtils decryptData:encrypted withKey:[@"abcdeg" dataUsingEncoding:NSUTF8StringEncoding]], @"wrong key is rejected");
+
+    NSMutableData* tampered = [encrypted mutableCopy];
+    ((uint8_t*) tampered.mutableBytes)[20] ^= 1;
+
+    XCTAssertNil([JSONStoreSecurityUtils decryptData:tampered withKey:key], @"changed cipher text is rejected");
+}
+
+-(void) testAggregate
+{
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"orders"];
+    [col1 setSearchField:@"category" withType:JSONStore_String];
+    [col1 setSearchField:@"price" withType:JSONStore_Number];
+    [col1 setSearchField:@"quantity" withType:JSONStore_Integer];
+
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+
+    int numAdded = [[col1 addData:@[ @{ @"category" : @"books", @"price" : @10.5, @"quantity" : @1},
+                                     @{ @"category" : @"books", @"price" : @4.5, @"quantity" : @3},
+                                     @{ @"category" : @"games", @"price" : @60, @"quantity" : @2} ] andMarkDirty:NO withOptions:nil error:nil] intValue];
+
+    XCTAssertTrue(numAdded == 3, @"add count");
+
+    JSONStoreAggregateOptions* aops = [[JSONStoreAggregateOptions alloc] init];
+    [aops groupBySearchField:@"category"];
+    [aops countDocuments];
+    [aops sumOfSearchField:@"quantity"];
+    [aops averageOfSearchField:@"price"];
+    [aops maximumOfSearchField:@"price"];
+
+    NSError* error = nil;
+    NSArray* results = [col1 aggregateWithQueryParts:nil andOptions:aops error:&error];
+
+    XCTAssertNil(error, @"no error");
+    XCTAssertTrue([results count] == 2, @"one row per category");
+
+    NSDictionary* books = results[0];
+
+    XCTAssertTrue([books[@"category"] isEqualToString:@"books"], @"group value");
+    XCTAssertEqual([books[@"count"] intValue], 2, @"count");
+    XCTAssertEqual([books[@"sum(quantity)"] intValue], 4, @"sum");
+    XCTAssertEqualWithAccuracy([books[@"avg(price)"] doubleValue], 7.5, 0.001, @"avg");
+    XCTAssertEqualWithAccuracy([books[@"max(price)"] doubleValue], 10.5, 0.001, @"max");
+
+    JSONStoreQueryPart* q1 = [[JSONStoreQueryPart alloc] init];
+    [q1 searchField:@"price" greaterThan:@5];
+
+    NSArray* countResults = [col1 aggregateWithQueryParts:@[q1] andOptions:nil error:nil];
+
+    XCTAssertTrue([countResults count] == 1, @"single summary row");
+    XCTAssertEqual([countResults[0][@"count"] intValue], 2, @"count with query part");
+
+    JSONStoreAggregateOptions* invalid = [[JSONStoreAggregateOptions alloc] init];
+    [invalid sumOfSearchField:@"weight"];
+
+    error = nil;
+    XCTAssertNil([col1 aggregateWithQueryParts:nil andOptions:invalid error:&error], @"unknown search field");
+    XCTAssertEqual([error code], JSON_STORE_INVALID_SEARCH_FIELD, @"invalid search field");
 }
 
 -(void) testRemoveWithMarkDirtyTrueAndClean
@@ -1069,6 +2404,36 @@
     XCTAssertTrue([[[res objectAtIndex:0] valueForKeyPath:@"json.a"] isEqualToString:@"1"], @"correct value");
 }
 
+-(void) testFindAllDecodesLargeResultsInOrder
+{
+    NSMutableArray* data = [NSMutableArray new];
+    
+    for (int i = 0; i < 1000; i++) {
+        [data addObject:@{@"a" : @(i)}];
+    }
+    
+    JSONStoreCollection* col1 = [[JSONStoreCollection alloc] initWithName:@"ppl"];
+    [col1 setSearchField:@"name" withType:JSONStore_String];
+    
+    JSONStoreOpenOptions* ops = [[JSONStoreOpenOptions alloc] init];
+    [[JSONStore sharedInstance] openCollections:@[col1] withOptions:ops error:nil];
+    
+    [col1 addData:data andMarkDirty:YES withOptions:nil error:nil];
+    
+    NSArray* res = [col1 findAllWithOptions:nil error:nil];
+    
+    XCTAssertTrue([res count] == 1000, @"find all count");
+    
+    for (int i = 0; i < 1000; i++) {
+        XCTAssertTrue([[[res objectAtIndex:i] valueForKeyPath:@"json.a"] intValue] == i, @"decoded in order");
+    }
+    
+    NSArray* dirty = [col1 allDirtyAndReturnError:nil];
+    
+    XCTAssertTrue([dirty count] == 1000, @"all dirty count");
+    XCTAssertTrue([[[dirty lastObject] valueForKeyPath:@"json.a"] intValue] == 999, @"all dirty decoded");
+}
+
 -(void) testAddingObjectsWithArrays
 {
     JSONStoreCollection* col = [[JSONStoreCollection alloc] initWithName:@"heyo"];